@@ -0,0 +1,56 @@
+function appendTOMLfile(tomlfile, section, entries, varargin)
+    % APPENDTOMLFILE Append [[section]] entries to a TOML file
+    %
+    % Syntax:
+    %   appendTOMLfile(tomlfile, section, entries)
+    %   appendTOMLfile(tomlfile, section, entries, 'Name', value, ...)
+    %   appendTOMLfile(tomlfile, 'close')
+    %
+    % Description:
+    %   Wrapper for toml_append. Each entry is written as a [[section]]
+    %   table at the end of the file, formatted like writeTOMLfile. The file
+    %   is kept open between calls and never rewritten, so an append costs
+    %   the same however large the file has grown.
+    %
+    % Inputs:
+    %   tomlfile - Path to TOML file (string or char); created if missing
+    %   section  - Name of the array of tables, e.g. 'record'
+    %   entries  - Struct (one entry per element) or cell array of structs
+    %
+    % Options:
+    %   'Buffered'  - Keep entries in memory until 1 MB is collected or the
+    %                 file is closed (default false)
+    %   'SyncEvery' - fsync after every N entries (default 0 = never)
+    %
+    %   Buffered entries of a file that was replaced go to the new file. If
+    %   it cannot be reopened they are discarded, and the error says so.
+    %
+    % Example:
+    %   for k = 1:numEvents
+    %       ev = struct('t', now, 'value', readSensor());
+    %       appendTOMLfile('events.toml', 'record', ev, 'SyncEvery', 100);
+    %   end
+    %   appendTOMLfile('events.toml', 'close');
+
+    if nargin < 2
+        error('appendTOMLfile:missingInput', 'File and section are required');
+    end
+    if isstring(tomlfile)
+        tomlfile = char(tomlfile);
+    end
+    if isstring(section)
+        section = char(section);
+    end
+
+    try
+        if nargin == 2 && strcmp(section, 'close')
+            toml_mex('append', 'close', tomlfile);
+        else
+            toml_mex('append', tomlfile, section, entries, varargin{:});
+        end
+    catch ME
+        % Report errors under this function's identifiers
+        id = strrep(ME.identifier, 'toml_append:', 'appendTOMLfile:');
+        error(id, '%s', ME.message);
+    end
+end
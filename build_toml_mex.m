@@ -1,6 +1,18 @@
-function build_toml_mex()
-    %% Cross-platform MEX compilation for toml_parse_string.cpp
-    clear all;clc;
+function build_toml_mex(target)
+    %% Cross-platform MEX compilation
+    % build_toml_mex              - toml_mex (all commands in one binary,
+    %                               used by the .m wrappers) and toml_parse_api
+    % build_toml_mex('separate')  - one MEX file per command (toml_parse_file,
+    %                               toml_write_string, ...)
+    if nargin < 1
+        target = 'dispatcher';
+    end
+
+    % toml_mex locks itself in memory; release it so it can be rebuilt
+    if exist('toml_mex', 'file') == 3
+        toml_mex('unlock');
+    end
+    clear mex; clc;
     % Base path (current folder)
     basePath = pwd;
 
@@ -21,6 +33,19 @@ function build_toml_mex()
             error('Unsupported platform: %s', computer);
     end
     
+    if strcmpi(target, 'dispatcher')
+        mex('toml_mex.cpp', ...
+            ['-I"' incPath '"'], ...
+            [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
+        mex('toml_parse_api.cpp', ...
+            ['-I"' incPath '"'], ...
+            [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
+        disp('Compilation finished successfully!');
+        return;
+    elseif ~strcmpi(target, 'separate')
+        error('build_toml_mex:invalidTarget', 'Target must be ''dispatcher'' or ''separate''');
+    end
+
     %% Compile MEX files
      %% parse string
     mex('toml_parse_string.cpp', ...
@@ -30,11 +55,43 @@ function build_toml_mex()
     mex('toml_write_string.cpp', ...
         ['-I"' incPath '"'], ...
         [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
+    %% write file
+    mex('toml_write_file.cpp', ...
+        ['-I"' incPath '"'], ...
+        [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
+    %% update file
+    mex('toml_update_file.cpp', ...
+        ['-I"' incPath '"'], ...
+        [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
+    %% update many files
+    mex('toml_update_files.cpp', ...
+        ['-I"' incPath '"'], ...
+        [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
 
     %% parse file
     mex('toml_parse_file.cpp', ...
         ['-I"' incPath '"'], ...
         [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
+    %% diff
+    mex('toml_diff.cpp', ...
+        ['-I"' incPath '"'], ...
+        [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
+    %% merge
+    mex('toml_merge.cpp', ...
+        ['-I"' incPath '"'], ...
+        [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
+    %% record batches
+    mex('toml_records.cpp', ...
+        ['-I"' incPath '"'], ...
+        [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
+    %% append entries
+    mex('toml_append.cpp', ...
+        ['-I"' incPath '"'], ...
+        [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
+    %% TOML <-> JSON
+    mex('toml_json.cpp', ...
+        ['-I"' incPath '"'], ...
+        [mexFlagName '="$' mexFlagName ' ' cppFlag '"']);
     
     disp('Compilation finished successfully!');
 end
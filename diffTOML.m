@@ -0,0 +1,55 @@
+function changes = diffTOML(a, b, varargin)
+    % DIFFTOML Compare two TOML documents
+    %
+    % Syntax:
+    %   changes = diffTOML(a, b)
+    %   changes = diffTOML(a, b, 'Name', value, ...)
+    %
+    % Description:
+    %   Lists the differences between two TOML files (or strings). Wrapper
+    %   for toml_diff, which compares the parsed documents in C++ and only
+    %   converts the values that differ.
+    %
+    % Inputs:
+    %   a, b - File names, or TOML text with 'Source', 'string'
+    %
+    % Options:
+    %   'Source'   - 'file' (default) or 'string'
+    %   'KeyField' - Match elements of arrays of tables by this key
+    %                instead of by position; elements with the same key
+    %                value are paired in order
+    %
+    % Outputs:
+    %   changes - Nx1 struct array with the fields
+    %             path - dotted key path, "name[k]" for array of table elements
+    %             kind - 'added', 'removed', 'changed' or 'typeChanged'
+    %             old  - value in a ([] if added)
+    %             new  - value in b ([] if removed)
+    %
+    % Example:
+    %   changes = diffTOML('deployed.toml', 'desired.toml', 'KeyField', 'name');
+    %   for k = 1:numel(changes)
+    %       fprintf('%s %s\n', changes(k).kind, changes(k).path);
+    %   end
+
+    % Validate inputs
+    if nargin < 2
+        error('diffTOML:missingInput', 'Two inputs required: diffTOML(a, b)');
+    end
+
+    % Convert to char if string
+    if isstring(a)
+        a = char(a);
+    end
+    if isstring(b)
+        b = char(b);
+    end
+
+    try
+        changes = toml_mex('diff', a, b, varargin{:});
+    catch ME
+        % Report errors under this function's identifiers
+        id = strrep(ME.identifier, 'toml_diff:', 'diffTOML:');
+        error(id, '%s', ME.message);
+    end
+end
@@ -0,0 +1,105 @@
+%% benchmark the conversions on normal-sized configs
+% Parses and writes typical configuration documents (a few hundred keys in
+% nested tables, short arrays, arrays of tables) many times, to measure
+% what the explicit work stacks and the 'MaxDepth'/'MaxNodes' checks cost
+% against the recursive conversion they replaced.
+%
+% Set baselineDir to a folder holding toml_mex built from a checkout
+% before the conversions used explicit work stacks; the script then times
+% both builds on the same documents and prints the ratio. With baselineDir
+% empty only the current build is timed.
+%
+% Run from the repository folder, after build_toml_mex.
+
+baselineDir = '';
+calls = 200;       % conversions per timing; configs are small
+repeats = 7;
+
+docs = {
+    'example.toml', fileread(fullfile(fileparts(mfilename('fullpath')), 'example.toml'))
+    'service', serviceConfig(20)
+    'fleet', serviceConfig(200)
+};
+
+current = timeBuild(pwd, docs, calls, repeats);
+if ~isempty(baselineDir)
+    baseline = timeBuild(baselineDir, docs, calls, repeats);
+end
+
+fprintf('%-12s %8s %14s %14s', 'document', 'bytes', 'parse [ms]', 'write [ms]');
+if ~isempty(baselineDir)
+    fprintf(' %14s %14s', 'parse ratio', 'write ratio');
+end
+fprintf('\n');
+for i = 1:size(docs, 1)
+    fprintf('%-12s %8d %14.4f %14.4f', docs{i, 1}, numel(docs{i, 2}), ...
+            1e3 * current.parse(i), 1e3 * current.write(i));
+    if ~isempty(baselineDir)
+        fprintf(' %14.2f %14.2f', current.parse(i) / baseline.parse(i), ...
+                current.write(i) / baseline.write(i));
+    end
+    fprintf('\n');
+end
+
+% Time parse_string and write_string per call with the toml_mex found in
+% folder; the current folder takes precedence over the path
+function t = timeBuild(folder, docs, calls, repeats)
+    previous = cd(folder);
+    restore = onCleanup(@() cd(previous));
+    if exist('toml_mex', 'file') == 3
+        toml_mex('unlock');
+    end
+    clear toml_mex
+
+    n = size(docs, 1);
+    t.parse = zeros(n, 1);
+    t.write = zeros(n, 1);
+    for i = 1:n
+        text = docs{i, 2};
+        data = toml_mex('parse_string', text);
+        t.parse(i) = perCall(@() toml_mex('parse_string', text), calls, repeats);
+        t.write(i) = perCall(@() toml_mex('write_string', data), calls, repeats);
+    end
+
+    toml_mex('unlock');
+    clear toml_mex
+end
+
+function t = perCall(f, calls, repeats)
+    best = inf;
+    for r = 1:repeats
+        tic;
+        for k = 1:calls
+            f();
+        end
+        best = min(best, toc);
+    end
+    t = best / calls;
+end
+
+% A service config: global settings, one table per service with nested
+% tables and short arrays, and an array of tables of routes
+function text = serviceConfig(numServices)
+    lines = ["title = ""fleet""", "version = 3", "debug = false", ""];
+    for k = 1:numServices
+        lines(end + 1) = sprintf('[services.svc%d]', k); %#ok<AGROW>
+        lines(end + 1) = sprintf('host = "10.0.%d.%d"', floor(k / 250), mod(k, 250)); %#ok<AGROW>
+        lines(end + 1) = sprintf('ports = [%d, %d]', 8000 + k, 9000 + k); %#ok<AGROW>
+        lines(end + 1) = sprintf('weights = [0.5, 0.25, %.3f]', k / numServices); %#ok<AGROW>
+        lines(end + 1) = 'enabled = true'; %#ok<AGROW>
+        lines(end + 1) = sprintf('[services.svc%d.limits]', k); %#ok<AGROW>
+        lines(end + 1) = 'rps = 100'; %#ok<AGROW>
+        lines(end + 1) = 'burst = 20'; %#ok<AGROW>
+        lines(end + 1) = sprintf('[services.svc%d.limits.timeouts]', k); %#ok<AGROW>
+        lines(end + 1) = 'connect = 1.5'; %#ok<AGROW>
+        lines(end + 1) = 'read = 30.0'; %#ok<AGROW>
+        lines(end + 1) = ""; %#ok<AGROW>
+    end
+    for k = 1:numServices
+        lines(end + 1) = "[[routes]]"; %#ok<AGROW>
+        lines(end + 1) = sprintf('path = "/api/v1/svc%d"', k); %#ok<AGROW>
+        lines(end + 1) = sprintf('service = "svc%d"', k); %#ok<AGROW>
+        lines(end + 1) = 'methods = ["GET", "POST"]'; %#ok<AGROW>
+    end
+    text = char(strjoin(lines, newline));
+end
@@ -0,0 +1,44 @@
+%% benchmark the C and C++ MEX API builds on identical documents
+% Generates a document with many tables, strings and numeric arrays, then
+% parses it with toml_mex (C API) and
+% toml_parse_api (C++ API) and checks that both return the same struct.
+
+numTables = 2000;
+arrayLength = 256;
+repeats = 5;
+
+lines = strings(numTables, 1);
+for k = 1:numTables
+    lines(k) = sprintf(['[item%d]\nname = "item %d"\npath = "/data/item%d/raw"\n' ...
+                        'ids = [%s]\nweights = [%s]\nenabled = %s\n'], ...
+                       k, k, k, ...
+                       strjoin(string(1:arrayLength), ', '), ...
+                       strjoin(compose('%.3f', rand(1, arrayLength)), ', '), ...
+                       string(mod(k, 2) == 0));
+end
+tomlText = char(strjoin(lines, newline));
+tomlFile = [tempname '.toml'];
+fid = fopen(tomlFile, 'w');
+fwrite(fid, tomlText);
+fclose(fid);
+cleanup = onCleanup(@() delete(tomlFile));
+
+timeIt = @(f) min(arrayfun(@(~) timeOnce(f), 1:repeats));
+
+tFileC   = timeIt(@() toml_mex('parse_file', tomlFile));
+tFileCpp = timeIt(@() toml_parse_api(tomlFile));
+tStrC    = timeIt(@() toml_mex('parse_string', tomlText));
+tStrCpp  = timeIt(@() toml_parse_api(tomlText, 'Source', 'string'));
+
+fprintf('%-8s %12s %12s\n', 'input', 'C API [s]', 'C++ API [s]');
+fprintf('%-8s %12.4f %12.4f\n', 'file', tFileC, tFileCpp);
+fprintf('%-8s %12.4f %12.4f\n', 'string', tStrC, tStrCpp);
+
+assert(isequal(toml_mex('parse_file', tomlFile), toml_parse_api(tomlFile)), ...
+       'The C and C++ API builds returned different values');
+
+function t = timeOnce(f)
+    tic;
+    f();
+    t = toc;
+end
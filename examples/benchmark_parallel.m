@@ -0,0 +1,41 @@
+%% benchmark writing with 'Parallel' against the single-threaded writer
+% Builds a struct of channels holding large numeric arrays (the part that
+% 'Parallel' hands to worker threads), writes it with and without
+% 'Parallel' for several thread counts, and prints the time and speedup of
+% each. Both ways must produce the same text.
+%
+% Run from the repository folder, after build_toml_mex.
+
+numChannels = 32;
+samples = 200000;
+threadCounts = [1 2 4 8];
+repeats = 5;
+
+data.title = 'recording';
+for k = 1:numChannels
+    name = sprintf('ch%d', k);
+    data.channels.(name).gain = k / 10;
+    data.channels.(name).samples = rand(1, samples);
+    data.channels.(name).counts = int64(randi(1e6, 1, samples));
+end
+
+timeIt = @(f) min(arrayfun(@(~) timeOnce(f), 1:repeats));
+
+serial = toml_mex('write_string', data);
+tSerial = timeIt(@() toml_mex('write_string', data));
+
+fprintf('%-10s %10s %10s\n', 'threads', 'time [s]', 'speedup');
+fprintf('%-10s %10.4f %10.2f\n', 'serial', tSerial, 1);
+for n = threadCounts
+    assert(isequal(toml_mex('write_string', data, 'Parallel', true, 'Threads', n), serial), ...
+           'Parallel output with %d threads differs', n);
+    t = timeIt(@() toml_mex('write_string', data, 'Parallel', true, 'Threads', n));
+    fprintf('%-10d %10.4f %10.2f\n', n, t, tSerial / t);
+end
+fprintf('%.1f MB of TOML\n', numel(serial) / 2^20);
+
+function t = timeOnce(f)
+    tic;
+    f();
+    t = toc;
+end
@@ -0,0 +1,55 @@
+%% benchmark the streaming parser against the toml++ based conversion
+% Generates a large document of tables, strings, numeric arrays, dates and
+% an array of tables, then parses the file with and without 'Streaming'
+% and prints the throughput of both. Streaming is meant to be at least
+% twice as fast; the script warns when it is not. Both ways must return
+% the same struct.
+%
+% Run from the repository folder, after build_toml_mex.
+
+numTables = 5000;
+arrayLength = 64;
+repeats = 5;
+
+lines = strings(numTables, 1);
+for k = 1:numTables
+    lines(k) = sprintf(['[item%d]\nname = "item %d"\npath = ''/data/item%d/raw''\n' ...
+                        'ids = [%s]\nweights = [%s]\nenabled = %s\n' ...
+                        'created = 1979-05-27T07:32:%02dZ\n' ...
+                        '[[item%d.parts]]\nid = %d\n[[item%d.parts]]\nid = %d\n'], ...
+                       k, k, k, ...
+                       strjoin(string(1:arrayLength), ', '), ...
+                       strjoin(compose('%.3f', rand(1, arrayLength)), ', '), ...
+                       string(mod(k, 2) == 0), mod(k, 60), ...
+                       k, 2 * k, k, 2 * k + 1);
+end
+tomlText = char(strjoin(lines, newline));
+tomlFile = [tempname '.toml'];
+fid = fopen(tomlFile, 'w');
+fwrite(fid, tomlText);
+fclose(fid);
+cleanup = onCleanup(@() delete(tomlFile));
+
+timeIt = @(f) min(arrayfun(@(~) timeOnce(f), 1:repeats));
+
+tTree   = timeIt(@() toml_mex('parse_file', tomlFile));
+tStream = timeIt(@() toml_mex('parse_file', tomlFile, 'Streaming', true));
+
+megabytes = numel(tomlText) / 2^20;
+fprintf('%-10s %10s %10s\n', 'parser', 'time [s]', 'MB/s');
+fprintf('%-10s %10.4f %10.1f\n', 'toml++', tTree, megabytes / tTree);
+fprintf('%-10s %10.4f %10.1f\n', 'streaming', tStream, megabytes / tStream);
+fprintf('speedup %.2fx on %.1f MB\n', tTree / tStream, megabytes);
+if tTree / tStream < 2
+    warning('Streaming is less than twice as fast as the toml++ based conversion');
+end
+
+assert(isequal(toml_mex('parse_file', tomlFile), ...
+               toml_mex('parse_file', tomlFile, 'Streaming', true)), ...
+       'Streaming returned a different value');
+
+function t = timeOnce(f)
+    tic;
+    f();
+    t = toc;
+end
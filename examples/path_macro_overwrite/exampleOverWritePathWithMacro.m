@@ -16,6 +16,13 @@ path = '${DATA_ROOT}\Documents\data';
 expandedPath = expandPath(path, macros)
 
 
+%% example expanding macros while parsing
+toml_str = ['[macros]' newline 'DATA_ROOT = "C:/data"' newline ...
+            '[paths]' newline 'project = "${macros.DATA_ROOT}/${PROJECT}"'];
+expanded = parseTOMLstring(toml_str, 'Macros', struct('PROJECT', 'MyProject'));
+expandedPath = expanded.paths.project
+
+
 %% example changing the toml file
 try 
     folderPath = uigetdir(pwd, 'Select a folder');
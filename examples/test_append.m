@@ -0,0 +1,54 @@
+% test_append
+% Round trips of toml_append: appended entries read back as the elements
+% of the array of tables, a file replaced by toml_write_file is followed
+% (also with text still buffered), and names of the same file share one
+% handle and buffer.
+clear all;clc
+
+folder = tempname;
+mkdir(folder);
+previous = cd(folder);
+cleanup = onCleanup(@() finish(previous, folder));
+
+%% appends
+toml_mex('write_file', struct('title', 'log'), 'a.toml');
+toml_mex('append', 'a.toml', 'record', struct('id', int64(1), 'msg', 'one'));
+toml_mex('append', 'a.toml', 'record', struct('id', {int64(2), int64(3)}, 'msg', {'two', 'three'}));
+data = toml_mex('parse_file', 'a.toml');
+assert(strcmp(data.title, 'log'), 'the header is kept');
+assert(isequal(cellfun(@(r) r.id, data.record), int64([1 2 3])), 'every entry is appended in order');
+assert(strcmp(data.record{3}.msg, 'three'), 'struct arrays give one entry per element');
+
+%% file replaced
+% The handle stays open between calls; an atomic write replaces the file,
+% and the next append goes to the new one
+toml_mex('write_file', struct('title', 'new'), 'a.toml');
+toml_mex('append', 'a.toml', 'record', struct('id', int64(4), 'msg', 'four'));
+data = toml_mex('parse_file', 'a.toml');
+assert(strcmp(data.title, 'new') && numel(data.record) == 1 && data.record{1}.id == 4, ...
+    'appends after a replacement go to the new file');
+
+%% buffered appends
+before = fileread('a.toml');
+toml_mex('append', './a.toml', 'record', struct('id', int64(5), 'msg', 'five'), 'Buffered', true);
+toml_mex('append', 'a.toml', 'record', struct('id', int64(6), 'msg', 'six'), 'Buffered', true);
+assert(strcmp(fileread('a.toml'), before), 'buffered text is not written before the file is closed');
+toml_mex('append', 'close', 'a.toml');
+data = toml_mex('parse_file', 'a.toml');
+assert(isequal(cellfun(@(r) r.id, data.record), int64([4 5 6])), ...
+    'a.toml and ./a.toml share one buffer, written in order on close');
+
+% Text buffered when the file is replaced goes to the new file
+toml_mex('append', 'a.toml', 'record', struct('id', int64(7), 'msg', 'seven'), 'Buffered', true);
+toml_mex('write_file', struct('title', 'third'), 'a.toml');
+toml_mex('append', 'close');
+data = toml_mex('parse_file', 'a.toml');
+assert(strcmp(data.title, 'third') && numel(data.record) == 1 && data.record{1}.id == 7, ...
+    'buffered text follows the replaced file');
+fprintf('append tests passed\n');
+
+function finish(previous, folder)
+    toml_mex('append', 'close');
+    cd(previous);
+    rmdir(folder, 's');
+end
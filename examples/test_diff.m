@@ -0,0 +1,82 @@
+% test_diff
+% Change lists of toml_diff: which paths are reported with which kind and
+% values, in the source order of the first document and then the second,
+% with arrays of tables matched by position or by a key field.
+clear all;clc
+
+a = doc('title = "v1"', ...
+    'port = 80', ...
+    'debug = true', ...
+    'tags = ["a", "b"]', ...
+    '', ...
+    '[owner]', ...
+    'name = "Tom"', ...
+    '', ...
+    '[[products]]', ...
+    'name = "Hammer"', ...
+    'price = 1.5', ...
+    '', ...
+    '[[products]]', ...
+    'name = "Nail"', ...
+    'price = 0.25');
+b = doc('title = "v2"', ...
+    'port = "80"', ...
+    'tags = ["a", "b"]', ...
+    'new = 1', ...
+    '', ...
+    '[owner]', ...
+    'name = "Tom"', ...
+    '', ...
+    '[[products]]', ...
+    'name = "Nail"', ...
+    'price = 0.5', ...
+    '', ...
+    '[[products]]', ...
+    'name = "Hammer"', ...
+    'price = 1.5', ...
+    '', ...
+    '[[products]]', ...
+    'name = "Saw"', ...
+    'price = 12.5');
+
+%% positional matching
+changes = toml_mex('diff', a, b, 'Source', 'string');
+assert(isequal(summary(changes), {'changed title'; 'typeChanged port'; 'removed debug'; ...
+    'changed products[1].name'; 'changed products[1].price'; ...
+    'changed products[2].name'; 'changed products[2].price'; ...
+    'added products[3]'; 'added new'}), 'elements are compared by position');
+assert(strcmp(changes(1).old, 'v1') && strcmp(changes(1).new, 'v2'), 'old and new values');
+assert(isequal(changes(2).old, int64(80)) && strcmp(changes(2).new, '80'), 'a type change keeps both values');
+assert(isequal(changes(3).old, true) && isempty(changes(3).new), 'a removed value has no new value');
+assert(isempty(changes(8).old) && isequal(changes(8).new, struct('name', 'Saw', 'price', 12.5)), ...
+    'an added element is a struct');
+assert(isempty(toml_mex('diff', a, a, 'Source', 'string')), 'a document does not differ from itself');
+
+%% KeyField matching
+changes = toml_mex('diff', a, b, 'Source', 'string', 'KeyField', 'name');
+assert(isequal(summary(changes), {'changed title'; 'typeChanged port'; 'removed debug'; ...
+    'changed products[1].price'; 'added products[3]'; 'added new'}), ...
+    'elements are matched by name and reported at their index in the second document');
+assert(changes(4).old == 0.25 && changes(4).new == 0.5, 'the Nail price changed');
+
+% Elements with the same key value pair up in order
+dup = @(varargin) strjoin(cellfun(@(p) sprintf('[[p]]\nname = "%s"\nn = %d\n', p{:}), ...
+    varargin, 'UniformOutput', false), newline);
+changes = toml_mex('diff', dup({'x', 1}, {'x', 2}), dup({'y', 0}, {'x', 1}, {'x', 2}), ...
+    'Source', 'string', 'KeyField', 'name');
+assert(isequal(summary(changes), {'added p[1]'}), 'duplicates are paired in order');
+changes = toml_mex('diff', dup({'x', 1}, {'x', 2}, {'y', 0}), dup({'y', 0}, {'x', 2}), ...
+    'Source', 'string', 'KeyField', 'name');
+assert(isequal(summary(changes), {'changed p[2].n'; 'removed p[2]'}), ...
+    'an extra duplicate is removed at its index in the first document');
+fprintf('diff tests passed\n');
+
+function text = doc(varargin)
+    text = strjoin(varargin, newline);
+end
+
+% "kind path" of each change, as an Nx1 cell
+function s = summary(changes)
+    s = arrayfun(@(c) [c.kind ' ' c.path], changes, 'UniformOutput', false);
+    s = s(:);
+end
@@ -0,0 +1,93 @@
+% test_json
+% JSON reader of json_to_toml: escapes, numbers, duplicate keys, nesting
+% limits, and the round trip through toml_to_json.
+clear all;clc
+
+%% escapes and surrogate pairs
+s = from_json(['{"s": "q\"b\\s\/n\nt\tu' char(233) '"}']);
+assert(isequal(s.s, ['q"b\s/n' newline 't' char(9) 'u' char(233)]), 'simple escapes');
+s = from_json('{"face": "\ud83d\ude00", "euro": "\u20AC", "nul": "a\u0000b"}');
+assert(isequal(double(s.face), [55357 56832]), 'surrogate pair');
+assert(isequal(s.euro, char(8364)), 'BMP escape');
+assert(isequal(double(s.nul), [97 0 98]), 'escaped NUL');
+
+%% numbers
+s = from_json('{"max": 9223372036854775807, "min": -9223372036854775808, "over": 9223372036854775808, "f": 1.5e3, "z": -0}');
+assert(isa(s.max, 'int64') && s.max == intmax('int64'), 'int64 max stays an integer');
+assert(isa(s.min, 'int64') && s.min == intmin('int64'), 'int64 min stays an integer');
+assert(isa(s.over, 'double') && s.over == 2^63, 'int64 overflow becomes a float');
+assert(isa(s.f, 'double') && s.f == 1500, 'exponent makes a float');
+assert(isa(s.z, 'int64') && s.z == 0, '-0 is an integer');
+
+%% invalid documents
+invalid = {
+    '{"a": 1, "a": 2}'
+    '{"a": {"b": 1, "b": 1}}'
+    '{"a": null}'
+    '{"s": "\ud83d"}'
+    '{"s": "\ude00"}'
+    '{"s": "\ud83dx"}'
+    '{"s": "\x"}'
+    ['{"s": "a' char(10) '"}']
+    '{"n": 01}'
+    '{"n": 1.}'
+    '{"n": -}'
+    '{"a": [1, 2,]}'
+    '{"a": 1,}'
+    '{a: 1}'
+    '[1, 2]'
+    '{"a": 1} x'
+};
+for i = 1:numel(invalid)
+    assert_error(@() json_to_toml(invalid{i}, 'Source', 'string'), 'json_to_toml:parseError', i);
+end
+fprintf('%d invalid JSON documents are rejected\n', numel(invalid));
+
+%% nesting limits
+deep_json = ['{"a": ' repmat('[', 1, 2000) repmat(']', 1, 2000) '}'];
+assert_error(@() json_to_toml(deep_json, 'Source', 'string'), 'json_to_toml:parseError', 1);
+assert_error(@() json_to_toml('{"a": {"b": {"c": 1}}}', 'Source', 'string', 'MaxDepth', 2), ...
+    'json_to_toml:parseError', 2);
+s = from_json('{"a": {"b": {"c": 1}}}', 'MaxDepth', 3);
+assert(s.a.b.c == 1, 'exactly MaxDepth levels are allowed');
+
+deep_toml = ['x = ' repmat('[', 1, 20) repmat(']', 1, 20)];
+assert_error(@() toml_to_json(deep_toml, 'Source', 'string', 'MaxDepth', 10), ...
+    'toml_to_json:limitExceeded', 3);
+
+%% round trip
+toml = doc('title = "x\"y"', 'n = 9007199254740993', 'f = 0.1', 'd = 1979-05-27T07:32:00Z', ...
+    'arr = [1, 2.5, "s"]', '[t.u]', 'v = true');
+back = json_to_toml(toml_to_json(toml, 'Source', 'string', 'Tagged', true), 'Source', 'string', 'Tagged', true);
+assert(isequaln(toml_mex('parse_string', toml), toml_mex('parse_string', back)), 'tagged round trip');
+
+% Keys keep their order both ways
+toml = doc('zeta = 1', 'alpha = [1, {y = 1, b = 2}]', 'mid = 3', '[m]', 'y = 2', 'b = 3', ...
+    '[[list]]', 'k2 = 1', 'k1 = 2');
+orig = toml_mex('parse_string', toml);
+back = toml_mex('parse_string', json_to_toml(toml_to_json(toml, 'Source', 'string'), 'Source', 'string'));
+assert(isequal(fieldnames(back), fieldnames(orig)), 'key order of the top level');
+assert(isequal(fieldnames(back.m), {'y'; 'b'}), 'key order of a table');
+assert(isequal(fieldnames(back.list), {'k2'; 'k1'}), 'key order of an array of tables');
+assert(isequal(fieldnames(back.alpha{2}), {'y'; 'b'}), 'key order of an inline table');
+fprintf('JSON reader tests passed\n');
+
+function s = from_json(json, varargin)
+    s = toml_mex('parse_string', json_to_toml(json, 'Source', 'string', varargin{:}));
+end
+
+function text = doc(varargin)
+    text = strjoin(varargin, newline);
+end
+
+function assert_error(f, id, i)
+    try
+        f();
+    catch ME
+        if ~strcmp(ME.identifier, id)
+            error('test_json:wrongError', 'Case %d failed with %s: %s', i, ME.identifier, ME.message);
+        end
+        return;
+    end
+    error('test_json:accepted', 'Case %d did not raise %s', i, id);
+end
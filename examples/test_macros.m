@@ -0,0 +1,77 @@
+% test_macros
+% ${NAME} expansion with 'Macros': names are looked up in the macro
+% struct, then in the environment (with 'env'), then as dotted key paths
+% of the document; unknown names are kept, and a macro that refers back to
+% itself is an error.
+clear all;clc
+
+text = doc('[macros]', ...
+    'DATA_ROOT = "/srv/data"', ...
+    '', ...
+    '[run]', ...
+    'id = 7', ...
+    'scale = 0.5', ...
+    '', ...
+    '[paths]', ...
+    'raw = "${macros.DATA_ROOT}/raw"', ...
+    'cache = "${paths.raw}/cache"', ...
+    'name = "run${run.id} x${run.scale}"', ...
+    'list = ["${macros.DATA_ROOT}", "b"]', ...
+    'unknown = "${NOPE}/x"', ...
+    'plain = "$HOME costs $5"');
+
+%% document lookups
+data = toml_mex('parse_string', text, 'Macros', struct());
+assert(strcmp(data.paths.raw, '/srv/data/raw'), 'a document string');
+assert(strcmp(data.paths.cache, '/srv/data/raw/cache'), 'document values are expanded themselves');
+assert(strcmp(data.paths.name, 'run7 x0.5'), 'integers and floats as they are written');
+assert(isequal(data.paths.list, {'/srv/data', 'b'}), 'strings in arrays');
+assert(strcmp(data.paths.unknown, '${NOPE}/x'), 'unknown names are kept');
+assert(strcmp(data.paths.plain, '$HOME costs $5'), 'a $ without braces is kept');
+plain = toml_mex('parse_string', text);
+assert(strcmp(plain.paths.raw, '${macros.DATA_ROOT}/raw'), 'nothing is expanded without Macros');
+
+%% macro struct and environment
+macros = struct('ROOT', '${BASE}/m', 'BASE', '/b');
+data = toml_mex('parse_string', doc('ROOT = "doc"', 'p = "${ROOT}"'), 'Macros', macros);
+assert(strcmp(data.p, '/b/m'), 'the macro struct comes before the document, and macros are expanded');
+
+setenv('TOML_TEST_MACRO', '/env');
+restoreEnv = onCleanup(@() setenv('TOML_TEST_MACRO', ''));
+data = toml_mex('parse_string', 'p = "${TOML_TEST_MACRO}"', 'Macros', 'env');
+assert(strcmp(data.p, '/env'), 'the environment with env');
+data = toml_mex('parse_string', 'p = "${TOML_TEST_MACRO}"', 'Macros', struct());
+assert(strcmp(data.p, '${TOML_TEST_MACRO}'), 'the environment only with env');
+data = toml_mex('parse_string', 'p = "${TOML_TEST_MACRO}"', 'Macros', {struct('TOML_TEST_MACRO', '/s'), 'env'});
+assert(strcmp(data.p, '/s'), 'the macro struct comes before the environment');
+
+%% errors
+file = [tempname '.toml'];
+cleanup = onCleanup(@() delete(file));
+fid = fopen(file, 'w');
+fwrite(fid, doc('a = "${b}"', 'b = "x${a}"'));
+fclose(fid);
+assert_error(@() toml_mex('parse_string', 'p = "${A}"', 'Macros', struct('A', '${B}', 'B', '${A}')), ...
+    'toml_parse_string:macroError', 1);
+assert_error(@() toml_mex('parse_string', 'a = "${a}"', 'Macros', struct()), ...
+    'toml_parse_string:macroError', 2);
+assert_error(@() toml_mex('parse_file', file, 'Macros', struct()), 'toml_parse_file:macroError', 3);
+assert_error(@() toml_mex('parse_string', 'a = 1', 'Macros', 5), 'toml_parse_string:invalidArgs', 4);
+assert_error(@() toml_mex('parse_string', 'a = 1', 'Macros', struct('A', 1)), 'toml_parse_string:invalidArgs', 5);
+fprintf('macro tests passed\n');
+
+function text = doc(varargin)
+    text = strjoin(varargin, newline);
+end
+
+function assert_error(f, id, i)
+    try
+        f();
+    catch ME
+        if ~strcmp(ME.identifier, id)
+            error('test_macros:wrongError', 'Case %d failed with %s: %s', i, ME.identifier, ME.message);
+        end
+        return;
+    end
+    error('test_macros:accepted', 'Case %d did not raise %s', i, id);
+end
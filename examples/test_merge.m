@@ -0,0 +1,62 @@
+% test_merge
+% Layered merges with toml_merge: tables are merged key by key, other
+% values are replaced, 'Rules' switch a path to 'replace' or 'append', and
+% the sources output names the layer that set each value of the result.
+clear all;clc
+
+base = doc('name = "svc"', ...
+    'plugins = ["a"]', ...
+    'tags = ["x"]', ...
+    '', ...
+    '[db]', ...
+    'host = "h1"', ...
+    'port = 5432', ...
+    '', ...
+    '[logging]', ...
+    'level = "info"', ...
+    'file = "a.log"');
+site = doc('plugins = ["b"]', ...
+    'tags = ["y"]', ...
+    '', ...
+    '[db]', ...
+    'port = 6543', ...
+    'user = "u"', ...
+    '', ...
+    '[logging]', ...
+    'level = "warn"');
+host = doc('name = 3', ...
+    '', ...
+    '[db]', ...
+    'host = "h3"', ...
+    'timeout = 1.5');
+
+%% default rules
+merged = toml_mex('merge', {base, site, host}, 'Source', 'string');
+assert(isequal(merged.name, int64(3)), 'a value of another type replaces the old one');
+assert(isequal(merged.plugins, {'b'}) && isequal(merged.tags, {'y'}), 'arrays are replaced');
+assert(isequal(fieldnames(merged.db), {'host'; 'port'; 'user'; 'timeout'}), ...
+    'tables are merged and keep the order in which their keys first appeared');
+assert(strcmp(merged.db.host, 'h3') && merged.db.port == 6543 && strcmp(merged.db.user, 'u') ...
+    && merged.db.timeout == 1.5, 'later layers win');
+assert(strcmp(merged.logging.level, 'warn') && strcmp(merged.logging.file, 'a.log'), ...
+    'keys that a later layer does not set are kept');
+
+%% Rules and sources
+[merged, sources] = toml_mex('merge', {base, site, host}, 'Source', 'string', ...
+    'Rules', {'plugins', 'append'; 'logging', 'replace'});
+assert(isequal(merged.plugins, {'a', 'b'}), 'append concatenates arrays');
+assert(isequal(fieldnames(merged.logging), {'level'}), 'replace drops the keys of the old table');
+assert(isequal(size(sources), [9 1]), 'one source per value of the result');
+assert(isequal({sources.path}', {'name'; 'plugins[1]'; 'plugins[2]'; 'tags'; 'db.host'; 'db.port'; ...
+    'db.user'; 'db.timeout'; 'logging.level'}), 'sources are in the key order of the result');
+assert(isequal([sources.layer], [3 1 2 2 3 2 2 3 2]), 'each value names the layer that set it');
+
+% A single layer is its own result
+[merged, sources] = toml_mex('merge', {base}, 'Source', 'string');
+assert(isequal(merged, toml_mex('parse_string', base)), 'one layer merges to itself');
+assert(all([sources.layer] == 1), 'every value comes from the only layer');
+fprintf('merge tests passed\n');
+
+function text = doc(varargin)
+    text = strjoin(varargin, newline);
+end
@@ -4,7 +4,7 @@ clear all;clc
 toml_file = fullfile(pwd,'tomlplusplus/examples/example.toml');
 
 if isfile(toml_file)
-    parsed_file_as_struct = toml_parse_file(toml_file);
+    parsed_file_as_struct = toml_mex('parse_file', toml_file);
 end
 
 %% parse a TOML string
@@ -13,7 +13,7 @@ string_to_parse =  sprintf( strcat( '[library]\n',...
                                 'authors = ["Mark Gillard <mark.gillard@outlook.com.au>"]\n',...
                                 'cpp = 17\n'));
 
-parsed_toml_string = toml_parse_string(string_to_parse);
+parsed_toml_string = toml_mex('parse_string', string_to_parse);
 
 
 
@@ -31,15 +31,15 @@ config.database.credentials.user = 'admin';
 config.database.credentials.password = 'secret';
 
 % Convert to TOML string
-toml_str = toml_write_string(config);
+toml_str = toml_mex('write_string', config);
 disp(toml_str);
 
 
 % parse the toml string back to a structure
-mystruct = toml_parse_string(toml_str)
+mystruct = toml_mex('parse_string', toml_str)
 
 % convert back to toml
-toml_str2 = toml_write_string(mystruct)
+toml_str2 = toml_mex('write_string', mystruct)
 
 % if the 2 structures are the same
 if strcmp(toml_str,toml_str2)
@@ -58,7 +58,7 @@ data.server.host = 'localhost';
 data.server.ports = [8080, 8081, 8082];
 
 % Generate TOML string
-toml_str = toml_write_string(data);
+toml_str = toml_mex('write_string', data);
 
 % Write it to a file
 fid = fopen('config.toml', 'w');
@@ -70,17 +70,17 @@ fclose(fid);
 clear all; clc
 toml_file = fullfile(pwd,'tomlplusplus/examples/example.toml');
 if isfile(toml_file)
-    pfas = toml_parse_file(toml_file); % parsed file as structure
+    pfas = toml_mex('parse_file', toml_file); % parsed file as structure
 
     % reserialise
-    serialised_pfas = toml_write_string(pfas);
+    serialised_pfas = toml_mex('write_string', pfas);
     % write a new file
     fid = fopen('newfile.toml', 'w');
     fprintf(fid, '%s', serialised_pfas);
     fclose(fid);
 
 
-    pfas2 = toml_parse_file('newfile.toml');
+    pfas2 = toml_mex('parse_file', 'newfile.toml');
 
     isequaln(pfas,pfas2)
 
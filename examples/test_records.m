@@ -0,0 +1,98 @@
+% test_records
+% Batches of toml_records against toml_parse_file: reading the [[record]]
+% entries of a file through a small window, in batches that do not line
+% up with the window, must give the same records as parsing the whole
+% file, both as struct arrays and as columns.
+clear all;clc
+
+numRecords = 1500;
+lines = strings(0, 1);
+lines(end + 1) = 'title = "log"';
+lines(end + 1) = '[meta]';
+lines(end + 1) = 'version = 2';
+for k = 1:numRecords
+    lines(end + 1) = '[[record]]'; %#ok<SAGROW>
+    lines(end + 1) = sprintf('id = %d', k); %#ok<SAGROW>
+    lines(end + 1) = sprintf('name = "%s"', repmat('x', 1, mod(7 * k, 90))); %#ok<SAGROW>
+    lines(end + 1) = sprintf('value = %.4f', k / 8); %#ok<SAGROW>
+    if mod(k, 3) == 0
+        lines(end + 1) = 'note = "every third"'; %#ok<SAGROW>
+        lines(end + 1) = '[record.tags]'; %#ok<SAGROW>
+        lines(end + 1) = sprintf('host = "h%d"', mod(k, 5)); %#ok<SAGROW>
+        lines(end + 1) = '[[record.items]]'; %#ok<SAGROW>
+        lines(end + 1) = sprintf('n = %d', k); %#ok<SAGROW>
+    end
+    if k == 700
+        % A record larger than the window
+        lines(end + 1) = sprintf('blob = "%s"', repmat('b', 1, 10000)); %#ok<SAGROW>
+    end
+end
+lines(end + 1) = '[footer]';
+lines(end + 1) = 'end = true';
+
+file = [tempname '.toml'];
+cleanup = onCleanup(@() delete(file));
+fid = fopen(file, 'w');
+fwrite(fid, char(strjoin(lines, newline)));
+fclose(fid);
+parsed = toml_mex('parse_file', file);
+expected = parsed.record;
+
+%% struct array batches
+id = toml_mex('records', 'open', file, 'record', 'Window', 4096);
+records = read_all(id, 97);
+assert(numel(records) == numRecords, 'every record is read once');
+for k = 1:numRecords
+    assert_record(records{k}, expected{k}, k);
+end
+
+%% columnar batches
+id = toml_mex('records', 'open', file, 'record', 'Window', 4096, 'Columnar', true);
+[batch, done] = toml_mex('records', 'next', id, 10);
+assert(~done && isequal(size(batch.id), [10 1]) && isa(batch.id, 'int64'), 'numeric columns');
+assert(isequal(batch.id, int64(1:10)'), 'records in file order');
+assert(iscell(batch.note) && isempty(batch.note{1}) && strcmp(batch.note{3}, 'every third'), ...
+    'a field that some records lack is a cell column');
+toml_mex('records', 'close', id);
+assert_error(@() toml_mex('records', 'next', id, 10), 'toml_records:invalidIterator', 1);
+assert_error(@() toml_mex('records', 'next', 0.5, 10), 'toml_records:invalidIterator', 2);
+assert_error(@() toml_mex('records', 'open', file, 'record', 'Window', 100), 'toml_records:invalidArgs', 3);
+fprintf('record batch tests passed\n');
+
+% Read the remaining records of an iterator in batches of count; the
+% batches have different fields, so the records are returned in a cell
+function records = read_all(id, count)
+    records = {};
+    done = false;
+    while ~done
+        [batch, done] = toml_mex('records', 'next', id, count);
+        assert(numel(batch) <= count, 'a batch has at most count records');
+        records = [records; num2cell(batch(:))]; %#ok<AGROW>
+    end
+end
+
+% A record of a batch has the fields of the parsed record, and [] for the
+% fields that only other records have
+function assert_record(record, expected, k)
+    names = fieldnames(record);
+    for i = 1:numel(names)
+        if isfield(expected, names{i})
+            assert(isequal(record.(names{i}), expected.(names{i})), 'record %d field %s differs', k, names{i});
+        else
+            assert(isempty(record.(names{i})), 'record %d has no field %s', k, names{i});
+        end
+    end
+    assert(all(isfield(record, fieldnames(expected))), 'record %d lacks fields', k);
+end
+
+function assert_error(f, id, i)
+    try
+        f();
+    catch ME
+        if ~strcmp(ME.identifier, id)
+            error('test_records:wrongError', 'Case %d failed with %s: %s', i, ME.identifier, ME.message);
+        end
+        return;
+    end
+    error('test_records:accepted', 'Case %d did not raise %s', i, id);
+end
@@ -0,0 +1,121 @@
+% test_schema
+% Schema checks of toml_parse_file: defaults and coercions are applied to
+% a valid document, violations are listed with their path, kind and
+% position (or raised as an error without a second output), and a schema
+% given as a struct behaves like the same schema in a file.
+clear all;clc
+
+schemaFile = [tempname '.toml'];
+file = [tempname '.toml'];
+cleanup = onCleanup(@() delete(schemaFile, file));
+write_text(schemaFile, doc('[server.port]', ...
+    'type = "integer"', ...
+    'min = 1', ...
+    'max = 65535', ...
+    'required = true', ...
+    '', ...
+    '[server.host]', ...
+    'type = "string"', ...
+    'required = true', ...
+    '', ...
+    '[server.timeout]', ...
+    'type = "float"', ...
+    'default = 30', ...
+    '', ...
+    '[logging.level]', ...
+    'type = "categorical"', ...
+    'enum = ["debug", "info", "warn"]', ...
+    'default = "info"', ...
+    '', ...
+    '[products.name]', ...
+    'type = "string"', ...
+    'required = true', ...
+    '', ...
+    '[products.price]', ...
+    'type = "float"', ...
+    'min = 0', ...
+    ''));
+
+%% defaults and coercion
+write_text(file, doc('[server]', ...
+    'port = 8080', ...
+    'host = "example.org"', ...
+    '', ...
+    '[[products]]', ...
+    'name = "Hammer"', ...
+    'price = 2', ...
+    ''));
+[data, violations] = toml_mex('parse_file', file, 'Schema', schemaFile);
+assert(isempty(violations), 'a valid document has no violations');
+assert(isequal(data.server.port, int64(8080)), 'values without coercion are converted as usual');
+assert(isa(data.server.timeout, 'double') && data.server.timeout == 30, 'a default is coerced to its type');
+assert(iscategorical(data.logging.level) && data.logging.level == 'info', ...
+    'a missing table gets the defaults of its keys');
+assert(isa(data.products{1}.price, 'double') && data.products{1}.price == 2, ...
+    'float rules convert integers to double, also in arrays of tables');
+assert(isequal(toml_mex('parse_file', file, 'Schema', schemaFile), data), ...
+    'a valid document needs no second output');
+
+% The same schema as a struct
+schema = toml_mex('parse_file', schemaFile);
+assert(isequal(toml_mex('parse_file', file, 'Schema', schema), data), 'a struct schema gives the same result');
+
+%% violations
+write_text(file, doc('[server]', ...
+    'port = 70000', ...
+    'host = 5', ...
+    '', ...
+    '[logging]', ...
+    'level = "trace"', ...
+    '', ...
+    '[[products]]', ...
+    'price = 1.5', ...
+    ''));
+[data, violations] = toml_mex('parse_file', file, 'Schema', schemaFile);
+assert(isequal({violations.path}', {'server.port'; 'server.host'; 'logging.level'; 'products[1].name'}), ...
+    'violations are listed in document order');
+assert(isequal({violations.kind}', {'range'; 'type'; 'enum'; 'missing'}), 'the kind of each violation');
+assert(isequal([violations(1:3).line], [2 3 6]) && isequal([violations(1:3).column], [8 8 9]), ...
+    'violations are reported at the offending value');
+assert(isequal(data.server.port, int64(70000)) && strcmp(data.logging.level, 'trace'), ...
+    'values that violate their rule are converted unchanged');
+
+% Without the second output the first violation is an error
+try
+    toml_mex('parse_file', file, 'Schema', schemaFile);
+    error('test_schema:accepted', 'Violations did not raise an error');
+catch ME
+    assert(strcmp(ME.identifier, 'toml_parse_file:schemaViolation'), ME.message);
+    assert(contains(ME.message, ':2:8:') && contains(ME.message, '(and 3 more)'), ME.message);
+end
+
+%% invalid schemas
+assert_error(@() toml_mex('parse_file', file, 'Schema', struct('x', struct('type', 'int'))), ...
+    'toml_parse_file:invalidSchema', 1);
+assert_error(@() toml_mex('parse_file', file, 'Schema', struct('x', struct('type', 'integer', 'maximum', 1))), ...
+    'toml_parse_file:invalidSchema', 2);
+assert_error(@() toml_mex('parse_file', file, 'Schema', [tempname '.toml']), ...
+    'toml_parse_file:invalidSchema', 3);
+fprintf('schema tests passed\n');
+
+function text = doc(varargin)
+    text = strjoin(varargin, newline);
+end
+
+function write_text(file, text)
+    fid = fopen(file, 'w');
+    fwrite(fid, text);
+    fclose(fid);
+end
+
+function assert_error(f, id, i)
+    try
+        f();
+    catch ME
+        if ~strcmp(ME.identifier, id)
+            error('test_schema:wrongError', 'Case %d failed with %s: %s', i, ME.identifier, ME.message);
+        end
+        return;
+    end
+    error('test_schema:accepted', 'Case %d did not raise %s', i, id);
+end
@@ -0,0 +1,114 @@
+% test_streaming
+% Conformance of the streaming parser ('Streaming', true) with the toml++
+% based conversion: every valid document must give the same value both
+% ways, and every invalid document must be rejected both ways.
+clear all;clc
+
+%% valid documents
+valid = {
+    doc('title = "TOML \"x\" \u00e9 \t tab"', 'lit = ''C:\path''', 'empty = ""')
+    doc('s = """', 'Roses \', '   are red', '  Violets""""', 'l = ''''''', 'raw \n ''''x''''''''')
+    doc('n = -9_223_372_036_854_775_808', 'p = +17', 'h = 0xDEAD_beef', 'o = 0o755', 'b = 0b101')
+    doc('f = 6.626e-34', 'g = -inf', 'k = +1_000.5', 'z = -0.0', 'e = 5e+22', 'q = nan')
+    doc('t = true', 'u = false')
+    doc('d = 1979-05-27', 't = 07:32:00.5', 'dt = 1979-05-27T07:32:00Z', ...
+        'do = 1979-05-27 00:32:00.999-07:00', 'ld = 1979-05-27T07:32:00')
+    doc('ints = [1, 2, 3]', 'floats = [1.5, 2.0]', 'mixed = [1, 2.5]', 'bools = [true, false]', ...
+        'strs = ["a", ''b'']', 'nested = [[1, 2], ["x"]]', 'hetero = [1, "x", {y = 2}]', 'empty = []')
+    doc('a = [', '  1, # one', '  2,', ']')
+    doc('point = {x = 1, y = 2}', 'nested = {a.b = 1, c = {d = "e"}}', 'empty = {}')
+    doc('a.b.c = 1', 'a.b.d = 2', 'a.e = 3', '"quoted.key" = 4', 'site."google.com" = true')
+    doc('[x.y.z]', 'q = 1', '[x]', 'r = 2')
+    doc('[[fruit]]', 'name = "apple"', '[fruit.physical]', 'color = "red"', ...
+        '[[fruit.variety]]', 'name = "red delicious"', '[[fruit.variety]]', 'name = "granny"', ...
+        '[[fruit]]', 'name = "banana"')
+    doc('# comment only', '', '[t] # trailing', 'k = "v" # trailing')
+    [char([239 187 191]) 'bom = 1']
+    ['crlf = 1' char([13 10]) 'two = 2' char([13 10])]
+    doc('big = 9007199254740993', 'mix = [1, 2.5, 9007199254740993]')
+};
+
+for i = 1:numel(valid)
+    expected = toml_mex('parse_string', valid{i});
+    streamed = toml_mex('parse_string', valid{i}, 'Streaming', true);
+    if ~isequaln(expected, streamed)
+        error('test_streaming:mismatch', 'Valid case %d differs:\n%s', i, valid{i});
+    end
+end
+fprintf('%d valid documents convert identically\n', numel(valid));
+
+%% invalid documents
+invalid = {
+    doc('a = 1', 'a = 2')
+    doc('[a]', '[a]')
+    doc('[fruit]', 'apple.color = "red"', '[fruit.apple]')
+    doc('a = [1]', '[[a]]')
+    doc('[[a]]', '[a]')
+    doc('a = {x = 1}', '[a]')
+    doc('a.b = 1', 'a.b.c = 2')
+    'x = 012'
+    'x = 9223372036854775808'
+    'x = 1__0'
+    'x = 1_'
+    'x = 0x-1'
+    'x = .5'
+    'x = 1.'
+    'x = "abc'
+    'x = "\q"'
+    'x = "\uD800"'
+    'x = 1 y = 2'
+    'x = [1 2]'
+    'x = {a = 1,}'
+    'x = 1979-13-01'
+    'x = 25:00:00'
+    'x = 07:32'
+    'x = 1979-05-27T07:32Z'
+    'x = 1979-05-27 07:32'
+    '= 1'
+    'x ='
+    '[a'
+    ['x = 1' char(13) 'y = 2']
+};
+
+for i = 1:numel(invalid)
+    assert_parse_error(invalid{i}, {}, i);
+    assert_parse_error(invalid{i}, {'Streaming', true}, i);
+end
+fprintf('%d invalid documents are rejected\n', numel(invalid));
+
+%% nesting limits of the streaming parser
+deep_header = ['[' repmat('a.', 1, 300) 'a]'];
+deep_key = [repmat('a.', 1, 300) 'a = 1'];
+deep_array = ['x = ' repmat('[', 1, 300) repmat(']', 1, 300)];
+deep_inline = ['x = ' repmat('{a = ', 1, 300) '1' repmat('}', 1, 300)];
+deep = {deep_header, deep_key, deep_array, deep_inline};
+for i = 1:numel(deep)
+    assert_parse_error(deep{i}, {'Streaming', true}, i);
+end
+fprintf('%d over-deep documents are rejected by the streaming parser\n', numel(deep));
+
+% The conversion limits do not apply to the streaming parser
+for opt = {'MaxDepth', 'MaxNodes'}
+    try
+        toml_mex('parse_string', 'a = 1', 'Streaming', true, opt{1}, 10);
+        error('test_streaming:accepted', '''Streaming'' was accepted with ''%s''', opt{1});
+    catch ME
+        assert(strcmp(ME.identifier, 'toml_parse_string:invalidArgs'), ME.message);
+    end
+end
+
+function text = doc(varargin)
+    text = strjoin(varargin, newline);
+end
+
+function assert_parse_error(text, options, i)
+    try
+        toml_mex('parse_string', text, options{:});
+    catch ME
+        if ~contains(ME.identifier, 'parseError')
+            error('test_streaming:wrongError', 'Case %d failed with %s: %s', i, ME.identifier, ME.message);
+        end
+        return;
+    end
+    error('test_streaming:accepted', 'Invalid case %d was accepted:\n%s', i, text);
+end
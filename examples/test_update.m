@@ -0,0 +1,201 @@
+% test_update
+% Round trips of toml_update_file: only the modified values change, every
+% other byte of the file (comments, spacing, key spelling, line endings)
+% stays as it was, and new values are written as toml_write_string writes
+% them.
+clear all;clc
+
+file = [tempname '.toml'];
+cleanup = onCleanup(@() delete(file));
+
+original = doc('# Service config', ...
+    'title = "old"   # trailing comment', ...
+    '  port=8080', ...
+    'hex = 0xff', ...
+    '', ...
+    '[database]   # db', ...
+    '"server" = ''10.0.0.1''', ...
+    'ports = [ 8001, 8002 ]', ...
+    'nested.level = "x"', ...
+    '', ...
+    '[[products]]', ...
+    'name = "Hammer"', ...
+    'price = 1.5', ...
+    '', ...
+    '[[products]]', ...
+    'name = "Nail"', ...
+    'price = 0.25', ...
+    '');
+
+%% format-preserving updates
+write_text(file, original);
+mods = struct();
+mods.title = 'new';
+mods.port = int64(9090);
+mods.database.server = '10.0.0.2';
+mods.database.nested.level = 'y';
+mods.database.missing = 1.5;
+[updated, unmatched] = toml_mex('update_file', file, mods);
+assert(updated == 4, 'four values are updated');
+assert(isequal(unmatched, {'database.missing'}), 'keys that do not exist are reported');
+expected = replace_lines(original, ...
+    'title = "old"   # trailing comment', ['title = ' render('new') '   # trailing comment'], ...
+    '  port=8080', ['  port=' render(int64(9090))], ...
+    '"server" = ''10.0.0.1''', ['"server" = ' render('10.0.0.2')], ...
+    'nested.level = "x"', ['nested.level = ' render('y')]);
+assert(strcmp(fileread(file), expected), 'only the modified values change');
+parsed = toml_mex('parse_file', file);
+assert(strcmp(parsed.title, 'new') && parsed.port == 9090 && strcmp(parsed.database.server, '10.0.0.2'), ...
+    'the updated file reads back with the new values');
+
+% Values that are already set leave the file alone
+[updated, unmatched] = toml_mex('update_file', file, struct('title', 'new'));
+assert(updated == 0 && isempty(unmatched), 'an unchanged value is not counted');
+assert(strcmp(fileread(file), expected), 'an unchanged value does not rewrite the file');
+
+%% line endings
+crlf = [char(13) newline];
+write_text(file, strjoin({'a = 1', 'b = "x"', '[t]', 'c = true', ''}, crlf));
+mods = struct('b', 'yy', 't', struct('c', false), 'n', int64(1));
+toml_mex('update_file', file, mods, 'AddMissing', true);
+expected = strjoin({'a = 1', ['b = ' render('yy')], ['n = ' render(int64(1))], '[t]', ...
+    ['c = ' render(false)], ''}, crlf);
+assert(strcmp(fileread(file), expected), 'CRLF line endings are kept, also for added keys');
+
+%% AddMissing
+write_text(file, original);
+mods = struct();
+mods.top = int64(3);
+mods.database.missing = int64(1);
+mods.extra.a = int64(2);
+[updated, unmatched] = toml_mex('update_file', file, mods, 'AddMissing', true);
+assert(updated == 3 && isempty(unmatched), 'missing keys are added');
+expected = replace_lines(original, ...
+    'hex = 0xff', ['hex = 0xff' newline 'top = ' render(int64(3))], ...
+    'nested.level = "x"', ['nested.level = "x"' newline 'missing = ' render(int64(1))]);
+expected = [expected newline '[extra]' newline 'a = ' render(int64(2)) newline];
+assert(strcmp(fileread(file), expected), ...
+    'keys are added at the end of their table and new tables at the end of the file');
+fprintf('format-preserving updates passed\n');
+
+%% elements of arrays of tables
+write_text(file, original);
+mods = struct();
+mods.products = struct('price', {[], 0.5, 2.5});
+[updated, unmatched] = toml_mex('update_file', file, mods);
+assert(updated == 1, 'elements whose fields are all empty are skipped');
+assert(isequal(unmatched, {'products[3].price'}), 'elements past the end are reported with their index');
+expected = replace_lines(original, 'price = 0.25', ['price = ' render(0.5)]);
+assert(strcmp(fileread(file), expected), 'only the second element changes');
+
+% AddMissing adds keys to existing elements but never adds elements
+write_text(file, original);
+mods.products = struct('stock', {int64(7), []});
+[updated, unmatched] = toml_mex('update_file', file, mods, 'AddMissing', true);
+assert(updated == 1 && isempty(unmatched), 'the key is added');
+expected = replace_lines(original, 'price = 1.5', ['price = 1.5' newline 'stock = ' render(int64(7))]);
+assert(strcmp(fileread(file), expected), 'the key is added to the first element');
+parsed = toml_mex('parse_file', file);
+assert(parsed.products{1}.stock == 7 && ~isfield(parsed.products{2}, 'stock'), ...
+    'the added key belongs to the first element only');
+mods.products = struct('price', {[], [], 2.5});
+assert_error(@() toml_mex('update_file', file, mods, 'AddMissing', true), ...
+    'toml_update_file:invalidModification', 1);
+assert(strcmp(fileread(file), expected), 'a failed update leaves the file alone');
+fprintf('array of tables updates passed\n');
+
+%% same-length patches
+% A value of the same length is written in place, so a hard link to the
+% file sees the change; with 'Patch', false the file is replaced and the
+% link keeps the old text. Both give the same text.
+mods = struct('port', int64(9091));
+expected = replace_lines(original, '  port=8080', ['  port=' render(int64(9091))]);
+for patch = [true false]
+    write_text(file, original);
+    link = [tempname '.toml'];
+    linked = isunix && system(sprintf('ln "%s" "%s"', file, link)) == 0;
+    updated = toml_mex('update_file', file, mods, 'Patch', patch);
+    assert(updated == 1, 'the port is updated');
+    assert(strcmp(fileread(file), expected), 'patching and rewriting give the same text');
+    if linked
+        assert(strcmp(fileread(link), expected) == patch, ...
+            'only an in-place patch is seen through a hard link');
+        delete(link);
+    end
+end
+
+% A value of another length is never patched in place
+write_text(file, original);
+mods = struct('port', int64(80));
+toml_mex('update_file', file, mods);
+expected = replace_lines(original, '  port=8080', ['  port=' render(int64(80))]);
+assert(strcmp(fileread(file), expected), 'a shorter value rewrites the file');
+fprintf('patch updates passed\n');
+
+%% batch updates
+% Every file gets the same text as a single update would give; a missing
+% file is reported in its status and does not stop the others
+mods = struct('title', 'new');
+mods.database.server = '10.0.0.2';
+write_text(file, original);
+toml_mex('update_file', file, mods);
+expected = fileread(file);
+
+files = arrayfun(@(~) [tempname '.toml'], 1:3, 'UniformOutput', false);
+cleanupFiles = onCleanup(@() cellfun(@delete, files));
+cellfun(@(f) write_text(f, original), files);
+missing = [tempname '.toml'];
+status = toml_mex('update_files', [files {missing}], mods, 'Threads', 2);
+assert(numel(status) == 4, 'one status per file');
+for k = 1:3
+    assert(strcmp(status(k).file, files{k}), 'statuses are in the order of the files');
+    assert(status(k).ok && status(k).written && status(k).updated == 2, 'file %d is updated', k);
+    assert(isequal(sort(status(k).changed), {'database.server', 'title'}), 'the changed paths are listed');
+    assert(isempty(status(k).unmatched) && isempty(status(k).identifier), 'file %d has no errors', k);
+    assert(strcmp(fileread(files{k}), expected), 'a batch update gives the same text as a single one');
+end
+assert(~status(4).ok && ~status(4).written, 'the missing file is not written');
+assert(strcmp(status(4).identifier, 'toml_update_files:fileNotFound'), status(4).message);
+
+% Files that are already up to date are not written again
+status = toml_mex('update_files', files, mods);
+assert(all([status.ok]) && ~any([status.written]) && all([status.updated] == 0), ...
+    'unchanged files are not written');
+fprintf('batch updates passed\n');
+
+function text = doc(varargin)
+    text = strjoin(varargin, newline);
+end
+
+% A value as toml_write_string writes it
+function text = render(value)
+    text = toml_mex('write_string', struct('v', value));
+    text = strtrim(extractAfter(text, 'v = '));
+end
+
+% Replace each old line (which must occur once) by its new text
+function text = replace_lines(text, varargin)
+    for i = 1:2:numel(varargin)
+        old = [varargin{i} newline];
+        assert(numel(strfind(text, old)) == 1, 'test_update:badCase', 'Line not unique: %s', varargin{i});
+        text = strrep(text, old, [varargin{i + 1} newline]);
+    end
+end
+
+function write_text(file, text)
+    fid = fopen(file, 'w');
+    fwrite(fid, text);
+    fclose(fid);
+end
+
+function assert_error(f, id, i)
+    try
+        f();
+    catch ME
+        if ~strcmp(ME.identifier, id)
+            error('test_update:wrongError', 'Case %d failed with %s: %s', i, ME.identifier, ME.message);
+        end
+        return;
+    end
+    error('test_update:accepted', 'Case %d did not raise %s', i, id);
+end
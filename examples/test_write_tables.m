@@ -0,0 +1,65 @@
+% test_write_tables
+% Round trips of arrays of tables: struct arrays and cell arrays of structs
+% are written as one [[key]] section per element (with their sub-tables),
+% read back as cell arrays of structs, and writing the parsed value again
+% gives the same text.
+clear all;clc
+
+%% struct arrays
+data.title = 'shop';
+data.products(1).name = 'Hammer';
+data.products(1).price = 9.5;
+data.products(1).dims = struct('w', 0.5, 'h', 2.5);
+data.products(2).name = 'Nail';
+data.products(2).price = 0.25;
+data.products(2).dims = struct('w', 0.125, 'h', 1.5);
+data.parts = {struct('a', int64(1)), struct('a', int64(2), 'b', 'x')};
+
+expected = doc('title = "shop"', ...
+    '', ...
+    '[[products]]', ...
+    'name = "Hammer"', ...
+    'price = 9.5', ...
+    '', ...
+    '[products.dims]', ...
+    'w = 0.5', ...
+    'h = 2.5', ...
+    '', ...
+    '[[products]]', ...
+    'name = "Nail"', ...
+    'price = 0.25', ...
+    '', ...
+    '[products.dims]', ...
+    'w = 0.125', ...
+    'h = 1.5', ...
+    '', ...
+    '[[parts]]', ...
+    'a = 1', ...
+    '', ...
+    '[[parts]]', ...
+    'a = 2', ...
+    'b = "x"', ...
+    '');
+text = toml_mex('write_string', data);
+assert(strcmp(text, expected), 'one [[key]] section per element, sub-tables after their element');
+
+%% round trip
+parsed = toml_mex('parse_string', text);
+assert(iscell(parsed.products) && isequal(size(parsed.products), [1 2]), ...
+    'an array of tables reads back as a 1xN cell array');
+for k = 1:2
+    assert(isequal(parsed.products{k}, data.products(k)), 'element %d reads back unchanged', k);
+end
+assert(isequal(parsed.parts, data.parts), 'elements with different fields read back unchanged');
+assert(strcmp(toml_mex('write_string', parsed), text), 'writing the parsed value gives the same text');
+assert(isequal(toml_mex('write_string', data, 'Parallel', true), text), 'Parallel gives the same text');
+
+% A 1x1 struct is a table, not an array of tables
+single = struct('products', struct('name', 'Hammer'));
+parsed = toml_mex('parse_string', toml_mex('write_string', single));
+assert(isstruct(parsed.products) && strcmp(parsed.products.name, 'Hammer'), 'a scalar struct is a table');
+fprintf('array of tables round trips passed\n');
+
+function text = doc(varargin)
+    text = strjoin(varargin, newline);
+end
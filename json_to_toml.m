@@ -0,0 +1,59 @@
+function toml = json_to_toml(input, varargin)
+    % JSON_TO_TOML Convert JSON text to a TOML document
+    %
+    % Syntax:
+    %   toml = json_to_toml(input)
+    %   toml = json_to_toml(input, 'Name', value, ...)
+    %
+    % Description:
+    %   Reads the JSON in C++ into a toml++ tree and writes it as TOML,
+    %   without building a MATLAB struct. The top level must be an object.
+    %   Whole numbers that fit into int64 become integers, other numbers
+    %   floats; null cannot be represented in TOML and is an error. Keys
+    %   are written in the order of the JSON objects, plain values of a
+    %   table before its [tables] and [[arrays of tables]], as writeTOMLfile
+    %   lays out a struct.
+    %
+    % Inputs:
+    %   input - JSON file name or JSON text. Without 'Source', an existing
+    %           file is read and anything else is parsed as text.
+    %
+    % Options:
+    %   'Source' - 'file' or 'string'
+    %   'Tagged' - Decode {"type": ..., "value": "..."} objects written by
+    %              toml_to_json(..., 'Tagged', true) back into typed values
+    %              (default false)
+    %   'File'   - Write the TOML to this file instead of returning it
+    %              (toml is then '')
+    %   'MaxDepth' - Deepest nesting of objects and arrays that is read
+    %              (default 1000; Inf for no limit)
+    %
+    % Outputs:
+    %   toml - TOML text (char)
+    %
+    % Example:
+    %   json = toml_to_json('service.toml', 'Tagged', true);
+    %   json_to_toml(json, 'Tagged', true, 'File', 'copy.toml');
+
+    if nargin < 1
+        error('json_to_toml:missingInput', 'Input file or JSON text is required');
+    end
+    if isstring(input)
+        input = char(input);
+    end
+    if ~any(strcmpi(varargin(1:2:end), 'Source'))
+        if isfile(input)
+            varargin = [varargin, {'Source', 'file'}];
+        else
+            varargin = [varargin, {'Source', 'string'}];
+        end
+    end
+
+    try
+        toml = toml_mex('json', 'to_toml', input, varargin{:});
+    catch ME
+        % Report errors under this function's identifiers
+        id = strrep(ME.identifier, 'toml_json:', 'json_to_toml:');
+        error(id, '%s', ME.message);
+    end
+end
@@ -0,0 +1,55 @@
+function [merged, sources] = mergeTOML(layers, varargin)
+    % MERGETOML Merge a base TOML file with overlays
+    %
+    % Syntax:
+    %   merged = mergeTOML(layers)
+    %   [merged, sources] = mergeTOML(layers, 'Name', value, ...)
+    %
+    % Description:
+    %   Deep-merges the layers in order (base first, later layers win) and
+    %   returns the result as a struct. Wrapper for toml_merge, which merges
+    %   the parsed documents in C++ and only converts the merged result.
+    %
+    % Inputs:
+    %   layers - Cell array (or string array) of file names, or of TOML text
+    %            with 'Source', 'string'
+    %
+    % Options:
+    %   'Rules'    - Nx2 cell array of {path, rule}: 'merge' (tables,
+    %                default), 'replace' (default for other values) or
+    %                'append' (concatenate arrays)
+    %   'Source'   - 'file' (default) or 'string'
+    %   'Parallel' - Parse the layers on worker threads (default false)
+    %   'Threads'  - Number of threads with 'Parallel' (default 0 = all cores)
+    %
+    % Outputs:
+    %   merged  - Merged TOML data as MATLAB struct
+    %   sources - Struct array with the path of every value and the index
+    %             of the layer it came from
+    %
+    % Example:
+    %   [cfg, src] = mergeTOML({'base.toml', 'site.toml', 'host.toml'}, ...
+    %                          'Rules', {'plugins', 'append'});
+
+    % Validate inputs
+    if nargin < 1
+        error('mergeTOML:missingInput', 'Input layers are required');
+    end
+
+    % Accept string arrays
+    if isstring(layers)
+        layers = cellstr(layers);
+    end
+
+    try
+        if nargout > 1
+            [merged, sources] = toml_mex('merge', layers, varargin{:});
+        else
+            merged = toml_mex('merge', layers, varargin{:});
+        end
+    catch ME
+        % Report errors under this function's identifiers
+        id = strrep(ME.identifier, 'toml_merge:', 'mergeTOML:');
+        error(id, '%s', ME.message);
+    end
+end
@@ -1,18 +1,43 @@
-function parsedStructure = parseTOMLfile(tomlfile)
+function [parsedStructure, violations] = parseTOMLfile(tomlfile, varargin)
     % PARSETOMLFILE Parse TOML file with error handling
     %
     % Syntax:
     %   parsedStructure = parseTOMLfile(tomlfile)
+    %   [parsedStructure, violations] = parseTOMLfile(tomlfile, 'Schema', schema)
+    %   parsedStructure = parseTOMLfile(tomlfile, 'Macros', macros)
+    %   parsedStructure = parseTOMLfile(tomlfile, 'Streaming', true)
+    %   parsedStructure = parseTOMLfile(tomlfile, 'IntegerClass', 'auto')
+    %   parsedStructure = parseTOMLfile(tomlfile, 'MaxDepth', 64, 'MaxNodes', 1e6)
     %
     % Description:
     %   Wrapper for toml_parse_file with robust error handling and validation
     %
     % Inputs:
     %   tomlfile - Path to TOML file (string or char)
+    %   'Schema' - Schema file or struct: the file is validated, defaulted
+    %              and coerced while it is converted (see toml_schema.hpp)
+    %   'Macros' - Struct of macro values, 'env', or a cell array of both:
+    %              ${NAME} tokens in string values are expanded
+    %   'Streaming' - true to convert the file in one pass without a toml++
+    %              tree (lower peak memory); not with 'Schema', 'Macros',
+    %              'MaxDepth' or 'MaxNodes'
+    %   'IntegerClass' - 'int64' (default), 'double', or 'auto': integer
+    %              arrays get the smallest signed class that holds them and
+    %              scalars are doubles (int64 beyond 2^53)
+    %   'MixedNumbers' - Arrays of integers and floats: 'exact' (default)
+    %              gives a double vector unless an integer is beyond 2^53,
+    %              'double' always a double vector, 'cell' a cell array
+    %   'MaxDepth' - Deepest nesting of tables and arrays allowed
+    %              (default 1000; Inf for no limit)
+    %   'MaxNodes' - Most values allowed, array elements included
+    %              (default Inf)
     %
     % Outputs:
     %   parsedStructure - Parsed TOML data as MATLAB struct
     %                     Empty struct if file not found or parse error
+    %   violations      - Struct array of schema violations (path, kind,
+    %                     message, line, column). Without this output any
+    %                     violation is an error.
     %
     % Example:
     %   config = parseTOMLfile('config.toml');
@@ -25,6 +50,7 @@ function parsedStructure = parseTOMLfile(tomlfile)
     
     % Initialize output
     parsedStructure = struct();
+    violations = struct('path', {}, 'kind', {}, 'message', {}, 'line', {}, 'column', {});
     
     % Validate input
     if nargin < 1
@@ -58,18 +84,28 @@ function parsedStructure = parseTOMLfile(tomlfile)
     
     % Try to parse the file
     try
-        parsedStructure = toml_parse_file(tomlfile);
+        if nargout > 1
+            [parsedStructure, violations] = toml_mex('parse_file', tomlfile, varargin{:});
+        else
+            parsedStructure = toml_mex('parse_file', tomlfile, varargin{:});
+        end
         
     catch ME
         % Handle different types of errors
-        if contains(ME.identifier, 'parseError')
+        if contains(ME.identifier, 'schemaViolation') || contains(ME.identifier, 'invalidSchema')
+            error(strrep(ME.identifier, 'toml_parse_file:', 'parseTOMLfile:'), '%s', ME.message);
+        elseif contains(ME.identifier, 'parseError')
             warning('parseTOMLfile:parseError', ...
                     'Failed to parse TOML file: %s\nError: %s', ...
                     tomlfile, ME.message);
+        elseif contains(ME.identifier, 'limitExceeded')
+            warning('parseTOMLfile:limitExceeded', ...
+                    'TOML file exceeds the conversion limits: %s\nError: %s', ...
+                    tomlfile, ME.message);
         elseif contains(ME.identifier, 'mexNotFound') || contains(ME.message, 'Undefined')
             warning('parseTOMLfile:mexNotCompiled', ...
-                    'toml_parse_file MEX function not found. Please compile it first:\n%s', ...
-                    'mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_parse_file.cpp');
+                    'toml_mex MEX function not found. Please compile it first:\n%s', ...
+                    'build_toml_mex');
         else
             warning('parseTOMLfile:unknownError', ...
                     'Unexpected error parsing TOML file: %s\nError: %s', ...
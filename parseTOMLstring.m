@@ -1,14 +1,28 @@
-function parsedStructure = parseTOMLstring(tomlstring)
+function parsedStructure = parseTOMLstring(tomlstring, varargin)
     % PARSETOMLSTRING Parse TOML string with error handling
     %
     % Syntax:
     %   parsedStructure = parseTOMLstring(tomlstring)
+    %   parsedStructure = parseTOMLstring(tomlstring, 'Macros', macros)
+    %   parsedStructure = parseTOMLstring(tomlstring, 'Streaming', true)
+    %   parsedStructure = parseTOMLstring(tomlstring, 'IntegerClass', 'auto')
     %
     % Description:
     %   Wrapper for toml_parse_string with robust error handling and validation
     %
     % Inputs:
     %   tomlstring - TOML content as string or char
+    %   'Macros'   - Struct of macro values, 'env', or a cell array of both:
+    %                ${NAME} tokens in string values are expanded
+    %   'Streaming'  - true to convert the text in one pass without a
+    %                toml++ tree; not with 'Macros', 'MaxDepth' or
+    %                'MaxNodes'
+    %   'IntegerClass' - 'int64' (default), 'double' or 'auto', as for
+    %                parseTOMLfile
+    %   'MixedNumbers' - 'exact' (default), 'double' or 'cell', as for
+    %                parseTOMLfile
+    %   'MaxDepth', 'MaxNodes' - Limits on nesting and number of values,
+    %                as for parseTOMLfile
     %
     % Outputs:
     %   parsedStructure - Parsed TOML data as MATLAB struct
@@ -55,17 +69,20 @@ function parsedStructure = parseTOMLstring(tomlstring)
     
     % Try to parse the string
     try
-        parsedStructure = toml_parse_string(tomlstring);
+        parsedStructure = toml_mex('parse_string', tomlstring, varargin{:});
         
     catch ME
         % Handle different types of errors
         if contains(ME.identifier, 'parseError')
             warning('parseTOMLstring:parseError', ...
                     'Failed to parse TOML string.\nError: %s', ME.message);
+        elseif contains(ME.identifier, 'limitExceeded')
+            warning('parseTOMLstring:limitExceeded', ...
+                    'TOML string exceeds the conversion limits.\nError: %s', ME.message);
         elseif contains(ME.identifier, 'mexNotFound') || contains(ME.message, 'Undefined')
             error('parseTOMLstring:mexNotCompiled', ...
-                    'toml_parse_string MEX function not found. Please compile it first:\n%s', ...
-                    'mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_parse_string.cpp');
+                    'toml_mex MEX function not found. Please compile it first:\n%s', ...
+                    'build_toml_mex');
         else
             warning('parseTOMLstring:unknownError', ...
                     'Unexpected error parsing TOML string.\nError: %s', ME.message);
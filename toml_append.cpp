@@ -0,0 +1,206 @@
+/*
+ * toml_append.cpp
+ * Append [[section]] entries to a TOML file without rewriting it.
+ *
+ * The new entries are serialized exactly as toml_write_file writes an
+ * array of tables (serialize_table_array) and added to the end of the
+ * file, which is opened with O_APPEND and kept open between calls (see
+ * AppendFile). The cost of a call depends on the new entries only, not on
+ * the size of the file.
+ *
+ * Compile with:
+ *   mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_append.cpp
+ *
+ * Usage in MATLAB:
+ *   toml_append('events.toml', 'record', event);           % one entry
+ *   toml_append('events.toml', 'record', events);          % struct array: one entry each
+ *   toml_append('events.toml', 'record', event, 'SyncEvery', 100);
+ *   toml_append('events.toml', 'record', event, 'Buffered', true);
+ *   toml_append('close', 'events.toml');                   % flush and close
+ *   toml_append('close');                                  % all files
+ *
+ * Options:
+ *   'Buffered'  - Keep the text in memory until 1 MB has been collected
+ *                 (or the file is closed) instead of writing it before
+ *                 returning (default false)
+ *   'SyncEvery' - fsync the file after every N appended entries (default
+ *                 0 = never)
+ *
+ * Open files belong to the loaded MEX binary and are keyed by their
+ * resolved path, so 'a.toml' and './a.toml' share one buffer. Buffered text
+ * is written when the binary is cleared. A file that was replaced since it
+ * was opened (e.g. by an atomic toml_write_file) is reopened, and text still
+ * buffered for it is written to the new file; if it cannot be reopened the
+ * text is discarded and the error (or, when the binary is cleared, a
+ * toml_append:textDiscarded warning) says so.
+ */
+
+#include "mex.h"
+#include "toml_serialize.hpp"
+#include "toml_file_sink.hpp"
+#include "toml_mex_options.hpp"
+#include "toml_at_exit.hpp"
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct AppendOptions {
+    bool buffered = false;
+    size_t sync_every = 0;
+};
+
+struct AppendHandle {
+    std::unique_ptr<AppendFile> file;
+    size_t unsynced = 0;   // entries appended since the last fsync
+};
+
+// Keyed by file_canonical_path
+static std::map<std::string, AppendHandle>& open_files() {
+    static std::map<std::string, AppendHandle> files;
+    return files;
+}
+
+// Close every file; returns the errors, one per file that failed
+static std::vector<std::string> close_every_file() {
+    std::vector<std::string> errors;
+    for (auto& entry : open_files()) {
+        try {
+            entry.second.file->close();
+        }
+        catch (const std::exception& e) {
+            errors.push_back(e.what());
+        }
+    }
+    open_files().clear();
+    return errors;
+}
+
+// Write buffered text before the binary is unloaded
+static void close_all_files() {
+    for (const std::string& error : close_every_file())
+        mexWarnMsgIdAndTxt("toml_append:textDiscarded", "Error closing TOML file: %s", error.c_str());
+}
+
+// Parse trailing 'Name', value option pairs
+static AppendOptions parse_options(int nrhs, const mxArray* prhs[], int first) {
+    AppendOptions opts;
+    check_option_pairs(nrhs, first, "toml_append");
+    for (int i = first; i < nrhs; i += 2) {
+        std::string opt = option_name(prhs[i], "toml_append");
+        const mxArray* v = prhs[i + 1];
+
+        if (option_is(opt, "Buffered")) {
+            opts.buffered = option_logical(v, opt, "toml_append");
+        } else if (option_is(opt, "SyncEvery")) {
+            double n = option_scalar(v, opt, "toml_append");
+            opts.sync_every = n > 0 ? static_cast<size_t>(n) : 0;
+        } else {
+            mexErrMsgIdAndTxt("toml_append:invalidArgs", "Unknown option '%s'", opt.c_str());
+        }
+    }
+    return opts;
+}
+
+// Flush and close one file, or all of them
+static void close_files(int nrhs, const mxArray* prhs[]) {
+    std::string error_msg;
+    try {
+        if (nrhs == 0) {
+            for (const std::string& error : close_every_file())
+                error_msg += (error_msg.empty() ? "Error closing TOML file: " : "\n") + error;
+        } else {
+            auto found = open_files().find(file_canonical_path(mx_to_std_string(prhs[0])));
+            if (found != open_files().end()) {
+                AppendHandle handle = std::move(found->second);
+                open_files().erase(found);
+                handle.file->close();
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        open_files().clear();
+        error_msg = std::string("Error closing TOML file: ") + e.what();
+    }
+    if (!error_msg.empty())
+        mexErrMsgIdAndTxt("toml_append:error", "%s", error_msg.c_str());
+}
+
+// MEX entry point
+void mexFunction(int nlhs, mxArray* /*plhs*/[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs >= 1 && nrhs <= 2 && mxIsChar(prhs[0]) && mx_to_std_string(prhs[0]) == "close") {
+        close_files(nrhs - 1, prhs + 1);
+        return;
+    }
+
+    if (nrhs < 3)
+        mexErrMsgIdAndTxt("toml_append:invalidArgs",
+                          "Usage: toml_append(filename, section, entries, 'Name', value, ...)");
+
+    if (nlhs > 0)
+        mexErrMsgIdAndTxt("toml_append:tooManyOutputs", "Too many output arguments");
+
+    if (!mxIsChar(prhs[0]) || !mxIsChar(prhs[1]))
+        mexErrMsgIdAndTxt("toml_append:invalidInput", "Filename and section must be char arrays");
+
+    const mxArray* entries = prhs[2];
+    bool valid = mxIsStruct(entries);
+    if (mxIsCell(entries)) {
+        valid = true;
+        for (size_t i = 0; i < mxGetNumberOfElements(entries); ++i) {
+            const mxArray* elem = mxGetCell(entries, i);
+            if (!elem || !mxIsStruct(elem) || mxGetNumberOfElements(elem) != 1) valid = false;
+        }
+    }
+    if (!valid)
+        mexErrMsgIdAndTxt("toml_append:invalidInput",
+                          "Entries must be a struct array or a cell array of scalar structs");
+
+    std::string filename = mx_to_std_string(prhs[0]);
+    std::string key = file_canonical_path(filename);
+    std::string section = mx_to_std_string(prhs[1]);
+    if (section.empty())
+        mexErrMsgIdAndTxt("toml_append:invalidInput", "Section must not be empty");
+    AppendOptions opts = parse_options(nrhs, prhs, 3);
+
+    toml_at_exit(&close_all_files);
+
+    // Errors are raised after the new text has been discarded, so a failed
+    // serialization never leaves half an entry in the file
+    std::string error_id;
+    std::string error_msg;
+    bool serialized = false;
+    try {
+        std::ostringstream text;
+        serialize_table_array(text, entries, section);
+        serialized = true;
+
+        AppendHandle& handle = open_files()[key];
+        if (handle.file) handle.file->follow_path();
+        else handle.file.reset(new AppendFile(filename));
+
+        handle.file->append(text.str());
+        handle.unsynced += mxGetNumberOfElements(entries);
+        if (opts.sync_every > 0 && handle.unsynced >= opts.sync_every) {
+            handle.file->sync();
+            handle.unsynced = 0;
+        } else if (!opts.buffered) {
+            handle.file->flush();
+        }
+    }
+    catch (const FileOpenError& e) {
+        open_files().erase(key);
+        error_id = "toml_append:cannotOpenFile";
+        error_msg = e.what();
+    }
+    catch (const std::exception& e) {
+        if (serialized) open_files().erase(key);
+        error_id = "toml_append:error";
+        error_msg = std::string("Error appending to TOML file: ") + e.what();
+    }
+
+    if (!error_id.empty())
+        mexErrMsgIdAndTxt(error_id.c_str(), "%s", error_msg.c_str());
+}
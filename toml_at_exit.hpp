@@ -0,0 +1,43 @@
+/*
+ * toml_at_exit.hpp
+ * Cleanup functions to run before the MEX binary is unloaded.
+ *
+ * MATLAB keeps a single mexAtExit function per MEX file, so toml_mex, which
+ * holds the state of several commands, registers one function that runs
+ * every cleanup added here, in reverse order.
+ *
+ * Usage:
+ *   toml_at_exit(&close_all_files);
+ */
+
+#ifndef TOML_AT_EXIT_HPP
+#define TOML_AT_EXIT_HPP
+
+#include "mex.h"
+#include <vector>
+
+inline std::vector<void (*)()>& toml_exit_functions() {
+    static std::vector<void (*)()> functions;
+    return functions;
+}
+
+inline void toml_run_exit_functions() {
+    std::vector<void (*)()>& functions = toml_exit_functions();
+    while (!functions.empty()) {
+        void (*fn)() = functions.back();
+        functions.pop_back();
+        fn();
+    }
+}
+
+// Run fn before the binary is unloaded (once, however often it is added)
+inline void toml_at_exit(void (*fn)()) {
+    std::vector<void (*)()>& functions = toml_exit_functions();
+    for (void (*added)() : functions) {
+        if (added == fn) return;
+    }
+    functions.push_back(fn);
+    mexAtExit(&toml_run_exit_functions);
+}
+
+#endif // TOML_AT_EXIT_HPP
@@ -0,0 +1,557 @@
+/*
+ * toml_convert.hpp
+ * Conversion of parsed toml++ trees to MATLAB values, shared by the MEX
+ * files that return TOML data (toml_parse_file, toml_parse_string, ...).
+ *
+ * Tables become 1x1 structs with their fields in source order, homogeneous
+ * integer/float/boolean arrays become int64/double/logical row vectors,
+ * arrays of integers and floats double row vectors, and everything else a
+ * cell array. Integers written in hex, octal or
+ * binary keep their format in a {value, format} struct, and date-times with
+ * an offset become {datetime, offset_minutes} structs, so the writer can
+ * reproduce them.
+ *
+ * String values can be rewritten on the way (e.g. macro expansion, see
+ * toml_macros.hpp) by installing a StringExpander for one conversion with
+ * ScopedStringExpander. Only strings that contain a '$' are passed to it.
+ * How numbers are converted can be chosen for one conversion with
+ * ScopedNumberOptions (see toml_numbers.hpp).
+ *
+ * The tree is walked with an explicit work stack; ScopedConvertLimits sets
+ * how deep and how large a document may be (see toml_limits.hpp).
+ */
+
+#ifndef TOML_CONVERT_HPP
+#define TOML_CONVERT_HPP
+
+#include "mex.h"
+#include <toml++/toml.h>
+#include "toml_macros.hpp"
+#include "toml_limits.hpp"
+#include "toml_numbers.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Forward declaration
+inline mxArray* convert_node(const toml::node& node);
+
+// Helper structure to track field order by source position
+struct FieldInfo {
+    std::string key;
+    const toml::node* node;
+    uint32_t line;
+    uint32_t column;
+    
+    // Sort by line first, then column to preserve original order
+    bool operator<(const FieldInfo& other) const {
+        if (line != other.line) return line < other.line;
+        return column < other.column;
+    }
+};
+
+// Key order of tables whose fields came from different documents, where
+// source positions cannot be compared (see toml_merge.hpp). Ranked keys
+// come first, in rank order; the rest follow in source order
+using FieldRanks = std::unordered_map<const toml::table*,
+                                      std::unordered_map<std::string, uint32_t>>;
+
+inline const FieldRanks*& current_field_ranks() {
+    static const FieldRanks* ranks = nullptr;
+    return ranks;
+}
+
+// Installs field ranks for the lifetime of the object
+class ScopedFieldRanks {
+public:
+    explicit ScopedFieldRanks(const FieldRanks* ranks)
+        : previous_(current_field_ranks()) {
+        current_field_ranks() = ranks;
+    }
+    ~ScopedFieldRanks() { current_field_ranks() = previous_; }
+    ScopedFieldRanks(const ScopedFieldRanks&) = delete;
+    ScopedFieldRanks& operator=(const ScopedFieldRanks&) = delete;
+
+private:
+    const FieldRanks* previous_;
+};
+
+// Fields of a table in source order (tables are stored sorted by key),
+// into a vector that may be reused between tables
+inline void ordered_fields_into(const toml::table& tbl, std::vector<FieldInfo>& fields) {
+    fields.resize(tbl.size());
+    
+    size_t n = 0;
+    for (auto& [k, v] : tbl) {
+        FieldInfo& info = fields[n++];
+        info.key = k.str();
+        info.node = &v;
+        
+        // Get source location to preserve original order
+        auto src = v.source();
+        if (src.begin) {
+            info.line = src.begin.line;
+            info.column = src.begin.column;
+        } else {
+            // If no source info (e.g., programmatically created), 
+            // use max values (will sort to end)
+            info.line = UINT32_MAX;
+            info.column = UINT32_MAX;
+        }
+    }
+
+    // A rank stands in for the position (line 0 sorts before any source line)
+    if (const FieldRanks* ranks = current_field_ranks()) {
+        auto table_ranks = ranks->find(&tbl);
+        if (table_ranks != ranks->end()) {
+            for (FieldInfo& info : fields) {
+                auto rank = table_ranks->second.find(info.key);
+                if (rank == table_ranks->second.end()) continue;
+                info.line = 0;
+                info.column = rank->second;
+            }
+        }
+    }
+    
+    // Sort by source position to restore original order
+    std::sort(fields.begin(), fields.end());
+}
+
+inline std::vector<FieldInfo> ordered_fields(const toml::table& tbl) {
+    std::vector<FieldInfo> fields;
+    ordered_fields_into(tbl, fields);
+    return fields;
+}
+
+// Call f with the concrete type of a node (table, array or value<T>);
+// Node is toml::node or const toml::node
+template <typename Node, typename F>
+inline void with_node_type(Node& node, F&& f) {
+    if (auto v = node.as_table()) f(*v);
+    else if (auto v = node.as_array()) f(*v);
+    else if (auto v = node.as_string()) f(*v);
+    else if (auto v = node.as_integer()) f(*v);
+    else if (auto v = node.as_floating_point()) f(*v);
+    else if (auto v = node.as_boolean()) f(*v);
+    else if (auto v = node.as_date()) f(*v);
+    else if (auto v = node.as_time()) f(*v);
+    else if (auto v = node.as_date_time()) f(*v);
+}
+
+// Class of an integer array whose elements lie in [lo, hi]
+inline mxClassID integer_array_class(int64_t lo, int64_t hi) {
+    switch (integer_array_element(lo, hi)) {
+        case IntegerElement::Double: return mxDOUBLE_CLASS;
+        case IntegerElement::Int8:   return mxINT8_CLASS;
+        case IntegerElement::Int16:  return mxINT16_CLASS;
+        case IntegerElement::Int32:  return mxINT32_CLASS;
+        default:                     return mxINT64_CLASS;
+    }
+}
+
+template <typename T, typename Get>
+inline mxArray* fill_integer_row(mxClassID cls, size_t count, Get get) {
+    mxArray* result = mxCreateUninitNumericMatrix(1, count, cls, mxREAL);
+    T* data = static_cast<T*>(mxGetData(result));
+    for (size_t i = 0; i < count; ++i) data[i] = static_cast<T>(get(i));
+    return result;
+}
+
+// Row vector of count integers in [lo, hi]; get(i) returns element i
+template <typename Get>
+inline mxArray* integer_row_vector(size_t count, int64_t lo, int64_t hi, Get get) {
+    switch (integer_array_class(lo, hi)) {
+        case mxDOUBLE_CLASS: return fill_integer_row<double>(mxDOUBLE_CLASS, count, get);
+        case mxINT8_CLASS:   return fill_integer_row<int8_t>(mxINT8_CLASS, count, get);
+        case mxINT16_CLASS:  return fill_integer_row<int16_t>(mxINT16_CLASS, count, get);
+        case mxINT32_CLASS:  return fill_integer_row<int32_t>(mxINT32_CLASS, count, get);
+        default:             return fill_integer_row<int64_t>(mxINT64_CLASS, count, get);
+    }
+}
+
+// Integer value; integers written in hex, octal or binary become a
+// {value, format} struct so the writer can reproduce them
+inline mxArray* integer_to_mx(int64_t int_val, toml::value_flags flags) {
+    // Check if this integer has special formatting (check in specific order)
+    bool is_hex = (flags & toml::value_flags::format_as_hexadecimal) != toml::value_flags::none;
+    bool is_oct = (flags & toml::value_flags::format_as_octal) != toml::value_flags::none;
+    bool is_bin = (flags & toml::value_flags::format_as_binary) != toml::value_flags::none;
+    
+    // If it has special formatting, store as struct with format info
+    if (is_hex || is_oct || is_bin) {
+        const char* field_names[] = {"value", "format"};
+        mxArray* result = mxCreateStructMatrix(1, 1, 2, field_names);
+        
+        // Store the numeric value
+        mxArray* value_field = mxCreateNumericMatrix(1, 1, mxINT64_CLASS, mxREAL);
+        *((int64_t*)mxGetData(value_field)) = int_val;
+        mxSetField(result, 0, "value", value_field);
+        
+        // Store the format string - check each format explicitly
+        const char* format_str;
+        if (is_bin) {
+            format_str = "bin";
+        } else if (is_oct) {
+            format_str = "oct";
+        } else if (is_hex) {
+            format_str = "hex";
+        } else {
+            // Shouldn't reach here, but default to hex
+            format_str = "hex";
+        }
+        mxSetField(result, 0, "format", mxCreateString(format_str));
+        
+        return result;
+    }
+    
+    // Regular integer without special formatting
+    if (integer_scalar_to_double(int_val)) {
+        return mxCreateDoubleScalar(static_cast<double>(int_val));
+    }
+    mxArray* result = mxCreateNumericMatrix(1, 1, mxINT64_CLASS, mxREAL);
+    *((int64_t*)mxGetData(result)) = int_val;
+    return result;
+}
+
+inline mxArray* date_to_mx(const toml::date& d) {
+    // Local date only - create datetime with just the date
+    
+    // Create MATLAB datetime: datetime(year, month, day)
+    mxArray* dateArgs[3];
+    dateArgs[0] = mxCreateDoubleScalar(d.year);
+    dateArgs[1] = mxCreateDoubleScalar(d.month);
+    dateArgs[2] = mxCreateDoubleScalar(d.day);
+    
+    mxArray* lhs[1];
+    mexCallMATLAB(1, lhs, 3, dateArgs, "datetime");
+    
+    mxDestroyArray(dateArgs[0]);
+    mxDestroyArray(dateArgs[1]);
+    mxDestroyArray(dateArgs[2]);
+    
+    return lhs[0];
+}
+
+inline mxArray* time_to_mx(const toml::time& t) {
+    // Local time only - create datetime with default date (1970-01-01) and the time
+    
+    // Create MATLAB datetime: datetime(1970, 1, 1, hour, minute, second)
+    mxArray* dateArgs[6];
+    dateArgs[0] = mxCreateDoubleScalar(1970);  // Default year
+    dateArgs[1] = mxCreateDoubleScalar(1);     // Default month
+    dateArgs[2] = mxCreateDoubleScalar(1);     // Default day
+    dateArgs[3] = mxCreateDoubleScalar(t.hour);
+    dateArgs[4] = mxCreateDoubleScalar(t.minute);
+    dateArgs[5] = mxCreateDoubleScalar(t.second + t.nanosecond / 1e9);
+    
+    mxArray* lhs[1];
+    mexCallMATLAB(1, lhs, 6, dateArgs, "datetime");
+    
+    for (int i = 0; i < 6; i++) {
+        mxDestroyArray(dateArgs[i]);
+    }
+    
+    return lhs[0];
+}
+
+inline mxArray* date_time_to_mx(const toml::date_time& dt) {
+    // Date-time (with or without offset)
+    
+    // Create datetime(year, month, day, hour, minute, second)
+    mxArray* dateArgs[6];
+    dateArgs[0] = mxCreateDoubleScalar(dt.date.year);
+    dateArgs[1] = mxCreateDoubleScalar(dt.date.month);
+    dateArgs[2] = mxCreateDoubleScalar(dt.date.day);
+    dateArgs[3] = mxCreateDoubleScalar(dt.time.hour);
+    dateArgs[4] = mxCreateDoubleScalar(dt.time.minute);
+    dateArgs[5] = mxCreateDoubleScalar(dt.time.second + dt.time.nanosecond / 1e9);
+    
+    mxArray* lhs[1];
+    mexCallMATLAB(1, lhs, 6, dateArgs, "datetime");
+    
+    for (int i = 0; i < 6; i++) {
+        mxDestroyArray(dateArgs[i]);
+    }
+    
+    // If there's a timezone offset, store as struct with datetime and offset
+    if (dt.offset.has_value()) {
+        auto offset = dt.offset.value();
+        int offset_minutes = offset.minutes;
+        
+        // Create the datetime without timezone first (local time)
+        const char* field_names[] = {"datetime", "offset_minutes"};
+        mxArray* result = mxCreateStructMatrix(1, 1, 2, field_names);
+        
+        // Store the datetime
+        mxSetField(result, 0, "datetime", lhs[0]);
+        
+        // Store the offset in minutes
+        mxArray* offset_field = mxCreateDoubleScalar(offset_minutes);
+        mxSetField(result, 0, "offset_minutes", offset_field);
+        
+        return result;
+    }
+    
+    return lhs[0];
+}
+
+// Typed row vector for an array of integers, floats or booleans, or
+// nullptr if the array needs a cell array
+inline mxArray* convert_typed_array(const toml::array& arr) {
+    // Count the elements of each type (one type() call per element), and
+    // find the range of the integers on the way
+    const size_t count = arr.size();
+    size_t integers = 0;
+    size_t floats = 0;
+    size_t bools = 0;
+    int64_t lo = INT64_MAX;
+    int64_t hi = INT64_MIN;
+    bool other = false;
+    for (size_t i = 0; i < count && !other; ++i) {
+        switch (arr[i].type()) {
+            case toml::node_type::integer: {
+                int64_t v = static_cast<const toml::value<int64_t>&>(arr[i]).get();
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+                ++integers;
+                break;
+            }
+            case toml::node_type::floating_point:
+                ++floats;
+                break;
+            case toml::node_type::boolean:
+                ++bools;
+                break;
+            default:
+                other = true;
+                break;
+        }
+    }
+    
+    // Typed results are allocated uninitialized since every element is
+    // written, and filled through a downcast that the type check above
+    // has already made safe
+    if (integers == count) {
+        return integer_row_vector(count, lo, hi, [&arr](size_t i) {
+            return static_cast<const toml::value<int64_t>&>(arr[i]).get();
+        });
+    }
+    
+    if (floats == count) {
+        mxArray* float_array = mxCreateUninitNumericMatrix(1, count, mxDOUBLE_CLASS, mxREAL);
+        double* data = static_cast<double*>(mxGetData(float_array));
+        
+        for (size_t i = 0; i < count; ++i) {
+            data[i] = static_cast<const toml::value<double>&>(arr[i]).get();
+        }
+        
+        return float_array;
+    }
+    
+    // Integers and floats, e.g. [1, 2.5, 3]
+    if (integers + floats == count && mixed_numbers_to_double(lo, hi)) {
+        mxArray* float_array = mxCreateUninitNumericMatrix(1, count, mxDOUBLE_CLASS, mxREAL);
+        double* data = static_cast<double*>(mxGetData(float_array));
+        
+        for (size_t i = 0; i < count; ++i) {
+            const toml::node& elem = arr[i];
+            data[i] = elem.type() == toml::node_type::integer
+                          ? static_cast<double>(static_cast<const toml::value<int64_t>&>(elem).get())
+                          : static_cast<const toml::value<double>&>(elem).get();
+        }
+        
+        return float_array;
+    }
+    
+    // Logical arrays have no uninitialized constructor
+    if (bools == count) {
+        mxArray* bool_array = mxCreateLogicalMatrix(1, count);
+        mxLogical* data = mxGetLogicals(bool_array);
+        
+        for (size_t i = 0; i < count; ++i) {
+            data[i] = static_cast<const toml::value<bool>&>(arr[i]).get();
+        }
+        
+        return bool_array;
+    }
+    
+    return nullptr;
+}
+
+// Convert a TOML value that is not a table or array
+inline mxArray* convert_value(const toml::node& node) {
+    // Handle string values
+    if (auto val = node.as_string()) {
+        const std::string& text = val->get();
+        StringExpander* expander = current_string_expander();
+        if (expander && std::memchr(text.data(), '$', text.size()))
+            return mxCreateString(expander->expand(text).c_str());
+        return mxCreateString(text.c_str());
+    }
+    
+    // Handle integer values - check for special formatting (hex, octal, binary)
+    if (auto val = node.as_integer()) {
+        return integer_to_mx(val->get(), val->flags());
+    }
+    
+    // Handle floating point values
+    if (auto val = node.as_floating_point()) {
+        return mxCreateDoubleScalar(val->get());
+    }
+    
+    // Handle boolean values
+    if (auto val = node.as_boolean()) {
+        return mxCreateLogicalScalar(val->get());
+    }
+    
+    // Handle date/time types
+    if (auto val = node.as_date()) {
+        return date_to_mx(val->get());
+    }
+    
+    if (auto val = node.as_time()) {
+        return time_to_mx(val->get());
+    }
+    
+    if (auto val = node.as_date_time()) {
+        return date_time_to_mx(val->get());
+    }
+    
+    // Default: empty matrix
+    return mxCreateDoubleMatrix(0, 0, mxREAL);
+}
+
+// Converts a toml++ tree with an explicit work stack instead of recursion,
+// so the nesting depth of a document is bounded by the ConvertLimits and
+// not by the thread's stack (see toml_limits.hpp). Structs and cell arrays
+// are attached to their parent when they are created and filled in as the
+// walk reaches their children. The stack is kept between conversions.
+class MxTreeConverter {
+public:
+    bool busy() const { return depth_ > 0; }
+
+    mxArray* convert(const toml::node& root) {
+        ConvertBudget& budget = current_convert_budget();
+        mxArray* result = nullptr;
+        try {
+            result = open(root, budget);
+            while (depth_ > 0) {
+                Frame& top = frames_[depth_ - 1];
+                if (top.next == top.count) {
+                    --depth_;
+                    continue;
+                }
+                size_t i = top.next++;
+                mxArray* parent = top.result;
+                bool is_table = top.array == nullptr;
+                const toml::node& child = is_table ? *top.fields[i].node : (*top.array)[i];
+
+                // May push a frame and so move top
+                mxArray* value = open(child, budget);
+                if (is_table)
+                    mxSetFieldByNumber(parent, 0, static_cast<int>(i), value);
+                else
+                    mxSetCell(parent, static_cast<mwIndex>(i), value);
+            }
+        }
+        catch (...) {
+            depth_ = 0;
+            if (result) mxDestroyArray(result);
+            throw;
+        }
+        return result;
+    }
+
+private:
+    // A struct (array == nullptr) or cell array whose elements are still
+    // being converted
+    struct Frame {
+        const toml::array* array;
+        std::vector<FieldInfo> fields;
+        mxArray* result;
+        size_t next;
+        size_t count;
+    };
+
+    std::vector<Frame> frames_;
+    size_t depth_ = 0;
+    std::vector<const char*> names_;
+
+    Frame& push(ConvertBudget& budget) {
+        budget.check_depth(depth_ + 1);
+        if (depth_ == frames_.size()) frames_.emplace_back();
+        Frame& frame = frames_[depth_++];
+        frame.next = 0;
+        return frame;
+    }
+
+    // The MATLAB value of node; tables and cell arrays are returned empty
+    // with a frame pushed for their elements
+    mxArray* open(const toml::node& node, ConvertBudget& budget) {
+        budget.count();
+        if (auto tbl = node.as_table()) {
+            if (tbl->empty()) {
+                return mxCreateStructMatrix(1, 1, 0, nullptr);
+            }
+            Frame& frame = push(budget);
+            frame.array = nullptr;
+            ordered_fields_into(*tbl, frame.fields);
+            frame.count = frame.fields.size();
+            names_.clear();
+            for (const FieldInfo& field : frame.fields) {
+                names_.push_back(field.key.c_str());
+            }
+            frame.result = mxCreateStructMatrix(1, 1, static_cast<int>(names_.size()), names_.data());
+            return frame.result;
+        }
+        
+        if (auto arr = node.as_array()) {
+            if (arr->empty()) {
+                return mxCreateCellMatrix(1, 0);
+            }
+            if (mxArray* typed = convert_typed_array(*arr)) {
+                try {
+                    budget.count(arr->size());
+                }
+                catch (...) {
+                    mxDestroyArray(typed);
+                    throw;
+                }
+                return typed;
+            }
+            Frame& frame = push(budget);
+            frame.array = arr;
+            frame.count = arr->size();
+            frame.result = mxCreateCellMatrix(1, arr->size());
+            return frame.result;
+        }
+        
+        return convert_value(node);
+    }
+};
+
+// Convert any TOML node to MATLAB type
+inline mxArray* convert_node(const toml::node& node) {
+    static MxTreeConverter shared;
+    if (shared.busy()) {
+        // Called while a conversion is running (e.g. from a StringExpander)
+        MxTreeConverter nested;
+        return nested.convert(node);
+    }
+    return shared.convert(node);
+}
+
+// Convert TOML table to MATLAB struct (with order preservation)
+inline mxArray* convert_table(const toml::table& tbl) {
+    return convert_node(tbl);
+}
+
+// Convert TOML array to MATLAB array (typed for homogeneous data)
+inline mxArray* convert_array(const toml::array& arr) {
+    return convert_node(arr);
+}
+
+#endif // TOML_CONVERT_HPP
@@ -0,0 +1,303 @@
+/*
+ * toml_convert_api.hpp
+ * Conversion of parsed toml++ trees to MATLAB values with the C++ MEX API
+ * (matlab::data::ArrayFactory). Produces the same values as
+ * toml_convert.hpp, which is the C API version, including the number
+ * options set with ScopedNumberOptions (see toml_numbers.hpp).
+ *
+ * Numeric and logical arrays are filled in a buffer from createBuffer() and
+ * handed to MATLAB with createArrayFromBuffer(), without a copy. Struct and
+ * cell trees are built bottom-up and moved into their parents, with an
+ * explicit work stack instead of recursion; the ConvertLimits passed to
+ * the converter bound its depth and size (see toml_limits.hpp). Strings
+ * are converted from UTF-8 once, straight into a CharArray.
+ *
+ * Only the date/time types still call into MATLAB (datetime), through the
+ * engine passed to the converter.
+ */
+
+#ifndef TOML_CONVERT_API_HPP
+#define TOML_CONVERT_API_HPP
+
+#include "mex.hpp"
+#include <toml++/toml.h>
+#include "toml_macros.hpp"
+#include "toml_limits.hpp"
+#include "toml_numbers.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+class ApiConverter {
+public:
+    ApiConverter(matlab::data::ArrayFactory& factory,
+                 std::shared_ptr<matlab::engine::MATLABEngine> engine,
+                 const ConvertLimits& limits = ConvertLimits())
+        : factory_(factory), engine_(std::move(engine)), budget_{limits, 0} {}
+
+    // Expand ${NAME} macros in strings (nullptr = off)
+    void set_expander(StringExpander* expander) { expander_ = expander; }
+
+    // Throw ConvertLimitError when the limits are exceeded
+    matlab::data::StructArray table(const toml::table& tbl) { return matlab::data::StructArray(node(tbl)); }
+    matlab::data::Array array(const toml::array& arr) { return node(arr); }
+    matlab::data::Array node(const toml::node& root);
+
+private:
+    struct Field {
+        std::string key;
+        const toml::node* node;
+        uint32_t line;
+        uint32_t column;
+    };
+
+    // A table (array == nullptr) or cell array whose elements are still
+    // being converted; they are moved into it once all are done
+    struct Frame {
+        const toml::array* array;
+        std::vector<Field> fields;
+        std::vector<matlab::data::Array> values;
+        size_t next;
+        size_t count;
+    };
+
+    bool open(const toml::node& node, std::vector<Frame>& frames, matlab::data::Array& value);
+    matlab::data::Array close(Frame& frame);
+    bool typed_array(const toml::array& arr, matlab::data::Array& value);
+    matlab::data::Array scalar(const toml::node& node);
+
+    template <typename T, typename Get>
+    matlab::data::Array row_vector(const toml::array& arr, Get get) {
+        matlab::data::buffer_ptr_t<T> buffer = factory_.createBuffer<T>(arr.size());
+        T* data = buffer.get();
+        for (size_t i = 0; i < arr.size(); ++i) data[i] = get(arr[i]);
+        return factory_.createArrayFromBuffer<T>({1, arr.size()}, std::move(buffer));
+    }
+
+    template <typename T>
+    matlab::data::Array integer_vector(const toml::array& arr) {
+        return row_vector<T>(arr, [](const toml::node& n) {
+            return static_cast<T>(static_cast<const toml::value<int64_t>&>(n).get());
+        });
+    }
+
+    matlab::data::CharArray chars(const std::string& text) {
+        return factory_.createCharArray(matlab::engine::convertUTF8StringToUTF16String(text));
+    }
+
+    matlab::data::Array datetime(std::vector<double> parts) {
+        std::vector<matlab::data::Array> args;
+        args.reserve(parts.size());
+        for (double p : parts) args.push_back(factory_.createScalar<double>(p));
+        return engine_->feval(u"datetime", args);
+    }
+
+    matlab::data::ArrayFactory& factory_;
+    std::shared_ptr<matlab::engine::MATLABEngine> engine_;
+    StringExpander* expander_ = nullptr;
+    ConvertBudget budget_;
+};
+
+// Walks the tree depth first; a frame is pushed for every table and cell
+// array, and popped (and its value handed to the parent) after its last
+// element
+inline matlab::data::Array ApiConverter::node(const toml::node& root) {
+    std::vector<Frame> frames;
+    matlab::data::Array result;
+    if (open(root, frames, result)) return result;
+
+    while (true) {
+        Frame& top = frames.back();
+        if (top.next < top.count) {
+            size_t i = top.next++;
+            const toml::node& child = top.array ? (*top.array)[i] : *top.fields[i].node;
+            matlab::data::Array value;
+            // May push a frame and so move top
+            if (open(child, frames, value)) frames.back().values.push_back(std::move(value));
+            continue;
+        }
+        matlab::data::Array done = close(top);
+        frames.pop_back();
+        if (frames.empty()) return done;
+        frames.back().values.push_back(std::move(done));
+    }
+}
+
+// Converts node into value and returns true, or pushes a frame for a
+// non-empty table or cell array and returns false
+inline bool ApiConverter::open(const toml::node& node, std::vector<Frame>& frames, matlab::data::Array& value) {
+    budget_.count();
+    const toml::table* tbl = node.as_table();
+    const toml::array* arr = node.as_array();
+    if (tbl && tbl->empty()) {
+        value = factory_.createStructArray({1, 1}, std::vector<std::string>());
+        return true;
+    }
+    if (arr && typed_array(*arr, value)) {
+        budget_.count(arr->size());
+        return true;
+    }
+    if (!tbl && !arr) {
+        value = scalar(node);
+        return true;
+    }
+
+    budget_.check_depth(frames.size() + 1);
+    frames.emplace_back();
+    Frame& frame = frames.back();
+    frame.array = arr;
+    frame.next = 0;
+    if (tbl) {
+        // Fields in source order (tables are stored sorted by key)
+        frame.fields.reserve(tbl->size());
+        for (auto& [k, v] : *tbl) {
+            auto src = v.source();
+            uint32_t line = src.begin ? src.begin.line : UINT32_MAX;
+            uint32_t column = src.begin ? src.begin.column : UINT32_MAX;
+            frame.fields.push_back({std::string(k.str()), &v, line, column});
+        }
+        std::sort(frame.fields.begin(), frame.fields.end(), [](const Field& a, const Field& b) {
+            return a.line != b.line ? a.line < b.line : a.column < b.column;
+        });
+        frame.count = frame.fields.size();
+    } else {
+        frame.count = arr->size();
+    }
+    frame.values.reserve(frame.count);
+    return false;
+}
+
+// Struct or cell array of a frame whose elements are all converted
+inline matlab::data::Array ApiConverter::close(Frame& frame) {
+    if (frame.array) {
+        matlab::data::CellArray cell = factory_.createCellArray({1, frame.count});
+        for (size_t i = 0; i < frame.count; ++i) cell[0][i] = std::move(frame.values[i]);
+        return cell;
+    }
+
+    std::vector<std::string> names;
+    names.reserve(frame.count);
+    for (const Field& f : frame.fields) names.push_back(f.key);
+
+    matlab::data::StructArray result = factory_.createStructArray({1, 1}, names);
+    for (size_t i = 0; i < frame.count; ++i) result[0][frame.fields[i].key] = std::move(frame.values[i]);
+    return result;
+}
+
+// Typed row vector for arrays of integers, floats or booleans, as
+// convert_typed_array(); false if the array needs a cell
+inline bool ApiConverter::typed_array(const toml::array& arr, matlab::data::Array& value) {
+    if (arr.empty()) {
+        value = factory_.createCellArray({1, 0});
+        return true;
+    }
+
+    const size_t count = arr.size();
+    size_t integers = 0;
+    size_t floats = 0;
+    size_t bools = 0;
+    int64_t lo = INT64_MAX;
+    int64_t hi = INT64_MIN;
+    for (const toml::node& elem : arr) {
+        switch (elem.type()) {
+            case toml::node_type::integer: {
+                int64_t v = static_cast<const toml::value<int64_t>&>(elem).get();
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+                ++integers;
+                break;
+            }
+            case toml::node_type::floating_point:
+                ++floats;
+                break;
+            case toml::node_type::boolean:
+                ++bools;
+                break;
+            default:
+                return false;
+        }
+    }
+
+    if (integers == count) {
+        switch (integer_array_element(lo, hi)) {
+            case IntegerElement::Double: value = integer_vector<double>(arr); break;
+            case IntegerElement::Int8:   value = integer_vector<int8_t>(arr); break;
+            case IntegerElement::Int16:  value = integer_vector<int16_t>(arr); break;
+            case IntegerElement::Int32:  value = integer_vector<int32_t>(arr); break;
+            default:                     value = integer_vector<int64_t>(arr); break;
+        }
+    } else if (integers + floats == count && (integers == 0 || mixed_numbers_to_double(lo, hi))) {
+        // Floats, or integers and floats, e.g. [1, 2.5, 3]
+        value = row_vector<double>(arr, [](const toml::node& n) {
+            return n.type() == toml::node_type::integer
+                       ? static_cast<double>(static_cast<const toml::value<int64_t>&>(n).get())
+                       : static_cast<const toml::value<double>&>(n).get();
+        });
+    } else if (bools == count) {
+        value = row_vector<bool>(arr, [](const toml::node& n) {
+            return static_cast<const toml::value<bool>&>(n).get();
+        });
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// A value that is not a table or array
+inline matlab::data::Array ApiConverter::scalar(const toml::node& node) {
+    if (auto val = node.as_string()) {
+        const std::string& text = val->get();
+        if (expander_ && std::memchr(text.data(), '$', text.size()))
+            return chars(expander_->expand(text));
+        return chars(text);
+    }
+
+    if (auto val = node.as_integer()) {
+        auto flags = val->flags();
+        const char* format = nullptr;
+        if ((flags & toml::value_flags::format_as_binary) != toml::value_flags::none) format = "bin";
+        else if ((flags & toml::value_flags::format_as_octal) != toml::value_flags::none) format = "oct";
+        else if ((flags & toml::value_flags::format_as_hexadecimal) != toml::value_flags::none) format = "hex";
+        if (!format) {
+            if (integer_scalar_to_double(val->get()))
+                return factory_.createScalar<double>(static_cast<double>(val->get()));
+            return factory_.createScalar<int64_t>(val->get());
+        }
+
+        matlab::data::StructArray result = factory_.createStructArray({1, 1}, {"value", "format"});
+        result[0]["value"] = factory_.createScalar<int64_t>(val->get());
+        result[0]["format"] = factory_.createCharArray(format);
+        return result;
+    }
+
+    if (auto val = node.as_floating_point()) return factory_.createScalar<double>(val->get());
+    if (auto val = node.as_boolean()) return factory_.createScalar<bool>(val->get());
+
+    if (auto val = node.as_date()) {
+        auto d = val->get();
+        return datetime({double(d.year), double(d.month), double(d.day)});
+    }
+    if (auto val = node.as_time()) {
+        auto t = val->get();
+        return datetime({1970, 1, 1, double(t.hour), double(t.minute), t.second + t.nanosecond / 1e9});
+    }
+    if (auto val = node.as_date_time()) {
+        auto dt = val->get();
+        matlab::data::Array value = datetime({double(dt.date.year), double(dt.date.month), double(dt.date.day),
+                                              double(dt.time.hour), double(dt.time.minute),
+                                              dt.time.second + dt.time.nanosecond / 1e9});
+        if (!dt.offset) return value;
+
+        matlab::data::StructArray result = factory_.createStructArray({1, 1}, {"datetime", "offset_minutes"});
+        result[0]["datetime"] = std::move(value);
+        result[0]["offset_minutes"] = factory_.createScalar<double>(dt.offset->minutes);
+        return result;
+    }
+
+    return factory_.createArray<double>({0, 0});
+}
+
+#endif // TOML_CONVERT_API_HPP
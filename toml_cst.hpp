@@ -0,0 +1,974 @@
+/*
+ * toml_cst.hpp
+ * Lossless concrete syntax tree for format-preserving edits of TOML documents.
+ *
+ * TomlCst::scan() walks the document once and produces
+ *   - a flat token array (comments, table headers, keys, values) holding
+ *     byte offsets into the original buffer. Whitespace, newlines and '='
+ *     are not stored: they are the gaps between tokens.
+ *   - one entry per table header and key/value pair, with its full dotted
+ *     path (stored in a single arena) and the byte range of its lines.
+ *     Paths are spelled the way toml_key_segment() writes keys: escapes in
+ *     quoted keys are decoded, and segments that are not valid bare keys
+ *     are quoted again, so "a.b" (one key) and a.b (two) stay distinct and
+ *     a quoted "x[2]" is never an index.
+ *   - an index of the tables and the entries of their sections. Elements of
+ *     arrays of tables are tables of their own, addressed by 1-based index
+ *     ("products[2]"), so a lookup inside one element only searches that
+ *     element's section.
+ *
+ * Edits (replace a value, insert a key into the right table, remove a key or
+ * a table) are recorded as byte ranges with their new text and never touch
+ * the buffer. emit() writes the document as large untouched spans copied
+ * straight from the buffer with the edited text in between, so everything
+ * that was not edited comes out byte for byte as it was.
+ *
+ * The scanner checks the structure (keys, quoting, brackets, what may follow
+ * a value) but does not validate the contents of values the way toml++ does.
+ * The buffer must outlive the TomlCst.
+ *
+ * Usage:
+ *   MappedFile file(filename);
+ *   TomlCst doc = TomlCst::scan(file.data(), file.size());
+ *   if (const CstEntry* e = doc.find("server.port")) doc.replace_value(*e, "8080");
+ *   doc.insert("server.timeout", "30");
+ *   if (const CstEntry* e = doc.find("products[2].price")) doc.replace_value(*e, "9.5");
+ *   doc.emit(os);
+ */
+
+#ifndef TOML_CST_HPP
+#define TOML_CST_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <deque>
+
+enum class CstTokenKind : unsigned char {
+    Comment,           // '#' to the end of the line
+    TableHeader,       // [a.b]
+    ArrayTableHeader,  // [[a.b]]
+    Key,               // key as spelled, dotted and quoted parts included
+    Value              // whole value, nested arrays and inline tables included
+};
+
+struct CstToken {
+    size_t begin;
+    uint32_t length;
+    CstTokenKind kind;
+
+    size_t end() const { return begin + length; }
+};
+
+enum class CstKind : unsigned char {
+    Table,       // [a.b]
+    ArrayTable,  // [[a.b]]
+    KeyValue     // key = value
+};
+
+struct CstEntry {
+    CstKind kind;
+    bool in_array_table;   // inside a [[...]] element (path is not unique)
+    uint32_t path_length;
+    size_t path_offset;    // full dotted path in the arena (see above)
+    size_t token;          // header token, or key token (the value is token + 1)
+    size_t line_begin;     // start of the entry's first line
+    size_t line_end;       // just past the newline ending its last line
+    size_t line;           // 1-based line number
+};
+
+// A pending change: bytes [begin, end) are replaced by text
+struct CstEdit {
+    size_t begin;
+    size_t end;
+    std::string text;
+};
+
+// Thrown for structural errors, with the position in the message
+class TomlScanError : public std::runtime_error {
+public:
+    TomlScanError(const std::string& msg, size_t line, size_t column)
+        : std::runtime_error(msg + " (line " + std::to_string(line) +
+                             ", column " + std::to_string(column) + ")"),
+          line_(line), column_(column) {}
+    size_t line() const { return line_; }
+    size_t column() const { return column_; }
+private:
+    size_t line_;
+    size_t column_;
+};
+
+// Quote a key segment unless it is a valid bare key
+inline std::string toml_key_segment(std::string_view segment) {
+    bool bare = !segment.empty();
+    for (char c : segment) {
+        if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+              (c >= '0' && c <= '9') || c == '_' || c == '-')) {
+            bare = false;
+            break;
+        }
+    }
+    if (bare) return std::string(segment);
+    static const char hex[] = "0123456789ABCDEF";
+    std::string quoted = "\"";
+    for (char c : segment) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (u < 0x20 || u == 0x7F) {
+            quoted += "\\u00";
+            quoted += hex[u >> 4];
+            quoted += hex[u & 0xF];
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+// Offset of the first c at or after start that is not inside a quoted
+// segment of a key path, or npos. start must be at a segment boundary.
+inline size_t key_path_find(std::string_view path, char c, size_t start = 0) {
+    bool quoted = false;
+    for (size_t i = start; i < path.size(); ++i) {
+        if (quoted) {
+            if (path[i] == '\\') ++i;
+            else if (path[i] == '"') quoted = false;
+        } else if (path[i] == '"') {
+            quoted = true;
+        } else if (path[i] == c) {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// Offset of the last '.' separating two segments of path[0, end), or npos
+inline size_t key_path_last_dot(std::string_view path, size_t end) {
+    size_t last = std::string_view::npos;
+    for (size_t dot = key_path_find(path.substr(0, end), '.'); dot != std::string_view::npos;
+         dot = key_path_find(path.substr(0, end), '.', dot + 1))
+        last = dot;
+    return last;
+}
+
+class TomlCst {
+public:
+    static TomlCst scan(const char* data, size_t size);
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::vector<CstToken>& tokens() const { return tokens_; }
+    const std::vector<CstEntry>& entries() const { return entries_; }
+
+    std::string_view path(const CstEntry& e) const {
+        return std::string_view(paths_.data() + e.path_offset, e.path_length);
+    }
+    const CstToken& value_token(const CstEntry& e) const { return tokens_[e.token + 1]; }
+    std::string_view value_text(const CstEntry& e) const {
+        const CstToken& t = value_token(e);
+        return std::string_view(data_ + t.begin, t.length);
+    }
+
+    // Key/value pair or table header, or nullptr. Elements of arrays of
+    // tables are addressed by 1-based index: "products[2].price". Only the
+    // section of the table owning path is searched.
+    const CstEntry* find(std::string_view path) const {
+        size_t entry = find_in_section(owning_table(path), path);
+        if (entry == npos && !array_tables_.empty()) {
+            std::string alt = with_first_elements(path);
+            if (alt != path) entry = find_in_section(owning_table(alt), alt);
+        }
+        return entry == npos ? nullptr : &entries_[entry];
+    }
+    const CstEntry* find_table(std::string_view path) const {
+        auto it = tables_.find(path);
+        if (it == tables_.end() || tables_info_[it->second].header == npos) return nullptr;
+        return &entries_[tables_info_[it->second].header];
+    }
+
+    // Replace the value of a key/value entry. Returns false (and records
+    // nothing) if text is identical to the current value.
+    bool replace_value(const CstEntry& e, std::string_view text) {
+        const CstToken& t = value_token(e);
+        if (value_text(e) == text) return false;
+        edits_.push_back({t.begin, t.end(), std::string(text)});
+        sorted_ = false;
+        return true;
+    }
+
+    // Remove a key/value pair (its whole lines, trailing comment included),
+    // a table header together with the key/value pairs of its section, or
+    // an element of an array of tables including its sub-tables
+    void remove(const CstEntry& e) {
+        size_t end = e.line_end;
+        if (e.kind != CstKind::KeyValue) {
+            std::string_view p = path(e);
+            end = size_;
+            for (size_t i = static_cast<size_t>(&e - entries_.data()) + 1; i < entries_.size(); ++i) {
+                const CstEntry& next = entries_[i];
+                if (next.kind == CstKind::KeyValue) continue;
+                std::string_view q = path(next);
+                if (e.kind == CstKind::ArrayTable && q.size() > p.size() && q[p.size()] == '.' &&
+                    q.compare(0, p.size(), p) == 0)
+                    continue;
+                end = attached_comment_start(next.line_begin);
+                break;
+            }
+        }
+        edits_.push_back({e.line_begin, end, std::string()});
+        sorted_ = false;
+    }
+
+    // Add `path = text` as a new key. It goes after the last key of the
+    // table that holds it (as a dotted key if that table is defined by
+    // dotted keys); a missing table is created at the end of the document.
+    // Throws std::invalid_argument if path exists or cannot hold a key.
+    void insert(std::string_view path, const std::string& text);
+
+    // Edits sorted by position. Throws std::invalid_argument on overlaps.
+    // Tables created by insert() are not included (see appended()).
+    const std::vector<CstEdit>& edits() {
+        sort_edits();
+        return sorted_edits_;
+    }
+
+    // True if insert() created tables that go after the end of the document
+    bool appended() const { return !new_tables_.empty(); }
+
+    bool modified() const { return !edits_.empty() || !new_tables_.empty(); }
+
+    // True if every edit replaces its span with text of the same length and
+    // nothing is appended, so the edits can be patched into the file as is
+    bool same_length() const {
+        if (!new_tables_.empty()) return false;
+        for (const CstEdit& e : edits_) {
+            if (e.text.size() != e.end - e.begin) return false;
+        }
+        return true;
+    }
+
+    // Write the edited document
+    void emit(std::ostream& os) { emit(os, data_, 0, size_); }
+
+    // Write bytes [from, to) of the edited document. text holds the original
+    // bytes starting at offset from (e.g. a copy of the file's tail).
+    void emit(std::ostream& os, const char* text, size_t from, size_t to) {
+        sort_edits();
+        size_t pos = from;
+        char last = from > 0 ? '\n' : '\0';
+        for (const CstEdit& e : sorted_edits_) {
+            if (e.begin < from) continue;
+            if (e.end > to) break;
+            os.write(text + (pos - from), static_cast<std::streamsize>(e.begin - pos));
+            os.write(e.text.data(), static_cast<std::streamsize>(e.text.size()));
+            if (!e.text.empty()) last = e.text.back();
+            else if (e.begin > pos) last = text[e.begin - 1 - from];
+            pos = e.end;
+        }
+        os.write(text + (pos - from), static_cast<std::streamsize>(to - pos));
+        if (to > pos) last = text[to - 1 - from];
+
+        // New tables follow the document, separated by a blank line
+        if (to == size_) {
+            for (const std::string& table : new_tables_) {
+                if (last != '\0') {
+                    if (last != '\n') os << newline_;
+                    os << newline_;
+                }
+                os << table;
+                last = '\n';
+            }
+        }
+    }
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+private:
+    friend class TomlScanner;
+
+    // The root, a [header] table or a [[header]] element, with the key/value
+    // entries of its section
+    struct TableInfo {
+        std::string_view name;     // indexed path, e.g. "products[2].sub"
+        size_t raw_length = 0;     // length of the header's path as written
+        size_t header = npos;      // entry of the header (npos for the root)
+        size_t first_entry = 0;    // key/value entries [first_entry, end_entry)
+        size_t end_entry = 0;
+        // Key index of large sections, built on first lookup
+        mutable std::unique_ptr<std::unordered_map<std::string_view, size_t>> keys;
+    };
+
+    // Sections up to this many entries are searched linearly
+    static constexpr size_t linear_section_size = 32;
+
+    void build_index();
+    size_t owning_table(std::string_view path) const;
+    size_t find_in_section(size_t table, std::string_view path) const;
+    std::string_view key_in_section(const TableInfo& info, const CstEntry& e) const {
+        std::string_view p = path(e);
+        return info.raw_length == 0 ? p : p.substr(info.raw_length + 1);
+    }
+    bool defined_by_dotted_keys(size_t table, std::string_view path) const;
+    std::string with_first_elements(std::string_view path) const;
+    size_t section_end(size_t table, std::string* indent) const;
+    void insert_into_table(size_t table, std::string_view key, const std::string& text);
+    size_t attached_comment_start(size_t offset) const;
+    std::string indentation_of(const CstEntry& e) const;
+
+    void sort_edits() {
+        if (sorted_) return;
+        sorted_edits_ = edits_;
+        std::stable_sort(sorted_edits_.begin(), sorted_edits_.end(), [](const CstEdit& a, const CstEdit& b) {
+            return a.begin != b.begin ? a.begin < b.begin : a.end < b.end;
+        });
+        for (size_t i = 1; i < sorted_edits_.size(); ++i) {
+            if (sorted_edits_[i].begin < sorted_edits_[i - 1].end)
+                throw std::invalid_argument("Overlapping edits");
+        }
+        sorted_ = true;
+    }
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::string newline_ = "\n";
+    std::vector<CstToken> tokens_;
+    std::vector<CstEntry> entries_;
+    std::string paths_;  // arena; the index holds views into it
+
+    std::unordered_map<std::string_view, size_t> tables_;   // indexed path -> tables_info_
+    std::vector<TableInfo> tables_info_;
+    std::deque<std::string> element_names_;                 // storage for indexed paths
+    std::unordered_set<std::string_view> array_tables_;     // [[...]] paths as written
+
+    // Tables created by insert(), so that later keys join them
+    struct NewTable {
+        bool at_end;   // in new_tables_, otherwise an edit inside the document
+        size_t index;
+    };
+    std::unordered_map<std::string, NewTable> created_;
+    std::vector<std::string> new_tables_;   // appended after the document
+    std::vector<CstEdit> edits_;            // in the order they were made
+    std::vector<CstEdit> sorted_edits_;
+    bool sorted_ = true;
+};
+
+class TomlScanner {
+public:
+    TomlScanner(TomlCst& doc) : doc_(doc), p_(doc.data_), n_(doc.size_) {}
+
+    void scan() {
+        size_t table_offset = 0;
+        uint32_t table_length = 0;
+        bool table_in_aot = false;
+        std::unordered_set<std::string> array_tables;
+
+        while (pos_ < n_) {
+            skip_blank();
+            if (pos_ >= n_) break;
+            char c = p_[pos_];
+            if (c == '\n' || c == '\r') {
+                newline();
+                continue;
+            }
+            if (c == '#') {
+                skip_comment();
+                continue;
+            }
+
+            size_t line_begin = line_start_;
+            size_t line = line_;
+            size_t path_offset = doc_.paths_.size();
+            if (c == '[') {
+                size_t begin = pos_;
+                bool aot = peek(1) == '[';
+                pos_ += aot ? 2 : 1;
+                skip_blank();
+                parse_key(doc_.paths_);
+                skip_blank();
+                expect(']', "Expected ']' to close table header");
+                if (aot) expect(']', "Expected ']]' to close array of tables header");
+                add_token(begin, aot ? CstTokenKind::ArrayTableHeader : CstTokenKind::TableHeader);
+                size_t token = doc_.tokens_.size() - 1;
+                end_of_line();
+
+                table_offset = path_offset;
+                table_length = static_cast<uint32_t>(doc_.paths_.size() - path_offset);
+                std::string table(doc_.paths_, path_offset, table_length);
+                table_in_aot = aot || under_array_table(array_tables, table);
+                if (aot) array_tables.insert(table);
+                doc_.entries_.push_back({aot ? CstKind::ArrayTable : CstKind::Table, table_in_aot,
+                                         table_length, path_offset, token, line_begin, pos_, line});
+                continue;
+            }
+
+            // The table path is copied in front of the key
+            if (table_length > 0) {
+                doc_.paths_.append(doc_.paths_, table_offset, table_length);
+                doc_.paths_ += '.';
+            }
+            size_t begin = pos_;
+            parse_key(doc_.paths_);
+            add_token(begin, CstTokenKind::Key);
+            size_t token = doc_.tokens_.size() - 1;
+            skip_blank();
+            expect('=', "Expected '=' after key");
+            skip_blank();
+            begin = pos_;
+            scan_value();
+            add_token(begin, CstTokenKind::Value);
+            end_of_line();
+
+            doc_.entries_.push_back({CstKind::KeyValue, table_in_aot,
+                                     static_cast<uint32_t>(doc_.paths_.size() - path_offset),
+                                     path_offset, token, line_begin, pos_, line});
+        }
+    }
+
+private:
+    char peek(size_t ahead = 0) const {
+        return pos_ + ahead < n_ ? p_[pos_ + ahead] : '\0';
+    }
+
+    [[noreturn]] void fail(const std::string& msg) const {
+        throw TomlScanError(msg, line_, pos_ - line_start_ + 1);
+    }
+
+    void expect(char c, const char* msg) {
+        if (peek() != c) fail(msg);
+        ++pos_;
+    }
+
+    // Token from begin to the current position, trailing blanks excluded
+    void add_token(size_t begin, CstTokenKind kind) {
+        size_t end = pos_;
+        while (end > begin && (p_[end - 1] == ' ' || p_[end - 1] == '\t')) --end;
+        if (end - begin > UINT32_MAX) fail("Token too large");
+        doc_.tokens_.push_back({begin, static_cast<uint32_t>(end - begin), kind});
+    }
+
+    void skip_blank() {
+        while (pos_ < n_ && (p_[pos_] == ' ' || p_[pos_] == '\t')) ++pos_;
+    }
+
+    void newline() {
+        if (p_[pos_] == '\r') {
+            if (peek(1) != '\n') fail("Bare carriage return");
+            if (line_ == 1) doc_.newline_ = "\r\n";
+            ++pos_;
+        }
+        ++pos_;
+        ++line_;
+        line_start_ = pos_;
+    }
+
+    void skip_comment() {
+        size_t begin = pos_;
+        while (pos_ < n_ && p_[pos_] != '\n' && p_[pos_] != '\r') ++pos_;
+        doc_.tokens_.push_back({begin, static_cast<uint32_t>(pos_ - begin), CstTokenKind::Comment});
+    }
+
+    // Whitespace, newlines and comments, as allowed inside arrays. Comments
+    // inside a value are part of the value token.
+    void skip_trivia() {
+        while (pos_ < n_) {
+            char c = p_[pos_];
+            if (c == ' ' || c == '\t') ++pos_;
+            else if (c == '\n' || c == '\r') newline();
+            else if (c == '#') {
+                while (pos_ < n_ && p_[pos_] != '\n' && p_[pos_] != '\r') ++pos_;
+            }
+            else break;
+        }
+    }
+
+    // Only a comment may follow a header or a value on the same line
+    void end_of_line() {
+        skip_blank();
+        if (peek() == '#') skip_comment();
+        if (pos_ >= n_) return;
+        if (p_[pos_] != '\n' && p_[pos_] != '\r') fail("Unexpected text after value");
+        newline();
+    }
+
+    static bool under_array_table(const std::unordered_set<std::string>& array_tables,
+                                  const std::string& path) {
+        if (array_tables.empty()) return false;
+        for (size_t dot = key_path_find(path, '.'); dot != std::string::npos; dot = key_path_find(path, '.', dot + 1)) {
+            if (array_tables.count(path.substr(0, dot))) return true;
+        }
+        return false;
+    }
+
+    static bool is_bare_key_char(char c) {
+        return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+               (c >= '0' && c <= '9') || c == '_' || c == '-';
+    }
+
+    // Parse a (possibly dotted) key and append its segments to out, spelled
+    // as toml_key_segment() spells them
+    void parse_key(std::string& out) {
+        size_t start_size = out.size();
+        for (;;) {
+            if (out.size() > start_size) out += '.';
+            char c = peek();
+            if (c == '"') {
+                ++pos_;
+                segment_.clear();
+                while (pos_ < n_ && p_[pos_] != '"') {
+                    if (p_[pos_] == '\n' || p_[pos_] == '\r') fail("Unterminated quoted key");
+                    if (p_[pos_] == '\\') parse_escape(segment_);
+                    else segment_ += p_[pos_++];
+                }
+                expect('"', "Unterminated quoted key");
+                out += toml_key_segment(segment_);
+            } else if (c == '\'') {
+                size_t start = ++pos_;
+                while (pos_ < n_ && p_[pos_] != '\'') {
+                    if (p_[pos_] == '\n' || p_[pos_] == '\r') fail("Unterminated quoted key");
+                    ++pos_;
+                }
+                expect('\'', "Unterminated quoted key");
+                out += toml_key_segment(std::string_view(p_ + start, pos_ - 1 - start));
+            } else {
+                size_t start = pos_;
+                while (pos_ < n_ && is_bare_key_char(p_[pos_])) ++pos_;
+                if (pos_ == start) fail("Expected a key");
+                out.append(p_ + start, pos_ - start);
+            }
+            size_t before_blank = pos_;
+            skip_blank();
+            if (peek() != '.') {
+                pos_ = before_blank;
+                return;
+            }
+            ++pos_;
+            skip_blank();
+        }
+    }
+
+    // Decode the escape sequence at pos_ in a basic string into out
+    void parse_escape(std::string& out) {
+        ++pos_;  // '\\'
+        char c = peek();
+        ++pos_;
+        switch (c) {
+            case 'b': out += '\b'; return;
+            case 't': out += '\t'; return;
+            case 'n': out += '\n'; return;
+            case 'f': out += '\f'; return;
+            case 'r': out += '\r'; return;
+            case '"': out += '"'; return;
+            case '\\': out += '\\'; return;
+            case 'u':
+            case 'U': break;
+            default: --pos_; fail("Invalid escape sequence in quoted key");
+        }
+        int digits = c == 'u' ? 4 : 8;
+        uint32_t code = 0;
+        for (int i = 0; i < digits; ++i) {
+            char h = peek();
+            int v = (h >= '0' && h <= '9') ? h - '0' : (h >= 'a' && h <= 'f') ? h - 'a' + 10 :
+                    (h >= 'A' && h <= 'F') ? h - 'A' + 10 : -1;
+            if (v < 0) fail("Invalid unicode escape in quoted key");
+            code = code * 16 + static_cast<uint32_t>(v);
+            ++pos_;
+        }
+        if (code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+            fail("Invalid unicode escape in quoted key");
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    // Advance past one value of any type
+    void scan_value() {
+        char c = peek();
+        if (c == '"' || c == '\'') {
+            if (peek(1) == c && peek(2) == c) scan_multiline_string(c);
+            else scan_string(c);
+        } else if (c == '[') {
+            ++pos_;
+            for (;;) {
+                skip_trivia();
+                if (peek() == ']') break;
+                scan_value();
+                skip_trivia();
+                if (peek() == ',') {
+                    ++pos_;
+                    continue;
+                }
+                if (peek() != ']') fail("Expected ',' or ']' in array");
+            }
+            ++pos_;
+        } else if (c == '{') {
+            ++pos_;
+            skip_blank();
+            if (peek() == '}') {
+                ++pos_;
+                return;
+            }
+            std::string ignored;
+            for (;;) {
+                skip_blank();
+                ignored.clear();
+                parse_key(ignored);
+                skip_blank();
+                expect('=', "Expected '=' in inline table");
+                skip_blank();
+                scan_value();
+                skip_blank();
+                if (peek() == ',') {
+                    ++pos_;
+                    continue;
+                }
+                expect('}', "Expected ',' or '}' in inline table");
+                return;
+            }
+        } else {
+            // Numbers, booleans, dates and times. A date and a time may be
+            // separated by a space, so trailing blanks are trimmed instead.
+            size_t start = pos_;
+            while (pos_ < n_) {
+                char d = p_[pos_];
+                if (d == '\n' || d == '\r' || d == '#' || d == ',' || d == ']' || d == '}') break;
+                ++pos_;
+            }
+            while (pos_ > start && (p_[pos_ - 1] == ' ' || p_[pos_ - 1] == '\t')) --pos_;
+            if (pos_ == start) fail("Expected a value");
+        }
+    }
+
+    void scan_string(char quote) {
+        ++pos_;
+        while (pos_ < n_ && p_[pos_] != quote) {
+            if (p_[pos_] == '\n' || p_[pos_] == '\r') fail("Unterminated string");
+            if (quote == '"' && p_[pos_] == '\\') ++pos_;
+            ++pos_;
+        }
+        if (pos_ >= n_) fail("Unterminated string");
+        ++pos_;
+    }
+
+    void scan_multiline_string(char quote) {
+        pos_ += 3;
+        while (pos_ < n_) {
+            char c = p_[pos_];
+            if (c == quote && peek(1) == quote && peek(2) == quote) {
+                // Up to two quotes may directly precede the closing delimiter
+                pos_ += 3;
+                for (int extra = 0; extra < 2 && peek() == quote; ++extra) ++pos_;
+                return;
+            }
+            if (c == '\n' || c == '\r') newline();
+            else if (quote == '"' && c == '\\') {
+                ++pos_;
+                if (pos_ < n_ && (p_[pos_] == '\n' || p_[pos_] == '\r')) newline();
+                else ++pos_;
+            }
+            else ++pos_;
+        }
+        fail("Unterminated multi-line string");
+    }
+
+    TomlCst& doc_;
+    const char* p_;
+    size_t n_;
+    size_t pos_ = 0;
+    size_t line_ = 1;
+    size_t line_start_ = 0;
+    std::string segment_;   // decoded quoted key
+};
+
+inline TomlCst TomlCst::scan(const char* data, size_t size) {
+    TomlCst doc;
+    doc.data_ = data;
+    doc.size_ = size;
+    // Keep the arena out of the small-string buffer so that moving the
+    // TomlCst does not move the characters the index points to
+    doc.paths_.reserve(std::max<size_t>(64, size / 4));
+    doc.tokens_.reserve(size / 32);
+    doc.entries_.reserve(size / 64);
+    TomlScanner(doc).scan();
+    doc.build_index();
+    return doc;
+}
+
+// Index the tables once the arena no longer grows. Keys are only indexed
+// per section, on demand.
+//
+// Every [[a]] header starts element a[k] (counted from 1), and headers
+// below it are indexed through the element they belong to, so [a.b] after
+// the second [[a]] is "a[2].b" and [[a.c]] there starts "a[2].c[1]".
+inline void TomlCst::build_index() {
+    tables_info_.emplace_back();
+    tables_.emplace(std::string_view(), 0);
+
+    // Array of tables (as written) -> indexed path of its current element
+    std::unordered_map<std::string_view, std::string_view> current_element;
+    std::unordered_map<std::string_view, size_t> element_count;
+
+    size_t current = 0;  // table receiving the key/value pairs that follow
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const CstEntry& e = entries_[i];
+        if (e.kind == CstKind::KeyValue) {
+            tables_info_[current].end_entry = i + 1;
+            continue;
+        }
+
+        std::string_view raw = path(e);
+        std::string_view name = raw;
+        if (e.in_array_table) {
+            // Rewrite the path through the innermost enclosing element
+            for (size_t dot = key_path_last_dot(raw, raw.size()); dot != std::string_view::npos;
+                 dot = key_path_last_dot(raw, dot)) {
+                auto it = current_element.find(raw.substr(0, dot));
+                if (it != current_element.end()) {
+                    element_names_.push_back(std::string(it->second) + std::string(raw.substr(dot)));
+                    name = element_names_.back();
+                    break;
+                }
+            }
+        }
+        if (e.kind == CstKind::ArrayTable) {
+            array_tables_.insert(raw);
+            size_t k = ++element_count[name];
+            element_names_.push_back(std::string(name) + "[" + std::to_string(k) + "]");
+            name = element_names_.back();
+
+            // Arrays nested in the previous element no longer apply
+            for (auto it = current_element.begin(); it != current_element.end();) {
+                if (it->first.size() > raw.size() && it->first[raw.size()] == '.' &&
+                    it->first.compare(0, raw.size(), raw) == 0)
+                    it = current_element.erase(it);
+                else
+                    ++it;
+            }
+            current_element[raw] = name;
+        }
+
+        current = tables_info_.size();
+        tables_info_.emplace_back();
+        TableInfo& info = tables_info_[current];
+        info.name = name;
+        info.raw_length = raw.size();
+        info.header = i;
+        info.first_entry = i + 1;
+        info.end_entry = i + 1;
+        tables_.emplace(name, current);
+    }
+}
+
+// Longest prefix of path (path itself included) that is a table; a key can
+// only live in that table's section
+inline size_t TomlCst::owning_table(std::string_view path) const {
+    size_t cut = path.size();
+    for (;;) {
+        auto it = tables_.find(path.substr(0, cut));
+        if (it != tables_.end()) return it->second;
+        size_t dot = cut == 0 ? std::string_view::npos : key_path_last_dot(path, cut);
+        cut = dot == std::string_view::npos ? 0 : dot;
+    }
+}
+
+inline size_t TomlCst::find_in_section(size_t table, std::string_view path) const {
+    const TableInfo& info = tables_info_[table];
+    if (path.size() <= info.name.size())
+        return path == info.name ? info.header : npos;
+    std::string_view key = info.name.empty() ? path : path.substr(info.name.size() + 1);
+
+    if (info.end_entry - info.first_entry <= linear_section_size) {
+        for (size_t i = info.first_entry; i < info.end_entry; ++i) {
+            if (key_in_section(info, entries_[i]) == key) return i;
+        }
+        return npos;
+    }
+    if (!info.keys) {
+        info.keys.reset(new std::unordered_map<std::string_view, size_t>());
+        info.keys->reserve(info.end_entry - info.first_entry);
+        for (size_t i = info.first_entry; i < info.end_entry; ++i)
+            info.keys->emplace(key_in_section(info, entries_[i]), i);
+    }
+    auto it = info.keys->find(key);
+    return it == info.keys->end() ? npos : it->second;
+}
+
+// A 1x1 struct in MATLAB is also element 1 of a struct array, so "a.b"
+// refers to "a[1].b" when a is an array of tables
+inline std::string TomlCst::with_first_elements(std::string_view path) const {
+    std::string out;
+    size_t start = 0;
+    for (size_t dot = key_path_find(path, '.'); dot != std::string_view::npos; dot = key_path_find(path, '.', start)) {
+        out.append(path.substr(start, dot - start));
+        if (out.back() != ']' && !tables_.count(out) && tables_.count(out + "[1]")) out += "[1]";
+        out += '.';
+        start = dot + 1;
+    }
+    out.append(path.substr(start));
+    return out;
+}
+
+// True if path names a table implied by dotted keys in the given table
+inline bool TomlCst::defined_by_dotted_keys(size_t table, std::string_view path) const {
+    const TableInfo& info = tables_info_[table];
+    if (path.size() <= info.name.size()) return false;
+    std::string_view key = info.name.empty() ? path : path.substr(info.name.size() + 1);
+    for (size_t i = info.first_entry; i < info.end_entry; ++i) {
+        std::string_view p = key_in_section(info, entries_[i]);
+        if (p.size() > key.size() && p[key.size()] == '.' && p.compare(0, key.size(), key) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Start of the comment lines directly above offset (no blank line between)
+inline size_t TomlCst::attached_comment_start(size_t offset) const {
+    size_t start = offset;
+    while (start > 0) {
+        // Find the beginning of the previous line
+        size_t end = start - 1;
+        if (end > 0 && data_[end - 1] == '\r') --end;
+        size_t begin = end;
+        while (begin > 0 && data_[begin - 1] != '\n') --begin;
+        size_t first = begin;
+        while (first < end && (data_[first] == ' ' || data_[first] == '\t')) ++first;
+        if (first >= end || data_[first] != '#') break;
+        start = begin;
+    }
+    return start;
+}
+
+inline std::string TomlCst::indentation_of(const CstEntry& e) const {
+    return std::string(data_ + e.line_begin, tokens_[e.token].begin - e.line_begin);
+}
+
+// Offset just past the last line of a table's section, and its indentation
+inline size_t TomlCst::section_end(size_t table, std::string* indent) const {
+    const TableInfo& info = tables_info_[table];
+    size_t last = info.end_entry > info.first_entry ? info.end_entry - 1 : info.header;
+    if (indent) *indent = indentation_of(entries_[last]);
+    return entries_[last].line_end;
+}
+
+inline void TomlCst::insert_into_table(size_t table, std::string_view key, const std::string& text) {
+    const TableInfo& info = tables_info_[table];
+    size_t offset;
+    std::string indent;
+    if (info.header != npos || info.end_entry > info.first_entry) {
+        offset = section_end(table, &indent);
+    } else {
+        // Root table without keys: above the first header and its comments
+        offset = size_;
+        for (const CstEntry& e : entries_) {
+            if (e.kind != CstKind::KeyValue) {
+                offset = attached_comment_start(e.line_begin);
+                break;
+            }
+        }
+    }
+
+    std::string line;
+    if (offset == size_ && size_ > 0 && data_[size_ - 1] != '\n') line = newline_;
+    line += indent + std::string(key) + " = " + text + newline_;
+    edits_.push_back({offset, offset, std::move(line)});
+    sorted_ = false;
+}
+
+inline void TomlCst::insert(std::string_view path_in, const std::string& text) {
+    std::string normalized = array_tables_.empty() ? std::string(path_in) : with_first_elements(path_in);
+    std::string_view key_path = normalized;
+    size_t owner = owning_table(key_path);
+    std::string_view owner_path = tables_info_[owner].name;
+    if (find_in_section(owner, key_path) != npos || array_tables_.count(key_path) ||
+        defined_by_dotted_keys(owner, key_path))
+        throw std::invalid_argument("'" + std::string(key_path) + "' already exists");
+
+    // Elements of arrays of tables are never created
+    size_t bracket = key_path_find(key_path, '[', owner_path.size());
+    if (bracket != std::string_view::npos)
+        throw std::invalid_argument("Cannot add '" + std::string(key_path) + "': '" +
+                                    std::string(key_path.substr(0, key_path.find(']', bracket) + 1)) +
+                                    "' does not exist");
+
+    size_t dot = key_path_last_dot(key_path, key_path.size());
+    std::string_view parent = dot == std::string_view::npos ? std::string_view() : key_path.substr(0, dot);
+    std::string_view key = dot == std::string_view::npos ? key_path : key_path.substr(dot + 1);
+
+    // An existing table, or a table defined by dotted keys in its owner
+    if (owner_path.size() == parent.size()) {
+        insert_into_table(owner, key, text);
+        return;
+    }
+    if (defined_by_dotted_keys(owner, parent)) {
+        size_t skip = owner == 0 ? 0 : owner_path.size() + 1;
+        insert_into_table(owner, key_path.substr(skip), text);
+        return;
+    }
+
+    // A value or an array of tables on the way cannot hold new keys
+    for (size_t d = key_path_find(key_path, '.'); d != std::string_view::npos; d = key_path_find(key_path, '.', d + 1)) {
+        std::string_view prefix = key_path.substr(0, d);
+        if (array_tables_.count(prefix))
+            throw std::invalid_argument("Cannot add '" + std::string(key_path) + "': '" +
+                                        std::string(prefix) + "' is an array of tables");
+        const CstEntry* e = find(prefix);
+        if (e && e->kind == CstKind::KeyValue)
+            throw std::invalid_argument("Cannot add '" + std::string(key_path) + "': '" +
+                                        std::string(prefix) + "' is not a table");
+    }
+
+    // New table; later keys for it are added to the same text
+    std::string line = std::string(key) + " = " + text + newline_;
+    auto created = created_.find(std::string(parent));
+    if (created != created_.end()) {
+        if (created->second.at_end) {
+            new_tables_[created->second.index] += line;
+        } else {
+            edits_[created->second.index].text += line;
+            sorted_ = false;
+        }
+        return;
+    }
+
+    // Inside an element of an array of tables the header must come before
+    // the next element, so it goes right after the owner's section and is
+    // spelled with the path as written in the document
+    if (owner_path.find('[') != std::string_view::npos) {
+        std::string raw = std::string(path(entries_[tables_info_[owner].header])) +
+                          std::string(parent.substr(owner_path.size()));
+        size_t offset = section_end(owner, nullptr);
+        std::string header;
+        if (offset == size_ && size_ > 0 && data_[size_ - 1] != '\n') header = newline_;
+        header += "[" + raw + "]" + newline_;
+        created_.emplace(std::string(parent), NewTable{false, edits_.size()});
+        edits_.push_back({offset, offset, header + line});
+        sorted_ = false;
+        return;
+    }
+
+    // Otherwise after the end of the document
+    created_.emplace(std::string(parent), NewTable{true, new_tables_.size()});
+    new_tables_.push_back("[" + std::string(parent) + "]" + newline_ + line);
+}
+
+#endif // TOML_CST_HPP
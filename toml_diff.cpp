@@ -0,0 +1,132 @@
+/*
+ * toml_diff.cpp
+ * Compare two TOML documents and return the differences as a change list.
+ *
+ * Both documents are parsed with toml++ and compared in C++ (see
+ * toml_diff.hpp); only the old and new values of the reported changes are
+ * converted to MATLAB values.
+ *
+ * Compile with:
+ *   mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_diff.cpp
+ *
+ * Usage in MATLAB:
+ *   changes = toml_diff('deployed.toml', 'desired.toml');
+ *   changes = toml_diff(deployed_text, desired_text, 'Source', 'string');
+ *   changes = toml_diff('a.toml', 'b.toml', 'KeyField', 'name');
+ *
+ * changes is an Nx1 struct array with the fields
+ *   path - dotted key path, "name[k]" for elements of arrays of tables
+ *   kind - 'added', 'removed', 'changed' or 'typeChanged'
+ *   old  - value in the first document ([] if added)
+ *   new  - value in the second document ([] if removed)
+ *
+ * Values nested deeper than ConvertLimits allows are a
+ * "toml_diff:limitExceeded" error (see toml_limits.hpp).
+ *
+ * Options:
+ *   'Source'   - 'file' (default): the inputs are file names,
+ *                'string': the inputs are TOML text
+ *   'KeyField' - match elements of arrays of tables by this key instead of
+ *                by position; elements with the same key value are paired
+ *                in order
+ */
+
+#include "mex.h"
+#include "toml_diff.hpp"
+#include "toml_mex_options.hpp"
+#include <string>
+#include <vector>
+
+struct DiffOptions {
+    bool from_string = false;
+    std::string key_field;
+};
+
+// Parse trailing 'Name', value option pairs
+static DiffOptions parse_options(int nrhs, const mxArray* prhs[], int first) {
+    DiffOptions opts;
+    check_option_pairs(nrhs, first, "toml_diff");
+    for (int i = first; i < nrhs; i += 2) {
+        std::string opt = option_name(prhs[i], "toml_diff");
+        const mxArray* v = prhs[i + 1];
+
+        if (option_is(opt, "Source")) {
+            std::string source = option_string(v, opt, "toml_diff");
+            if (option_is(source, "string"))
+                opts.from_string = true;
+            else if (option_is(source, "file"))
+                opts.from_string = false;
+            else
+                option_error("toml_diff", "Value of option 'Source' must be 'file' or 'string'");
+        } else if (option_is(opt, "KeyField")) {
+            opts.key_field = option_string(v, opt, "toml_diff");
+        } else {
+            mexErrMsgIdAndTxt("toml_diff:invalidArgs", "Unknown option '%s'", opt.c_str());
+        }
+    }
+    return opts;
+}
+
+static toml::table parse_document(const std::string& input, bool from_string) {
+    return from_string ? toml::parse(input) : toml::parse_file(input);
+}
+
+// MEX entry point
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs < 2)
+        mexErrMsgIdAndTxt("toml_diff:invalidArgs",
+                          "Usage: changes = toml_diff(a, b, 'Name', value, ...)");
+
+    if (nlhs > 1)
+        mexErrMsgIdAndTxt("toml_diff:tooManyOutputs", "Too many output arguments");
+
+    if (!mxIsChar(prhs[0]) || !mxIsChar(prhs[1]))
+        mexErrMsgIdAndTxt("toml_diff:invalidInput", "First two inputs must be file names or TOML strings");
+
+    DiffOptions opts = parse_options(nrhs, prhs, 2);
+    std::string input_a = mx_to_std_string(prhs[0]);
+    std::string input_b = mx_to_std_string(prhs[1]);
+
+    // The trees must outlive the change list, which points into them
+    std::string error_id;
+    std::string error_msg;
+    toml::table a, b;
+    std::vector<DiffEntry> changes;
+    try
+    {
+        a = parse_document(input_a, opts.from_string);
+        b = parse_document(input_b, opts.from_string);
+        changes = TomlDiff(opts.key_field).compare(a, b);
+
+        const char* fields[] = {"path", "kind", "old", "new"};
+        plhs[0] = mxCreateStructMatrix(changes.size(), 1, 4, fields);
+        for (size_t i = 0; i < changes.size(); ++i) {
+            const DiffEntry& c = changes[i];
+            mxSetFieldByNumber(plhs[0], i, 0, mxCreateString(c.path.c_str()));
+            mxSetFieldByNumber(plhs[0], i, 1, mxCreateString(diff_kind_name(c.kind)));
+            mxSetFieldByNumber(plhs[0], i, 2, c.old_node ? convert_node(*c.old_node)
+                                                         : mxCreateDoubleMatrix(0, 0, mxREAL));
+            mxSetFieldByNumber(plhs[0], i, 3, c.new_node ? convert_node(*c.new_node)
+                                                         : mxCreateDoubleMatrix(0, 0, mxREAL));
+        }
+    }
+    catch (const toml::parse_error& e)
+    {
+        error_id = "toml_diff:parseError";
+        error_msg = std::string("TOML parse error: ") + e.what();
+    }
+    catch (const ConvertLimitError& e)
+    {
+        error_id = "toml_diff:limitExceeded";
+        error_msg = e.what();
+    }
+    catch (const std::exception& e)
+    {
+        error_id = "toml_diff:error";
+        error_msg = std::string("Error: ") + e.what();
+    }
+
+    if (!error_id.empty())
+        mexErrMsgIdAndTxt(error_id.c_str(), "%s", error_msg.c_str());
+}
@@ -0,0 +1,293 @@
+/*
+ * toml_diff.hpp
+ * Structural comparison of two parsed TOML documents.
+ *
+ * TomlDiff walks both toml++ trees together and records every difference
+ * as a (path, kind, old node, new node) entry; nothing is converted to
+ * MATLAB values here, so unchanged parts of the documents cost no mx
+ * allocations. Paths are dotted keys (quoted where they are not bare) with
+ * 1-based "[k]" indices for elements of arrays of tables, as accepted by
+ * toml_update_file.
+ *
+ * Every table and array gets a 64-bit content hash, computed once per node
+ * and memoized. Subtrees whose hashes differ are known to differ and are
+ * walked without comparing them first; subtrees with equal hashes are
+ * compared once in full and skipped if they are equal, so a hash collision
+ * cannot hide a change. Scalars are compared directly. Without the memo,
+ * checking equality before descending would compare deep subtrees once per
+ * level.
+ *
+ * Arrays of tables are matched by position, or by the value of a key field
+ * (e.g. "name") if one is given. Elements are then reported at their index
+ * in the new document, removed elements at their index in the old one.
+ * Elements with the same key value are paired in order: the first such
+ * element of the old array with the first of the new one, and so on; the
+ * extra ones are reported as removed or added. Elements without the key
+ * field are never matched and are reported as removed and added. Other
+ * arrays are compared as values.
+ */
+
+#ifndef TOML_DIFF_HPP
+#define TOML_DIFF_HPP
+
+#include <toml++/toml.h>
+#include "toml_convert.hpp"
+#include "toml_cst.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+
+enum class DiffKind { Added, Removed, Changed, TypeChanged };
+
+inline const char* diff_kind_name(DiffKind kind) {
+    switch (kind) {
+        case DiffKind::Added:       return "added";
+        case DiffKind::Removed:     return "removed";
+        case DiffKind::Changed:     return "changed";
+        case DiffKind::TypeChanged: return "typeChanged";
+    }
+    return "";
+}
+
+struct DiffEntry {
+    std::string path;
+    DiffKind kind;
+    const toml::node* old_node;   // nullptr if added
+    const toml::node* new_node;   // nullptr if removed
+};
+
+class TomlDiff {
+public:
+    // key_field: match elements of arrays of tables by this key (empty =
+    // by position)
+    explicit TomlDiff(std::string key_field = std::string())
+        : key_field_(std::move(key_field)) {}
+
+    // Differences from a to b, in the source order of a, then b
+    std::vector<DiffEntry> compare(const toml::table& a, const toml::table& b) {
+        entries_.clear();
+        std::string path;
+        diff_table(path, a, b);
+        return std::move(entries_);
+    }
+
+private:
+    uint64_t hash(const toml::node& node);
+    bool equal(const toml::node& a, const toml::node& b);
+    void diff_node(std::string& path, const toml::node& a, const toml::node& b);
+    void diff_table(std::string& path, const toml::table& a, const toml::table& b);
+    void diff_array_of_tables(std::string& path, const toml::array& a, const toml::array& b);
+    void add(const std::string& path, DiffKind kind, const toml::node* a, const toml::node* b) {
+        entries_.push_back({path, kind, a, b});
+    }
+
+    std::string key_field_;
+    std::unordered_map<const toml::node*, uint64_t> hashes_;   // tables and arrays
+    std::vector<DiffEntry> entries_;
+};
+
+inline uint64_t diff_hash_mix(uint64_t h, uint64_t v) {
+    // splitmix64 finalizer on the value, then combine
+    v += 0x9E3779B97F4A7C15ull;
+    v = (v ^ (v >> 30)) * 0xBF58476D1CE4E5B9ull;
+    v = (v ^ (v >> 27)) * 0x94D049BB133111EBull;
+    v ^= v >> 31;
+    return (h ^ v) * 0x100000001B3ull + 0x9E3779B97F4A7C15ull;
+}
+
+// True for a non-empty array whose elements are all tables
+inline bool is_array_of_tables(const toml::array& arr) {
+    if (arr.empty()) return false;
+    for (const toml::node& e : arr) {
+        if (!e.is_table()) return false;
+    }
+    return true;
+}
+
+inline uint64_t TomlDiff::hash(const toml::node& node) {
+    if (node.is_table() || node.is_array()) {
+        auto it = hashes_.find(&node);
+        if (it != hashes_.end()) return it->second;
+    }
+
+    uint64_t h = diff_hash_mix(0, static_cast<uint64_t>(node.type()));
+    if (auto tbl = node.as_table()) {
+        for (auto& [k, v] : *tbl) {
+            h = diff_hash_mix(h, std::hash<std::string_view>()(k.str()));
+            h = diff_hash_mix(h, hash(v));
+        }
+        h = diff_hash_mix(h, tbl->size());
+    } else if (auto arr = node.as_array()) {
+        for (const toml::node& e : *arr) h = diff_hash_mix(h, hash(e));
+        h = diff_hash_mix(h, arr->size());
+    } else if (auto s = node.as_string()) {
+        h = diff_hash_mix(h, std::hash<std::string_view>()(s->get()));
+    } else if (auto i = node.as_integer()) {
+        h = diff_hash_mix(h, static_cast<uint64_t>(i->get()));
+    } else if (auto f = node.as_floating_point()) {
+        double d = f->get();
+        uint64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        h = diff_hash_mix(h, bits);
+    } else if (auto b = node.as_boolean()) {
+        h = diff_hash_mix(h, b->get() ? 1 : 0);
+    } else if (auto d = node.as_date()) {
+        const toml::date& v = d->get();
+        h = diff_hash_mix(h, (uint64_t(v.year) << 16) | (uint64_t(v.month) << 8) | v.day);
+    } else if (auto t = node.as_time()) {
+        const toml::time& v = t->get();
+        h = diff_hash_mix(h, (uint64_t(v.hour) << 48) | (uint64_t(v.minute) << 40) |
+                             (uint64_t(v.second) << 32) | v.nanosecond);
+    } else if (auto dt = node.as_date_time()) {
+        const toml::date_time& v = dt->get();
+        h = diff_hash_mix(h, (uint64_t(v.date.year) << 16) | (uint64_t(v.date.month) << 8) | v.date.day);
+        h = diff_hash_mix(h, (uint64_t(v.time.hour) << 48) | (uint64_t(v.time.minute) << 40) |
+                             (uint64_t(v.time.second) << 32) | v.time.nanosecond);
+        h = diff_hash_mix(h, v.offset ? (uint64_t(1) << 32) | uint32_t(v.offset->minutes) : 0);
+    }
+
+    if (node.is_table() || node.is_array()) hashes_.emplace(&node, h);
+    return h;
+}
+
+// Whether a and b have the same value; float values must be identical to
+// the bit, as for hash()
+inline bool TomlDiff::equal(const toml::node& a, const toml::node& b) {
+    if (a.type() != b.type()) return false;
+    if (auto ta = a.as_table()) {
+        const toml::table& tb = *b.as_table();
+        if (ta->size() != tb.size() || hash(a) != hash(b)) return false;
+        for (auto& [k, v] : *ta) {
+            const toml::node* other = tb.get(k.str());
+            if (!other || !equal(v, *other)) return false;
+        }
+        return true;
+    }
+    if (auto aa = a.as_array()) {
+        const toml::array& ab = *b.as_array();
+        if (aa->size() != ab.size() || hash(a) != hash(b)) return false;
+        for (size_t i = 0; i < aa->size(); ++i) {
+            if (!equal((*aa)[i], ab[i])) return false;
+        }
+        return true;
+    }
+    if (auto s = a.as_string()) return s->get() == b.as_string()->get();
+    if (auto i = a.as_integer()) return i->get() == b.as_integer()->get();
+    if (auto f = a.as_floating_point()) {
+        double x = f->get();
+        double y = b.as_floating_point()->get();
+        return std::memcmp(&x, &y, sizeof(double)) == 0;
+    }
+    if (auto v = a.as_boolean()) return v->get() == b.as_boolean()->get();
+    if (auto d = a.as_date()) return d->get() == b.as_date()->get();
+    if (auto t = a.as_time()) return t->get() == b.as_time()->get();
+    if (auto dt = a.as_date_time()) return dt->get() == b.as_date_time()->get();
+    return true;
+}
+
+inline void TomlDiff::diff_node(std::string& path, const toml::node& a, const toml::node& b) {
+    if (a.type() != b.type()) {
+        add(path, DiffKind::TypeChanged, &a, &b);
+        return;
+    }
+    if (!a.is_table() && !a.is_array()) {
+        if (!equal(a, b)) add(path, DiffKind::Changed, &a, &b);
+        return;
+    }
+    if (hash(a) == hash(b) && equal(a, b)) return;
+
+    if (auto ta = a.as_table()) {
+        diff_table(path, *ta, *b.as_table());
+    } else if (a.is_array() && is_array_of_tables(*a.as_array()) && is_array_of_tables(*b.as_array())) {
+        diff_array_of_tables(path, *a.as_array(), *b.as_array());
+    } else {
+        add(path, DiffKind::Changed, &a, &b);
+    }
+}
+
+inline void TomlDiff::diff_table(std::string& path, const toml::table& a, const toml::table& b) {
+    size_t prefix_length = path.size();
+    auto child = [&](const std::string& key) {
+        if (prefix_length > 0) path += '.';
+        path += toml_key_segment(key);
+    };
+
+    for (const FieldInfo& f : ordered_fields(a)) {
+        child(f.key);
+        if (const toml::node* other = b.get(f.key))
+            diff_node(path, *f.node, *other);
+        else
+            add(path, DiffKind::Removed, f.node, nullptr);
+        path.resize(prefix_length);
+    }
+    for (const FieldInfo& f : ordered_fields(b)) {
+        if (a.contains(f.key)) continue;
+        child(f.key);
+        add(path, DiffKind::Added, nullptr, f.node);
+        path.resize(prefix_length);
+    }
+}
+
+inline void TomlDiff::diff_array_of_tables(std::string& path, const toml::array& a, const toml::array& b) {
+    size_t name_length = path.size();
+    auto element = [&](size_t index) {
+        path += '[';
+        path += std::to_string(index + 1);
+        path += ']';
+    };
+
+    // b index matched to each element of a (npos if none)
+    const size_t none = static_cast<size_t>(-1);
+    std::vector<size_t> match(a.size(), none);
+    std::vector<bool> used(b.size(), false);
+    if (key_field_.empty()) {
+        for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+            match[i] = i;
+            used[i] = true;
+        }
+    } else {
+        // Index b by the hash of its key values; elements whose hashes
+        // match are only paired if the key values are equal. Each element
+        // of a takes the first unused equal element of b, so duplicate
+        // keys pair up in order (the multimap does not keep that order).
+        std::unordered_multimap<uint64_t, size_t> keys;
+        for (size_t j = 0; j < b.size(); ++j) {
+            if (const toml::node* key = b[j].as_table()->get(key_field_))
+                keys.emplace(hash(*key), j);
+        }
+        for (size_t i = 0; i < a.size(); ++i) {
+            const toml::node* key = a[i].as_table()->get(key_field_);
+            if (!key) continue;
+            auto range = keys.equal_range(hash(*key));
+            for (auto it = range.first; it != range.second; ++it) {
+                size_t j = it->second;
+                if (!used[j] && j < match[i] && equal(*key, *b[j].as_table()->get(key_field_)))
+                    match[i] = j;
+            }
+            if (match[i] != none) used[match[i]] = true;
+        }
+    }
+
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (match[i] == none) {
+            element(i);
+            add(path, DiffKind::Removed, &a[i], nullptr);
+        } else {
+            element(match[i]);
+            diff_node(path, a[i], b[match[i]]);
+        }
+        path.resize(name_length);
+    }
+    for (size_t j = 0; j < b.size(); ++j) {
+        if (used[j]) continue;
+        element(j);
+        add(path, DiffKind::Added, nullptr, &b[j]);
+        path.resize(name_length);
+    }
+}
+
+#endif // TOML_DIFF_HPP
@@ -0,0 +1,641 @@
+/*
+ * toml_file_sink.hpp
+ * Buffered output stream buffer for the MEX file writers.
+ *
+ * FileSink is a std::streambuf that collects output in a fixed-size buffer
+ * and hands it to the OS in large write() calls, so memory use stays bounded
+ * by the buffer no matter how large the document is. It can optionally
+ * fsync before closing, and commit atomically by writing to a temporary file
+ * next to the target and renaming it over the target once everything has
+ * been written. An atomic replace keeps what an in-place write would: the
+ * temporary file gets the mode and (where permitted) the owner of the file
+ * it replaces, and a symlink is followed and its target replaced. If no
+ * temporary file can be created next to the file (read-only directory),
+ * FileOpenError is thrown; the caller has to ask for an in-place write.
+ *
+ * Usage:
+ *   FileSink sink(filename, true, false);   // atomic, no fsync
+ *   std::ostream os(&sink);
+ *   os << ...;
+ *   sink.commit();                           // throws on I/O errors
+ *
+ * If commit() is never reached (e.g. an exception is thrown while writing),
+ * the destructor closes the descriptor and removes the temporary file. In
+ * place, a file written from the start is truncated when it is opened and
+ * then holds what was written so far. A file resumed after a kept prefix
+ * (resume_at) is only truncated on commit, so it then holds the new text
+ * followed by the rest of the old file.
+ *
+ * ChangedOnlySink wraps the same machinery for 'OnlyIfChanged' writes: the
+ * output is compared chunk by chunk against a read-only mapping of the
+ * existing file, and a FileSink is only opened once the first difference
+ * is seen. An unchanged file is never opened for writing.
+ *
+ * AppendFile keeps a file open for appending (O_APPEND) between calls, so
+ * adding text costs one write() of the new text, whatever the file size.
+ * Buffered text is never written to a file that was replaced: if the path
+ * cannot be reopened, the text is dropped and the error says how much was
+ * lost.
+ */
+
+#ifndef TOML_FILE_SINK_HPP
+#define TOML_FILE_SINK_HPP
+
+#include <streambuf>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include "toml_mapped_file.hpp"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+// Thrown when the output (or temporary) file cannot be created
+class FileOpenError : public std::runtime_error {
+public:
+    explicit FileOpenError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+// Thin portable layer over the low-level file API
+inline int file_open_for_write(const std::string& path, bool truncate = true) {
+#ifdef _WIN32
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : 0),
+                 _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0666);
+#endif
+}
+
+// Every write goes to the current end of the file. On Windows the file is
+// shared for deletion, so that it can still be replaced (MoveFileEx) or
+// removed while it is open
+inline int file_open_for_append(const std::string& path) {
+#ifdef _WIN32
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_WRITE,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        DWORD error = GetLastError();
+        errno = (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) ? ENOENT :
+                (error == ERROR_ACCESS_DENIED || error == ERROR_SHARING_VIOLATION) ? EACCES : EIO;
+        return -1;
+    }
+    int fd = _open_osfhandle(reinterpret_cast<intptr_t>(h), _O_WRONLY | _O_BINARY | _O_APPEND);
+    if (fd < 0) CloseHandle(h);
+    return fd;
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | O_APPEND, 0666);
+#endif
+}
+
+inline void file_seek(int fd, uint64_t offset) {
+#ifdef _WIN32
+    if (_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0)
+#else
+    if (::lseek(fd, static_cast<off_t>(offset), SEEK_SET) < 0)
+#endif
+        throw std::runtime_error(std::string("Seek failed: ") + std::strerror(errno));
+}
+
+inline void file_truncate(int fd, uint64_t size) {
+#ifdef _WIN32
+    if (_chsize_s(fd, static_cast<__int64>(size)) != 0)
+#else
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+#endif
+        throw std::runtime_error(std::string("Truncate failed: ") + std::strerror(errno));
+}
+
+inline void file_write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        unsigned int chunk = size > 0x40000000u ? 0x40000000u : static_cast<unsigned int>(size);
+        int written = _write(fd, data, chunk);
+#else
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR) continue;
+#endif
+        if (written < 0) {
+            throw std::runtime_error(std::string("Write failed: ") + std::strerror(errno));
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+// Write size bytes at the given offset without moving the file position
+inline void file_write_at(int fd, uint64_t offset, const char* data, size_t size) {
+#ifdef _WIN32
+    file_seek(fd, offset);
+    file_write_all(fd, data, size);
+#else
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) {
+            throw std::runtime_error(std::string("Write failed: ") + std::strerror(errno));
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+#endif
+}
+
+inline void file_sync(int fd) {
+#ifdef _WIN32
+    if (_commit(fd) != 0)
+#else
+    if (::fsync(fd) != 0)
+#endif
+        throw std::runtime_error(std::string("fsync failed: ") + std::strerror(errno));
+}
+
+inline int file_close(int fd) {
+#ifdef _WIN32
+    return _close(fd);
+#else
+    return ::close(fd);
+#endif
+}
+
+// Replace target with source in a single rename
+inline void file_replace(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    if (!MoveFileExA(from.c_str(), to.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        throw std::runtime_error("Could not replace " + to + " (error " +
+                                 std::to_string(GetLastError()) + ")");
+    }
+#else
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+        throw std::runtime_error("Could not replace " + to + ": " + std::strerror(errno));
+    }
+#endif
+}
+
+// Flush the directory entry of path so a completed rename survives a crash
+inline void file_sync_parent_dir(const std::string& path) {
+#ifndef _WIN32
+    size_t slash = path.find_last_of('/');
+    std::string dir = (slash == std::string::npos) ? "." :
+                      (slash == 0 ? "/" : path.substr(0, slash));
+    int dfd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dfd >= 0) {
+        ::fsync(dfd);
+        ::close(dfd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+// Whether fd is open on the file that is now at path; false if path was
+// removed or replaced since fd was opened
+inline bool file_is_at_path(int fd, const std::string& path) {
+#ifdef _WIN32
+    HANDLE open_handle = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+    HANDLE path_handle = CreateFileA(path.c_str(), 0,
+                                     FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                     OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (open_handle == INVALID_HANDLE_VALUE || path_handle == INVALID_HANDLE_VALUE) {
+        if (path_handle != INVALID_HANDLE_VALUE) CloseHandle(path_handle);
+        return false;
+    }
+    BY_HANDLE_FILE_INFORMATION open_info, path_info;
+    bool same = GetFileInformationByHandle(open_handle, &open_info) &&
+                GetFileInformationByHandle(path_handle, &path_info) &&
+                open_info.dwVolumeSerialNumber == path_info.dwVolumeSerialNumber &&
+                open_info.nFileIndexHigh == path_info.nFileIndexHigh &&
+                open_info.nFileIndexLow == path_info.nFileIndexLow;
+    CloseHandle(path_handle);
+    return same;
+#else
+    struct stat open_st, path_st;
+    if (::fstat(fd, &open_st) != 0 || ::stat(path.c_str(), &path_st) != 0) return false;
+    return open_st.st_dev == path_st.st_dev && open_st.st_ino == path_st.st_ino;
+#endif
+}
+
+// The file a symlink points to, so that replacing it keeps the link; path
+// itself if it is not a link or does not exist yet
+inline std::string file_resolve_links(const std::string& path) {
+#ifdef _WIN32
+    return path;
+#else
+    char* real = ::realpath(path.c_str(), nullptr);
+    if (!real) return path;
+    std::string result(real);
+    std::free(real);
+    return result;
+#endif
+}
+
+// An absolute name for path without ".", ".." or symlinks, so that two
+// names of one file compare equal. For a file that does not exist yet the
+// directory is resolved and the file name kept; if the directory does not
+// exist either, "." and ".." are removed from the name as written.
+inline std::string file_canonical_path(const std::string& path) {
+#ifdef _WIN32
+    char full[MAX_PATH];
+    DWORD n = GetFullPathNameA(path.c_str(), MAX_PATH, full, nullptr);
+    if (n == 0 || n >= MAX_PATH) return path;
+    return std::string(full, n);
+#else
+    auto real = [](const std::string& p, std::string& out) {
+        char* r = ::realpath(p.c_str(), nullptr);
+        if (!r) return false;
+        out = r;
+        std::free(r);
+        return true;
+    };
+    std::string result;
+    if (real(path, result)) return result;
+
+    size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    if (real(dir, result)) return (result == "/" ? result : result + "/") + name;
+
+    std::string absolute = path;
+    if (path.empty() || path[0] != '/') {
+        char* cwd = ::getcwd(nullptr, 0);
+        if (!cwd) return path;
+        absolute = std::string(cwd) + "/" + path;
+        std::free(cwd);
+    }
+    std::vector<std::string> parts;
+    for (size_t start = 0; start <= absolute.size();) {
+        size_t end = std::min(absolute.find('/', start), absolute.size());
+        std::string part = absolute.substr(start, end - start);
+        if (part == "..") {
+            if (!parts.empty()) parts.pop_back();
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        start = end + 1;
+    }
+    result.clear();
+    for (const std::string& part : parts) result += "/" + part;
+    return result.empty() ? "/" : result;
+#endif
+}
+
+// Give a new file the owner and mode of the file at path, if there is one.
+// Changing the owner needs privileges, so failing to is not an error.
+inline void file_copy_owner_and_mode(int fd, const std::string& path) {
+#ifndef _WIN32
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return;
+    // Owner first: fchown clears the set-id bits that fchmod restores
+    if (::fchown(fd, st.st_uid, st.st_gid) != 0 && ::fchown(fd, (uid_t)-1, st.st_gid) != 0) {
+        // Keep the caller's owner and group
+    }
+    if (::fchmod(fd, st.st_mode & 07777) != 0)
+        throw std::runtime_error(std::string("Could not set file mode: ") + std::strerror(errno));
+#else
+    (void)fd;
+    (void)path;
+#endif
+}
+
+inline std::string temp_path_for(const std::string& path) {
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = static_cast<int>(::getpid());
+#endif
+    // Several threads may write (different) files at the same time
+    static std::atomic<unsigned> counter(0);
+    return path + ".tmp" + std::to_string(pid) + "." + std::to_string(counter++);
+}
+
+class FileSink : public std::streambuf {
+public:
+    // Size of the write buffer; also the largest single write() issued
+    static constexpr size_t buffer_size = size_t(1) << 20;
+
+    // resume_at > 0 (in-place mode only) keeps the first resume_at bytes of
+    // an existing file, writes from there and truncates to the new length
+    FileSink(const std::string& path, bool atomic, bool fsync_on_commit, uint64_t resume_at = 0)
+        : path_(path), atomic_(atomic), fsync_(fsync_on_commit),
+          resume_at_(atomic ? 0 : resume_at), buffer_(buffer_size) {
+        target_ = path_;
+        if (atomic_) {
+            path_ = file_resolve_links(path_);
+            target_ = temp_path_for(path_);
+            fd_ = file_open_for_write(target_);
+            if (fd_ < 0) {
+                throw FileOpenError("Cannot create a temporary file next to " + path_ +
+                                    " (" + std::strerror(errno) + "); 'Atomic', false writes in place");
+            }
+        } else {
+            // A kept prefix is only cut off after it on commit
+            fd_ = file_open_for_write(target_, resume_at_ == 0);
+        }
+        if (fd_ < 0) {
+            throw FileOpenError("Cannot open file for writing: " + target_ +
+                                " (" + std::strerror(errno) + ")");
+        }
+        try {
+            if (atomic_) file_copy_owner_and_mode(fd_, path_);
+            if (resume_at_ > 0) file_seek(fd_, resume_at_);
+        }
+        catch (...) {
+            file_close(fd_);
+            if (atomic_) std::remove(target_.c_str());
+            throw;
+        }
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    ~FileSink() override {
+        if (fd_ >= 0) {
+            file_close(fd_);
+            if (atomic_) std::remove(target_.c_str());
+        }
+    }
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    // False if the output goes straight to the file
+    bool atomic() const { return atomic_; }
+
+    // Flush remaining output, optionally fsync, close and (in atomic mode)
+    // move the temporary file over the target
+    void commit() {
+        flush_buffer();
+        if (!atomic_) file_truncate(fd_, resume_at_ + written_);
+        if (fsync_) file_sync(fd_);
+        int fd = fd_;
+        fd_ = -1;
+        if (file_close(fd) != 0) {
+            if (atomic_) std::remove(target_.c_str());
+            throw std::runtime_error(std::string("Close failed: ") + std::strerror(errno));
+        }
+        if (atomic_) {
+            try {
+                file_replace(target_, path_);
+            }
+            catch (...) {
+                std::remove(target_.c_str());
+                throw;
+            }
+            if (fsync_) file_sync_parent_dir(path_);
+        }
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        flush_buffer();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        size_t count = static_cast<size_t>(n);
+        size_t space = static_cast<size_t>(epptr() - pptr());
+        if (count <= space) {
+            std::memcpy(pptr(), s, count);
+            pbump(static_cast<int>(count));
+            return n;
+        }
+        // Larger than what is left: flush, then either buffer or pass through
+        flush_buffer();
+        if (count >= buffer_.size()) {
+            file_write_all(fd_, s, count);
+            written_ += count;
+        } else {
+            std::memcpy(pptr(), s, count);
+            pbump(static_cast<int>(count));
+        }
+        return n;
+    }
+
+    int sync() override {
+        flush_buffer();
+        return 0;
+    }
+
+private:
+    void flush_buffer() {
+        size_t pending = static_cast<size_t>(pptr() - pbase());
+        if (pending > 0) file_write_all(fd_, pbase(), pending);
+        written_ += pending;
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    std::string path_;
+    std::string target_;
+    bool atomic_;
+    bool fsync_;
+    uint64_t resume_at_;
+    uint64_t written_ = 0;
+    int fd_ = -1;
+    std::vector<char> buffer_;
+};
+
+class ChangedOnlySink : public std::streambuf {
+public:
+    ChangedOnlySink(const std::string& path, bool atomic, bool fsync_on_commit)
+        : path_(path), atomic_(atomic), fsync_(fsync_on_commit),
+          existing_(path), buffer_(FileSink::buffer_size) {
+        if (!existing_.valid()) {
+            // Nothing to compare against: write from the start
+            sink_.reset(new FileSink(path_, atomic_, fsync_));
+        }
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    ChangedOnlySink(const ChangedOnlySink&) = delete;
+    ChangedOnlySink& operator=(const ChangedOnlySink&) = delete;
+
+    // Finish the output. Returns true if the file was (re)written, false if
+    // its contents were already identical and it was left untouched.
+    bool commit() {
+        flush_buffer();
+        if (!sink_ && matched_ == existing_.size()) {
+            existing_.close();
+            return false;
+        }
+        // Output is a strict prefix of the old file (or was empty)
+        if (!sink_) diverge();
+        sink_->commit();
+        return true;
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        flush_buffer();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        flush_buffer();
+        return 0;
+    }
+
+private:
+    void flush_buffer() {
+        size_t pending = static_cast<size_t>(pptr() - pbase());
+        if (pending > 0) {
+            if (!sink_) {
+                if (matched_ + pending <= existing_.size() &&
+                    std::memcmp(existing_.data() + matched_, pbase(), pending) == 0) {
+                    matched_ += pending;
+                } else {
+                    diverge();
+                }
+            }
+            if (sink_) sink_->sputn(pbase(), static_cast<std::streamsize>(pending));
+        }
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    // Switch from comparing to writing. Everything up to matched_ is known
+    // to be identical to the existing file.
+    void diverge() {
+        if (atomic_) {
+            sink_.reset(new FileSink(path_, true, fsync_));
+            if (matched_ > 0) {
+                sink_->sputn(existing_.data(), static_cast<std::streamsize>(matched_));
+            }
+            existing_.close();
+        } else {
+            // In place: keep the identical prefix on disk and write after it
+            existing_.close();
+            sink_.reset(new FileSink(path_, false, fsync_, matched_));
+        }
+    }
+
+    std::string path_;
+    bool atomic_;
+    bool fsync_;
+    MappedFile existing_;
+    size_t matched_ = 0;
+    std::unique_ptr<FileSink> sink_;
+    std::vector<char> buffer_;
+};
+
+class AppendFile {
+public:
+    // Text is collected up to this size before it is written
+    static constexpr size_t buffer_size = FileSink::buffer_size;
+
+    explicit AppendFile(const std::string& path) : path_(path) {
+        fd_ = file_open_for_append(path_);
+        if (fd_ < 0) {
+            throw FileOpenError("Cannot open file for appending: " + path_ +
+                                " (" + std::strerror(errno) + ")");
+        }
+        buffer_.reserve(buffer_size);
+    }
+
+    // Pending text is written if the path can still be opened; otherwise
+    // it is dropped, since errors can no longer be reported here. Call
+    // close() to find out.
+    ~AppendFile() {
+        if (fd_ < 0) return;
+        try {
+            if (!buffer_.empty()) follow_path();
+            flush();
+        }
+        catch (...) {
+        }
+        file_close(fd_);
+    }
+
+    AppendFile(const AppendFile&) = delete;
+    AppendFile& operator=(const AppendFile&) = delete;
+
+    const std::string& path() const { return path_; }
+
+    // Add text; it is written once the buffer is full or on flush()
+    void append(const std::string& text) {
+        if (buffer_.size() + text.size() > buffer_size) flush();
+        if (text.size() >= buffer_size) file_write_all(fd_, text.data(), text.size());
+        else buffer_.append(text);
+    }
+
+    void flush() {
+        if (buffer_.empty()) return;
+        file_write_all(fd_, buffer_.data(), buffer_.size());
+        buffer_.clear();
+    }
+
+    // Flush and fsync
+    void sync() {
+        flush();
+        file_sync(fd_);
+    }
+
+    void close() {
+        if (!buffer_.empty()) follow_path();
+        flush();
+        int fd = fd_;
+        fd_ = -1;
+        if (file_close(fd) != 0)
+            throw std::runtime_error(std::string("Close failed: ") + std::strerror(errno));
+    }
+
+    // False if path was removed or replaced (e.g. by an atomic rewrite)
+    // since it was opened, so appends would go to the old file
+    bool still_at_path() const { return file_is_at_path(fd_, path_); }
+
+    // Reopen path if it was removed or replaced; text that is still
+    // buffered then goes to the new file. If path cannot be reopened the
+    // buffered text is dropped, not written to the old file.
+    void follow_path() {
+        if (still_at_path()) return;
+        int fd = file_open_for_append(path_);
+        if (fd < 0) {
+            std::string message = "Cannot open file for appending: " + path_ +
+                                  " (" + std::strerror(errno) + ")";
+            if (!buffer_.empty()) {
+                message += "; " + std::to_string(buffer_.size()) +
+                           " bytes of buffered text were discarded";
+                buffer_.clear();
+            }
+            throw FileOpenError(message);
+        }
+        file_close(fd_);
+        fd_ = fd;
+    }
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    std::string buffer_;
+};
+
+#endif // TOML_FILE_SINK_HPP
@@ -0,0 +1,53 @@
+function it = toml_iter(tomlfile, section, varargin)
+    % TOML_ITER Open a TOML file for reading an array of tables in batches
+    %
+    % Syntax:
+    %   it = toml_iter(tomlfile, section)
+    %   it = toml_iter(tomlfile, section, 'Name', value, ...)
+    %
+    % Description:
+    %   For files that are mostly one long [[section]] list (logs, event
+    %   records). The file is mapped through a sliding window and each call
+    %   of toml_next converts only the next batch of entries, so the whole
+    %   file is never in memory. Other parts of the file are skipped.
+    %
+    % Inputs:
+    %   tomlfile - Path to TOML file (string or char)
+    %   section  - Dotted key of the array of tables, e.g. 'record' for
+    %              [[record]] or 'logs.record' for [[logs.record]]
+    %
+    % Options:
+    %   'Columnar' - Return batches as a struct of Nx1 columns instead of an
+    %                Nx1 struct array (default false)
+    %   'Window'   - Bytes of the file mapped at a time (default 64 MiB)
+    %
+    % Outputs:
+    %   it - Iterator for toml_next and toml_iter_close
+    %
+    % Example:
+    %   it = toml_iter('events.toml', 'record', 'Columnar', true);
+    %   done = false;
+    %   while ~done
+    %       [batch, done] = toml_next(it, 10000);
+    %       process(batch);
+    %   end
+
+    if nargin < 2
+        error('toml_iter:missingInput', 'File and section are required');
+    end
+    if isstring(tomlfile)
+        tomlfile = char(tomlfile);
+    end
+    if isstring(section)
+        section = char(section);
+    end
+
+    try
+        id = toml_mex('records', 'open', tomlfile, section, varargin{:});
+    catch ME
+        % Report errors under this function's identifiers
+        id = strrep(ME.identifier, 'toml_records:', 'toml_iter:');
+        error(id, '%s', ME.message);
+    end
+    it = struct('id', id, 'file', tomlfile, 'section', section);
+end
@@ -0,0 +1,15 @@
+function toml_iter_close(it)
+    % TOML_ITER_CLOSE Close a toml_iter iterator before its last batch
+    %
+    % Syntax:
+    %   toml_iter_close(it)
+    %
+    % Description:
+    %   Unmaps and closes the file. Iterators that reached the end of the
+    %   file are already closed; closing them again does nothing.
+
+    if ~isstruct(it) || ~isfield(it, 'id')
+        error('toml_iter_close:invalidIterator', 'Input must be an iterator from toml_iter');
+    end
+    toml_mex('records', 'close', it.id);
+end
@@ -0,0 +1,176 @@
+/*
+ * toml_json.cpp
+ * Convert between TOML and JSON text without building MATLAB values.
+ *
+ * The input is parsed into a tree (toml++ for TOML, toml_json.hpp for
+ * JSON) and written straight out as the other format, to a char array or
+ * a file; see toml_json.hpp for how values are mapped. TOML output keeps
+ * the key order of the JSON objects, so TOML -> JSON -> TOML keeps the
+ * order of the original document's keys.
+ *
+ * Compile with:
+ *   mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_json.cpp
+ *
+ * Usage in MATLAB:
+ *   json = toml_json('to_json', 'config.toml');
+ *   json = toml_json('to_json', toml_text, 'Source', 'string', 'Tagged', true);
+ *   toml_json('to_json', 'config.toml', 'File', 'config.json', 'PrettyPrint', true);
+ *   text = toml_json('to_toml', json_text, 'Source', 'string');
+ *   toml_json('to_toml', 'config.json', 'File', 'config.toml');
+ *
+ * Options:
+ *   'Source'      - 'file' (default): the input is a file name,
+ *                   'string': the input is the document text
+ *   'Tagged'      - Write (to_json) or read (to_toml) values as
+ *                   {"type", "value"} objects that keep TOML types
+ *                   (default false)
+ *   'PrettyPrint' - Indent the JSON output (default false)
+ *   'File'        - Write the output to this file (replaced atomically)
+ *                   and return '' instead of the text
+ *   'MaxDepth'    - Deepest nesting of objects/arrays or tables allowed
+ *                   (default 1000; Inf for no limit)
+ */
+
+#include "mex.h"
+#include "toml_json.hpp"
+#include "toml_file_sink.hpp"
+#include "toml_mapped_file.hpp"
+#include "toml_mex_options.hpp"
+#include <memory>
+#include <sstream>
+#include <string>
+
+struct JsonOptions {
+    bool from_string = false;
+    bool tagged = false;
+    bool pretty = false;
+    std::string file;
+    ConvertLimits limits;
+};
+
+// Parse trailing 'Name', value option pairs
+static JsonOptions parse_options(int nrhs, const mxArray* prhs[], int first) {
+    JsonOptions opts;
+    check_option_pairs(nrhs, first, "toml_json");
+    for (int i = first; i < nrhs; i += 2) {
+        std::string opt = option_name(prhs[i], "toml_json");
+        const mxArray* v = prhs[i + 1];
+
+        if (option_is(opt, "Source")) {
+            std::string source = option_string(v, opt, "toml_json");
+            if (option_is(source, "string"))
+                opts.from_string = true;
+            else if (option_is(source, "file"))
+                opts.from_string = false;
+            else
+                option_error("toml_json", "Value of option 'Source' must be 'file' or 'string'");
+        } else if (option_is(opt, "Tagged")) {
+            opts.tagged = option_logical(v, opt, "toml_json");
+        } else if (option_is(opt, "PrettyPrint")) {
+            opts.pretty = option_logical(v, opt, "toml_json");
+        } else if (option_is(opt, "File")) {
+            opts.file = option_string(v, opt, "toml_json");
+        } else if (option_is(opt, "MaxDepth")) {
+            try {
+                limit_option_from_mx(opts.limits, opt, v);
+            }
+            catch (const std::invalid_argument& e) {
+                option_error("toml_json", e.what());
+            }
+        } else {
+            mexErrMsgIdAndTxt("toml_json:invalidArgs", "Unknown option '%s'", opt.c_str());
+        }
+    }
+    return opts;
+}
+
+// Convert the input document and write it to os
+static void convert(std::ostream& os, bool to_json, const std::string& input, const JsonOptions& opts) {
+    if (to_json) {
+        toml::table tbl = opts.from_string ? toml::parse(input) : toml::parse_file(input);
+        write_toml_as_json(os, tbl, opts.tagged, opts.pretty, opts.limits);
+    } else {
+        JsonTomlDocument doc;
+        if (opts.from_string) {
+            read_json_as_toml(input, opts.tagged, doc, opts.limits);
+        } else {
+            MappedFile file(input);
+            if (!file.valid()) throw std::runtime_error("File could not be opened for reading: " + input);
+            read_json_as_toml(std::string_view(file.data(), file.size()), opts.tagged, doc, opts.limits);
+        }
+        write_toml_text(os, doc);
+    }
+}
+
+// MEX entry point
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs < 2 || !mxIsChar(prhs[0]))
+        mexErrMsgIdAndTxt("toml_json:invalidArgs",
+                          "Usage: text = toml_json('to_json' | 'to_toml', input, 'Name', value, ...)");
+
+    if (nlhs > 1)
+        mexErrMsgIdAndTxt("toml_json:tooManyOutputs", "Too many output arguments");
+
+    std::string action = mx_to_std_string(prhs[0]);
+    if (action != "to_json" && action != "to_toml")
+        mexErrMsgIdAndTxt("toml_json:invalidArgs", "Unknown action '%s'", action.c_str());
+    bool to_json = action == "to_json";
+
+    if (!mxIsChar(prhs[1]))
+        mexErrMsgIdAndTxt("toml_json:invalidInput", "Input must be a file name or a char array of text");
+
+    JsonOptions opts = parse_options(nrhs, prhs, 2);
+    std::string input = mx_to_std_string(prhs[1]);
+
+    // Errors are raised only after the sink has been destroyed, so an
+    // unfinished temporary file is always cleaned up first
+    std::string error_id;
+    std::string error_msg;
+    std::string text;
+    try
+    {
+        if (opts.file.empty()) {
+            std::ostringstream os;
+            convert(os, to_json, input, opts);
+            text = os.str();
+        } else {
+            FileSink sink(opts.file, true, false);
+            std::ostream os(&sink);
+            os.exceptions(std::ios::badbit);
+            convert(os, to_json, input, opts);
+            os.flush();
+            sink.commit();
+        }
+    }
+    catch (const toml::parse_error& e)
+    {
+        error_id = "toml_json:parseError";
+        error_msg = std::string("TOML parse error: ") + e.what();
+    }
+    catch (const JsonParseError& e)
+    {
+        error_id = "toml_json:parseError";
+        error_msg = std::string("JSON parse error: ") + e.what();
+    }
+    catch (const FileOpenError& e)
+    {
+        error_id = "toml_json:cannotOpenFile";
+        error_msg = e.what();
+    }
+    catch (const ConvertLimitError& e)
+    {
+        error_id = "toml_json:limitExceeded";
+        error_msg = e.what();
+    }
+    catch (const std::exception& e)
+    {
+        error_id = "toml_json:error";
+        error_msg = std::string("Error: ") + e.what();
+    }
+
+    if (!error_id.empty())
+        mexErrMsgIdAndTxt(error_id.c_str(), "%s", error_msg.c_str());
+
+    plhs[0] = mxCreateString(text.c_str());
+}
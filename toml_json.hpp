@@ -0,0 +1,823 @@
+/*
+ * toml_json.hpp
+ * Direct conversion between parsed TOML documents and JSON text.
+ *
+ * TomlJsonWriter writes a toml++ tree as JSON to any std::ostream, with the
+ * keys of every table in source order (ordered_fields). Integers are
+ * written exactly, floats in the shortest form that reads back to the same
+ * double, and strings as UTF-8 with only '"', '\' and control characters
+ * escaped. Dates and times become RFC 3339 strings, and inf/nan (which
+ * JSON has no numbers for) become null.
+ *
+ * With tagging enabled every value is written as a {"type", "value"}
+ * object instead, in the format of the toml-test suite, e.g.
+ *   {"type": "integer", "value": "255", "format": "hex"}
+ * so dates, local date-times, hex/octal/binary integers and inf/nan survive
+ * the trip. The types are string, integer, float, bool, datetime,
+ * datetime-local, date-local and time-local.
+ *
+ * read_json_as_toml reads JSON text into a toml::table. The top level
+ * must be an object, numbers without a fraction or exponent become
+ * integers if they fit into int64, and null has no TOML equivalent and is
+ * an error. With tagging enabled the tagged objects above are decoded back
+ * into typed values. toml++ keeps the keys of a table sorted, so the key
+ * order of every object is kept as field ranks (see toml_convert.hpp).
+ *
+ * write_toml_text writes such a table as TOML in the layout of
+ * toml_serialize.hpp: each table's plain values in key order, then its
+ * nested tables as [path] sections, then its arrays of tables as [[path]]
+ * sections. Values are formatted by toml++ as in serialize_value, except
+ * that tables inside other arrays are written inline in key order.
+ *
+ * Both directions recurse once per level of nesting, which is bounded by
+ * ConvertLimits::max_depth: deeper JSON is a JsonParseError, and a deeper
+ * TOML tree a ConvertLimitError when it is written as JSON.
+ */
+
+#ifndef TOML_JSON_HPP
+#define TOML_JSON_HPP
+
+#include <toml++/toml.h>
+#include "toml_convert.hpp"
+#include "toml_cst.hpp"
+#include "toml_limits.hpp"
+#include "toml_serialize.hpp"
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Error in JSON input, with the 1-based line and column in the message
+class JsonParseError : public std::runtime_error {
+public:
+    JsonParseError(const std::string& msg, size_t line, size_t column)
+        : std::runtime_error("line " + std::to_string(line) + ", column " +
+                             std::to_string(column) + ": " + msg),
+          line(line), column(column) {}
+    size_t line;
+    size_t column;
+};
+
+inline void append_2digits(std::string& out, unsigned v) {
+    out += static_cast<char>('0' + v / 10 % 10);
+    out += static_cast<char>('0' + v % 10);
+}
+
+inline std::string format_toml_date(const toml::date& d) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%04u-%02u-%02u", unsigned(d.year), unsigned(d.month), unsigned(d.day));
+    return buf;
+}
+
+// HH:MM:SS with the fraction of a second (if any) and no trailing zeros
+inline std::string format_toml_time(const toml::time& t) {
+    std::string out;
+    append_2digits(out, t.hour);
+    out += ':';
+    append_2digits(out, t.minute);
+    out += ':';
+    append_2digits(out, t.second);
+    if (t.nanosecond) {
+        char frac[16];
+        std::snprintf(frac, sizeof(frac), ".%09u", unsigned(t.nanosecond));
+        std::string digits(frac);
+        digits.erase(digits.find_last_not_of('0') + 1);
+        out += digits;
+    }
+    return out;
+}
+
+inline std::string format_toml_date_time(const toml::date_time& dt) {
+    std::string out = format_toml_date(dt.date) + 'T' + format_toml_time(dt.time);
+    if (dt.offset) {
+        int minutes = dt.offset->minutes;
+        if (minutes == 0) {
+            out += 'Z';
+        } else {
+            out += minutes < 0 ? '-' : '+';
+            minutes = std::abs(minutes);
+            append_2digits(out, static_cast<unsigned>(minutes / 60));
+            out += ':';
+            append_2digits(out, static_cast<unsigned>(minutes % 60));
+        }
+    }
+    return out;
+}
+
+// "hex", "oct", "bin" or nullptr for a decimal integer
+inline const char* integer_format_name(toml::value_flags flags) {
+    using vf = toml::value_flags;
+    if ((flags & vf::format_as_hexadecimal) == vf::format_as_hexadecimal) return "hex";
+    if ((flags & vf::format_as_hexadecimal) == vf::format_as_octal) return "oct";
+    if ((flags & vf::format_as_hexadecimal) == vf::format_as_binary) return "bin";
+    return nullptr;
+}
+
+class TomlJsonWriter {
+public:
+    TomlJsonWriter(std::ostream& out, bool tagged, bool pretty,
+                   const ConvertLimits& limits = ConvertLimits())
+        : out_(out), tagged_(tagged), pretty_(pretty), budget_{limits, 0} {}
+
+    void write(const toml::table& tbl) {
+        write_table(tbl, 0);
+        if (pretty_) out_ << '\n';
+    }
+
+private:
+    std::ostream& out_;
+    bool tagged_;
+    bool pretty_;
+    ConvertBudget budget_;
+
+    void newline(int depth) {
+        if (!pretty_) return;
+        out_ << '\n';
+        for (int i = 0; i < depth; ++i) out_ << "  ";
+    }
+
+    void write_string(std::string_view s) {
+        static const char hex[] = "0123456789abcdef";
+        out_ << '"';
+        size_t run = 0;  // start of the current run of unescaped bytes
+        for (size_t i = 0; i < s.size(); ++i) {
+            unsigned char c = static_cast<unsigned char>(s[i]);
+            if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f) continue;
+            out_.write(s.data() + run, static_cast<std::streamsize>(i - run));
+            run = i + 1;
+            switch (c) {
+                case '"':  out_ << "\\\""; break;
+                case '\\': out_ << "\\\\"; break;
+                case '\n': out_ << "\\n"; break;
+                case '\t': out_ << "\\t"; break;
+                case '\r': out_ << "\\r"; break;
+                case '\b': out_ << "\\b"; break;
+                case '\f': out_ << "\\f"; break;
+                default:   out_ << "\\u00" << hex[c >> 4] << hex[c & 15]; break;
+            }
+        }
+        out_.write(s.data() + run, static_cast<std::streamsize>(s.size() - run));
+        out_ << '"';
+    }
+
+    void write_tag(const char* type, const std::string& value, const char* format = nullptr) {
+        out_ << (pretty_ ? "{\"type\": " : "{\"type\":");
+        write_string(type);
+        out_ << (pretty_ ? ", \"value\": " : ",\"value\":");
+        write_string(value);
+        if (format) {
+            out_ << (pretty_ ? ", \"format\": " : ",\"format\":");
+            write_string(format);
+        }
+        out_ << '}';
+    }
+
+    void write_table(const toml::table& tbl, int depth) {
+        budget_.check_depth(static_cast<size_t>(depth) + 1);
+        if (tbl.empty()) {
+            out_ << "{}";
+            return;
+        }
+        out_ << '{';
+        bool first = true;
+        for (const FieldInfo& field : ordered_fields(tbl)) {
+            if (!first) out_ << ',';
+            first = false;
+            newline(depth + 1);
+            write_string(field.key);
+            out_ << (pretty_ ? ": " : ":");
+            write_node(*field.node, depth + 1);
+        }
+        newline(depth);
+        out_ << '}';
+    }
+
+    void write_array(const toml::array& arr, int depth) {
+        budget_.check_depth(static_cast<size_t>(depth) + 1);
+        if (arr.empty()) {
+            out_ << "[]";
+            return;
+        }
+        out_ << '[';
+        for (size_t i = 0; i < arr.size(); ++i) {
+            if (i) out_ << ',';
+            newline(depth + 1);
+            write_node(arr[i], depth + 1);
+        }
+        newline(depth);
+        out_ << ']';
+    }
+
+    void write_node(const toml::node& node, int depth) {
+        switch (node.type()) {
+            case toml::node_type::table:
+                write_table(*node.as_table(), depth);
+                break;
+            case toml::node_type::array:
+                write_array(*node.as_array(), depth);
+                break;
+            case toml::node_type::string:
+                if (tagged_) write_tag("string", node.as_string()->get());
+                else write_string(node.as_string()->get());
+                break;
+            case toml::node_type::integer: {
+                auto* v = node.as_integer();
+                if (tagged_) write_tag("integer", std::to_string(v->get()), integer_format_name(v->flags()));
+                else out_ << v->get();
+                break;
+            }
+            case toml::node_type::floating_point: {
+                double d = node.as_floating_point()->get();
+                if (tagged_) write_tag("float", toml_float_text(d));
+                else if (std::isfinite(d)) out_ << shortest_float(d);
+                else out_ << "null";
+                break;
+            }
+            case toml::node_type::boolean: {
+                const char* text = node.as_boolean()->get() ? "true" : "false";
+                if (tagged_) write_tag("bool", text);
+                else out_ << text;
+                break;
+            }
+            case toml::node_type::date: {
+                std::string text = format_toml_date(node.as_date()->get());
+                if (tagged_) write_tag("date-local", text);
+                else write_string(text);
+                break;
+            }
+            case toml::node_type::time: {
+                std::string text = format_toml_time(node.as_time()->get());
+                if (tagged_) write_tag("time-local", text);
+                else write_string(text);
+                break;
+            }
+            case toml::node_type::date_time: {
+                const toml::date_time& dt = node.as_date_time()->get();
+                std::string text = format_toml_date_time(dt);
+                if (tagged_) write_tag(dt.offset ? "datetime" : "datetime-local", text);
+                else write_string(text);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+};
+
+// Write a parsed TOML document as JSON
+inline void write_toml_as_json(std::ostream& out, const toml::table& tbl, bool tagged, bool pretty,
+                               const ConvertLimits& limits = ConvertLimits()) {
+    TomlJsonWriter(out, tagged, pretty, limits).write(tbl);
+}
+
+// A JSON document read into a TOML table. The ranks refer to the tables by
+// address, so the document cannot be copied or moved; install them with
+// ScopedFieldRanks while the table is written or converted.
+struct JsonTomlDocument {
+    toml::table table;
+    FieldRanks ranks;
+
+    JsonTomlDocument() = default;
+    JsonTomlDocument(const JsonTomlDocument&) = delete;
+    JsonTomlDocument& operator=(const JsonTomlDocument&) = delete;
+};
+
+class JsonTomlReader {
+public:
+    JsonTomlReader(std::string_view text, bool tagged, size_t max_depth = ConvertLimits().max_depth)
+        : text_(text), tagged_(tagged), max_depth_(max_depth) {}
+
+    void parse(JsonTomlDocument& doc) {
+        // Skip a UTF-8 byte order mark
+        if (text_.substr(0, 3) == "\xEF\xBB\xBF") pos_ = 3;
+        skip_space();
+        if (peek() != '{') fail("the top level must be a JSON object");
+        std::vector<std::string> keys;
+        doc.table = parse_object(keys);
+        rank_keys(doc.table, keys);
+        skip_space();
+        if (pos_ < text_.size()) fail("unexpected text after the top-level object");
+        doc.ranks = std::move(ranks_);
+    }
+
+private:
+    std::string_view text_;
+    bool tagged_;
+    size_t max_depth_;   // 0 = no limit
+    size_t depth_ = 0;
+    size_t pos_ = 0;
+    FieldRanks ranks_;
+
+    // Record the key order of an object once its table has its final
+    // address; a table's own nodes do not move when it is moved
+    void rank_keys(const toml::table& tbl, const std::vector<std::string>& keys) {
+        if (keys.size() < 2) return;
+        std::unordered_map<std::string, uint32_t>& ranks = ranks_[&tbl];
+        for (const std::string& key : keys) ranks.emplace(key, static_cast<uint32_t>(ranks.size()));
+    }
+
+    [[noreturn]] void fail(const std::string& msg) const { fail_at(pos_, msg); }
+
+    [[noreturn]] void fail_at(size_t at, const std::string& msg) const {
+        size_t line = 1, column = 1;
+        for (size_t i = 0; i < at && i < text_.size(); ++i) {
+            if (text_[i] == '\n') { ++line; column = 1; }
+            else ++column;
+        }
+        throw JsonParseError(msg, line, column);
+    }
+
+    char peek() const { return pos_ < text_.size() ? text_[pos_] : '\0'; }
+
+    void skip_space() {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r'))
+            ++pos_;
+    }
+
+    void expect(char c) {
+        skip_space();
+        if (peek() != c) fail(std::string("expected '") + c + "'");
+        ++pos_;
+    }
+
+    bool consume_word(const char* word) {
+        size_t n = std::strlen(word);
+        if (text_.compare(pos_, n, word) != 0) return false;
+        pos_ += n;
+        return true;
+    }
+
+    // Objects and arrays are read recursively, so their nesting is limited
+    void enter() {
+        if (max_depth_ && ++depth_ > max_depth_)
+            fail("nested more than " + std::to_string(max_depth_) + " levels deep (see 'MaxDepth')");
+    }
+
+    // The keys of the object are added to keys in the order they appear
+    toml::table parse_object(std::vector<std::string>& keys) {
+        enter();
+        toml::table tbl;
+        ++pos_;  // '{'
+        skip_space();
+        if (peek() == '}') {
+            ++pos_;
+            --depth_;
+            return tbl;
+        }
+        while (true) {
+            skip_space();
+            size_t key_at = pos_;
+            if (peek() != '"') fail("expected a string key");
+            std::string key = parse_string();
+            expect(':');
+            skip_space();
+            if (tbl.contains(key)) fail_at(key_at, "duplicate key '" + key + "'");
+            insert_value(tbl, key);
+            keys.push_back(std::move(key));
+            skip_space();
+            if (peek() == ',') { ++pos_; continue; }
+            if (peek() == '}') { ++pos_; --depth_; return tbl; }
+            fail("expected ',' or '}'");
+        }
+    }
+
+    toml::array parse_array() {
+        enter();
+        toml::array arr;
+        ++pos_;  // '['
+        skip_space();
+        if (peek() == ']') {
+            ++pos_;
+            --depth_;
+            return arr;
+        }
+        while (true) {
+            skip_space();
+            push_value(arr);
+            skip_space();
+            if (peek() == ',') { ++pos_; continue; }
+            if (peek() == ']') { ++pos_; --depth_; return arr; }
+            fail("expected ',' or ']'");
+        }
+    }
+
+    // The value at pos_ as a node of its own type, added to a table or
+    // array. add returns the node it added.
+    template <typename Add>
+    void parse_value(Add&& add) {
+        char c = peek();
+        if (c == '{') {
+            size_t at = pos_;
+            std::vector<std::string> keys;
+            toml::table tbl = parse_object(keys);
+            if (tagged_ && is_tagged_value(tbl)) decode_tagged(tbl, at, add);
+            else rank_keys(*add(std::move(tbl))->as_table(), keys);
+        } else if (c == '[') {
+            add(parse_array());
+        } else if (c == '"') {
+            add(parse_string());
+        } else if (consume_word("true")) {
+            add(true);
+        } else if (consume_word("false")) {
+            add(false);
+        } else if (text_.compare(pos_, 4, "null") == 0) {
+            fail("null has no TOML equivalent");
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            parse_number(add);
+        } else {
+            fail("expected a JSON value");
+        }
+    }
+
+    void insert_value(toml::table& tbl, const std::string& key) {
+        parse_value([&](auto&& v) {
+            tbl.insert(key, std::forward<decltype(v)>(v));
+            return tbl.get(key);
+        });
+    }
+
+    void push_value(toml::array& arr) {
+        parse_value([&](auto&& v) {
+            arr.push_back(std::forward<decltype(v)>(v));
+            return arr.get(arr.size() - 1);
+        });
+    }
+
+    template <typename Add>
+    void parse_number(Add&& add) {
+        size_t start = pos_;
+        bool is_float = false;
+        if (peek() == '-') ++pos_;
+        if (peek() == '0') {
+            ++pos_;
+        } else if (peek() >= '1' && peek() <= '9') {
+            while (std::isdigit(static_cast<unsigned char>(peek()))) ++pos_;
+        } else {
+            fail("invalid number");
+        }
+        if (peek() == '.') {
+            is_float = true;
+            ++pos_;
+            if (!std::isdigit(static_cast<unsigned char>(peek()))) fail("invalid number");
+            while (std::isdigit(static_cast<unsigned char>(peek()))) ++pos_;
+        }
+        if (peek() == 'e' || peek() == 'E') {
+            is_float = true;
+            ++pos_;
+            if (peek() == '+' || peek() == '-') ++pos_;
+            if (!std::isdigit(static_cast<unsigned char>(peek()))) fail("invalid number");
+            while (std::isdigit(static_cast<unsigned char>(peek()))) ++pos_;
+        }
+
+        std::string number(text_.substr(start, pos_ - start));
+        if (!is_float) {
+            errno = 0;
+            long long n = std::strtoll(number.c_str(), nullptr, 10);
+            if (errno != ERANGE) {
+                add(static_cast<int64_t>(n));
+                return;
+            }
+        }
+        add(std::strtod(number.c_str(), nullptr));
+    }
+
+    unsigned parse_hex4() {
+        unsigned cp = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = peek();
+            cp <<= 4;
+            if (c >= '0' && c <= '9') cp |= unsigned(c - '0');
+            else if (c >= 'a' && c <= 'f') cp |= unsigned(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') cp |= unsigned(c - 'A' + 10);
+            else fail("invalid \\u escape");
+            ++pos_;
+        }
+        return cp;
+    }
+
+    static void append_utf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    std::string parse_string() {
+        std::string out;
+        ++pos_;  // opening quote
+        while (true) {
+            size_t run = pos_;
+            while (pos_ < text_.size() && text_[pos_] != '"' && text_[pos_] != '\\' &&
+                   static_cast<unsigned char>(text_[pos_]) >= 0x20)
+                ++pos_;
+            out.append(text_.data() + run, pos_ - run);
+            if (pos_ >= text_.size()) fail("unterminated string");
+            char c = text_[pos_];
+            if (c == '"') {
+                ++pos_;
+                return out;
+            }
+            if (c != '\\') fail("control character in string");
+            ++pos_;
+            char e = peek();
+            ++pos_;
+            switch (e) {
+                case '"':  out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/'; break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u': {
+                    uint32_t cp = parse_hex4();
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        // Surrogate pair
+                        if (!consume_word("\\u")) fail("unpaired surrogate in \\u escape");
+                        uint32_t low = parse_hex4();
+                        if (low < 0xDC00 || low > 0xDFFF) fail("unpaired surrogate in \\u escape");
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                        fail("unpaired surrogate in \\u escape");
+                    }
+                    append_utf8(out, cp);
+                    break;
+                }
+                default:
+                    pos_ -= 2;
+                    fail("invalid escape sequence");
+            }
+        }
+    }
+
+    // {"type": <known type>, "value": <string>[, "format": <string>]}
+    static bool is_tagged_value(const toml::table& tbl) {
+        const toml::node* type = tbl.get("type");
+        const toml::node* value = tbl.get("value");
+        if (!type || !value || !type->is_string() || !value->is_string()) return false;
+        if (tbl.size() == 3 && !(tbl.get("format") && tbl.get("format")->is_string())) return false;
+        if (tbl.size() > 3) return false;
+        static const char* const types[] = {"string", "integer", "float", "bool", "datetime",
+                                            "datetime-local", "date-local", "time-local"};
+        for (const char* t : types)
+            if (type->as_string()->get() == t) return true;
+        return false;
+    }
+
+    template <typename Add>
+    void decode_tagged(const toml::table& tbl, size_t at, Add&& add) {
+        const std::string& type = tbl.get("type")->as_string()->get();
+        const std::string& text = tbl.get("value")->as_string()->get();
+        try {
+            if (type == "string") {
+                add(text);
+            } else if (type == "integer") {
+                toml::value<int64_t> v(parse_integer_text(text));
+                if (const toml::node* format = tbl.get("format")) {
+                    const std::string& f = format->as_string()->get();
+                    if (f == "hex") v.flags(toml::value_flags::format_as_hexadecimal);
+                    else if (f == "oct") v.flags(toml::value_flags::format_as_octal);
+                    else if (f == "bin") v.flags(toml::value_flags::format_as_binary);
+                    else throw std::invalid_argument("unknown integer format '" + f + "'");
+                }
+                add(std::move(v));
+            } else if (type == "float") {
+                add(parse_float_text(text));
+            } else if (type == "bool") {
+                if (text != "true" && text != "false") throw std::invalid_argument("invalid bool");
+                add(text == "true");
+            } else if (type == "date-local") {
+                size_t p = 0;
+                toml::date d = parse_date_text(text, p);
+                if (p != text.size()) throw std::invalid_argument("invalid date");
+                add(d);
+            } else if (type == "time-local") {
+                size_t p = 0;
+                toml::time t = parse_time_text(text, p);
+                if (p != text.size()) throw std::invalid_argument("invalid time");
+                add(t);
+            } else {
+                add(parse_date_time_text(text, type == "datetime"));
+            }
+        }
+        catch (const std::invalid_argument& e) {
+            fail_at(at, "tagged " + type + " value \"" + text + "\": " + e.what());
+        }
+    }
+
+    static int64_t parse_integer_text(const std::string& text) {
+        errno = 0;
+        char* end = nullptr;
+        long long n = std::strtoll(text.c_str(), &end, 10);
+        if (text.empty() || *end != '\0' || errno == ERANGE) throw std::invalid_argument("invalid integer");
+        return static_cast<int64_t>(n);
+    }
+
+    static double parse_float_text(const std::string& text) {
+        std::string t = text;
+        bool negative = !t.empty() && t[0] == '-';
+        if (!t.empty() && (t[0] == '+' || t[0] == '-')) t.erase(0, 1);
+        if (t == "inf") return negative ? -INFINITY : INFINITY;
+        if (t == "nan") return NAN;
+        char* end = nullptr;
+        double d = std::strtod(text.c_str(), &end);
+        if (text.empty() || *end != '\0') throw std::invalid_argument("invalid float");
+        return d;
+    }
+
+    static unsigned digits(const std::string& s, size_t& p, size_t n) {
+        unsigned v = 0;
+        for (size_t i = 0; i < n; ++i, ++p) {
+            if (p >= s.size() || !std::isdigit(static_cast<unsigned char>(s[p])))
+                throw std::invalid_argument("invalid date or time");
+            v = v * 10 + unsigned(s[p] - '0');
+        }
+        return v;
+    }
+
+    static void literal(const std::string& s, size_t& p, char c) {
+        if (p >= s.size() || s[p] != c) throw std::invalid_argument("invalid date or time");
+        ++p;
+    }
+
+    static toml::date parse_date_text(const std::string& s, size_t& p) {
+        unsigned y = digits(s, p, 4);
+        literal(s, p, '-');
+        unsigned m = digits(s, p, 2);
+        literal(s, p, '-');
+        unsigned d = digits(s, p, 2);
+        if (m < 1 || m > 12 || d < 1 || d > 31) throw std::invalid_argument("invalid date");
+        return toml::date{static_cast<int>(y), m, d};
+    }
+
+    static toml::time parse_time_text(const std::string& s, size_t& p) {
+        unsigned h = digits(s, p, 2);
+        literal(s, p, ':');
+        unsigned mi = digits(s, p, 2);
+        literal(s, p, ':');
+        unsigned sec = digits(s, p, 2);
+        unsigned ns = 0;
+        if (p < s.size() && s[p] == '.') {
+            ++p;
+            size_t start = p;
+            unsigned scale = 100000000;
+            while (p < s.size() && std::isdigit(static_cast<unsigned char>(s[p]))) {
+                ns += unsigned(s[p] - '0') * scale;
+                scale /= 10;
+                ++p;
+            }
+            if (p == start) throw std::invalid_argument("invalid time");
+        }
+        if (h > 23 || mi > 59 || sec > 60) throw std::invalid_argument("invalid time");
+        return toml::time{h, mi, sec, ns};
+    }
+
+    static toml::date_time parse_date_time_text(const std::string& s, bool with_offset) {
+        size_t p = 0;
+        toml::date d = parse_date_text(s, p);
+        if (p >= s.size() || (s[p] != 'T' && s[p] != 't' && s[p] != ' '))
+            throw std::invalid_argument("invalid date-time");
+        ++p;
+        toml::time t = parse_time_text(s, p);
+        if (!with_offset) {
+            if (p != s.size()) throw std::invalid_argument("local date-time has an offset");
+            return toml::date_time{d, t};
+        }
+        if (p < s.size() && (s[p] == 'Z' || s[p] == 'z') && p + 1 == s.size())
+            return toml::date_time{d, t, toml::time_offset{0, 0}};
+        if (p >= s.size() || (s[p] != '+' && s[p] != '-'))
+            throw std::invalid_argument("date-time has no offset");
+        int sign = s[p] == '-' ? -1 : 1;
+        ++p;
+        int oh = static_cast<int>(digits(s, p, 2));
+        literal(s, p, ':');
+        int om = static_cast<int>(digits(s, p, 2));
+        if (p != s.size()) throw std::invalid_argument("invalid date-time");
+        return toml::date_time{d, t, toml::time_offset{sign * oh, sign * om}};
+    }
+};
+
+// Read a JSON object into a TOML table; throws JsonParseError
+inline void read_json_as_toml(std::string_view text, bool tagged, JsonTomlDocument& doc,
+                              const ConvertLimits& limits = ConvertLimits()) {
+    JsonTomlReader(text, tagged, limits.max_depth).parse(doc);
+}
+
+class TomlTextWriter {
+public:
+    explicit TomlTextWriter(std::ostream& out) : out_(out) {}
+
+    void write(const toml::table& tbl) {
+        std::string path;
+        write_section(tbl, path);
+    }
+
+private:
+    std::ostream& out_;
+
+    static bool is_table_array(const toml::node& node) {
+        const toml::array* arr = node.as_array();
+        if (!arr || arr->empty()) return false;
+        for (const toml::node& e : *arr)
+            if (!e.is_table()) return false;
+        return true;
+    }
+
+    static bool holds_table(const toml::node& node) {
+        if (node.is_table()) return true;
+        if (const toml::array* arr = node.as_array()) {
+            for (const toml::node& e : *arr)
+                if (holds_table(e)) return true;
+        }
+        return false;
+    }
+
+    // Nesting is bounded by the depth limit the table was read with
+    void write_section(const toml::table& tbl, std::string& path) {
+        std::vector<FieldInfo> fields = ordered_fields(tbl);
+        for (const FieldInfo& f : fields) {
+            if (f.node->is_table() || is_table_array(*f.node)) continue;
+            out_ << toml_key_segment(f.key) << " = ";
+            write_value(*f.node);
+            out_ << "\n";
+        }
+
+        size_t prefix_length = path.size();
+        for (int pass = 0; pass < 2; ++pass) {
+            for (const FieldInfo& f : fields) {
+                if (pass == 0 ? !f.node->is_table() : !is_table_array(*f.node)) continue;
+                if (prefix_length > 0) path += '.';
+                path += toml_key_segment(f.key);
+                if (pass == 0) {
+                    out_ << "\n[" << path << "]\n";
+                    write_section(*f.node->as_table(), path);
+                } else {
+                    for (const toml::node& e : *f.node->as_array()) {
+                        out_ << "\n[[" << path << "]]\n";
+                        write_section(*e.as_table(), path);
+                    }
+                }
+                path.resize(prefix_length);
+            }
+        }
+    }
+
+    void write_value(const toml::node& node) {
+        if (const toml::table* tbl = node.as_table()) {
+            if (tbl->empty()) {
+                out_ << "{}";
+                return;
+            }
+            out_ << "{ ";
+            bool first = true;
+            for (const FieldInfo& f : ordered_fields(*tbl)) {
+                if (!first) out_ << ", ";
+                first = false;
+                out_ << toml_key_segment(f.key) << " = ";
+                write_value(*f.node);
+            }
+            out_ << " }";
+        } else if (holds_table(node)) {
+            out_ << "[ ";
+            const toml::array& arr = *node.as_array();
+            for (size_t i = 0; i < arr.size(); ++i) {
+                if (i) out_ << ", ";
+                write_value(arr[i]);
+            }
+            out_ << " ]";
+        } else {
+            toml::table tmp;
+            with_node_type(node, [&](const auto& v) { tmp.insert("__tmp__", v); });
+            stream_table_value(out_, tmp);
+        }
+    }
+};
+
+// Write a table read by read_json_as_toml as TOML text, keys in JSON order
+inline void write_toml_text(std::ostream& out, const JsonTomlDocument& doc) {
+    ScopedFieldRanks ranks(&doc.ranks);
+    TomlTextWriter(out).write(doc.table);
+}
+
+#endif // TOML_JSON_HPP
@@ -0,0 +1,88 @@
+/*
+ * toml_limits.hpp
+ * Depth and size limits for converting documents between toml++ trees and
+ * MATLAB values, in both directions.
+ *
+ * The conversions (toml_convert.hpp, toml_convert_api.hpp and
+ * toml_serialize.hpp) and the flattening of modification structs
+ * (toml_update.hpp) walk nested tables and structs with an explicit work
+ * stack rather than recursion, so their depth is not bounded by the MATLAB
+ * thread's stack. toml++ itself still builds, copies and destroys its trees
+ * recursively, as do toml_diff.hpp and toml_merge.hpp; they rely on how
+ * deep a parsed document can get. The limits turn documents that are too
+ * deep or too large into a ConvertLimitError instead of an unbounded
+ * conversion:
+ *   max_depth - nesting of tables, arrays and structs (default 1000)
+ *   max_nodes - values converted in total, array elements included
+ *               (default 0 = no limit)
+ *
+ * Values are counted the same way in both directions, so a document that
+ * can be read under a limit can be written under it again: every table
+ * (the root included), every array and every element of an array is one
+ * value. A numeric or logical MATLAB array of n > 1 elements is thus
+ * n + 1 values and a scalar one; a struct array written as [[...]] is the
+ * array plus its elements.
+ *
+ * Usage:
+ *   ScopedConvertLimits limits({max_depth, max_nodes});
+ *   plhs[0] = convert_table(tbl);   // throws ConvertLimitError
+ */
+
+#ifndef TOML_LIMITS_HPP
+#define TOML_LIMITS_HPP
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+struct ConvertLimits {
+    size_t max_depth = 1000;
+    size_t max_nodes = 0;    // 0 = no limit
+};
+
+class ConvertLimitError : public std::runtime_error {
+public:
+    explicit ConvertLimitError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+// Limits of the current conversion and the values it has converted so far
+struct ConvertBudget {
+    ConvertLimits limits;
+    size_t nodes = 0;
+
+    void check_depth(size_t depth) const {
+        if (limits.max_depth && depth > limits.max_depth)
+            throw ConvertLimitError("Document is nested more than " + std::to_string(limits.max_depth) +
+                                    " levels deep (see 'MaxDepth')");
+    }
+
+    void count(size_t n = 1) {
+        nodes += n;
+        if (limits.max_nodes && nodes > limits.max_nodes)
+            throw ConvertLimitError("Document has more than " + std::to_string(limits.max_nodes) +
+                                    " values (see 'MaxNodes')");
+    }
+};
+
+inline ConvertBudget& current_convert_budget() {
+    static ConvertBudget budget;
+    return budget;
+}
+
+// Sets the limits, and starts a new count of values, for the lifetime of
+// the object
+class ScopedConvertLimits {
+public:
+    explicit ScopedConvertLimits(const ConvertLimits& limits)
+        : previous_(current_convert_budget()) {
+        current_convert_budget() = ConvertBudget{limits, 0};
+    }
+    ~ScopedConvertLimits() { current_convert_budget() = previous_; }
+    ScopedConvertLimits(const ScopedConvertLimits&) = delete;
+    ScopedConvertLimits& operator=(const ScopedConvertLimits&) = delete;
+
+private:
+    ConvertBudget previous_;
+};
+
+#endif // TOML_LIMITS_HPP
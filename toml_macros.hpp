@@ -0,0 +1,186 @@
+/*
+ * toml_macros.hpp
+ * Expansion of ${NAME} macros in string values while a parsed TOML
+ * document is converted to MATLAB values.
+ *
+ * A name is looked up, in this order, in the macro dictionary (a struct of
+ * char values), in the environment (if enabled) and as a dotted key path
+ * of a string, integer or float value in the same document:
+ *
+ *   [macros]
+ *   DATA_ROOT = "/srv/data"
+ *
+ *   [paths]
+ *   raw = "${macros.DATA_ROOT}/raw"
+ *   cache = "${paths.raw}/cache"
+ *
+ * Macro values are expanded themselves, once, the first time they are
+ * used; a macro that refers back to itself is an error. Tokens with an
+ * unknown name are kept as they are, like expandPath.m does.
+ *
+ * Strings are scanned once, jumping between '$' characters with memchr;
+ * strings without a '$' never reach the expander (see toml_convert.hpp).
+ * Nothing here uses the MEX API, so both the C and the C++ API builds
+ * share it; macros_from_mx() in toml_mex_options.hpp reads the C API option.
+ */
+
+#ifndef TOML_MACROS_HPP
+#define TOML_MACROS_HPP
+
+#include <toml++/toml.h>
+#include "toml_numbers.hpp"
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+
+// Rewrites string values that contain a '$' during conversion
+class StringExpander {
+public:
+    virtual ~StringExpander() = default;
+    virtual std::string expand(const std::string& text) = 0;
+};
+
+inline StringExpander*& current_string_expander() {
+    static StringExpander* expander = nullptr;
+    return expander;
+}
+
+// Installs an expander for the lifetime of the object
+class ScopedStringExpander {
+public:
+    explicit ScopedStringExpander(StringExpander* expander)
+        : previous_(current_string_expander()) {
+        current_string_expander() = expander;
+    }
+    ~ScopedStringExpander() { current_string_expander() = previous_; }
+    ScopedStringExpander(const ScopedStringExpander&) = delete;
+    ScopedStringExpander& operator=(const ScopedStringExpander&) = delete;
+
+private:
+    StringExpander* previous_;
+};
+
+// A macro that refers back to itself
+class MacroError : public std::runtime_error {
+public:
+    explicit MacroError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+class MacroExpander : public StringExpander {
+public:
+    void define(const std::string& name, std::string value) {
+        macros_[name] = Macro{std::move(value), State::Raw};
+    }
+    void use_environment(bool enable) { environment_ = enable; }
+    void set_document(const toml::table* doc) { doc_ = doc; }
+
+    std::string expand(const std::string& text) override {
+        std::string out;
+        expand_into(text, out);
+        return out;
+    }
+
+private:
+    enum class State { Raw, Expanding, Done };
+    struct Macro {
+        std::string value;
+        State state;
+    };
+
+    void expand_into(std::string_view text, std::string& out);
+    const std::string* resolve(const std::string& name);
+    bool lookup_document(const std::string& name, std::string& value) const;
+
+    std::unordered_map<std::string, Macro> macros_;   // also caches lookups
+    bool environment_ = false;
+    const toml::table* doc_ = nullptr;
+};
+
+inline void MacroExpander::expand_into(std::string_view text, std::string& out) {
+    out.reserve(out.size() + text.size());
+    size_t pos = 0;
+    while (pos < text.size()) {
+        const void* hit = std::memchr(text.data() + pos, '$', text.size() - pos);
+        if (!hit) break;
+        size_t dollar = static_cast<const char*>(hit) - text.data();
+        out.append(text.data() + pos, dollar - pos);
+        pos = dollar + 1;
+
+        if (pos < text.size() && text[pos] == '{') {
+            size_t close = text.find('}', pos + 1);
+            if (close != std::string_view::npos) {
+                std::string name(text.substr(pos + 1, close - pos - 1));
+                if (const std::string* value = resolve(name)) {
+                    out += *value;
+                    pos = close + 1;
+                    continue;
+                }
+            }
+        }
+        out += '$';
+    }
+    if (pos < text.size()) out.append(text.data() + pos, text.size() - pos);
+}
+
+// Expanded value of a macro, or nullptr if the name is unknown
+inline const std::string* MacroExpander::resolve(const std::string& name) {
+    auto it = macros_.find(name);
+    if (it == macros_.end()) {
+        std::string value;
+        const char* env = environment_ ? std::getenv(name.c_str()) : nullptr;
+        if (env) {
+            value = env;
+        } else if (!lookup_document(name, value)) {
+            return nullptr;
+        }
+        it = macros_.emplace(name, Macro{std::move(value), State::Raw}).first;
+    }
+
+    Macro& macro = it->second;
+    if (macro.state == State::Expanding)
+        throw MacroError("Macro '${" + name + "}' refers to itself");
+    if (macro.state == State::Raw) {
+        macro.state = State::Expanding;
+        // References to map elements stay valid while the map grows
+        if (macro.value.find('$') != std::string::npos) {
+            std::string expanded;
+            expand_into(macro.value, expanded);
+            macro.value = std::move(expanded);
+        }
+        macro.state = State::Done;
+    }
+    return &macro.value;
+}
+
+inline bool MacroExpander::lookup_document(const std::string& name, std::string& value) const {
+    if (!doc_) return false;
+    const toml::table* tbl = doc_;
+    const toml::node* node = nullptr;
+    size_t start = 0;
+    while (true) {
+        size_t dot = name.find('.', start);
+        std::string key = name.substr(start, dot == std::string::npos ? std::string::npos : dot - start);
+        node = tbl->get(key);
+        if (!node || dot == std::string::npos) break;
+        tbl = node->as_table();
+        if (!tbl) return false;
+        start = dot + 1;
+    }
+    if (!node) return false;
+
+    if (auto s = node->as_string()) {
+        value = s->get();
+    } else if (auto i = node->as_integer()) {
+        value = std::to_string(i->get());
+    } else if (auto f = node->as_floating_point()) {
+        value = toml_float_text(f->get());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#endif // TOML_MACROS_HPP
@@ -0,0 +1,335 @@
+/*
+ * toml_mapped_file.hpp
+ * Read-only memory mapping of a whole file for the MEX helpers.
+ *
+ * MappedFile maps an existing file into memory (mmap on POSIX,
+ * MapViewOfFile on Windows) so it can be compared or scanned without
+ * copying it into a buffer first. A missing file is not an error: the
+ * mapping is simply invalid (see valid()). Empty files are valid with
+ * size() == 0 and data() == nullptr.
+ *
+ * A MappedFile opened for patching also keeps its descriptor writable, so
+ * that bytes can be written back at offsets found in the mapping through
+ * the same open file (write_at), after checking that the file has not been
+ * replaced (still_at) or resized (same_size) in the meantime.
+ *
+ * MappedWindow keeps a file open and maps one range of it at a time, for
+ * files that are read front to back and may be larger than what should be
+ * mapped at once (toml_records.cpp).
+ */
+
+#ifndef TOML_MAPPED_FILE_HPP
+#define TOML_MAPPED_FILE_HPP
+
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    // Map path read-only. Returns an invalid mapping if the file does not
+    // exist; throws std::runtime_error on any other failure.
+    explicit MappedFile(const std::string& path) { open(path, false); }
+
+    // With patchable, the file is opened for reading and writing if it is
+    // writable (see writable()), and read-only otherwise
+    MappedFile(const std::string& path, bool patchable) { open(path, patchable); }
+
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool valid() const { return valid_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool writable() const { return writable_; }
+
+    // Whether path still names the mapped file, i.e. it has not been
+    // removed or replaced (e.g. by an atomic rewrite) since it was opened
+    bool still_at(const std::string& path) const {
+        if (!valid_) return false;
+#ifdef _WIN32
+        // The handle is not shared for deletion, so the file cannot have
+        // been replaced while it is open
+        (void)path;
+        return true;
+#else
+        struct stat open_st, path_st;
+        if (fstat(fd_, &open_st) != 0 || ::stat(path.c_str(), &path_st) != 0) return false;
+        return open_st.st_dev == path_st.st_dev && open_st.st_ino == path_st.st_ino;
+#endif
+    }
+
+    // Whether the open file still has the mapped size
+    bool same_size() const {
+        if (!valid_) return false;
+#ifdef _WIN32
+        LARGE_INTEGER sz;
+        return GetFileSizeEx(file_, &sz) && static_cast<size_t>(sz.QuadPart) == size_;
+#else
+        struct stat st;
+        return fstat(fd_, &st) == 0 && static_cast<size_t>(st.st_size) == size_;
+#endif
+    }
+
+    // Write size bytes at offset through the open descriptor (writable()
+    // mappings only); the mapping sees the new bytes
+    void write_at(uint64_t offset, const char* data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            OVERLAPPED at = {};
+            at.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFu);
+            at.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD chunk = size > 0x40000000u ? 0x40000000u : static_cast<DWORD>(size);
+            DWORD written = 0;
+            if (!WriteFile(file_, data, chunk, &written, &at))
+                throw std::runtime_error("Write failed (error " + std::to_string(GetLastError()) + ")");
+#else
+            ssize_t written = ::pwrite(fd_, data, size, static_cast<off_t>(offset));
+            if (written < 0 && errno == EINTR) continue;
+            if (written < 0) throw std::runtime_error(std::string("Write failed: ") + std::strerror(errno));
+#endif
+            data += written;
+            size -= static_cast<size_t>(written);
+            offset += static_cast<uint64_t>(written);
+        }
+    }
+
+    void sync() {
+#ifdef _WIN32
+        if (!FlushFileBuffers(file_))
+            throw std::runtime_error("fsync failed (error " + std::to_string(GetLastError()) + ")");
+#else
+        if (::fsync(fd_) != 0) throw std::runtime_error(std::string("fsync failed: ") + std::strerror(errno));
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap(const_cast<char*>(data_), size_);
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        valid_ = false;
+        writable_ = false;
+    }
+
+private:
+    void open(const std::string& path, bool patchable) {
+#ifdef _WIN32
+        if (patchable) {
+            file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            writable_ = file_ != INVALID_HANDLE_VALUE;
+        }
+        if (file_ == INVALID_HANDLE_VALUE)
+            file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            DWORD err = GetLastError();
+            if (err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND) return;
+            throw std::runtime_error("Cannot open " + path + " (error " + std::to_string(err) + ")");
+        }
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(file_, &sz)) {
+            close();
+            throw std::runtime_error("Cannot get size of " + path);
+        }
+        size_ = static_cast<size_t>(sz.QuadPart);
+        if (size_ > 0) {
+            mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data_ = mapping_ ? static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0))
+                             : nullptr;
+            if (!data_) {
+                close();
+                throw std::runtime_error("Cannot map " + path);
+            }
+        }
+#else
+        if (patchable) {
+            fd_ = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+            writable_ = fd_ >= 0;
+        }
+        if (fd_ < 0) fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) {
+            if (errno == ENOENT) return;
+            throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            close();
+            throw std::runtime_error("Cannot stat " + path + ": " + std::strerror(errno));
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+            if (p == MAP_FAILED) {
+                size_ = 0;
+                close();
+                throw std::runtime_error("Cannot map " + path + ": " + std::strerror(errno));
+            }
+            data_ = static_cast<const char*>(p);
+        }
+#endif
+        valid_ = true;
+    }
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool valid_ = false;
+    bool writable_ = false;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+class MappedWindow {
+public:
+    MappedWindow() = default;
+
+    // Open path read-only; throws std::runtime_error if it cannot be opened
+    explicit MappedWindow(const std::string& path) : path_(path) { open(); }
+
+    ~MappedWindow() { close(); }
+
+    MappedWindow(const MappedWindow&) = delete;
+    MappedWindow& operator=(const MappedWindow&) = delete;
+
+    uint64_t file_size() const { return file_size_; }
+
+    // Map [offset, offset + length) (clipped to the file) and return a
+    // pointer to the byte at offset. The previous range is unmapped.
+    const char* map(uint64_t offset, size_t length) {
+        unmap();
+        if (offset >= file_size_) return nullptr;
+        if (length > file_size_ - offset) length = static_cast<size_t>(file_size_ - offset);
+        uint64_t aligned = offset - offset % granularity();
+        size_t skip = static_cast<size_t>(offset - aligned);
+        view_size_ = length + skip;
+#ifdef _WIN32
+        view_ = MapViewOfFile(mapping_, FILE_MAP_READ, static_cast<DWORD>(aligned >> 32),
+                              static_cast<DWORD>(aligned & 0xFFFFFFFFu), view_size_);
+        if (!view_) throw std::runtime_error("Cannot map " + path_);
+#else
+        void* p = mmap(nullptr, view_size_, PROT_READ, MAP_SHARED, fd_, static_cast<off_t>(aligned));
+        if (p == MAP_FAILED) throw std::runtime_error("Cannot map " + path_ + ": " + std::strerror(errno));
+        view_ = p;
+#ifdef MADV_SEQUENTIAL
+        madvise(view_, view_size_, MADV_SEQUENTIAL);
+#endif
+#endif
+        return static_cast<const char*>(view_) + skip;
+    }
+
+    void unmap() {
+        if (!view_) return;
+#ifdef _WIN32
+        UnmapViewOfFile(view_);
+#else
+        munmap(view_, view_size_);
+#endif
+        view_ = nullptr;
+        view_size_ = 0;
+    }
+
+    void close() {
+        unmap();
+#ifdef _WIN32
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+#endif
+        file_size_ = 0;
+    }
+
+private:
+    void open() {
+#ifdef _WIN32
+        file_ = CreateFileA(path_.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Cannot open " + path_ + " (error " + std::to_string(GetLastError()) + ")");
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(file_, &sz)) {
+            close();
+            throw std::runtime_error("Cannot get size of " + path_);
+        }
+        file_size_ = static_cast<uint64_t>(sz.QuadPart);
+        if (file_size_ > 0) {
+            mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping_) {
+                close();
+                throw std::runtime_error("Cannot map " + path_);
+            }
+        }
+#else
+        fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) throw std::runtime_error("Cannot open " + path_ + ": " + std::strerror(errno));
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            close();
+            throw std::runtime_error("Cannot stat " + path_ + ": " + std::strerror(errno));
+        }
+        file_size_ = static_cast<uint64_t>(st.st_size);
+#endif
+    }
+
+    // Mapping offsets must be multiples of this
+    static uint64_t granularity() {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwAllocationGranularity;
+#else
+        return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    std::string path_;
+    uint64_t file_size_ = 0;
+    void* view_ = nullptr;
+    size_t view_size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+#endif // TOML_MAPPED_FILE_HPP
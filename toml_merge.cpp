@@ -0,0 +1,199 @@
+/*
+ * toml_merge.cpp
+ * Merge a base TOML document with any number of overlays and return the
+ * result as a MATLAB struct.
+ *
+ * The layers are parsed (on worker threads with 'Parallel') and merged as
+ * toml++ trees (see toml_merge.hpp); only the merged tree is converted to
+ * MATLAB values.
+ *
+ * Compile with:
+ *   mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_merge.cpp
+ *
+ * Usage in MATLAB:
+ *   config = toml_merge({'base.toml', 'site.toml', 'host.toml'});
+ *   [config, sources] = toml_merge(files, 'Parallel', true);
+ *   config = toml_merge(files, 'Rules', {'plugins', 'append'; 'logging', 'replace'});
+ *   config = toml_merge({base_text, overlay_text}, 'Source', 'string');
+ *
+ * sources is an Nx1 struct array with one element per value of the result
+ * and the fields path (dotted key path) and layer (1-based index of the
+ * layer that set the value). A result nested deeper than ConvertLimits
+ * allows is a "toml_merge:limitExceeded" error (see toml_limits.hpp).
+ *
+ * Options:
+ *   'Rules'    - Nx2 cell array of {path, rule} pairs, where rule is
+ *                'merge' (tables, the default), 'replace' (the overlay's
+ *                value wins, the default for everything else) or 'append'
+ *                (arrays are concatenated)
+ *   'Source'   - 'file' (default): the layers are file names,
+ *                'string': the layers are TOML text
+ *   'Parallel' - Parse the layers on worker threads (default false)
+ *   'Threads'  - Number of threads with 'Parallel' (0 = one per core)
+ */
+
+#include "mex.h"
+#include "toml_merge.hpp"
+#include "toml_mex_options.hpp"
+#include "toml_thread_pool.hpp"
+#include <string>
+#include <vector>
+#include <exception>
+#include <stdexcept>
+
+// A layer that could not be parsed; the message names the layer
+class LayerParseError : public std::runtime_error {
+public:
+    explicit LayerParseError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+struct MergeOptions {
+    bool from_string = false;
+    bool parallel = false;
+    unsigned threads = 0;
+    std::vector<std::pair<std::string, MergeRule>> rules;
+};
+
+static MergeRule parse_rule(const std::string& name) {
+    if (option_is(name, "merge")) return MergeRule::Merge;
+    if (option_is(name, "replace")) return MergeRule::Replace;
+    if (option_is(name, "append")) return MergeRule::Append;
+    option_error("toml_merge", "Unknown merge rule '" + name + "' (use 'merge', 'replace' or 'append')");
+    return MergeRule::Default;
+}
+
+// Parse trailing 'Name', value option pairs
+static MergeOptions parse_options(int nrhs, const mxArray* prhs[], int first) {
+    MergeOptions opts;
+    check_option_pairs(nrhs, first, "toml_merge");
+    for (int i = first; i < nrhs; i += 2) {
+        std::string opt = option_name(prhs[i], "toml_merge");
+        const mxArray* v = prhs[i + 1];
+
+        if (option_is(opt, "Rules")) {
+            if (!mxIsCell(v) || (mxGetNumberOfElements(v) > 0 && mxGetN(v) != 2))
+                option_error("toml_merge", "Value of option 'Rules' must be an Nx2 cell array");
+            size_t rows = mxGetM(v);
+            for (size_t r = 0; r < rows && mxGetNumberOfElements(v) > 0; ++r) {
+                const mxArray* path = mxGetCell(v, r);
+                const mxArray* rule = mxGetCell(v, r + rows);
+                if (!path || !rule || !mxIsChar(path) || !mxIsChar(rule))
+                    option_error("toml_merge", "Rules must be pairs of char arrays");
+                opts.rules.emplace_back(mx_to_std_string(path), parse_rule(mx_to_std_string(rule)));
+            }
+        } else if (option_is(opt, "Source")) {
+            std::string source = option_string(v, opt, "toml_merge");
+            if (option_is(source, "string"))
+                opts.from_string = true;
+            else if (option_is(source, "file"))
+                opts.from_string = false;
+            else
+                option_error("toml_merge", "Value of option 'Source' must be 'file' or 'string'");
+        } else if (option_is(opt, "Parallel")) {
+            opts.parallel = option_logical(v, opt, "toml_merge");
+        } else if (option_is(opt, "Threads")) {
+            double n = option_scalar(v, opt, "toml_merge");
+            opts.threads = n > 0 ? static_cast<unsigned>(n) : 0;
+        } else {
+            mexErrMsgIdAndTxt("toml_merge:invalidArgs", "Unknown option '%s'", opt.c_str());
+        }
+    }
+    return opts;
+}
+
+// Parse every layer, using worker threads if requested. The first failure
+// (in layer order) is rethrown after all threads are done.
+static std::vector<toml::table> parse_layers(const std::vector<std::string>& inputs,
+                                             const MergeOptions& opts) {
+    std::vector<toml::table> layers(inputs.size());
+    std::vector<std::exception_ptr> errors(inputs.size());
+
+    unsigned num_threads = opts.parallel ? opts.threads : 1;
+    toml_parallel_for(inputs.size(), num_threads, [&](size_t i) {
+        try {
+            layers[i] = opts.from_string ? toml::parse(inputs[i]) : toml::parse_file(inputs[i]);
+        }
+        catch (...) {
+            errors[i] = std::current_exception();
+        }
+    });
+
+    for (size_t i = 0; i < errors.size(); ++i) {
+        if (!errors[i]) continue;
+        try {
+            std::rethrow_exception(errors[i]);
+        }
+        catch (const toml::parse_error& e) {
+            throw LayerParseError("Layer " + std::to_string(i + 1) + ": " + e.what());
+        }
+    }
+    return layers;
+}
+
+// MEX entry point
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs < 1)
+        mexErrMsgIdAndTxt("toml_merge:invalidArgs",
+                          "Usage: [merged, sources] = toml_merge(layers, 'Name', value, ...)");
+
+    if (nlhs > 2)
+        mexErrMsgIdAndTxt("toml_merge:tooManyOutputs", "Too many output arguments");
+
+    if (!mxIsCell(prhs[0]) || mxGetNumberOfElements(prhs[0]) == 0)
+        mexErrMsgIdAndTxt("toml_merge:invalidInput", "First input must be a non-empty cell array of layers");
+
+    MergeOptions opts = parse_options(nrhs, prhs, 1);
+
+    size_t num_layers = mxGetNumberOfElements(prhs[0]);
+    std::vector<std::string> inputs(num_layers);
+    for (size_t i = 0; i < num_layers; ++i) {
+        const mxArray* layer = mxGetCell(prhs[0], i);
+        if (!layer || !mxIsChar(layer))
+            mexErrMsgIdAndTxt("toml_merge:invalidInput", "Layer %d is not a string",
+                              static_cast<int>(i + 1));
+        inputs[i] = mx_to_std_string(layer);
+    }
+
+    // Errors are raised only after the parsed layers are gone
+    std::string error_id;
+    std::string error_msg;
+    TomlMerge merge;
+    std::vector<MergeSource> sources;
+    try
+    {
+        std::vector<toml::table> layers = parse_layers(inputs, opts);
+        for (const auto& rule : opts.rules) merge.set_rule(rule.first, rule.second);
+        for (toml::table& layer : layers) merge.add_layer(layer);
+        if (nlhs > 1) sources = merge.sources();
+        ScopedFieldRanks ranks(&merge.field_ranks());
+        plhs[0] = convert_table(merge.result());
+    }
+    catch (const LayerParseError& e)
+    {
+        error_id = "toml_merge:parseError";
+        error_msg = std::string("TOML parse error: ") + e.what();
+    }
+    catch (const ConvertLimitError& e)
+    {
+        error_id = "toml_merge:limitExceeded";
+        error_msg = e.what();
+    }
+    catch (const std::exception& e)
+    {
+        error_id = "toml_merge:error";
+        error_msg = std::string("Error: ") + e.what();
+    }
+
+    if (!error_id.empty())
+        mexErrMsgIdAndTxt(error_id.c_str(), "%s", error_msg.c_str());
+
+    if (nlhs > 1) {
+        const char* fields[] = {"path", "layer"};
+        plhs[1] = mxCreateStructMatrix(sources.size(), 1, 2, fields);
+        for (size_t i = 0; i < sources.size(); ++i) {
+            mxSetFieldByNumber(plhs[1], i, 0, mxCreateString(sources[i].path.c_str()));
+            mxSetFieldByNumber(plhs[1], i, 1, mxCreateDoubleScalar(static_cast<double>(sources[i].layer + 1)));
+        }
+    }
+}
@@ -0,0 +1,187 @@
+/*
+ * toml_merge.hpp
+ * Layered merge of parsed TOML documents (base + overlays).
+ *
+ * TomlMerge folds each layer into the result in order. The nodes of the
+ * layers are moved, not copied, so a layer must not be used afterwards.
+ * The rules for what an overlay does with a value that already exists
+ * can be set per dotted key path:
+ *   Merge   - tables are merged key by key (default for tables)
+ *   Replace - the overlay's value replaces the old one (default otherwise)
+ *   Append  - the overlay's array elements are appended to the old array
+ * A value whose type differs from the old one always replaces it.
+ *
+ * Keys keep the order in which they first appeared, layer by layer: a
+ * table that an overlay adds keys to gets field ranks (field_ranks(),
+ * install with ScopedFieldRanks when converting the result), since the
+ * source positions of different layers cannot be compared.
+ *
+ * The layer that last set each value is tracked by marking the roots of
+ * the subtrees taken from each layer; sources() resolves the marks into one
+ * (path, layer) entry per value. Paths use the toml_diff syntax: quoted
+ * non-bare keys and 1-based "[k]" indices for elements of arrays of tables
+ * and of appended arrays.
+ */
+
+#ifndef TOML_MERGE_HPP
+#define TOML_MERGE_HPP
+
+#include <toml++/toml.h>
+#include "toml_convert.hpp"
+#include "toml_cst.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+enum class MergeRule { Default, Merge, Replace, Append };
+
+struct MergeSource {
+    std::string path;
+    size_t layer;   // index into the merged layers
+};
+
+class TomlMerge {
+public:
+    void set_rule(const std::string& path, MergeRule rule) { rules_[path] = rule; }
+
+    // Fold the next layer into the result
+    void add_layer(toml::table& layer) {
+        size_t index = layers_++;
+        if (index == 0) {
+            result_ = std::move(layer);
+            marks_[&result_] = 0;
+            return;
+        }
+        std::string path;
+        merge_table(path, result_, layer, index);
+    }
+
+    const toml::table& result() const { return result_; }
+
+    // Key order of the merged tables of the result
+    const FieldRanks& field_ranks() const { return ranks_; }
+
+    // Layer of every value in the result, in the key order of the result
+    std::vector<MergeSource> sources() const {
+        ScopedFieldRanks ranks(&ranks_);
+        std::vector<MergeSource> out;
+        std::string path;
+        collect(path, result_, 0, out);
+        return out;
+    }
+
+private:
+    MergeRule rule_for(const std::string& path) const {
+        auto it = rules_.find(path);
+        return it == rules_.end() ? MergeRule::Default : it->second;
+    }
+
+    void merge_table(std::string& path, toml::table& dst, toml::table& src, size_t layer);
+    std::unordered_map<std::string, uint32_t>& ranks_for(const toml::table& tbl);
+    void forget(const toml::node& node);
+    void collect(std::string& path, const toml::node& node, size_t layer,
+                 std::vector<MergeSource>& out) const;
+
+    toml::table result_;
+    size_t layers_ = 0;
+    std::unordered_map<std::string, MergeRule> rules_;
+    std::unordered_map<const toml::node*, size_t> marks_;   // subtree root -> layer
+    FieldRanks ranks_;
+};
+
+// Ranks of a table that is merged into, starting from its current order
+inline std::unordered_map<std::string, uint32_t>& TomlMerge::ranks_for(const toml::table& tbl) {
+    auto it = ranks_.find(&tbl);
+    if (it != ranks_.end()) return it->second;
+    std::unordered_map<std::string, uint32_t>& ranks = ranks_[&tbl];
+    for (const FieldInfo& f : ordered_fields(tbl)) {
+        ranks.emplace(f.key, static_cast<uint32_t>(ranks.size()));
+    }
+    return ranks;
+}
+
+inline void TomlMerge::merge_table(std::string& path, toml::table& dst, toml::table& src, size_t layer) {
+    size_t prefix_length = path.size();
+    std::unordered_map<std::string, uint32_t>& ranks = ranks_for(dst);
+    for (const FieldInfo& f : ordered_fields(src)) {
+        if (prefix_length > 0) path += '.';
+        path += toml_key_segment(f.key);
+
+        toml::node& value = *const_cast<toml::node*>(f.node);
+        toml::node* old = dst.get(f.key);
+        ranks.emplace(f.key, static_cast<uint32_t>(ranks.size()));
+        MergeRule rule = rule_for(path);
+        bool same_type = old && old->type() == value.type();
+
+        if (same_type && old->is_table() && rule != MergeRule::Replace) {
+            merge_table(path, *old->as_table(), *value.as_table(), layer);
+        } else if (same_type && old->is_array() && rule == MergeRule::Append) {
+            toml::array& arr = *old->as_array();
+            toml::array& extra = *value.as_array();
+            for (size_t i = 0; i < extra.size(); ++i) {
+                with_node_type(extra[i], [&](auto& v) { arr.push_back(std::move(v)); });
+                marks_[arr.get(arr.size() - 1)] = layer;
+            }
+        } else {
+            if (old) forget(*old);
+            with_node_type(value, [&](auto& v) { dst.insert_or_assign(f.key, std::move(v)); });
+            marks_[dst.get(f.key)] = layer;
+        }
+        path.resize(prefix_length);
+    }
+}
+
+// Drop the marks of a subtree that is about to be replaced, so its
+// addresses can be reused by new nodes
+inline void TomlMerge::forget(const toml::node& node) {
+    marks_.erase(&node);
+    if (auto tbl = node.as_table()) {
+        ranks_.erase(tbl);
+        for (auto& [k, v] : *tbl) forget(v);
+    } else if (auto arr = node.as_array()) {
+        for (const toml::node& e : *arr) forget(e);
+    }
+}
+
+inline void TomlMerge::collect(std::string& path, const toml::node& node, size_t layer,
+                               std::vector<MergeSource>& out) const {
+    auto mark = marks_.find(&node);
+    if (mark != marks_.end()) layer = mark->second;
+    size_t prefix_length = path.size();
+
+    if (auto tbl = node.as_table()) {
+        for (const FieldInfo& f : ordered_fields(*tbl)) {
+            if (prefix_length > 0) path += '.';
+            path += toml_key_segment(f.key);
+            collect(path, *f.node, layer, out);
+            path.resize(prefix_length);
+        }
+        return;
+    }
+
+    // Arrays are one value unless their elements are tables or came from
+    // different layers
+    if (auto arr = node.as_array()) {
+        bool by_element = !arr->empty();
+        bool any_marked = false;
+        for (const toml::node& e : *arr) {
+            if (!e.is_table()) by_element = false;
+            if (marks_.count(&e)) any_marked = true;
+        }
+        if (by_element || any_marked) {
+            for (size_t i = 0; i < arr->size(); ++i) {
+                path += '[';
+                path += std::to_string(i + 1);
+                path += ']';
+                collect(path, (*arr)[i], layer, out);
+                path.resize(prefix_length);
+            }
+            return;
+        }
+    }
+
+    out.push_back({path, layer});
+}
+
+#endif // TOML_MERGE_HPP
@@ -0,0 +1,139 @@
+/*
+ * toml_mex.cpp
+ * Single MEX binary for all TOML commands, called by the .m wrappers.
+ *
+ * Every command is the entry point of one of the standalone MEX sources,
+ * compiled into this binary in its own namespace, so the commands behave
+ * (and report errors) exactly as the standalone files do. One binary means
+ * one load of tomlplusplus in a fresh MATLAB, and state that lives for the
+ * binary is shared by all commands: the worker thread pool
+ * (toml_thread_pool.hpp), the compiled schema cache (toml_schema.hpp) and
+ * the open record iterators (toml_records.cpp) and append handles
+ * (toml_append.cpp). Parsed documents are not cached (see README) and
+ * there is no string interning table; every command reads its files again.
+ * The binary locks itself in memory on first use so that this state
+ * survives "clear functions"; toml_mex('unlock') releases it.
+ *
+ * Compile with:
+ *   mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_mex.cpp
+ *
+ * Usage in MATLAB:
+ *   data = toml_mex('parse_file', 'config.toml');
+ *   text = toml_mex('write_string', data);
+ *   toml_mex('unlock');
+ *
+ * Commands: parse_file, parse_string, write_string, write_file,
+ * update_file, update_files, diff, merge, records, append, json (same
+ * arguments as the MEX file with the name toml_<command>) and unlock.
+ */
+
+// Everything the command sources include, so that their own includes are
+// no-ops inside the namespaces below
+#include "mex.h"
+#include <toml++/toml.h>
+#include "toml_at_exit.hpp"
+#include "toml_convert.hpp"
+#include "toml_diff.hpp"
+#include "toml_file_sink.hpp"
+#include "toml_json.hpp"
+#include "toml_limits.hpp"
+#include "toml_macros.hpp"
+#include "toml_mapped_file.hpp"
+#include "toml_merge.hpp"
+#include "toml_mex_options.hpp"
+#include "toml_numbers.hpp"
+#include "toml_records.hpp"
+#include "toml_schema.hpp"
+#include "toml_serialize.hpp"
+#include "toml_stream.hpp"
+#include "toml_thread_pool.hpp"
+#include "toml_update.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cmd_parse_file {
+#include "toml_parse_file.cpp"
+}
+namespace cmd_parse_string {
+#include "toml_parse_string.cpp"
+}
+namespace cmd_write_string {
+#include "toml_write_string.cpp"
+}
+namespace cmd_write_file {
+#include "toml_write_file.cpp"
+}
+namespace cmd_update_file {
+#include "toml_update_file.cpp"
+}
+namespace cmd_update_files {
+#include "toml_update_files.cpp"
+}
+namespace cmd_diff {
+#include "toml_diff.cpp"
+}
+namespace cmd_merge {
+#include "toml_merge.cpp"
+}
+namespace cmd_records {
+#include "toml_records.cpp"
+}
+namespace cmd_append {
+#include "toml_append.cpp"
+}
+namespace cmd_json {
+#include "toml_json.cpp"
+}
+
+typedef void (*TomlCommand)(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]);
+
+static const struct {
+    const char* name;
+    TomlCommand run;
+} commands[] = {
+    {"parse_file", cmd_parse_file::mexFunction},
+    {"parse_string", cmd_parse_string::mexFunction},
+    {"write_string", cmd_write_string::mexFunction},
+    {"write_file", cmd_write_file::mexFunction},
+    {"update_file", cmd_update_file::mexFunction},
+    {"update_files", cmd_update_files::mexFunction},
+    {"diff", cmd_diff::mexFunction},
+    {"merge", cmd_merge::mexFunction},
+    {"records", cmd_records::mexFunction},
+    {"append", cmd_append::mexFunction},
+    {"json", cmd_json::mexFunction},
+};
+
+// MEX entry point
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs < 1 || !mxIsChar(prhs[0]))
+        mexErrMsgIdAndTxt("toml_mex:invalidArgs", "Usage: varargout = toml_mex(command, ...)");
+
+    char name[32];
+    if (mxGetString(prhs[0], name, sizeof(name)) != 0)
+        mexErrMsgIdAndTxt("toml_mex:unknownCommand", "Unknown command");
+
+    if (strcmp(name, "unlock") == 0) {
+        if (mexIsLocked()) mexUnlock();
+        return;
+    }
+
+    for (const auto& command : commands) {
+        if (strcmp(name, command.name) == 0) {
+            if (!mexIsLocked()) mexLock();
+            command.run(nlhs, plhs, nrhs - 1, prhs + 1);
+            return;
+        }
+    }
+    mexErrMsgIdAndTxt("toml_mex:unknownCommand", "Unknown command '%s'", name);
+}
@@ -0,0 +1,159 @@
+/*
+ * toml_mex_options.hpp
+ * Helpers for MATLAB-style 'Name', value option pairs in the MEX entry
+ * points. Option names are matched case-insensitively. Errors are raised
+ * with the identifier "<mex_name>:invalidArgs".
+ *
+ * Usage:
+ *   check_option_pairs(nrhs, 1, "toml_write_string");
+ *   for (int i = 1; i < nrhs; i += 2) {
+ *       std::string name = option_name(prhs[i], "toml_write_string");
+ *       if (option_is(name, "Parallel"))
+ *           parallel = option_logical(prhs[i + 1], name, "toml_write_string");
+ *       ...
+ *   }
+ */
+
+#ifndef TOML_MEX_OPTIONS_HPP
+#define TOML_MEX_OPTIONS_HPP
+
+#include "mex.h"
+#include "toml_convert.hpp"
+#include "toml_limits.hpp"
+#include "toml_macros.hpp"
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
+inline void option_error(const char* mex_name, const std::string& msg) {
+    std::string id = std::string(mex_name) + ":invalidArgs";
+    mexErrMsgIdAndTxt(id.c_str(), "%s", msg.c_str());
+}
+
+// Case-insensitive match of an option name, like MATLAB name-value pairs
+inline bool option_is(const std::string& name, const char* expected) {
+    if (name.size() != strlen(expected)) return false;
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (tolower((unsigned char)name[i]) != tolower((unsigned char)expected[i])) return false;
+    }
+    return true;
+}
+
+// Options must come in pairs after the positional arguments
+inline void check_option_pairs(int nrhs, int first, const char* mex_name) {
+    if (nrhs > first && (nrhs - first) % 2 != 0) {
+        option_error(mex_name, "Options must be given as 'Name', value pairs");
+    }
+}
+
+// Read a char array as std::string (empty if it is not a char array)
+inline std::string mx_to_std_string(const mxArray* mx) {
+    char* str = (mx && mxIsChar(mx)) ? mxArrayToString(mx) : nullptr;
+    if (!str) return std::string();
+    std::string result(str);
+    mxFree(str);
+    return result;
+}
+
+inline std::string option_name(const mxArray* mx, const char* mex_name) {
+    if (!mxIsChar(mx)) option_error(mex_name, "Option names must be char arrays");
+    return mx_to_std_string(mx);
+}
+
+inline bool option_logical(const mxArray* v, const std::string& name, const char* mex_name) {
+    if (mxIsEmpty(v) || !(mxIsLogical(v) || mxIsNumeric(v))) {
+        option_error(mex_name, "Value of option '" + name + "' must be logical");
+    }
+    return mxGetScalar(v) != 0;
+}
+
+inline double option_scalar(const mxArray* v, const std::string& name, const char* mex_name) {
+    if (mxIsEmpty(v) || !mxIsNumeric(v) || mxGetNumberOfElements(v) != 1) {
+        option_error(mex_name, "Value of option '" + name + "' must be a numeric scalar");
+    }
+    return mxGetScalar(v);
+}
+
+inline std::string option_string(const mxArray* v, const std::string& name, const char* mex_name) {
+    if (!mxIsChar(v)) {
+        option_error(mex_name, "Value of option '" + name + "' must be a char array");
+    }
+    return mx_to_std_string(v);
+}
+
+// Whether name is one of the options read by number_option_from_string
+inline bool is_number_option(const std::string& name) {
+    return option_is(name, "IntegerClass") || option_is(name, "MixedNumbers");
+}
+
+// Set an 'IntegerClass' ('int64', 'double', 'auto') or 'MixedNumbers'
+// ('exact', 'double', 'cell') option; throws std::invalid_argument for
+// other values
+inline void number_option_from_string(NumberOptions& options, const std::string& name,
+                                      const std::string& value) {
+    if (option_is(name, "IntegerClass")) {
+        if (option_is(value, "int64")) options.integer_class = IntegerClass::Int64;
+        else if (option_is(value, "double")) options.integer_class = IntegerClass::Double;
+        else if (option_is(value, "auto")) options.integer_class = IntegerClass::Auto;
+        else throw std::invalid_argument("Value of option 'IntegerClass' must be 'int64', 'double' or 'auto'");
+    } else {
+        if (option_is(value, "exact")) options.mixed = MixedNumbers::Exact;
+        else if (option_is(value, "double")) options.mixed = MixedNumbers::Double;
+        else if (option_is(value, "cell")) options.mixed = MixedNumbers::Cell;
+        else throw std::invalid_argument("Value of option 'MixedNumbers' must be 'exact', 'double' or 'cell'");
+    }
+}
+
+// Whether name is one of the options read by limit_option_from_mx
+inline bool is_limit_option(const std::string& name) {
+    return option_is(name, "MaxDepth") || option_is(name, "MaxNodes");
+}
+
+// Set a 'MaxDepth' or 'MaxNodes' option from a non-negative integer; Inf or
+// 0 means no limit. Throws std::invalid_argument for other values.
+inline void limit_option_from_mx(ConvertLimits& limits, const std::string& name, const mxArray* v) {
+    double n = (mxIsNumeric(v) && mxGetNumberOfElements(v) == 1) ? mxGetScalar(v) : -1;
+    if (!(n >= 0) || (std::isfinite(n) && n != std::floor(n)))
+        throw std::invalid_argument("Value of option '" + name + "' must be a non-negative integer or Inf");
+    size_t value = std::isfinite(n) && n < 1e18 ? static_cast<size_t>(n) : 0;
+    if (option_is(name, "MaxDepth")) limits.max_depth = value;
+    else limits.max_nodes = value;
+}
+
+// Macro dictionary from a 'Macros' option value: a scalar struct of char
+// values, 'env' for the environment, or a cell array of both
+inline void macros_from_mx(MacroExpander& expander, const mxArray* mx) {
+    if (mxIsCell(mx)) {
+        for (size_t i = 0; i < mxGetNumberOfElements(mx); ++i) {
+            const mxArray* item = mxGetCell(mx, i);
+            if (!item) throw std::invalid_argument("Macros must not contain empty cells");
+            macros_from_mx(expander, item);
+        }
+        return;
+    }
+    if (mxIsChar(mx)) {
+        char* text = mxArrayToString(mx);
+        bool env = text && std::strcmp(text, "env") == 0;
+        if (text) mxFree(text);
+        if (!env) throw std::invalid_argument("Macros must be a struct or 'env'");
+        expander.use_environment(true);
+        return;
+    }
+    if (!mxIsStruct(mx) || mxGetNumberOfElements(mx) != 1)
+        throw std::invalid_argument("Macros must be a scalar struct or 'env'");
+
+    int num_fields = mxGetNumberOfFields(mx);
+    for (int i = 0; i < num_fields; ++i) {
+        const char* name = mxGetFieldNameByNumber(mx, i);
+        const mxArray* value = mxGetFieldByNumber(mx, 0, i);
+        char* text = (value && mxIsChar(value)) ? mxArrayToString(value) : nullptr;
+        if (!text)
+            throw std::invalid_argument(std::string("Macro '") + name + "' must be a char array");
+        expander.define(name, text);
+        mxFree(text);
+    }
+}
+
+#endif // TOML_MEX_OPTIONS_HPP
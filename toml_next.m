@@ -0,0 +1,36 @@
+function [batch, done] = toml_next(it, count)
+    % TOML_NEXT Read the next batch of entries from a toml_iter iterator
+    %
+    % Syntax:
+    %   batch = toml_next(it)
+    %   [batch, done] = toml_next(it, count)
+    %
+    % Inputs:
+    %   it    - Iterator from toml_iter
+    %   count - Maximum number of entries in the batch (default 1000)
+    %
+    % Outputs:
+    %   batch - Nx1 struct array (fields an entry does not have are []), or
+    %           with 'Columnar' a struct of Nx1 columns. N is smaller than
+    %           count at the end of the file.
+    %   done  - true when no entries are left; the file is then closed
+    %
+    % Example:
+    %   it = toml_iter('events.toml', 'record');
+    %   [batch, done] = toml_next(it, 10000);
+
+    if nargin < 2
+        count = 1000;
+    end
+    if ~isstruct(it) || ~isfield(it, 'id')
+        error('toml_next:invalidIterator', 'Input must be an iterator from toml_iter');
+    end
+
+    try
+        [batch, done] = toml_mex('records', 'next', it.id, count);
+    catch ME
+        % Report errors under this function's identifiers
+        id = strrep(ME.identifier, 'toml_records:', 'toml_next:');
+        error(id, '%s', ME.message);
+    end
+end
@@ -0,0 +1,130 @@
+/*
+ * toml_numbers.hpp
+ * How integers and arrays of numbers are converted to MATLAB values,
+ * shared by the C API (toml_convert.hpp, toml_stream.hpp) and the C++ API
+ * (toml_convert_api.hpp) conversions.
+ *
+ * The class of plain integers is int64 (the default), double, or auto,
+ * which gives integer arrays the smallest signed class that holds all of
+ * their elements and scalars a double when they are exactly representable.
+ * Arrays that mix integers and floats are double vectors unless an integer
+ * is beyond 2^53 (exact, the default), always (double) or never (cell).
+ *
+ * Floats are written as text with shortest_float or toml_float_text,
+ * which do not depend on the locale.
+ *
+ * Usage:
+ *   ScopedNumberOptions numbers({IntegerClass::Auto, MixedNumbers::Exact});
+ *   plhs[0] = convert_table(tbl);
+ */
+
+#ifndef TOML_NUMBERS_HPP
+#define TOML_NUMBERS_HPP
+
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Numeric class of converted integers
+enum class IntegerClass { Int64, Double, Auto };
+
+// Conversion of arrays that mix integers and floats
+enum class MixedNumbers { Exact, Double, Cell };
+
+struct NumberOptions {
+    IntegerClass integer_class = IntegerClass::Int64;
+    MixedNumbers mixed = MixedNumbers::Exact;
+};
+
+inline NumberOptions& current_number_options() {
+    static NumberOptions options;
+    return options;
+}
+
+// Sets the number options for the lifetime of the object
+class ScopedNumberOptions {
+public:
+    explicit ScopedNumberOptions(const NumberOptions& options)
+        : previous_(current_number_options()) {
+        current_number_options() = options;
+    }
+    ~ScopedNumberOptions() { current_number_options() = previous_; }
+    ScopedNumberOptions(const ScopedNumberOptions&) = delete;
+    ScopedNumberOptions& operator=(const ScopedNumberOptions&) = delete;
+
+private:
+    NumberOptions previous_;
+};
+
+// Largest integer magnitude up to which every integer is a double exactly
+constexpr int64_t exact_double_limit = int64_t(1) << 53;
+
+// Whether an array with integers in [lo, hi] and floats is a double vector
+inline bool mixed_numbers_to_double(int64_t lo, int64_t hi) {
+    switch (current_number_options().mixed) {
+        case MixedNumbers::Double:
+            return true;
+        case MixedNumbers::Cell:
+            return false;
+        default:
+            return lo >= -exact_double_limit && hi <= exact_double_limit;
+    }
+}
+
+// Element type of an integer array whose elements lie in [lo, hi]
+enum class IntegerElement { Double, Int8, Int16, Int32, Int64 };
+
+inline IntegerElement integer_array_element(int64_t lo, int64_t hi) {
+    switch (current_number_options().integer_class) {
+        case IntegerClass::Double:
+            return IntegerElement::Double;
+        case IntegerClass::Auto:
+            if (lo >= INT8_MIN && hi <= INT8_MAX) return IntegerElement::Int8;
+            if (lo >= INT16_MIN && hi <= INT16_MAX) return IntegerElement::Int16;
+            if (lo >= INT32_MIN && hi <= INT32_MAX) return IntegerElement::Int32;
+            return IntegerElement::Int64;
+        default:
+            return IntegerElement::Int64;
+    }
+}
+
+// Whether a plain integer scalar becomes a double. With 'auto' a scalar is
+// a double unless it is too large to be one exactly
+inline bool integer_scalar_to_double(int64_t value) {
+    IntegerClass integer_class = current_number_options().integer_class;
+    return integer_class == IntegerClass::Double ||
+           (integer_class == IntegerClass::Auto &&
+            value >= -exact_double_limit && value <= exact_double_limit);
+}
+
+// Shortest decimal representation of a finite double that reads back to
+// the same value, always with a '.' or an exponent so that it stays a float
+inline std::string shortest_float(double value) {
+    char buf[32];
+    for (int precision = 15; precision <= 17; ++precision) {
+        std::snprintf(buf, sizeof(buf), "%.*g", precision, value);
+        if (std::strtod(buf, nullptr) == value) break;
+    }
+    std::string text(buf);
+
+    // printf and strtod both use the decimal point of the C locale
+    const char* point = std::localeconv()->decimal_point;
+    if (point && *point && std::string(point) != ".") {
+        size_t at = text.find(point);
+        if (at != std::string::npos) text.replace(at, std::char_traits<char>::length(point), ".");
+    }
+    if (text.find_first_of(".e") == std::string::npos) text += ".0";
+    return text;
+}
+
+// TOML spelling of a float, including inf and nan
+inline std::string toml_float_text(double value) {
+    if (std::isnan(value)) return "nan";
+    if (std::isinf(value)) return value < 0 ? "-inf" : "inf";
+    return shortest_float(value);
+}
+
+#endif // TOML_NUMBERS_HPP
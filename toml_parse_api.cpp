@@ -0,0 +1,203 @@
+/*
+ * toml_parse_api.cpp
+ * Parse a TOML file or string with the C++ MEX API (matlab::mex::Function).
+ *
+ * Returns the same values as toml_parse_file / toml_parse_string, which
+ * remain the C API build. The conversion lives in toml_convert_api.hpp:
+ * numeric arrays are handed over in their buffers without a copy, struct
+ * trees are moved, and string objects are read directly as StringArray
+ * (no call to char()).
+ *
+ * Compile with:
+ *   mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_parse_api.cpp
+ *
+ * Usage in MATLAB:
+ *   data = toml_parse_api('config.toml');
+ *   data = toml_parse_api(toml_text, 'Source', 'string');
+ *   data = toml_parse_api("config.toml", 'Macros', struct('HOME', '/home/me'));
+ *
+ * Options:
+ *   'Source' - 'file' (default): the input is a file name,
+ *              'string': the input is TOML text
+ *   'Macros' - Struct of char values, 'env', or a cell array of both; see
+ *              toml_macros.hpp
+ *   'IntegerClass' - 'int64' (default), 'double' or 'auto', as for
+ *              toml_parse_file
+ *   'MixedNumbers' - 'exact' (default), 'double' or 'cell', as for
+ *              toml_parse_file
+ *   'MaxDepth', 'MaxNodes' - Conversion limits as for toml_parse_file; a
+ *              document beyond them is a "toml_parse_api:limitExceeded"
+ *              error
+ *
+ * The 'Schema' option of toml_parse_file is only available in the C API
+ * build.
+ */
+
+#include "mex.hpp"
+#include "mexAdapter.hpp"
+#include "toml_convert_api.hpp"
+#include "toml_macros.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
+class MexFunction : public matlab::mex::Function {
+public:
+    void operator()(matlab::mex::ArgumentList outputs, matlab::mex::ArgumentList inputs) override {
+        if (inputs.size() < 1)
+            raise("invalidArgs", "Usage: data = toml_parse_api(input, 'Name', value, ...)");
+        if (outputs.size() > 1)
+            raise("tooManyOutputs", "Too many output arguments");
+
+        std::string input;
+        if (!text(inputs[0], input))
+            raise("invalidInput", "Input must be a file name or TOML text (string or char array)");
+
+        bool from_string = false;
+        std::unique_ptr<MacroExpander> macros;
+        ConvertLimits limits;
+        NumberOptions numbers;
+        if ((inputs.size() - 1) % 2 != 0)
+            raise("invalidArgs", "Options must be given as 'Name', value pairs");
+        for (size_t i = 1; i < inputs.size(); i += 2) {
+            std::string opt;
+            if (!text(inputs[i], opt)) raise("invalidArgs", "Option names must be char arrays");
+            const matlab::data::Array& v = inputs[i + 1];
+
+            if (option_is(opt, "Source")) {
+                std::string source;
+                text(v, source);
+                if (option_is(source, "string"))
+                    from_string = true;
+                else if (option_is(source, "file"))
+                    from_string = false;
+                else
+                    raise("invalidArgs", "Value of option 'Source' must be 'file' or 'string'");
+            } else if (option_is(opt, "Macros")) {
+                macros.reset(new MacroExpander());
+                read_macros(*macros, v);
+            } else if (option_is(opt, "IntegerClass")) {
+                std::string value;
+                text(v, value);
+                if (option_is(value, "int64")) numbers.integer_class = IntegerClass::Int64;
+                else if (option_is(value, "double")) numbers.integer_class = IntegerClass::Double;
+                else if (option_is(value, "auto")) numbers.integer_class = IntegerClass::Auto;
+                else raise("invalidArgs", "Value of option 'IntegerClass' must be 'int64', 'double' or 'auto'");
+            } else if (option_is(opt, "MixedNumbers")) {
+                std::string value;
+                text(v, value);
+                if (option_is(value, "exact")) numbers.mixed = MixedNumbers::Exact;
+                else if (option_is(value, "double")) numbers.mixed = MixedNumbers::Double;
+                else if (option_is(value, "cell")) numbers.mixed = MixedNumbers::Cell;
+                else raise("invalidArgs", "Value of option 'MixedNumbers' must be 'exact', 'double' or 'cell'");
+            } else if (option_is(opt, "MaxDepth")) {
+                limits.max_depth = limit(opt, v);
+            } else if (option_is(opt, "MaxNodes")) {
+                limits.max_nodes = limit(opt, v);
+            } else {
+                raise("invalidArgs", "Unknown option '" + opt + "'");
+            }
+        }
+
+        try {
+            toml::table tbl = from_string ? toml::parse(input) : toml::parse_file(input);
+            if (macros) macros->set_document(&tbl);
+            ScopedNumberOptions number_options(numbers);
+            ApiConverter convert(factory_, getEngine(), limits);
+            convert.set_expander(macros.get());
+            outputs[0] = convert.table(tbl);
+        }
+        catch (const toml::parse_error& err) {
+            raise("parseError", std::string("TOML parse error: ") + err.what());
+        }
+        catch (const MacroError& e) {
+            raise("macroError", e.what());
+        }
+        catch (const ConvertLimitError& e) {
+            raise("limitExceeded", e.what());
+        }
+        catch (const matlab::engine::MATLABException&) {
+            throw;
+        }
+        catch (const std::exception& e) {
+            raise("error", std::string("Error: ") + e.what());
+        }
+    }
+
+private:
+    // Throws a MATLAB error with the id "toml_parse_api:<id>"
+    [[noreturn]] void raise(const std::string& id, const std::string& msg) {
+        std::vector<matlab::data::Array> args({
+            factory_.createCharArray("toml_parse_api:" + id),
+            factory_.createCharArray("%s"),
+            factory_.createCharArray(matlab::engine::convertUTF8StringToUTF16String(msg))});
+        getEngine()->feval(u"error", 0, args);
+        throw std::logic_error(msg);   // not reached
+    }
+
+    // UTF-8 text of a char array or string scalar
+    static bool text(const matlab::data::Array& a, std::string& out) {
+        if (a.getType() == matlab::data::ArrayType::CHAR) {
+            matlab::data::CharArray chars(a);
+            out = matlab::engine::convertUTF16StringToUTF8String(chars.toUTF16());
+            return true;
+        }
+        if (a.getType() == matlab::data::ArrayType::MATLAB_STRING && a.getNumberOfElements() == 1) {
+            const matlab::data::StringArray strings(a);
+            matlab::data::MATLABString s = strings[0];
+            if (!s.has_value()) return false;
+            out = matlab::engine::convertUTF16StringToUTF8String(*s);
+            return true;
+        }
+        return false;
+    }
+
+    // Non-negative integer or Inf (0 = no limit), as limit_option_from_mx
+    size_t limit(const std::string& name, const matlab::data::Array& v) {
+        double n = -1;
+        if (v.getType() == matlab::data::ArrayType::DOUBLE && v.getNumberOfElements() == 1) {
+            const matlab::data::TypedArray<double> number(v);
+            n = number[0];
+        }
+        if (!(n >= 0) || (std::isfinite(n) && n != std::floor(n)))
+            raise("invalidArgs", "Value of option '" + name + "' must be a non-negative integer or Inf");
+        return std::isfinite(n) && n < 1e18 ? static_cast<size_t>(n) : 0;
+    }
+
+    static bool option_is(const std::string& name, const char* expected) {
+        if (name.size() != std::char_traits<char>::length(expected)) return false;
+        for (size_t i = 0; i < name.size(); ++i) {
+            if (std::tolower((unsigned char)name[i]) != std::tolower((unsigned char)expected[i])) return false;
+        }
+        return true;
+    }
+
+    // Same forms as macros_from_mx() in the C API build
+    void read_macros(MacroExpander& expander, const matlab::data::Array& v) {
+        std::string name;
+        if (v.getType() == matlab::data::ArrayType::CELL) {
+            const matlab::data::CellArray cell(v);
+            for (const matlab::data::Array& item : cell) read_macros(expander, item);
+        } else if (text(v, name)) {
+            if (name != "env") raise("invalidArgs", "Macros must be a struct or 'env'");
+            expander.use_environment(true);
+        } else if (v.getType() == matlab::data::ArrayType::STRUCT && v.getNumberOfElements() == 1) {
+            const matlab::data::StructArray st(v);
+            for (const matlab::data::MATLABFieldIdentifier& field : st.getFieldNames()) {
+                std::string key(field);
+                const matlab::data::Array item = st[0][key];
+                std::string value;
+                if (!text(item, value))
+                    raise("invalidArgs", "Macro '" + key + "' must be a char array");
+                expander.define(key, value);
+            }
+        } else {
+            raise("invalidArgs", "Macros must be a scalar struct or 'env'");
+        }
+    }
+
+    matlab::data::ArrayFactory factory_;
+};
@@ -9,313 +9,58 @@
  * Usage in MATLAB:
  *   data = toml_parse_file('config.toml');
  *   data = toml_parse_file("config.toml");  % Also accepts string objects
+ *   [data, violations] = toml_parse_file('config.toml', 'Schema', 'schema.toml');
+ *   data = toml_parse_file('config.toml', 'Macros', struct('HOME', 'C:\Users\me'));
+ *   data = toml_parse_file('big.toml', 'Streaming', true);
+ *   data = toml_parse_file('config.toml', 'IntegerClass', 'auto');
+ *   data = toml_parse_file('config.toml', 'MixedNumbers', 'cell');
+ *   data = toml_parse_file('untrusted.toml', 'MaxDepth', 64, 'MaxNodes', 1e6);
+ *
+ * With 'Schema' (a schema file or struct, see toml_schema.hpp) the document
+ * is validated, defaulted and coerced while it is converted. violations is
+ * an Nx1 struct array (path, kind, message, line, column); without that
+ * output any violation is an error. Schema files are compiled once and
+ * cached until they change.
+ *
+ * With 'Macros' (a struct of char values, 'env', or a cell array of both)
+ * ${NAME} tokens in string values are expanded during the conversion;
+ * names can also be dotted key paths of values in the same file (see
+ * toml_macros.hpp).
+ *
+ * With 'Streaming' true the file is mapped and converted in one pass by
+ * toml_stream.hpp, without building a toml++ tree first; this lowers the
+ * peak memory for large files. It cannot be combined with 'Schema' or
+ * 'Macros', which work on the parsed tree, nor with 'MaxDepth' or
+ * 'MaxNodes'.
+ *
+ * 'IntegerClass' sets the class of integers: 'int64' (default), 'double',
+ * or 'auto', which gives integer arrays the smallest of int8/int16/int32/
+ * int64 that holds every element and scalars a double (int64 beyond
+ * 2^53). Integers written in hex, octal or binary stay int64.
+ *
+ * 'MixedNumbers' sets how arrays of integers and floats are converted:
+ * 'exact' (default) gives a double vector unless an integer is beyond 2^53
+ * and so not exactly a double, 'double' always gives a double vector and
+ * 'cell' a cell array of int64 and double scalars.
+ *
+ * 'MaxDepth' (default 1000) and 'MaxNodes' (default Inf) limit how deeply
+ * nested, and how many values, a document may be; a document beyond either
+ * is a "toml_parse_file:limitExceeded" error (see toml_limits.hpp). The
+ * streaming parser has its own fixed nesting limit instead.
  */
 
 #include "mex.h"
-#include <toml++/toml.h>
+#include "toml_convert.hpp"
+#include "toml_schema.hpp"
+#include "toml_macros.hpp"
+#include "toml_mex_options.hpp"
+#include "toml_stream.hpp"
 #include <string>
 #include <vector>
 #include <sstream>
 #include <algorithm>
 #include <cstring>
 
-// Forward declaration
-mxArray* convert_node(const toml::node& node);
-
-// Helper structure to track field order by source position
-struct FieldInfo {
-    std::string key;
-    const toml::node* node;
-    uint32_t line;
-    uint32_t column;
-    
-    // Sort by line first, then column to preserve original order
-    bool operator<(const FieldInfo& other) const {
-        if (line != other.line) return line < other.line;
-        return column < other.column;
-    }
-};
-
-// Convert TOML table to MATLAB struct (with order preservation)
-mxArray* convert_table(const toml::table& tbl) {
-    if (tbl.empty()) {
-        return mxCreateStructMatrix(1, 1, 0, nullptr);
-    }
-    
-    // Collect all fields with their source positions
-    std::vector<FieldInfo> fields;
-    fields.reserve(tbl.size());
-    
-    for (auto& [k, v] : tbl) {
-        FieldInfo info;
-        info.key = std::string(k);
-        info.node = &v;
-        
-        // Get source location to preserve original order
-        auto src = v.source();
-        if (src.begin) {
-            info.line = src.begin.line;
-            info.column = src.begin.column;
-        } else {
-            // If no source info (e.g., programmatically created), 
-            // use max values (will sort to end)
-            info.line = UINT32_MAX;
-            info.column = UINT32_MAX;
-        }
-        
-        fields.push_back(info);
-    }
-    
-    // Sort by source position to restore original order
-    std::sort(fields.begin(), fields.end());
-    
-    // Create field names array in correct order
-    std::vector<const char*> field_names;
-    field_names.reserve(fields.size());
-    for (const auto& field : fields) {
-        field_names.push_back(field.key.c_str());
-    }
-    
-    // Create MATLAB struct with ordered fields
-    mxArray* matlab_struct = mxCreateStructMatrix(
-        1, 1,  // 1x1 struct
-        static_cast<int>(field_names.size()),
-        field_names.data()
-    );
-    
-    // Populate struct fields in the correct order
-    for (size_t i = 0; i < fields.size(); ++i) {
-        mxSetFieldByNumber(matlab_struct, 0, static_cast<int>(i), convert_node(*fields[i].node));
-    }
-    
-    return matlab_struct;
-}
-
-// Convert TOML array to MATLAB array (typed for homogeneous data)
-mxArray* convert_array(const toml::array& arr) {
-    if (arr.empty()) {
-        return mxCreateCellMatrix(1, 0);
-    }
-    
-    // Check if array is homogeneous
-    bool all_integers = true;
-    bool all_floats = true;
-    bool all_bools = true;
-    
-    for (const auto& elem : arr) {
-        if (!elem.is_integer()) all_integers = false;
-        if (!elem.is_floating_point()) all_floats = false;
-        if (!elem.is_boolean()) all_bools = false;
-    }
-    
-    // Create int64 array for integer arrays
-    if (all_integers) {
-        mxArray* int_array = mxCreateNumericMatrix(1, arr.size(), mxINT64_CLASS, mxREAL);
-        int64_t* data = (int64_t*)mxGetData(int_array);
-        
-        for (size_t i = 0; i < arr.size(); ++i) {
-            data[i] = arr[i].value_or<int64_t>(0);
-        }
-        
-        return int_array;
-    }
-    
-    // Create double array for float arrays
-    if (all_floats) {
-        mxArray* float_array = mxCreateDoubleMatrix(1, arr.size(), mxREAL);
-        double* data = mxGetPr(float_array);
-        
-        for (size_t i = 0; i < arr.size(); ++i) {
-            data[i] = arr[i].value_or<double>(0.0);
-        }
-        
-        return float_array;
-    }
-    
-    // Create logical array for boolean arrays
-    if (all_bools) {
-        mxArray* bool_array = mxCreateLogicalMatrix(1, arr.size());
-        mxLogical* data = mxGetLogicals(bool_array);
-        
-        for (size_t i = 0; i < arr.size(); ++i) {
-            data[i] = arr[i].value_or<bool>(false);
-        }
-        
-        return bool_array;
-    }
-    
-    // Otherwise use cell array for heterogeneous data
-    mxArray* cell = mxCreateCellMatrix(1, arr.size());
-    
-    for (size_t i = 0; i < arr.size(); ++i) {
-        mxSetCell(cell, static_cast<mwIndex>(i), convert_node(arr[i]));
-    }
-    
-    return cell;
-}
-
-// Convert any TOML node to MATLAB type
-mxArray* convert_node(const toml::node& node) {
-    // Handle tables
-    if (auto tbl = node.as_table()) {
-        return convert_table(*tbl);
-    }
-    
-    // Handle arrays
-    if (auto arr = node.as_array()) {
-        return convert_array(*arr);
-    }
-    
-    // Handle string values
-    if (auto val = node.as_string()) {
-        return mxCreateString(val->get().c_str());
-    }
-    
-    // Handle integer values - check for special formatting (hex, octal, binary)
-    if (auto val = node.as_integer()) {
-        int64_t int_val = val->get();
-        
-        // Access value flags from the value object itself
-        auto flags = val->flags();
-        
-        // Check if this integer has special formatting (check in specific order)
-        bool is_hex = (flags & toml::value_flags::format_as_hexadecimal) != toml::value_flags::none;
-        bool is_oct = (flags & toml::value_flags::format_as_octal) != toml::value_flags::none;
-        bool is_bin = (flags & toml::value_flags::format_as_binary) != toml::value_flags::none;
-        
-        // If it has special formatting, store as struct with format info
-        if (is_hex || is_oct || is_bin) {
-            const char* field_names[] = {"value", "format"};
-            mxArray* result = mxCreateStructMatrix(1, 1, 2, field_names);
-            
-            // Store the numeric value
-            mxArray* value_field = mxCreateNumericMatrix(1, 1, mxINT64_CLASS, mxREAL);
-            *((int64_t*)mxGetData(value_field)) = int_val;
-            mxSetField(result, 0, "value", value_field);
-            
-            // Store the format string - check each format explicitly
-            const char* format_str;
-            if (is_bin) {
-                format_str = "bin";
-            } else if (is_oct) {
-                format_str = "oct";
-            } else if (is_hex) {
-                format_str = "hex";
-            } else {
-                // Shouldn't reach here, but default to hex
-                format_str = "hex";
-            }
-            mxSetField(result, 0, "format", mxCreateString(format_str));
-            
-            return result;
-        }
-        
-        // Regular integer without special formatting
-        mxArray* result = mxCreateNumericMatrix(1, 1, mxINT64_CLASS, mxREAL);
-        *((int64_t*)mxGetData(result)) = int_val;
-        return result;
-    }
-    
-    // Handle floating point values
-    if (auto val = node.as_floating_point()) {
-        return mxCreateDoubleScalar(val->get());
-    }
-    
-    // Handle boolean values
-    if (auto val = node.as_boolean()) {
-        return mxCreateLogicalScalar(val->get());
-    }
-    
-    // Handle date/time types
-    if (auto val = node.as_date()) {
-        // Local date only - create datetime with just the date
-        auto d = val->get();
-        
-        // Create MATLAB datetime: datetime(year, month, day)
-        mxArray* dateArgs[3];
-        dateArgs[0] = mxCreateDoubleScalar(d.year);
-        dateArgs[1] = mxCreateDoubleScalar(d.month);
-        dateArgs[2] = mxCreateDoubleScalar(d.day);
-        
-        mxArray* lhs[1];
-        mexCallMATLAB(1, lhs, 3, dateArgs, "datetime");
-        
-        mxDestroyArray(dateArgs[0]);
-        mxDestroyArray(dateArgs[1]);
-        mxDestroyArray(dateArgs[2]);
-        
-        return lhs[0];
-    }
-    
-    if (auto val = node.as_time()) {
-        // Local time only - create datetime with default date (1970-01-01) and the time
-        auto t = val->get();
-        
-        // Create MATLAB datetime: datetime(1970, 1, 1, hour, minute, second)
-        mxArray* dateArgs[6];
-        dateArgs[0] = mxCreateDoubleScalar(1970);  // Default year
-        dateArgs[1] = mxCreateDoubleScalar(1);     // Default month
-        dateArgs[2] = mxCreateDoubleScalar(1);     // Default day
-        dateArgs[3] = mxCreateDoubleScalar(t.hour);
-        dateArgs[4] = mxCreateDoubleScalar(t.minute);
-        dateArgs[5] = mxCreateDoubleScalar(t.second + t.nanosecond / 1e9);
-        
-        mxArray* lhs[1];
-        mexCallMATLAB(1, lhs, 6, dateArgs, "datetime");
-        
-        for (int i = 0; i < 6; i++) {
-            mxDestroyArray(dateArgs[i]);
-        }
-        
-        return lhs[0];
-    }
-    
-    if (auto val = node.as_date_time()) {
-        // Date-time (with or without offset)
-        auto dt = val->get();
-        
-        // Create datetime(year, month, day, hour, minute, second)
-        mxArray* dateArgs[6];
-        dateArgs[0] = mxCreateDoubleScalar(dt.date.year);
-        dateArgs[1] = mxCreateDoubleScalar(dt.date.month);
-        dateArgs[2] = mxCreateDoubleScalar(dt.date.day);
-        dateArgs[3] = mxCreateDoubleScalar(dt.time.hour);
-        dateArgs[4] = mxCreateDoubleScalar(dt.time.minute);
-        dateArgs[5] = mxCreateDoubleScalar(dt.time.second + dt.time.nanosecond / 1e9);
-        
-        mxArray* lhs[1];
-        mexCallMATLAB(1, lhs, 6, dateArgs, "datetime");
-        
-        for (int i = 0; i < 6; i++) {
-            mxDestroyArray(dateArgs[i]);
-        }
-        
-        // If there's a timezone offset, store as struct with datetime and offset
-        if (dt.offset.has_value()) {
-            auto offset = dt.offset.value();
-            int offset_minutes = offset.minutes;
-            
-            // Create the datetime without timezone first (local time)
-            const char* field_names[] = {"datetime", "offset_minutes"};
-            mxArray* result = mxCreateStructMatrix(1, 1, 2, field_names);
-            
-            // Store the datetime
-            mxSetField(result, 0, "datetime", lhs[0]);
-            
-            // Store the offset in minutes
-            mxArray* offset_field = mxCreateDoubleScalar(offset_minutes);
-            mxSetField(result, 0, "offset_minutes", offset_field);
-            
-            return result;
-        }
-        
-        return lhs[0];
-    }
-    
-    // Default: empty matrix
-    return mxCreateDoubleMatrix(0, 0, mxREAL);
-}
-
 // Helper function to extract string from MATLAB string object or char array
 std::string extractMatlabString(const mxArray* mx) {
     // Handle char arrays
@@ -372,9 +117,13 @@ std::string extractMatlabString(const mxArray* mx) {
 // MEX entry point
 void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
     // Check arguments
-    if (nrhs != 1) {
+    if (nrhs < 1) {
         mexErrMsgIdAndTxt("toml_parse_file:invalidArgs", 
-                          "Usage: data = toml_parse_file('filename.toml')");
+                          "Usage: [data, violations] = toml_parse_file('filename.toml', 'Schema', schema)");
+    }
+
+    if (nlhs > 2) {
+        mexErrMsgIdAndTxt("toml_parse_file:tooManyOutputs", "Too many output arguments");
     }
     
     // Extract filename using the helper function
@@ -386,20 +135,129 @@ void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
         mexErrMsgIdAndTxt("toml_parse_file:invalidInput", 
                           "Input must be a filename (string or char array)");
     }
+
+    const mxArray* schema_arg = nullptr;
+    std::unique_ptr<MacroExpander> macros;
+    bool streaming = false;
+    NumberOptions numbers;
+    ConvertLimits limits;
+    bool limited = false;
+    check_option_pairs(nrhs, 1, "toml_parse_file");
+    for (int i = 1; i < nrhs; i += 2) {
+        std::string opt = option_name(prhs[i], "toml_parse_file");
+        if (option_is(opt, "Schema")) {
+            schema_arg = prhs[i + 1];
+        } else if (option_is(opt, "Macros")) {
+            macros.reset(new MacroExpander());
+            try {
+                macros_from_mx(*macros, prhs[i + 1]);
+            }
+            catch (const std::invalid_argument& e) {
+                macros.reset();
+                option_error("toml_parse_file", e.what());
+            }
+        } else if (option_is(opt, "Streaming")) {
+            streaming = option_logical(prhs[i + 1], opt, "toml_parse_file");
+        } else if (is_number_option(opt)) {
+            try {
+                number_option_from_string(numbers, opt, option_string(prhs[i + 1], opt, "toml_parse_file"));
+            }
+            catch (const std::invalid_argument& e) {
+                macros.reset();
+                option_error("toml_parse_file", e.what());
+            }
+        } else if (is_limit_option(opt)) {
+            try {
+                limit_option_from_mx(limits, opt, prhs[i + 1]);
+                limited = true;
+            }
+            catch (const std::invalid_argument& e) {
+                macros.reset();
+                option_error("toml_parse_file", e.what());
+            }
+        } else {
+            mexErrMsgIdAndTxt("toml_parse_file:invalidArgs", "Unknown option '%s'", opt.c_str());
+        }
+    }
+    if (streaming && (schema_arg || macros)) {
+        macros.reset();
+        option_error("toml_parse_file", "'Streaming' cannot be combined with 'Schema' or 'Macros'");
+    }
+    if (streaming && limited) {
+        macros.reset();
+        option_error("toml_parse_file", "'Streaming' cannot be combined with 'MaxDepth' or 'MaxNodes'");
+    }
     
-    // Parse TOML file
+    // Errors are raised only after the parsed document is gone
+    std::string error_id;
+    std::string error_msg;
+    std::vector<SchemaViolation> violations;
     try {
-        toml::table tbl = toml::parse_file(filename);
-        plhs[0] = convert_table(tbl);
+        ScopedNumberOptions number_options(numbers);
+        if (streaming) {
+            plhs[0] = toml_stream_parse_file(filename);
+        } else {
+            std::shared_ptr<const TomlSchema> schema;
+            try {
+                if (schema_arg) schema = schema_from_mx(schema_arg);
+            }
+            catch (const toml::parse_error& err) {
+                throw std::invalid_argument(std::string("Schema parse error: ") + err.what());
+            }
+
+            toml::table tbl = toml::parse_file(filename);
+            if (macros) macros->set_document(&tbl);
+            ScopedStringExpander expansion(macros.get());
+            ScopedConvertLimits convert_limits(limits);
+            if (schema) {
+                SchemaCheck check;
+                plhs[0] = convert_table_checked(tbl, schema->root(), check);
+                violations = std::move(check.violations);
+            } else {
+                plhs[0] = convert_table(tbl);
+            }
+        }
     }
     catch (const toml::parse_error& err) {
-        std::string error_msg = "TOML parse error: ";
-        error_msg += err.what();
-        mexErrMsgIdAndTxt("toml_parse_file:parseError", error_msg.c_str());
+        error_id = "toml_parse_file:parseError";
+        error_msg = std::string("TOML parse error: ") + err.what();
+    }
+    catch (const TomlScanError& err) {
+        error_id = "toml_parse_file:parseError";
+        error_msg = std::string("TOML parse error: ") + err.what();
+    }
+    catch (const std::invalid_argument& e) {
+        error_id = "toml_parse_file:invalidSchema";
+        error_msg = e.what();
+    }
+    catch (const MacroError& e) {
+        error_id = "toml_parse_file:macroError";
+        error_msg = e.what();
+    }
+    catch (const ConvertLimitError& e) {
+        error_id = "toml_parse_file:limitExceeded";
+        error_msg = e.what();
     }
     catch (const std::exception& e) {
-        std::string error_msg = "Error: ";
-        error_msg += e.what();
-        mexErrMsgIdAndTxt("toml_parse_file:error", error_msg.c_str());
+        error_id = "toml_parse_file:error";
+        error_msg = std::string("Error: ") + e.what();
+    }
+
+    macros.reset();
+
+    // Without an output for them, violations are an error
+    if (error_id.empty() && !violations.empty() && nlhs < 2) {
+        const SchemaViolation& v = violations.front();
+        error_id = "toml_parse_file:schemaViolation";
+        error_msg = filename + ":" + std::to_string(v.line) + ":" + std::to_string(v.column) +
+                    ": " + v.message;
+        if (violations.size() > 1)
+            error_msg += " (and " + std::to_string(violations.size() - 1) + " more)";
     }
-}
\ No newline at end of file
+
+    if (!error_id.empty())
+        mexErrMsgIdAndTxt(error_id.c_str(), "%s", error_msg.c_str());
+
+    if (nlhs > 1)
+        plhs[1] = schema_violations_to_mx(violations);
+}
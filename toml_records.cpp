@@ -0,0 +1,167 @@
+/*
+ * toml_records.cpp
+ * Read the [[record]] entries of a large TOML file in batches, so that the
+ * whole file is never converted at once (see toml_records.hpp).
+ *
+ * Compile with:
+ *   mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_records.cpp
+ *
+ * Usage in MATLAB:
+ *   id = toml_records('open', 'log.toml', 'record');
+ *   id = toml_records('open', 'log.toml', 'logs.record', 'Columnar', true);
+ *   [batch, done] = toml_records('next', id, 10000);
+ *   toml_records('close', id);
+ *
+ * batch is an Nx1 struct array with one element per record (fields a record
+ * does not have are []), or with 'Columnar' a 1x1 struct of Nx1 columns:
+ * numeric/logical where every record has a scalar of the same class, cell
+ * arrays otherwise. N is smaller than requested at the end of the file,
+ * and done is true once no record is left. The file is closed after the
+ * last record or a parse error; 'close' releases the reader earlier.
+ *
+ * Options ('open'):
+ *   'Columnar' - Return batches as a struct of columns (default false)
+ *   'Window'   - Bytes of the file mapped at a time (default 64 MiB); grows
+ *                if a single record is larger
+ *
+ * Open readers belong to the loaded MEX binary: "clear mex" closes them.
+ */
+
+#include "mex.h"
+#include "toml_records.hpp"
+#include "toml_mex_options.hpp"
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct RecordIterator {
+    std::unique_ptr<TomlRecordReader> reader;
+    bool columnar = false;
+};
+
+static std::map<uint64_t, RecordIterator>& iterators() {
+    static std::map<uint64_t, RecordIterator> open_iterators;
+    return open_iterators;
+}
+
+// Ids are positive integers, so NaN, fractions and anything below 1 are
+// rejected rather than truncated onto some other iterator
+static uint64_t iterator_id(const mxArray* mx) {
+    if (!mxIsNumeric(mx) || mxIsComplex(mx) || mxGetNumberOfElements(mx) != 1)
+        mexErrMsgIdAndTxt("toml_records:invalidIterator", "Iterator id must be a numeric scalar");
+    double id = mxGetScalar(mx);
+    if (!(id >= 1 && id <= 9007199254740992.0) || id != std::floor(id))
+        mexErrMsgIdAndTxt("toml_records:invalidIterator", "Iterator id must be a positive integer");
+    return static_cast<uint64_t>(id);
+}
+
+static void open_iterator(mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+    if (nrhs < 2 || !mxIsChar(prhs[0]) || !mxIsChar(prhs[1]))
+        mexErrMsgIdAndTxt("toml_records:invalidArgs",
+                          "Usage: id = toml_records('open', filename, section, 'Name', value, ...)");
+
+    std::string filename = mx_to_std_string(prhs[0]);
+    std::string section = mx_to_std_string(prhs[1]);
+    bool columnar = false;
+    double window = 64.0 * 1024 * 1024;
+    check_option_pairs(nrhs, 2, "toml_records");
+    for (int i = 2; i < nrhs; i += 2) {
+        std::string opt = option_name(prhs[i], "toml_records");
+        if (option_is(opt, "Columnar")) {
+            columnar = option_logical(prhs[i + 1], opt, "toml_records");
+        } else if (option_is(opt, "Window")) {
+            window = option_scalar(prhs[i + 1], opt, "toml_records");
+            if (window < 4096) option_error("toml_records", "Value of option 'Window' must be at least 4096");
+        } else {
+            mexErrMsgIdAndTxt("toml_records:invalidArgs", "Unknown option '%s'", opt.c_str());
+        }
+    }
+
+    std::string error_id;
+    std::string error_msg;
+    static uint64_t next_id = 1;
+    try {
+        RecordIterator it;
+        it.reader.reset(new TomlRecordReader(filename, section, static_cast<size_t>(window)));
+        it.columnar = columnar;
+        iterators()[next_id] = std::move(it);
+    }
+    catch (const std::invalid_argument& e) {
+        error_id = "toml_records:invalidArgs";
+        error_msg = e.what();
+    }
+    catch (const std::exception& e) {
+        error_id = "toml_records:error";
+        error_msg = std::string("Error: ") + e.what();
+    }
+    if (!error_id.empty())
+        mexErrMsgIdAndTxt(error_id.c_str(), "%s", error_msg.c_str());
+
+    plhs[0] = mxCreateDoubleScalar(static_cast<double>(next_id++));
+}
+
+static void next_batch(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+    if (nrhs != 2)
+        mexErrMsgIdAndTxt("toml_records:invalidArgs", "Usage: [batch, done] = toml_records('next', id, count)");
+
+    auto found = iterators().find(iterator_id(prhs[0]));
+    if (found == iterators().end())
+        mexErrMsgIdAndTxt("toml_records:invalidIterator", "Iterator is closed or does not exist");
+    double requested = option_scalar(prhs[1], "count", "toml_records");
+    if (requested < 0) option_error("toml_records", "count must not be negative");
+    size_t count = static_cast<size_t>(requested);
+    RecordIterator& it = found->second;
+
+    // Errors are raised after the partial batch is freed
+    std::string error_id;
+    std::string error_msg;
+    std::vector<mxArray*> records;
+    bool done = false;
+    try {
+        while (records.size() < count) {
+            mxArray* rec = it.reader->next();
+            if (!rec) break;
+            records.push_back(rec);
+        }
+        done = it.reader->at_end();
+    }
+    catch (const TomlScanError& e) {
+        error_id = "toml_records:parseError";
+        error_msg = std::string("TOML parse error: ") + e.what();
+    }
+    catch (const std::exception& e) {
+        error_id = "toml_records:error";
+        error_msg = std::string("Error: ") + e.what();
+    }
+    if (!error_id.empty()) {
+        for (mxArray* rec : records) mxDestroyArray(rec);
+        it.reader->close();
+        mexErrMsgIdAndTxt(error_id.c_str(), "%s", error_msg.c_str());
+    }
+
+    plhs[0] = it.columnar ? records_to_columns(records) : records_to_struct_array(records);
+    if (nlhs > 1) plhs[1] = mxCreateLogicalScalar(done);
+}
+
+// MEX entry point
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs < 1 || !mxIsChar(prhs[0]))
+        mexErrMsgIdAndTxt("toml_records:invalidArgs", "Usage: toml_records('open' | 'next' | 'close', ...)");
+    if (nlhs > 2)
+        mexErrMsgIdAndTxt("toml_records:tooManyOutputs", "Too many output arguments");
+
+    std::string action = mx_to_std_string(prhs[0]);
+    if (action == "open") {
+        open_iterator(plhs, nrhs - 1, prhs + 1);
+    } else if (action == "next") {
+        next_batch(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (action == "close") {
+        if (nrhs != 2) mexErrMsgIdAndTxt("toml_records:invalidArgs", "Usage: toml_records('close', id)");
+        iterators().erase(iterator_id(prhs[1]));
+    } else {
+        mexErrMsgIdAndTxt("toml_records:invalidArgs", "Unknown action '%s'", action.c_str());
+    }
+}
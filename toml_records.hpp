@@ -0,0 +1,406 @@
+/*
+ * toml_records.hpp
+ * Batched reading of one array-of-tables section ([[record]]) of a large
+ * TOML file (toml_records.cpp).
+ *
+ * TomlRecordReader maps the file through a sliding window (MappedWindow)
+ * and finds the records with a light scan that only follows strings,
+ * comments and brackets, so that header lines inside multi-line strings and
+ * arrays are not taken for headers. Each record, from its [[record]] line
+ * to the first header that does not belong to it ([record.sub] and
+ * [[record.items]] do), is then parsed on its own with TomlStreamParser.
+ * Only the window and the records of the current batch are in memory.
+ *
+ * Sections other than the records (the file header, other tables) are
+ * skipped without being checked. A record must fit in the window; the
+ * window grows if one does not.
+ *
+ * Usage:
+ *   TomlRecordReader reader("log.toml", "record", 64 << 20);
+ *   while (mxArray* rec = reader.next()) { ... }
+ */
+
+#ifndef TOML_RECORDS_HPP
+#define TOML_RECORDS_HPP
+
+#include "mex.h"
+#include "toml_mapped_file.hpp"
+#include "toml_stream.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+class TomlRecordReader {
+public:
+    // section is a dotted key path ("record", "logs.record")
+    TomlRecordReader(const std::string& path, const std::string& section, size_t window)
+        : file_(path), window_(window) {
+        size_t start = 0;
+        for (size_t dot = section.find('.'); ; dot = section.find('.', start)) {
+            section_.push_back(section.substr(start, dot == std::string::npos ? std::string::npos : dot - start));
+            if (section_.back().empty()) throw std::invalid_argument("Invalid section name '" + section + "'");
+            if (dot == std::string::npos) break;
+            start = dot + 1;
+        }
+        if (file_.file_size() == 0) {
+            finished_ = true;
+            return;
+        }
+        load(0);
+        if (window_size_ >= 3 && std::memcmp(data_, "\xEF\xBB\xBF", 3) == 0) pos_ = 3;
+    }
+
+    // The next record as a 1x1 struct, or nullptr after the last one.
+    // Throws TomlScanError if the record is not valid TOML.
+    mxArray* next() {
+        if (!find_start()) return nullptr;
+        have_start_ = false;
+
+        uint64_t from = start_next_;
+        size_t from_line = start_line_ + 1;
+        uint64_t end = file_.file_size();
+        for (;;) {
+            Scan r = scan(from, from_line);
+            if (r.kind == Scan::Incomplete) {
+                // The record must be in one window
+                if (start_ == window_offset_) window_ *= 2;
+                load(start_);
+                from = r.safe;
+                from_line = r.safe_line;
+                continue;
+            }
+            if (r.kind == Scan::End) {
+                pos_ = end;
+                break;
+            }
+            if (sub_header()) {
+                from = r.next;
+                from_line = r.next_line;
+                continue;
+            }
+            end = r.at;
+            pos_ = r.at;
+            line_ = r.line;
+            break;
+        }
+
+        const char* text = data_ + (start_ - window_offset_);
+        TomlStreamParser parser(text, static_cast<size_t>(end - start_), start_line_);
+        mxArray* doc = parser.parse();
+        return take_record(doc);
+    }
+
+    // No record after the ones read so far
+    bool at_end() { return !find_start(); }
+
+    // Unmap and close the file; next() returns nullptr from now on
+    void close() {
+        finished_ = true;
+        have_start_ = false;
+        file_.close();
+    }
+
+private:
+    struct Scan {
+        enum Kind { Header, End, Incomplete } kind;
+        uint64_t at = 0;        // start of the header line
+        size_t line = 0;
+        uint64_t next = 0;      // start of the line after it
+        size_t next_line = 0;
+        uint64_t safe = 0;      // last line start outside strings and brackets
+        size_t safe_line = 0;
+    };
+
+    void load(uint64_t offset) {
+        data_ = file_.map(offset, window_);
+        window_offset_ = offset;
+        window_size_ = static_cast<size_t>(std::min<uint64_t>(window_, file_.file_size() - offset));
+    }
+
+    // Position the reader on the next [[section]] header
+    bool find_start() {
+        if (have_start_) return true;
+        if (finished_) return false;
+        for (;;) {
+            Scan r = scan(pos_, line_);
+            if (r.kind == Scan::Incomplete) {
+                if (r.safe == window_offset_) window_ *= 2;
+                pos_ = r.safe;
+                line_ = r.safe_line;
+                load(pos_);
+                continue;
+            }
+            if (r.kind == Scan::End) {
+                close();
+                return false;
+            }
+            pos_ = r.next;
+            line_ = r.next_line;
+            if (header_array_ && header_ == section_) {
+                start_ = r.at;
+                start_line_ = r.line;
+                start_next_ = r.next;
+                have_start_ = true;
+                return true;
+            }
+        }
+    }
+
+    // [section.x] or [[section.x]]: still part of the current record
+    bool sub_header() const {
+        if (header_.size() <= section_.size()) return false;
+        for (size_t i = 0; i < section_.size(); ++i) {
+            if (header_[i] != section_[i]) return false;
+        }
+        return true;
+    }
+
+    // Find the next header line at or after from, which must be the start
+    // of a line outside strings and brackets. The header's keys are left in
+    // header_ / header_array_.
+    Scan scan(uint64_t from, size_t line) {
+        Scan out;
+        out.safe = from;
+        out.safe_line = line;
+        const char* begin = data_ + (from - window_offset_);
+        const char* end = data_ + window_size_;
+        bool window_at_eof = window_offset_ + window_size_ == file_.file_size();
+        auto offset = [&](const char* q) { return window_offset_ + static_cast<uint64_t>(q - data_); };
+        auto stop = [&]() {
+            out.kind = window_at_eof ? Scan::End : Scan::Incomplete;
+            return out;
+        };
+
+        const char* q = begin;
+        size_t depth = 0;
+        bool line_start = true;
+        for (;;) {
+            if (line_start) {
+                line_start = false;
+                if (depth == 0) {
+                    out.safe = offset(q);
+                    out.safe_line = line;
+                }
+                const char* s = q;
+                while (s < end && (*s == ' ' || *s == '\t')) ++s;
+                if (depth == 0 && s < end && *s == '[') {
+                    const char* after = nullptr;
+                    int found = parse_header(s, end, after);
+                    if (found < 0 && !window_at_eof) return stop();
+                    if (found > 0) {
+                        out.kind = Scan::Header;
+                        out.at = offset(q);
+                        out.line = line;
+                        const char* nl = static_cast<const char*>(std::memchr(after, '\n', end - after));
+                        if (!nl && !window_at_eof) return stop();
+                        out.next = nl ? offset(nl + 1) : file_.file_size();
+                        out.next_line = line + 1;
+                        return out;
+                    }
+                }
+                q = s;
+            }
+            if (q >= end) return stop();
+
+            char c = *q;
+            if (c == '\n') {
+                ++line;
+                ++q;
+                line_start = true;
+            } else if (c == '#') {
+                const char* nl = static_cast<const char*>(std::memchr(q, '\n', end - q));
+                q = nl ? nl : end;
+            } else if (c == '"' || c == '\'') {
+                if (end - q >= 3 && q[1] == c && q[2] == c) {
+                    q += 3;
+                    while (q < end && !(*q == c && end - q >= 3 && q[1] == c && q[2] == c)) {
+                        if (*q == '\n') ++line;
+                        if (c == '"' && *q == '\\' && q + 1 < end) {
+                            ++q;
+                            if (*q == '\n') ++line;
+                        }
+                        ++q;
+                    }
+                    if (q >= end) return stop();
+                    q += 3;
+                } else {
+                    ++q;
+                    while (q < end && *q != c && *q != '\n') {
+                        if (c == '"' && *q == '\\' && q + 1 < end && q[1] != '\n') ++q;
+                        ++q;
+                    }
+                    if (q < end && *q == c) ++q;
+                }
+            } else {
+                if (c == '[' || c == '{') ++depth;
+                else if ((c == ']' || c == '}') && depth > 0) --depth;
+                ++q;
+            }
+        }
+    }
+
+    // Keys of a [table] or [[array]] header at s: 1 if it is one, 0 if
+    // not, -1 if the window ends first
+    int parse_header(const char* s, const char* end, const char*& after) {
+        const char* q = s + 1;
+        if (q >= end) return -1;
+        header_array_ = *q == '[';
+        if (header_array_) ++q;
+        header_.clear();
+        for (;;) {
+            while (q < end && (*q == ' ' || *q == '\t')) ++q;
+            if (q >= end) return -1;
+            if (*q == '"' || *q == '\'') {
+                char quote = *q++;
+                std::string key;
+                while (q < end && *q != quote && *q != '\n') {
+                    if (quote == '"' && *q == '\\' && q + 1 < end) ++q;
+                    key += *q++;
+                }
+                if (q >= end) return -1;
+                if (*q != quote) return 0;
+                ++q;
+                header_.push_back(std::move(key));
+            } else {
+                const char* start = q;
+                while (q < end && ((*q >= 'A' && *q <= 'Z') || (*q >= 'a' && *q <= 'z') ||
+                                   (*q >= '0' && *q <= '9') || *q == '_' || *q == '-'))
+                    ++q;
+                if (q >= end) return -1;
+                if (q == start) return 0;
+                header_.emplace_back(start, q - start);
+            }
+            while (q < end && (*q == ' ' || *q == '\t')) ++q;
+            if (q >= end) return -1;
+            if (*q != '.') break;
+            ++q;
+        }
+        if (*q != ']') return 0;
+        ++q;
+        if (header_array_) {
+            if (q >= end) return -1;
+            if (*q != ']') return 0;
+            ++q;
+        }
+        after = q;
+        return 1;
+    }
+
+    // The record is the only element of section in its own document
+    mxArray* take_record(mxArray* doc) {
+        mxArray* holder = doc;
+        for (size_t i = 0; holder && i + 1 < section_.size(); ++i)
+            holder = mxIsStruct(holder) ? mxGetField(holder, 0, section_[i].c_str()) : nullptr;
+        mxArray* cell = holder && mxIsStruct(holder) ? mxGetField(holder, 0, section_.back().c_str()) : nullptr;
+        if (!cell || !mxIsCell(cell) || mxGetNumberOfElements(cell) != 1) {
+            mxDestroyArray(doc);
+            throw std::runtime_error("Record at line " + std::to_string(start_line_) + " could not be read");
+        }
+        mxArray* record = mxGetCell(cell, 0);
+        mxSetCell(cell, 0, nullptr);
+        mxDestroyArray(doc);
+        return record;
+    }
+
+    MappedWindow file_;
+    size_t window_;
+    std::vector<std::string> section_;
+
+    const char* data_ = nullptr;       // window, starting at window_offset_
+    uint64_t window_offset_ = 0;
+    size_t window_size_ = 0;
+
+    uint64_t pos_ = 0;                 // where the next scan starts (a line start)
+    size_t line_ = 1;
+    bool have_start_ = false;          // start_ is a [[section]] not read yet
+    uint64_t start_ = 0;
+    size_t start_line_ = 0;
+    uint64_t start_next_ = 0;
+    bool finished_ = false;
+
+    std::vector<std::string> header_;  // keys of the last header scanned
+    bool header_array_ = false;
+};
+
+// Field names of all records, in order of first appearance
+inline std::vector<std::string> record_field_names(const std::vector<mxArray*>& records) {
+    std::vector<std::string> names;
+    std::unordered_map<std::string, size_t> seen;
+    for (const mxArray* rec : records) {
+        for (int f = 0; f < mxGetNumberOfFields(rec); ++f) {
+            std::string name = mxGetFieldNameByNumber(rec, f);
+            if (seen.emplace(name, names.size()).second) names.push_back(name);
+        }
+    }
+    return names;
+}
+
+// Nx1 struct array; fields a record does not have are []. The records are
+// consumed.
+inline mxArray* records_to_struct_array(std::vector<mxArray*>& records) {
+    std::vector<std::string> names = record_field_names(records);
+    std::vector<const char*> name_ptrs;
+    for (const std::string& n : names) name_ptrs.push_back(n.c_str());
+    mxArray* result = mxCreateStructMatrix(records.size(), 1, static_cast<int>(names.size()),
+                                           name_ptrs.empty() ? nullptr : name_ptrs.data());
+    for (size_t r = 0; r < records.size(); ++r) {
+        mxArray* rec = records[r];
+        for (int f = 0; f < mxGetNumberOfFields(rec); ++f) {
+            int field = mxGetFieldNumber(result, mxGetFieldNameByNumber(rec, f));
+            mxSetFieldByNumber(result, r, field, mxGetFieldByNumber(rec, 0, f));
+            mxSetFieldByNumber(rec, 0, f, nullptr);
+        }
+        mxDestroyArray(rec);
+    }
+    records.clear();
+    return result;
+}
+
+// 1x1 struct of Nx1 columns: numeric or logical where every record has a
+// real scalar of the same class, else a cell column ([] where a record does
+// not have the field). The records are consumed.
+inline mxArray* records_to_columns(std::vector<mxArray*>& records) {
+    std::vector<std::string> names = record_field_names(records);
+    std::vector<const char*> name_ptrs;
+    for (const std::string& n : names) name_ptrs.push_back(n.c_str());
+    mxArray* result = mxCreateStructMatrix(1, 1, static_cast<int>(names.size()),
+                                           name_ptrs.empty() ? nullptr : name_ptrs.data());
+    size_t count = records.size();
+    std::vector<mxArray*> values(count);
+    for (size_t f = 0; f < names.size(); ++f) {
+        for (size_t r = 0; r < count; ++r) values[r] = mxGetField(records[r], 0, names[f].c_str());
+        bool typed = true;
+        for (const mxArray* v : values) {
+            if (!v || !values[0] || mxGetNumberOfElements(v) != 1 || mxIsComplex(v) ||
+                !(mxIsNumeric(v) || mxIsLogical(v)) || mxGetClassID(v) != mxGetClassID(values[0]))
+                typed = false;
+        }
+
+        mxArray* column;
+        if (typed) {
+            mxClassID cls = mxGetClassID(values[0]);
+            column = cls == mxLOGICAL_CLASS ? mxCreateLogicalMatrix(count, 1)
+                                            : mxCreateUninitNumericMatrix(count, 1, cls, mxREAL);
+            size_t size = mxGetElementSize(column);
+            char* dst = static_cast<char*>(mxGetData(column));
+            for (size_t r = 0; r < count; ++r) std::memcpy(dst + r * size, mxGetData(values[r]), size);
+        } else {
+            column = mxCreateCellMatrix(count, 1);
+            for (size_t r = 0; r < count; ++r) {
+                if (!values[r]) continue;
+                mxSetCell(column, r, values[r]);
+                mxSetField(records[r], 0, names[f].c_str(), nullptr);
+            }
+        }
+        mxSetFieldByNumber(result, 0, static_cast<int>(f), column);
+    }
+    for (mxArray* rec : records) mxDestroyArray(rec);
+    records.clear();
+    return result;
+}
+
+#endif // TOML_RECORDS_HPP
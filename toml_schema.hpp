@@ -0,0 +1,434 @@
+/*
+ * toml_schema.hpp
+ * Schema validation, defaulting and coercion applied while a parsed TOML
+ * document is converted to MATLAB values.
+ *
+ * A schema is itself a TOML document (or a struct with the same layout).
+ * Each table that has a string "type" key is the rule for the key at its
+ * path; any other table groups rules for nested keys:
+ *
+ *   [server.port]
+ *   type = "integer"
+ *   min = 1
+ *   max = 65535
+ *   required = true
+ *
+ *   [logging.level]
+ *   type = "categorical"
+ *   enum = ["debug", "info", "warn"]
+ *   default = "info"
+ *
+ * Types: "string", "integer", "float" (integers are converted to double),
+ * "number", "boolean", "date", "time", "datetime", "table", "array",
+ * "categorical" (a string converted to a MATLAB categorical) and "any".
+ * Rules for the keys of an array of tables apply to every element.
+ *
+ * convert_table_checked() produces the same values as convert_table(),
+ * except for the coercions and defaults, and records every violation with
+ * the line and column of the offending value (or of the table missing a
+ * required key, or its nearest enclosing table that has a position when
+ * the table itself is missing or has none). Values that violate their rule
+ * are converted unchanged.
+ *
+ * Compiled schemas read from files are cached per MEX file, keyed by path,
+ * size and modification time (see cached_schema_file()).
+ */
+
+#ifndef TOML_SCHEMA_HPP
+#define TOML_SCHEMA_HPP
+
+#include "mex.h"
+#include <toml++/toml.h>
+#include "toml_convert.hpp"
+#include "toml_serialize.hpp"
+#include "toml_cst.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <unordered_map>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+enum class SchemaType {
+    Any, String, Integer, Float, Number, Boolean, Date, Time, DateTime, Table, Array, Categorical
+};
+
+struct SchemaRule {
+    SchemaType type = SchemaType::Any;
+    bool required = false;
+    bool has_min = false;
+    bool has_max = false;
+    double min = 0;
+    double max = 0;
+    const toml::array* allowed = nullptr;   // enum values
+    const toml::node* default_value = nullptr;
+};
+
+struct SchemaNode {
+    std::unique_ptr<SchemaRule> rule;   // set for keys with a rule
+    std::map<std::string, std::unique_ptr<SchemaNode>> children;
+};
+
+struct SchemaViolation {
+    std::string path;
+    std::string kind;   // "missing", "type", "range" or "enum"
+    std::string message;
+    uint32_t line;
+    uint32_t column;
+};
+
+// A compiled schema; owns the schema document its rules point into
+class TomlSchema {
+public:
+    static std::shared_ptr<const TomlSchema> compile(toml::table doc) {
+        std::shared_ptr<TomlSchema> schema(new TomlSchema());
+        schema->doc_ = std::move(doc);
+        std::string path;
+        compile_table(schema->root_, schema->doc_, path);
+        return schema;
+    }
+
+    // Schema from a struct with the same layout as the TOML description
+    static std::shared_ptr<const TomlSchema> from_struct(const mxArray* mx) {
+        std::ostringstream text;
+        serialize_struct(text, mx, "");
+        return compile(toml::parse(text.str()));
+    }
+
+    const SchemaNode& root() const { return root_; }
+
+private:
+    TomlSchema() = default;
+
+    static SchemaType parse_type(const std::string& name, const std::string& path);
+    static void compile_rule(SchemaRule& rule, const toml::table& tbl, const std::string& path);
+    static void compile_table(SchemaNode& node, const toml::table& tbl, std::string& path);
+
+    toml::table doc_;
+    SchemaNode root_;
+};
+
+inline SchemaType TomlSchema::parse_type(const std::string& name, const std::string& path) {
+    static const std::unordered_map<std::string, SchemaType> types = {
+        {"any", SchemaType::Any}, {"string", SchemaType::String},
+        {"integer", SchemaType::Integer}, {"float", SchemaType::Float},
+        {"number", SchemaType::Number}, {"boolean", SchemaType::Boolean},
+        {"date", SchemaType::Date}, {"time", SchemaType::Time},
+        {"datetime", SchemaType::DateTime}, {"table", SchemaType::Table},
+        {"array", SchemaType::Array}, {"categorical", SchemaType::Categorical}};
+    auto it = types.find(name);
+    if (it == types.end())
+        throw std::invalid_argument("Unknown type '" + name + "' in schema for '" + path + "'");
+    return it->second;
+}
+
+inline void TomlSchema::compile_rule(SchemaRule& rule, const toml::table& tbl, const std::string& path) {
+    for (auto& [k, v] : tbl) {
+        std::string_view key = k.str();
+        if (key == "type") {
+            rule.type = parse_type(v.as_string()->get(), path);
+        } else if (key == "required" && v.is_boolean()) {
+            rule.required = v.as_boolean()->get();
+        } else if (key == "min" && (v.is_integer() || v.is_floating_point())) {
+            rule.has_min = true;
+            rule.min = v.value_or<double>(0.0);
+        } else if (key == "max" && (v.is_integer() || v.is_floating_point())) {
+            rule.has_max = true;
+            rule.max = v.value_or<double>(0.0);
+        } else if (key == "enum" && v.is_array()) {
+            rule.allowed = v.as_array();
+        } else if (key == "default") {
+            rule.default_value = &v;
+        } else {
+            throw std::invalid_argument("Invalid schema entry '" + std::string(key) +
+                                        "' for '" + path + "'");
+        }
+    }
+    // The integer conversion of an integral min/max is exact
+    if (rule.has_min) {
+        if (auto i = tbl.get("min")->as_integer()) rule.min = static_cast<double>(i->get());
+    }
+    if (rule.has_max) {
+        if (auto i = tbl.get("max")->as_integer()) rule.max = static_cast<double>(i->get());
+    }
+}
+
+inline void TomlSchema::compile_table(SchemaNode& node, const toml::table& tbl, std::string& path) {
+    size_t prefix_length = path.size();
+    for (auto& [k, v] : tbl) {
+        const toml::table* child = v.as_table();
+        if (prefix_length > 0) path += '.';
+        path += toml_key_segment(k.str());
+        if (!child)
+            throw std::invalid_argument("Schema entry '" + path + "' must be a table");
+
+        auto& slot = node.children[std::string(k.str())];
+        slot = std::make_unique<SchemaNode>();
+        const toml::node* type = child->get("type");
+        if (type && type->is_string()) {
+            slot->rule = std::make_unique<SchemaRule>();
+            compile_rule(*slot->rule, *child, path);
+        } else {
+            compile_table(*slot, *child, path);
+        }
+        path.resize(prefix_length);
+    }
+}
+
+// Compiled schema for a schema file, reused while the file is unchanged
+inline std::shared_ptr<const TomlSchema> cached_schema_file(const std::string& path) {
+    struct Entry {
+        long long size;
+        long long mtime;
+        std::shared_ptr<const TomlSchema> schema;
+    };
+    static std::unordered_map<std::string, Entry> cache;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        throw std::invalid_argument("Cannot open schema file: " + path);
+    long long size = static_cast<long long>(st.st_size);
+    long long mtime = static_cast<long long>(st.st_mtime);
+
+    auto it = cache.find(path);
+    if (it != cache.end() && it->second.size == size && it->second.mtime == mtime)
+        return it->second.schema;
+
+    auto schema = TomlSchema::compile(toml::parse_file(path));
+    cache[path] = Entry{size, mtime, schema};
+    return schema;
+}
+
+// Schema given as an option value: a schema file name or a struct
+inline std::shared_ptr<const TomlSchema> schema_from_mx(const mxArray* mx) {
+    if (mxIsStruct(mx) && mxGetNumberOfElements(mx) == 1) return TomlSchema::from_struct(mx);
+    if (mxIsChar(mx)) {
+        char* path = mxArrayToString(mx);
+        std::string result(path ? path : "");
+        if (path) mxFree(path);
+        return cached_schema_file(result);
+    }
+    throw std::invalid_argument("Schema must be a schema file name or a scalar struct");
+}
+
+// Violations found while converting, and the path of the current value
+struct SchemaCheck {
+    std::vector<SchemaViolation> violations;
+    std::string path;
+
+    void report(const char* kind, const std::string& message, const toml::source_region& where) {
+        violations.push_back({path, kind, message, where.begin.line, where.begin.column});
+    }
+};
+
+inline const char* schema_type_name(SchemaType type) {
+    switch (type) {
+        case SchemaType::Any:         return "any";
+        case SchemaType::String:      return "string";
+        case SchemaType::Integer:     return "integer";
+        case SchemaType::Float:       return "float";
+        case SchemaType::Number:      return "number";
+        case SchemaType::Boolean:     return "boolean";
+        case SchemaType::Date:        return "date";
+        case SchemaType::Time:        return "time";
+        case SchemaType::DateTime:    return "datetime";
+        case SchemaType::Table:       return "table";
+        case SchemaType::Array:       return "array";
+        case SchemaType::Categorical: return "categorical";
+    }
+    return "";
+}
+
+inline bool schema_type_matches(SchemaType type, const toml::node& node) {
+    switch (type) {
+        case SchemaType::Any:         return true;
+        case SchemaType::String:
+        case SchemaType::Categorical: return node.is_string();
+        case SchemaType::Integer:     return node.is_integer();
+        case SchemaType::Float:
+        case SchemaType::Number:      return node.is_integer() || node.is_floating_point();
+        case SchemaType::Boolean:     return node.is_boolean();
+        case SchemaType::Date:        return node.is_date();
+        case SchemaType::Time:        return node.is_time();
+        case SchemaType::DateTime:    return node.is_date_time();
+        case SchemaType::Table:       return node.is_table();
+        case SchemaType::Array:       return node.is_array();
+    }
+    return false;
+}
+
+// True if a scalar value equals one of the enum values
+inline bool schema_enum_contains(const toml::array& allowed, const toml::node& node) {
+    for (const toml::node& a : allowed) {
+        if (auto s = node.as_string()) {
+            if (a.is_string() && a.as_string()->get() == s->get()) return true;
+        } else if (node.is_integer() || node.is_floating_point()) {
+            if ((a.is_integer() || a.is_floating_point()) &&
+                a.value_or<double>(0.0) == node.value_or<double>(0.0)) return true;
+        } else if (auto b = node.as_boolean()) {
+            if (a.is_boolean() && a.as_boolean()->get() == b->get()) return true;
+        }
+    }
+    return false;
+}
+
+// Convert a value with a rule: check it, then coerce it if it passed
+inline mxArray* convert_value_checked(const toml::node& node, const SchemaRule& rule, SchemaCheck& check) {
+    if (!schema_type_matches(rule.type, node)) {
+        check.report("type", "'" + check.path + "' must be of type " + schema_type_name(rule.type),
+                     node.source());
+        return convert_node(node);
+    }
+
+    bool ok = true;
+    if ((rule.has_min || rule.has_max) && (node.is_integer() || node.is_floating_point())) {
+        double v = node.is_integer() ? static_cast<double>(node.as_integer()->get())
+                                     : node.as_floating_point()->get();
+        if ((rule.has_min && v < rule.min) || (rule.has_max && v > rule.max)) {
+            std::ostringstream msg;
+            msg << "'" << check.path << "' is out of range";
+            if (rule.has_min) msg << " (min " << rule.min << ")";
+            if (rule.has_max) msg << " (max " << rule.max << ")";
+            check.report("range", msg.str(), node.source());
+            ok = false;
+        }
+    }
+    if (rule.allowed && !schema_enum_contains(*rule.allowed, node)) {
+        check.report("enum", "'" + check.path + "' is not one of the allowed values", node.source());
+        ok = false;
+    }
+    if (!ok) return convert_node(node);
+
+    if (rule.type == SchemaType::Float && node.is_integer())
+        return mxCreateDoubleScalar(static_cast<double>(node.as_integer()->get()));
+    if (rule.type == SchemaType::Categorical) {
+        mxArray* str = mxCreateString(node.as_string()->get().c_str());
+        mxArray* lhs[1];
+        mexCallMATLAB(1, lhs, 1, &str, "categorical");
+        mxDestroyArray(str);
+        return lhs[0];
+    }
+    return convert_node(node);
+}
+
+inline mxArray* convert_table_checked(const toml::table& tbl, const SchemaNode& schema, SchemaCheck& check,
+                                      const toml::source_region* outer = nullptr);
+
+// Convert a node whose key has nested rules (a table or an array of tables);
+// outer is where the enclosing table is
+inline mxArray* convert_nested_checked(const toml::node& node, const SchemaNode& schema, SchemaCheck& check,
+                                       const toml::source_region& outer) {
+    if (auto tbl = node.as_table())
+        return convert_table_checked(*tbl, schema, check, &outer);
+
+    const toml::array* arr = node.as_array();
+    bool all_tables = arr && !arr->empty();
+    if (arr) {
+        for (const toml::node& e : *arr) {
+            if (!e.is_table()) all_tables = false;
+        }
+    }
+    if (!all_tables) {
+        check.report("type", "'" + check.path + "' must be a table", node.source());
+        return convert_node(node);
+    }
+
+    // Same layout as convert_array gives an array of tables
+    size_t prefix_length = check.path.size();
+    mxArray* cell = mxCreateCellMatrix(1, arr->size());
+    for (size_t i = 0; i < arr->size(); ++i) {
+        check.path += "[" + std::to_string(i + 1) + "]";
+        mxSetCell(cell, static_cast<mwIndex>(i),
+                  convert_table_checked(*(*arr)[i].as_table(), schema, check, &outer));
+        check.path.resize(prefix_length);
+    }
+    return cell;
+}
+
+// convert_table with the schema applied to the table's keys. Missing keys
+// are reported at the table, or at outer (the nearest enclosing table with
+// a position) if the table has no position of its own
+inline mxArray* convert_table_checked(const toml::table& tbl, const SchemaNode& schema, SchemaCheck& check,
+                                      const toml::source_region* outer) {
+    const toml::source_region& where = (tbl.source().begin || !outer) ? tbl.source() : *outer;
+    std::vector<FieldInfo> fields = ordered_fields(tbl);
+    std::vector<std::string> names;
+    std::vector<mxArray*> values;
+    names.reserve(fields.size());
+    values.reserve(fields.size());
+
+    size_t prefix_length = check.path.size();
+    auto enter = [&](const std::string& key) {
+        if (prefix_length > 0) check.path += '.';
+        check.path += toml_key_segment(key);
+    };
+
+    for (const FieldInfo& f : fields) {
+        auto it = schema.children.find(f.key);
+        mxArray* value;
+        if (it == schema.children.end()) {
+            value = convert_node(*f.node);
+        } else {
+            enter(f.key);
+            const SchemaNode& child = *it->second;
+            value = child.rule ? convert_value_checked(*f.node, *child.rule, check)
+                               : convert_nested_checked(*f.node, child, check, where);
+            check.path.resize(prefix_length);
+        }
+        names.push_back(f.key);
+        values.push_back(value);
+    }
+
+    // Keys of the schema that the table does not have
+    static const toml::table empty;
+    for (const auto& [key, child] : schema.children) {
+        if (tbl.contains(key)) continue;
+        enter(key);
+        if (child->rule) {
+            if (child->rule->default_value) {
+                names.push_back(key);
+                values.push_back(convert_value_checked(*child->rule->default_value, *child->rule, check));
+            } else if (child->rule->required) {
+                check.report("missing", "Required key '" + check.path + "' is missing", where);
+            }
+        } else {
+            // A missing table still gets its defaults and required checks
+            mxArray* nested = convert_table_checked(empty, *child, check, &where);
+            if (mxGetNumberOfFields(nested) > 0) {
+                names.push_back(key);
+                values.push_back(nested);
+            } else {
+                mxDestroyArray(nested);
+            }
+        }
+        check.path.resize(prefix_length);
+    }
+
+    std::vector<const char*> field_names;
+    field_names.reserve(names.size());
+    for (const auto& name : names) field_names.push_back(name.c_str());
+    mxArray* matlab_struct = mxCreateStructMatrix(1, 1, static_cast<int>(field_names.size()),
+                                                  field_names.data());
+    for (size_t i = 0; i < values.size(); ++i)
+        mxSetFieldByNumber(matlab_struct, 0, static_cast<int>(i), values[i]);
+    return matlab_struct;
+}
+
+// Nx1 struct array of violations (path, kind, message, line, column)
+inline mxArray* schema_violations_to_mx(const std::vector<SchemaViolation>& violations) {
+    const char* fields[] = {"path", "kind", "message", "line", "column"};
+    mxArray* out = mxCreateStructMatrix(violations.size(), 1, 5, fields);
+    for (size_t i = 0; i < violations.size(); ++i) {
+        const SchemaViolation& v = violations[i];
+        mxSetFieldByNumber(out, i, 0, mxCreateString(v.path.c_str()));
+        mxSetFieldByNumber(out, i, 1, mxCreateString(v.kind.c_str()));
+        mxSetFieldByNumber(out, i, 2, mxCreateString(v.message.c_str()));
+        mxSetFieldByNumber(out, i, 3, mxCreateDoubleScalar(v.line));
+        mxSetFieldByNumber(out, i, 4, mxCreateDoubleScalar(v.column));
+    }
+    return out;
+}
+
+#endif // TOML_SCHEMA_HPP
@@ -0,0 +1,978 @@
+/*
+ * toml_serialize.hpp
+ * MATLAB struct to TOML text serializer shared by toml_write_string and
+ * toml_write_file. Preserves MATLAB field order including nested structs,
+ * and forces double quotes for string scalars.
+ *
+ * Output goes to any std::ostream, so callers choose whether the document
+ * is collected in memory or streamed straight to a file.
+ *
+ * serialize_struct_parallel() produces the same text using worker threads
+ * for the expensive part (formatting large numeric arrays). The struct is
+ * walked on the calling (MATLAB) thread as usual, but large numeric arrays
+ * are only recorded in a SerializePlan as raw data pointers; the workers
+ * format them without touching the mx API, and the pieces are written out
+ * in field order. Text before the first deferred array goes straight to
+ * the output; the rest is held in one segment per deferred array, and
+ * each segment is written and freed right after its array.
+ *
+ * Nested structs and cell arrays are walked with explicit work stacks, so
+ * the nesting depth is bounded by the current ConvertLimits (see
+ * toml_limits.hpp) rather than by the size of the thread's stack.
+ */
+
+#ifndef TOML_SERIALIZE_HPP
+#define TOML_SERIALIZE_HPP
+
+#include "mex.h"
+#include <toml++/toml.h>
+#include "toml_limits.hpp"
+#include "toml_thread_pool.hpp"
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <memory>
+#include <cmath>
+#include <climits>
+#include <vector>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+
+// How a struct field is emitted. Computed once per struct (element) by
+// classify_fields() and reused by every emission pass.
+enum class FieldKind : unsigned char {
+    Skip,            // missing or empty, not written
+    Value,           // plain value: key = value
+    FormattedInt,    // {value, format} struct from the parser, written as a value
+    OffsetDateTime,  // {datetime, offset_minutes} struct, written as a value
+    Table,           // nested struct: [key]
+    ArrayOfTables    // 1xN struct array or cell array of structs: [[key]]
+};
+
+struct FieldEntry {
+    const char* name;
+    const mxArray* value;
+    FieldKind kind;
+};
+
+// A numeric array whose formatting has been handed off to a worker thread
+struct DeferredArray {
+    const void* data;      // raw MATLAB data, read-only
+    mxClassID class_id;    // mxDOUBLE_CLASS, mxINT64_CLASS or mxLOGICAL_CLASS
+    size_t count;
+};
+
+// Text written on the MATLAB thread plus the arrays deferred to workers
+struct SerializePlan {
+    // Arrays smaller than this are cheaper to format inline
+    size_t min_deferred_elements = 4096;
+    std::vector<DeferredArray> deferred;
+};
+
+// Forward declarations
+std::unique_ptr<toml::node> convert_mx_to_node(const mxArray* mx);
+void serialize_value(std::ostream &ss, const mxArray* mx, FieldKind kind,
+                     SerializePlan* plan = nullptr);
+void serialize_struct(std::ostream &ss, const mxArray* mx_struct,
+                      const std::string& prefix, SerializePlan* plan = nullptr);
+void serialize_table_array(std::ostream &ss, const mxArray* entries,
+                           const std::string& path, SerializePlan* plan = nullptr);
+
+// Helper: escape a string for double quotes
+inline std::string escape_for_double_quotes(const std::string &s) {
+    std::string out;
+    out.reserve(s.size() + 8);
+    for (char c : s) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '\"': out += "\\\""; break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default: out += c; break;
+        }
+    }
+    return out;
+}
+
+// Fetch both fields of a 2-field struct if (and only if) they are named
+// first/second, in either order. Uses the field numbers directly instead of
+// searching each name with mxGetField.
+inline bool get_field_pair(const mxArray* mx, const char* first, const char* second,
+                           const mxArray*& a, const mxArray*& b) {
+    if (mxGetNumberOfFields(mx) != 2) return false;
+    const char* n0 = mxGetFieldNameByNumber(mx, 0);
+    const char* n1 = mxGetFieldNameByNumber(mx, 1);
+    if (strcmp(n0, first) == 0 && strcmp(n1, second) == 0) {
+        a = mxGetFieldByNumber(mx, 0, 0);
+        b = mxGetFieldByNumber(mx, 0, 1);
+    } else if (strcmp(n0, second) == 0 && strcmp(n1, first) == 0) {
+        a = mxGetFieldByNumber(mx, 0, 1);
+        b = mxGetFieldByNumber(mx, 0, 0);
+    } else {
+        return false;
+    }
+    return a && b;
+}
+
+// The {value, format} pair of a formatted integer from the parser: an
+// integral numeric scalar and "hex", "oct" or "bin". Anything else with
+// those field names is an ordinary table.
+inline bool is_formatted_int(const mxArray* value, const mxArray* format) {
+    if (!mxIsNumeric(value) || mxIsComplex(value) || mxGetNumberOfElements(value) != 1) return false;
+    if (!mxIsChar(format) || mxGetNumberOfElements(format) != 3) return false;
+    const mxChar* f = mxGetChars(format);
+    bool known = (f[0] == 'h' && f[1] == 'e' && f[2] == 'x') ||
+                 (f[0] == 'o' && f[1] == 'c' && f[2] == 't') ||
+                 (f[0] == 'b' && f[1] == 'i' && f[2] == 'n');
+    if (!known) return false;
+    if (!mxIsDouble(value) && !mxIsSingle(value)) return true;
+    double v = mxGetScalar(value);
+    return std::isfinite(v) && v == std::floor(v) && std::fabs(v) < 9223372036854775808.0;
+}
+
+// Classify a single value as it would appear in a struct field
+inline FieldKind classify_field(const mxArray* fv) {
+    if (!fv || mxIsEmpty(fv)) return FieldKind::Skip;
+
+    if (mxIsStruct(fv)) {
+        if (mxGetNumberOfElements(fv) > 1) return FieldKind::ArrayOfTables;
+
+        const mxArray* a;
+        const mxArray* b;
+        if (get_field_pair(fv, "value", "format", a, b) && is_formatted_int(a, b)) {
+            return FieldKind::FormattedInt;
+        }
+        if (get_field_pair(fv, "datetime", "offset_minutes", a, b) &&
+            strcmp(mxGetClassName(a), "datetime") == 0 && mxIsDouble(b)) {
+            return FieldKind::OffsetDateTime;
+        }
+        return FieldKind::Table;
+    }
+
+    if (mxIsCell(fv)) {
+        // A non-empty cell whose elements are all structs is an array of tables
+        mwSize num_elements = mxGetNumberOfElements(fv);
+        for (mwSize j = 0; j < num_elements; ++j) {
+            mxArray* elem = mxGetCell(fv, j);
+            if (!elem || !mxIsStruct(elem)) return FieldKind::Value;
+        }
+        return FieldKind::ArrayOfTables;
+    }
+
+    return FieldKind::Value;
+}
+
+// Resolve the field names of a struct. All elements of a struct array share
+// them, so this is done once per array.
+inline void resolve_field_names(const mxArray* mx_struct, std::vector<FieldEntry>& fields) {
+    int num_fields = mxGetNumberOfFields(mx_struct);
+    fields.resize(num_fields);
+    for (int i = 0; i < num_fields; ++i) {
+        fields[i].name = mxGetFieldNameByNumber(mx_struct, i);
+    }
+}
+
+// Single classification pass over the fields of one struct element. The
+// names must already have been filled in by resolve_field_names().
+inline void classify_fields(const mxArray* mx_struct, mwIndex index,
+                            std::vector<FieldEntry>& fields) {
+    for (size_t i = 0; i < fields.size(); ++i) {
+        FieldEntry& f = fields[i];
+        f.value = mxGetFieldByNumber(mx_struct, index, static_cast<int>(i));
+        f.kind = classify_field(f.value);
+    }
+}
+
+// Number of values a plain MATLAB value is written as, counted the way the
+// parser counts them (see toml_limits.hpp): a numeric or logical array of
+// more than one element is the array and its elements
+inline size_t mx_value_count(const mxArray* mx) {
+    size_t n = mxGetNumberOfElements(mx);
+    return (mxIsNumeric(mx) || mxIsLogical(mx)) && n > 1 ? n + 1 : 1;
+}
+
+// Add a converted value to a TOML array
+inline void push_node(toml::array& arr, std::unique_ptr<toml::node> node_ptr) {
+    if (auto t = node_ptr->as_table()) {
+        toml::table* raw = static_cast<toml::table*>(node_ptr.release());
+        arr.push_back(std::move(*raw));
+        delete raw;
+    }
+    else if (auto a = node_ptr->as_array()) {
+        toml::array* raw = static_cast<toml::array*>(node_ptr.release());
+        arr.push_back(std::move(*raw));
+        delete raw;
+    }
+    else if (auto s = node_ptr->as_string()) {
+        auto *raw = static_cast<toml::value<std::string>*>(node_ptr.release());
+        arr.push_back(std::move(*raw));
+        delete raw;
+    }
+    else if (auto i = node_ptr->as_integer()) {
+        auto *raw = static_cast<toml::value<int64_t>*>(node_ptr.release());
+        arr.push_back(std::move(*raw));
+        delete raw;
+    }
+    else if (auto f = node_ptr->as_floating_point()) {
+        auto *raw = static_cast<toml::value<double>*>(node_ptr.release());
+        arr.push_back(std::move(*raw));
+        delete raw;
+    }
+    else if (auto b = node_ptr->as_boolean()) {
+        auto *raw = static_cast<toml::value<bool>*>(node_ptr.release());
+        arr.push_back(std::move(*raw));
+        delete raw;
+    }
+}
+
+// Convert MATLAB cell array to TOML array. Nested cell arrays are walked
+// with an explicit stack, bounded by the current ConvertLimits.
+inline toml::array convert_cell_to_array(const mxArray* mx_cell) {
+    struct Level {
+        const mxArray* cell;
+        mwSize next;
+        toml::array arr;
+    };
+    ConvertBudget& budget = current_convert_budget();
+    std::vector<Level> levels;
+    levels.push_back({mx_cell, 0, toml::array()});
+    
+    for (;;) {
+        Level& top = levels.back();
+        if (top.next == mxGetNumberOfElements(top.cell)) {
+            if (levels.size() == 1) return std::move(top.arr);
+            toml::array done = std::move(top.arr);
+            levels.pop_back();
+            levels.back().arr.push_back(std::move(done));
+            continue;
+        }
+        
+        mxArray* element = mxGetCell(top.cell, top.next++);
+        if (!element || mxIsEmpty(element)) continue;
+        
+        if (mxIsCell(element)) {
+            budget.count();
+            budget.check_depth(levels.size() + 1);
+            levels.push_back({element, 0, toml::array()});
+            continue;
+        }
+        
+        auto node_ptr = convert_mx_to_node(element);
+        if (node_ptr) {
+            budget.count(mx_value_count(element));
+            push_node(top.arr, std::move(node_ptr));
+        }
+    }
+}
+
+// Convert raw double data to TOML array (integral values become integers)
+inline toml::array double_data_to_toml(const double* data, size_t num_elements) {
+    toml::array arr;
+    arr.reserve(num_elements);
+    
+    for (size_t i = 0; i < num_elements; ++i) {
+        double val = data[i];
+        if (val == std::floor(val) && val >= INT64_MIN && val <= INT64_MAX)
+            arr.push_back(static_cast<int64_t>(val));
+        else
+            arr.push_back(val);
+    }
+    return arr;
+}
+
+inline toml::array int64_data_to_toml(const int64_t* data, size_t num_elements) {
+    toml::array arr;
+    arr.reserve(num_elements);
+    for (size_t i = 0; i < num_elements; ++i)
+        arr.push_back(data[i]);
+    return arr;
+}
+
+// Integer classes narrower than int64 (e.g. from 'IntegerClass', 'auto')
+template <typename T>
+inline std::unique_ptr<toml::node> narrow_integer_to_node(const mxArray* mx) {
+    const T* data = static_cast<const T*>(mxGetData(mx));
+    size_t num_elements = mxGetNumberOfElements(mx);
+    if (num_elements == 1)
+        return std::make_unique<toml::value<int64_t>>(static_cast<int64_t>(data[0]));
+    auto arr = std::make_unique<toml::array>();
+    arr->reserve(num_elements);
+    for (size_t i = 0; i < num_elements; ++i)
+        arr->push_back(static_cast<int64_t>(data[i]));
+    return arr;
+}
+
+inline toml::array logical_data_to_toml(const mxLogical* data, size_t num_elements) {
+    toml::array arr;
+    arr.reserve(num_elements);
+    for (size_t i = 0; i < num_elements; ++i)
+        arr.push_back(data[i] != 0);
+    return arr;
+}
+
+// Convert numeric MATLAB arrays to TOML array
+inline toml::array convert_numeric_array_to_toml(const mxArray* mx) {
+    return double_data_to_toml(mxGetPr(mx), mxGetNumberOfElements(mx));
+}
+
+// Convert MATLAB types to toml::node (but NOT structs - those are handled separately)
+inline std::unique_ptr<toml::node> convert_mx_to_node(const mxArray* mx) {
+    if (!mx || mxIsEmpty(mx))
+        return nullptr;
+
+    // Structs are NOT converted here - they're serialized directly
+    // EXCEPT for special structs: formatted integers and offset datetimes
+    if (mxIsStruct(mx)) {
+        // Check for offset datetime struct
+        if (classify_field(mx) == FieldKind::OffsetDateTime) {
+            const mxArray* datetime_field;
+            const mxArray* offset_field;
+            get_field_pair(mx, "datetime", "offset_minutes", datetime_field, offset_field);
+            // This is an offset datetime - extract components
+            mxArray* yearLhs[1], *monthLhs[1], *dayLhs[1];
+            mxArray* hourLhs[1], *minuteLhs[1], *secondLhs[1];
+            
+            mxArray* rhs[1] = {const_cast<mxArray*>(datetime_field)};
+            
+            mexCallMATLAB(1, yearLhs, 1, rhs, "year");
+            mexCallMATLAB(1, monthLhs, 1, rhs, "month");
+            mexCallMATLAB(1, dayLhs, 1, rhs, "day");
+            mexCallMATLAB(1, hourLhs, 1, rhs, "hour");
+            mexCallMATLAB(1, minuteLhs, 1, rhs, "minute");
+            mexCallMATLAB(1, secondLhs, 1, rhs, "second");
+            
+            int y = (int)mxGetScalar(yearLhs[0]);
+            int m = (int)mxGetScalar(monthLhs[0]);
+            int d = (int)mxGetScalar(dayLhs[0]);
+            int h = (int)mxGetScalar(hourLhs[0]);
+            int min = (int)mxGetScalar(minuteLhs[0]);
+            double s = mxGetScalar(secondLhs[0]);
+            
+            mxDestroyArray(yearLhs[0]);
+            mxDestroyArray(monthLhs[0]);
+            mxDestroyArray(dayLhs[0]);
+            mxDestroyArray(hourLhs[0]);
+            mxDestroyArray(minuteLhs[0]);
+            mxDestroyArray(secondLhs[0]);
+            
+            int offset_minutes = (int)mxGetScalar(offset_field);
+            
+            // Create date_time with offset
+            int sec = (int)s;
+            int nanosec = (int)((s - sec) * 1e9);
+            
+            toml::date date{y, (unsigned)m, (unsigned)d};
+            toml::time time{(unsigned)h, (unsigned)min, (unsigned)sec, (unsigned)nanosec};
+            
+            int tz_hours = offset_minutes / 60;
+            int tz_minutes = offset_minutes % 60;
+            toml::time_offset offset{tz_hours, tz_minutes};
+            toml::date_time dt{date, time, offset};
+            
+            return std::make_unique<toml::value<toml::date_time>>(dt);
+        }
+        
+        // Not a special struct - return nullptr so it's handled by serialization
+        return nullptr;
+    }
+
+    if (mxIsCell(mx))
+        return std::make_unique<toml::array>(convert_cell_to_array(mx));
+
+    // MATLAB string scalars: convert to char first
+    if (strcmp(mxGetClassName(mx), "string") == 0) {
+        mxArray* lhs[1];
+        mxArray* rhs[1] = {const_cast<mxArray*>(mx)};
+        mexCallMATLAB(1, lhs, 1, rhs, "char");
+        auto node = convert_mx_to_node(lhs[0]);
+        mxDestroyArray(lhs[0]);
+        return node;
+    }
+
+    if (mxIsChar(mx)) {
+        char* str = mxArrayToString(mx);
+        std::string result(str ? str : "");
+        if (str) mxFree(str);
+        return std::make_unique<toml::value<std::string>>(result);
+    }
+    
+    // Handle MATLAB datetime objects
+    if (strcmp(mxGetClassName(mx), "datetime") == 0) {
+        // Extract datetime components using MATLAB functions
+        mxArray* yearLhs[1], *monthLhs[1], *dayLhs[1];
+        mxArray* hourLhs[1], *minuteLhs[1], *secondLhs[1];
+        mxArray* tzLhs[1];
+        
+        mxArray* rhs[1] = {const_cast<mxArray*>(mx)};
+        
+        mexCallMATLAB(1, yearLhs, 1, rhs, "year");
+        mexCallMATLAB(1, monthLhs, 1, rhs, "month");
+        mexCallMATLAB(1, dayLhs, 1, rhs, "day");
+        mexCallMATLAB(1, hourLhs, 1, rhs, "hour");
+        mexCallMATLAB(1, minuteLhs, 1, rhs, "minute");
+        mexCallMATLAB(1, secondLhs, 1, rhs, "second");
+        
+        int y = (int)mxGetScalar(yearLhs[0]);
+        int m = (int)mxGetScalar(monthLhs[0]);
+        int d = (int)mxGetScalar(dayLhs[0]);
+        int h = (int)mxGetScalar(hourLhs[0]);
+        int min = (int)mxGetScalar(minuteLhs[0]);
+        double s = mxGetScalar(secondLhs[0]);
+        
+        mxDestroyArray(yearLhs[0]);
+        mxDestroyArray(monthLhs[0]);
+        mxDestroyArray(dayLhs[0]);
+        mxDestroyArray(hourLhs[0]);
+        mxDestroyArray(minuteLhs[0]);
+        mxDestroyArray(secondLhs[0]);
+        
+        // Check if it's date-only (all time components are 0)
+        if (h == 0 && min == 0 && s == 0.0) {
+            // Date only
+            toml::date date{y, (unsigned)m, (unsigned)d};
+            return std::make_unique<toml::value<toml::date>>(date);
+        }
+        
+        // Check if it's time-only (date is default 1970-01-01)
+        if (y == 1970 && m == 1 && d == 1) {
+            // Time only - write as TOML local time
+            int sec = (int)s;
+            int nanosec = (int)((s - sec) * 1e9);
+            toml::time time{(unsigned)h, (unsigned)min, (unsigned)sec, (unsigned)nanosec};
+            return std::make_unique<toml::value<toml::time>>(time);
+        }
+        
+        // Regular datetime (local, no timezone)
+        int sec = (int)s;
+        int nanosec = (int)((s - sec) * 1e9);
+        
+        toml::date date{y, (unsigned)m, (unsigned)d};
+        toml::time time{(unsigned)h, (unsigned)min, (unsigned)sec, (unsigned)nanosec};
+        toml::date_time dt{date, time};
+        return std::make_unique<toml::value<toml::date_time>>(dt);
+    }
+
+    if (mxIsLogical(mx)) {
+        mwSize num = mxGetNumberOfElements(mx);
+        if (num == 1) {
+            bool v = mxGetLogicals(mx)[0] != 0;
+            return std::make_unique<toml::value<bool>>(v);
+        } else {
+            return std::make_unique<toml::array>(logical_data_to_toml(mxGetLogicals(mx), num));
+        }
+    }
+
+    // Handle int64 arrays (from toml_parse_file)
+    if (mxIsInt64(mx)) {
+        mwSize num_elements = mxGetNumberOfElements(mx);
+        if (num_elements == 1) {
+            int64_t val = *((int64_t*)mxGetData(mx));
+            return std::make_unique<toml::value<int64_t>>(val);
+        } else {
+            return std::make_unique<toml::array>(
+                int64_data_to_toml((const int64_t*)mxGetData(mx), num_elements));
+        }
+    }
+
+    switch (mxGetClassID(mx)) {
+        case mxINT8_CLASS:   return narrow_integer_to_node<int8_t>(mx);
+        case mxINT16_CLASS:  return narrow_integer_to_node<int16_t>(mx);
+        case mxINT32_CLASS:  return narrow_integer_to_node<int32_t>(mx);
+        case mxUINT8_CLASS:  return narrow_integer_to_node<uint8_t>(mx);
+        case mxUINT16_CLASS: return narrow_integer_to_node<uint16_t>(mx);
+        case mxUINT32_CLASS: return narrow_integer_to_node<uint32_t>(mx);
+        default:             break;
+    }
+
+    if (mxIsDouble(mx) || mxIsSingle(mx)) {
+        mwSize num_elements = mxGetNumberOfElements(mx);
+        if (num_elements == 1) {
+            double val = mxGetScalar(mx);
+            if (val == std::floor(val) && val >= INT64_MIN && val <= INT64_MAX)
+                return std::make_unique<toml::value<int64_t>>(static_cast<int64_t>(val));
+            else
+                return std::make_unique<toml::value<double>>(val);
+        } else {
+            return std::make_unique<toml::array>(convert_numeric_array_to_toml(mx));
+        }
+    }
+
+    return nullptr;
+}
+
+// Stream a one-entry table and keep only the text after "key = "
+inline void stream_table_value(std::ostream &ss, const toml::table& tmp) {
+    std::ostringstream tmp_ss;
+    tmp_ss << tmp;
+    std::string result = tmp_ss.str();
+    
+    // Find "= " and extract everything after it
+    size_t pos = result.find("= ");
+    if (pos != std::string::npos) {
+        ss << result.substr(pos + 2);
+    }
+}
+
+// Format a deferred array exactly as serialize_value would have. Uses no
+// mx API calls, so it is safe to run on a worker thread.
+inline std::string format_deferred_array(const DeferredArray& d) {
+    toml::array arr;
+    switch (d.class_id) {
+        case mxDOUBLE_CLASS:
+            arr = double_data_to_toml(static_cast<const double*>(d.data), d.count);
+            break;
+        case mxINT64_CLASS:
+            arr = int64_data_to_toml(static_cast<const int64_t*>(d.data), d.count);
+            break;
+        default:
+            arr = logical_data_to_toml(static_cast<const mxLogical*>(d.data), d.count);
+            break;
+    }
+    toml::table tmp;
+    tmp.insert_or_assign("__tmp__", std::move(arr));
+    std::ostringstream os;
+    stream_table_value(os, tmp);
+    return os.str();
+}
+
+// Record a large numeric array in the plan instead of formatting it now.
+// Returns false if the value should be serialized inline.
+inline bool defer_array(const mxArray* mx, SerializePlan& plan) {
+    if (mxIsComplex(mx)) return false;
+    mxClassID class_id = mxGetClassID(mx);
+    if (class_id != mxDOUBLE_CLASS && class_id != mxINT64_CLASS && class_id != mxLOGICAL_CLASS)
+        return false;
+    size_t count = mxGetNumberOfElements(mx);
+    if (count < 2 || count < plan.min_deferred_elements) return false;
+
+    plan.deferred.push_back({mxGetData(mx), class_id, count});
+    return true;
+}
+
+// Write logical, int64 and integral double scalars the way toml++ prints
+// them. Returns false for anything else.
+inline bool write_plain_scalar(std::ostream &ss, const mxArray* mx) {
+    if (mxGetNumberOfElements(mx) != 1) return false;
+    char buf[24];
+    int64_t val;
+    if (mxIsLogical(mx)) {
+        ss << (mxGetLogicals(mx)[0] ? "true" : "false");
+        return true;
+    } else if (mxIsInt64(mx)) {
+        val = *static_cast<const int64_t*>(mxGetData(mx));
+    } else if (mxIsDouble(mx)) {
+        double d = mxGetScalar(mx);
+        if (!(d == std::floor(d) && d >= INT64_MIN && d <= INT64_MAX)) return false;
+        val = static_cast<int64_t>(d);
+    } else {
+        return false;
+    }
+    int n = std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(val));
+    ss.write(buf, n);
+    return true;
+}
+
+// Serialize a single value (non-struct) to the output stream
+inline void serialize_value(std::ostream &ss, const mxArray* mx, FieldKind kind,
+                            SerializePlan* plan) {
+    // Special case: formatted integer struct (from parser)
+    if (kind == FieldKind::FormattedInt) {
+        const mxArray* value_field;
+        const mxArray* format_field;
+        get_field_pair(mx, "value", "format", value_field, format_field);
+        int64_t val = mxIsInt64(value_field) ? *((int64_t*)mxGetData(value_field))
+                                             : static_cast<int64_t>(mxGetScalar(value_field));
+        char* format_str = mxArrayToString(format_field);
+        
+        if (format_str) {
+            std::string fmt(format_str);
+            mxFree(format_str);
+            
+            // Write in the specified format
+            if (fmt == "hex") {
+                ss << "0x" << std::hex << std::uppercase << val << std::dec;
+                return;
+            } else if (fmt == "oct") {
+                ss << "0o";
+                // Convert to octal string manually
+                if (val == 0) {
+                    ss << "0";
+                } else {
+                    std::string octal;
+                    int64_t v = val;
+                    // Handle negative numbers
+                    if (v < 0) {
+                        ss << "-";
+                        v = -v;
+                    }
+                    uint64_t uval = static_cast<uint64_t>(v);
+                    while (uval > 0) {
+                        octal = (char)('0' + (uval & 7)) + octal;
+                        uval >>= 3;
+                    }
+                    ss << octal;
+                }
+                return;
+            } else if (fmt == "bin") {
+                ss << "0b";
+                // Convert to binary string
+                if (val == 0) {
+                    ss << "0";
+                } else {
+                    std::string binary;
+                    int64_t v = val;
+                    // Handle negative numbers
+                    if (v < 0) {
+                        ss << "-";
+                        v = -v;
+                    }
+                    uint64_t uval = static_cast<uint64_t>(v);
+                    while (uval > 0) {
+                        binary = (char)('0' + (uval & 1)) + binary;
+                        uval >>= 1;
+                    }
+                    ss << binary;
+                }
+                return;
+            }
+        }
+    }
+    
+    // Plain scalars are written directly, without a temporary toml++ node
+    if (kind == FieldKind::Value && write_plain_scalar(ss, mx)) return;
+
+    // Large numeric arrays are left to the worker threads
+    if (plan && kind == FieldKind::Value && defer_array(mx, *plan)) return;
+    
+    auto node_ptr = convert_mx_to_node(mx);
+    if (!node_ptr) return;
+    
+    // String scalar - check for newlines and use appropriate format
+    if (auto s = node_ptr->as_string()) {
+        auto *raw = static_cast<toml::value<std::string>*>(node_ptr.release());
+        std::string v = raw->get();
+        delete raw;
+        
+        // Check if string contains newlines
+        if (v.find('\n') != std::string::npos) {
+            // Multi-line string - use triple quotes
+            // Output content exactly as-is (don't add trailing newline)
+            ss << "\"\"\"\n" << v << "\"\"\"";
+        } else {
+            // Single-line string - use double quotes with escaping
+            ss << "\"" << escape_for_double_quotes(v) << "\"";
+        }
+        return;
+    }
+    
+    // For other types, create temporary table and stream it, then extract the value part
+    toml::table tmp;
+    const char* dummy_key = "__tmp__";
+    
+    if (auto a = node_ptr->as_array()) {
+        toml::array* raw = static_cast<toml::array*>(node_ptr.release());
+        tmp.insert_or_assign(dummy_key, std::move(*raw));
+        delete raw;
+    }
+    else if (auto i = node_ptr->as_integer()) {
+        auto *raw = static_cast<toml::value<int64_t>*>(node_ptr.release());
+        tmp.insert_or_assign(dummy_key, std::move(*raw));
+        delete raw;
+    }
+    else if (auto f = node_ptr->as_floating_point()) {
+        auto *raw = static_cast<toml::value<double>*>(node_ptr.release());
+        double val = raw->get();
+        delete raw;
+        
+        // Format float with reasonable precision
+        // Check for special values
+        if (std::isinf(val)) {
+            ss << (val > 0 ? "inf" : "-inf");
+        } else if (std::isnan(val)) {
+            ss << "nan";
+        } else {
+            std::ostringstream float_ss;
+            double abs_val = std::abs(val);
+            
+            // Use scientific notation for very small/large numbers
+            if (abs_val > 0 && (abs_val < 1e-4 || abs_val >= 1e10)) {
+                // Round to 12 significant figures to avoid precision artifacts
+                // This turns 9.9999999999999994e-12 into 1e-11
+                float_ss << std::scientific << std::setprecision(11) << val;
+                std::string str = float_ss.str();
+                
+                // Clean up: remove unnecessary trailing zeros in mantissa
+                size_t e_pos = str.find('e');
+                if (e_pos != std::string::npos) {
+                    size_t decimal_pos = str.find('.');
+                    if (decimal_pos != std::string::npos && decimal_pos < e_pos) {
+                        size_t last_nonzero = e_pos - 1;
+                        while (last_nonzero > decimal_pos && str[last_nonzero] == '0') {
+                            last_nonzero--;
+                        }
+                        if (last_nonzero == decimal_pos) {
+                            str = str.substr(0, decimal_pos) + str.substr(e_pos);
+                        } else {
+                            str = str.substr(0, last_nonzero + 1) + str.substr(e_pos);
+                        }
+                    }
+                }
+                ss << str;
+            } else if (val == std::floor(val) && abs_val < 1e15) {
+                // Integer-like value
+                float_ss << std::fixed << std::setprecision(1) << val;
+                ss << float_ss.str();
+            } else {
+                // Regular float - use reasonable precision
+                float_ss << std::setprecision(12) << val;
+                std::string str = float_ss.str();
+                
+                // Clean up trailing zeros
+                if (str.find('.') != std::string::npos) {
+                    size_t last_nonzero = str.length() - 1;
+                    while (last_nonzero > 0 && str[last_nonzero] == '0') {
+                        last_nonzero--;
+                    }
+                    if (str[last_nonzero] == '.') {
+                        str = str.substr(0, last_nonzero + 2);
+                    } else {
+                        str = str.substr(0, last_nonzero + 1);
+                    }
+                }
+                ss << str;
+            }
+        }
+        return;
+    }
+    else if (auto b = node_ptr->as_boolean()) {
+        auto *raw = static_cast<toml::value<bool>*>(node_ptr.release());
+        tmp.insert_or_assign(dummy_key, std::move(*raw));
+        delete raw;
+    }
+    else if (auto d = node_ptr->as_date()) {
+        auto *raw = static_cast<toml::value<toml::date>*>(node_ptr.release());
+        tmp.insert_or_assign(dummy_key, std::move(*raw));
+        delete raw;
+    }
+    else if (auto t = node_ptr->as_time()) {
+        auto *raw = static_cast<toml::value<toml::time>*>(node_ptr.release());
+        tmp.insert_or_assign(dummy_key, std::move(*raw));
+        delete raw;
+    }
+    else if (auto dt = node_ptr->as_date_time()) {
+        auto *raw = static_cast<toml::value<toml::date_time>*>(node_ptr.release());
+        tmp.insert_or_assign(dummy_key, std::move(*raw));
+        delete raw;
+    }
+    else {
+        node_ptr.reset();
+        return;
+    }
+    
+    // Stream the temporary table and extract just the value part
+    stream_table_value(ss, tmp);
+}
+
+// Write the plain values of one classified struct element (including
+// special structs) as key = value lines
+inline void serialize_values(std::ostream &ss, const std::vector<FieldEntry>& fields,
+                             ConvertBudget& budget, SerializePlan* plan = nullptr) {
+    for (const FieldEntry& f : fields) {
+        if (f.kind != FieldKind::Value && f.kind != FieldKind::FormattedInt &&
+            f.kind != FieldKind::OffsetDateTime) continue;
+        
+        budget.count(mx_value_count(f.value));
+        ss << f.name << " = ";
+        serialize_value(ss, f.value, f.kind, plan);
+        ss << "\n";
+    }
+}
+
+// Writes structs as TOML sections with an explicit work stack instead of
+// recursion. Each struct element is written as its plain values, then its
+// nested tables [key], then its arrays of tables [[key]], each of those in
+// turn written the same way. The stack and field lists are reused between
+// documents.
+class StructWriter {
+public:
+    bool busy() const { return depth_ > 0; }
+
+    // Write a struct (table_array = false, without a header), or each
+    // element of a struct array or cell array of structs as a [[path]]
+    // section
+    void write(std::ostream &ss, const mxArray* mx, const std::string& path,
+               bool table_array, SerializePlan* plan) {
+        ConvertBudget& budget = current_convert_budget();
+        try {
+            push(mx, table_array, budget).path = path;
+            while (depth_ > 0) {
+                Frame& top = frames_[depth_ - 1];
+                if (top.next == top.count) {
+                    --depth_;
+                    continue;
+                }
+                mwIndex j = top.next++;
+                const mxArray* elem = top.mx;
+                mwIndex index = j;
+                if (mxIsCell(elem)) {
+                    elem = mxGetCell(elem, j);
+                    index = 0;
+                }
+                budget.count();
+                
+                if (top.table_array)
+                    ss << "\n[[" << top.path << "]]\n";
+                else if (depth_ > 1)
+                    ss << "\n[" << top.path << "]\n";
+                
+                // Elements of a struct array share their field names
+                if (elem != names_of_) {
+                    resolve_field_names(elem, fields_);
+                    names_of_ = elem;
+                }
+                classify_fields(elem, index, fields_);
+                serialize_values(ss, fields_, budget, plan);
+                
+                // Pushing may move top, so its path is copied first. Frames
+                // are pushed in reverse so that they are written in field
+                // order, all nested tables before all arrays of tables.
+                prefix_ = top.path;
+                for (size_t i = fields_.size(); i-- > 0;) {
+                    if (fields_[i].kind == FieldKind::ArrayOfTables)
+                        push_field(fields_[i], true, budget);
+                }
+                for (size_t i = fields_.size(); i-- > 0;) {
+                    if (fields_[i].kind == FieldKind::Table)
+                        push_field(fields_[i], false, budget);
+                }
+            }
+        }
+        catch (...) {
+            depth_ = 0;
+            names_of_ = nullptr;
+            throw;
+        }
+        names_of_ = nullptr;
+    }
+
+private:
+    struct Frame {
+        const mxArray* mx;  // struct, struct array or cell array of structs
+        mwSize next;
+        mwSize count;
+        bool table_array;
+        std::string path;
+    };
+
+    Frame& push(const mxArray* mx, bool table_array, ConvertBudget& budget) {
+        budget.check_depth(depth_ + 1);
+        if (table_array) budget.count();   // the array; its tables are counted as they are written
+        if (depth_ == frames_.size()) frames_.emplace_back();
+        Frame& frame = frames_[depth_++];
+        frame.mx = mx;
+        frame.next = 0;
+        frame.count = table_array ? mxGetNumberOfElements(mx) : 1;
+        frame.table_array = table_array;
+        return frame;
+    }
+
+    void push_field(const FieldEntry& f, bool table_array, ConvertBudget& budget) {
+        Frame& frame = push(f.value, table_array, budget);
+        frame.path = prefix_;
+        if (!prefix_.empty()) frame.path += '.';
+        frame.path += f.name;
+    }
+
+    std::vector<Frame> frames_;
+    size_t depth_ = 0;
+    std::vector<FieldEntry> fields_;
+    const mxArray* names_of_ = nullptr;
+    std::string prefix_;
+};
+
+inline void write_struct_sections(std::ostream &ss, const mxArray* mx, const std::string& path,
+                                  bool table_array, SerializePlan* plan) {
+    static StructWriter shared;
+    if (shared.busy()) {
+        StructWriter nested;
+        nested.write(ss, mx, path, table_array, plan);
+        return;
+    }
+    shared.write(ss, mx, path, table_array, plan);
+}
+
+// Write each element of a struct array or cell array of structs as a
+// [[path]] section
+inline void serialize_table_array(std::ostream &ss, const mxArray* entries,
+                                  const std::string& path, SerializePlan* plan) {
+    write_struct_sections(ss, entries, path, true, plan);
+}
+
+// Serialize a struct, preserving MATLAB field order. prefix is the path of
+// the struct's own table, whose header the caller has written.
+inline void serialize_struct(std::ostream &ss, const mxArray* mx_struct,
+                             const std::string& prefix, SerializePlan* plan) {
+    write_struct_sections(ss, mx_struct, prefix, false, plan);
+}
+
+// Text written while planning a parallel serialization. Until the first
+// array is deferred it goes straight to out; after that, segments[i] is
+// the text that follows deferred array i.
+class PlannedTextBuf : public std::streambuf {
+public:
+    PlannedTextBuf(std::ostream& out, const SerializePlan& plan) : out_(out), plan_(plan) {}
+
+    std::vector<std::string> segments;
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        if (plan_.deferred.empty()) {
+            out_.write(s, n);
+            return out_ ? n : 0;
+        }
+        while (segments.size() < plan_.deferred.size()) segments.emplace_back();
+        segments.back().append(s, static_cast<size_t>(n));
+        return n;
+    }
+
+    int_type overflow(int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        char ch = traits_type::to_char_type(c);
+        return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+    }
+
+private:
+    std::ostream& out_;
+    const SerializePlan& plan_;
+};
+
+// Serialize a struct using up to num_threads threads (0 = one per core).
+// Produces exactly the same text as serialize_struct.
+inline void serialize_struct_parallel(std::ostream &out, const mxArray* mx_struct,
+                                      unsigned num_threads = 0) {
+    // Walk the struct on this thread; large arrays are only recorded
+    SerializePlan plan;
+    PlannedTextBuf text(out, plan);
+    std::ostream planned(&text);
+    serialize_struct(planned, mx_struct, "", &plan);
+    if (!out) return;
+    text.segments.resize(plan.deferred.size());
+
+    // Format the deferred arrays concurrently into separate buffers
+    std::vector<std::string> formatted(plan.deferred.size());
+    toml_parallel_for(plan.deferred.size(), num_threads, [&](size_t i) {
+        formatted[i] = format_deferred_array(plan.deferred[i]);
+    });
+
+    // Write each array and the text after it, freeing both as they go
+    for (size_t i = 0; i < plan.deferred.size() && out; ++i) {
+        out << formatted[i];
+        std::string().swap(formatted[i]);
+        out << text.segments[i];
+        std::string().swap(text.segments[i]);
+    }
+}
+
+#endif // TOML_SERIALIZE_HPP
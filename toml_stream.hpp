@@ -0,0 +1,862 @@
+/*
+ * toml_stream.hpp
+ * Streaming TOML reader that builds MATLAB values directly, without a
+ * toml++ DOM ('Streaming' option of toml_parse_file / toml_parse_string).
+ *
+ * toml::parse followed by convert_table holds two complete trees at the
+ * peak: the toml++ nodes and the mxArrays. TomlStreamParser reads the text
+ * once and turns every value into its mxArray as soon as it has been read.
+ * Only tables that may still get keys (header tables, their super tables
+ * and tables made by dotted keys) stay open as small builders holding the
+ * finished values of their keys; TOML allows a table to be extended by any
+ * later header, so they become structs at the end of the document. Inline
+ * tables and arrays are closed values and become mxArrays right away.
+ *
+ * Keys are kept in the order they first appear, so no sort by source
+ * position is needed. The values are the same as convert_node() gives for
+ * the toml++ tree (typed row vectors for homogeneous arrays, {value,
+ * format} structs for hex/octal/binary integers, datetime for dates and
+ * times).
+ *
+ * Nesting is bounded: arrays and inline tables may be nested max_depth
+ * levels deep and keys may have at most max_depth parts, so tables (which
+ * are finished recursively) are nested at most a few times max_depth deep
+ * whatever the input.
+ *
+ * Syntax errors, duplicate keys and tables defined twice are reported as
+ * TomlScanError with the line and column. Like the CST scanner, string
+ * contents are not checked for invalid UTF-8 or control characters.
+ */
+
+#ifndef TOML_STREAM_HPP
+#define TOML_STREAM_HPP
+
+#include "mex.h"
+#include <toml++/toml.h>
+#include "toml_convert.hpp"
+#include "toml_cst.hpp"
+#include "toml_mapped_file.hpp"
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <stdexcept>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+
+// A table that can still get keys. Values are finished mxArrays; sub-tables
+// and arrays of tables stay open until finish().
+class StreamTable {
+public:
+    // How the table was created, for the TOML rules on redefinition
+    enum class Origin : unsigned char { Implicit, Header, Dotted, Inline };
+
+    struct Item {
+        std::string key;
+        mxArray* value = nullptr;
+        std::unique_ptr<StreamTable> table;
+        std::vector<std::unique_ptr<StreamTable>> elements;   // [[array of tables]]
+        bool array_of_tables = false;
+    };
+
+    explicit StreamTable(Origin origin) : origin(origin) {}
+
+    Item* find(const std::string& key) {
+        if (index_.empty() && items_.size() <= linear_size) {
+            for (Item& item : items_) {
+                if (item.key == key) return &item;
+            }
+            return nullptr;
+        }
+        if (index_.empty()) {
+            for (size_t i = 0; i < items_.size(); ++i) index_.emplace(items_[i].key, i);
+        }
+        auto it = index_.find(key);
+        return it == index_.end() ? nullptr : &items_[it->second];
+    }
+
+    // New key; the reference is valid until the next add()
+    Item& add(const std::string& key) {
+        if (!index_.empty()) index_.emplace(key, items_.size());
+        items_.emplace_back();
+        items_.back().key = key;
+        return items_.back();
+    }
+
+    // The struct for this table; open sub-tables are finished (and freed)
+    // on the way
+    mxArray* finish() {
+        std::vector<const char*> names;
+        names.reserve(items_.size());
+        for (const Item& item : items_) names.push_back(item.key.c_str());
+        mxArray* result = mxCreateStructMatrix(1, 1, static_cast<int>(names.size()),
+                                               names.empty() ? nullptr : names.data());
+        for (size_t i = 0; i < items_.size(); ++i) {
+            Item& item = items_[i];
+            mxArray* value = item.value;
+            if (item.array_of_tables) {
+                value = mxCreateCellMatrix(1, item.elements.size());
+                for (size_t k = 0; k < item.elements.size(); ++k) {
+                    mxSetCell(value, static_cast<mwIndex>(k), item.elements[k]->finish());
+                    item.elements[k].reset();
+                }
+            } else if (item.table) {
+                value = item.table->finish();
+                item.table.reset();
+            }
+            mxSetFieldByNumber(result, 0, static_cast<int>(i), value);
+        }
+        return result;
+    }
+
+    Origin origin;
+
+private:
+    static constexpr size_t linear_size = 8;
+
+    std::vector<Item> items_;
+    std::unordered_map<std::string, size_t> index_;   // built once the table grows
+};
+
+class TomlStreamParser {
+public:
+    // first_line numbers the lines of a part of a larger file
+    TomlStreamParser(const char* data, size_t size, size_t first_line = 1)
+        : p_(data), n_(size), line_(first_line) {}
+
+    // The whole document as a 1x1 struct
+    mxArray* parse() {
+        StreamTable root(StreamTable::Origin::Header);
+        StreamTable* current = &root;
+        if (n_ >= 3 && p_[0] == '\xEF' && p_[1] == '\xBB' && p_[2] == '\xBF') pos_ = 3;
+
+        while (pos_ < n_) {
+            skip_blank();
+            if (pos_ >= n_) break;
+            char c = p_[pos_];
+            if (c == '\n' || c == '\r') {
+                newline();
+                continue;
+            }
+            if (c == '#') {
+                skip_comment();
+                continue;
+            }
+
+            if (c == '[') {
+                bool aot = peek(1) == '[';
+                pos_ += aot ? 2 : 1;
+                skip_blank();
+                parse_key(keys_);
+                skip_blank();
+                expect(']', "Expected ']' to close table header");
+                if (aot) expect(']', "Expected ']]' to close array of tables header");
+                current = aot ? open_array_table(root) : open_table(root);
+                end_of_line();
+                continue;
+            }
+
+            size_t key_start = pos_;
+            parse_key(keys_);
+            skip_blank();
+            expect('=', "Expected '=' after key");
+            skip_blank();
+            StreamTable* target = dotted_parent(*current, keys_);
+            if (target->find(keys_.back())) fail_at(key_start, "Duplicate key '" + keys_.back() + "'");
+            StreamTable::Item& item = target->add(keys_.back());
+            item.value = parse_value();
+            end_of_line();
+        }
+        return root.finish();
+    }
+
+private:
+    // A scalar read as part of an array, kept unconverted until the array
+    // is known to be homogeneous
+    struct Element {
+        enum class Kind : unsigned char { Integer, Float, Boolean, Other } kind;
+        toml::value_flags flags;
+        int64_t integer;
+        double number;
+        bool boolean;
+        mxArray* value;   // Other
+    };
+
+    static constexpr size_t max_depth = 256;
+
+    char peek(size_t ahead = 0) const {
+        return pos_ + ahead < n_ ? p_[pos_ + ahead] : '\0';
+    }
+
+    [[noreturn]] void fail(const std::string& msg) const {
+        throw TomlScanError(msg, line_, pos_ - line_start_ + 1);
+    }
+
+    void expect(char c, const char* msg) {
+        if (peek() != c) fail(msg);
+        ++pos_;
+    }
+
+    void skip_blank() {
+        while (pos_ < n_ && (p_[pos_] == ' ' || p_[pos_] == '\t')) ++pos_;
+    }
+
+    void newline() {
+        if (p_[pos_] == '\r') {
+            if (peek(1) != '\n') fail("Bare carriage return");
+            ++pos_;
+        }
+        ++pos_;
+        ++line_;
+        line_start_ = pos_;
+    }
+
+    void skip_comment() {
+        while (pos_ < n_ && p_[pos_] != '\n' && p_[pos_] != '\r') ++pos_;
+    }
+
+    // Whitespace, newlines and comments, as allowed inside arrays
+    void skip_trivia() {
+        while (pos_ < n_) {
+            char c = p_[pos_];
+            if (c == ' ' || c == '\t') ++pos_;
+            else if (c == '\n' || c == '\r') newline();
+            else if (c == '#') skip_comment();
+            else break;
+        }
+    }
+
+    // Only a comment may follow a header or a value on the same line
+    void end_of_line() {
+        skip_blank();
+        if (peek() == '#') skip_comment();
+        if (pos_ >= n_) return;
+        if (p_[pos_] != '\n' && p_[pos_] != '\r') fail("Unexpected text after value");
+        newline();
+    }
+
+    static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+    static bool is_bare_key_char(char c) {
+        return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+               is_digit(c) || c == '_' || c == '-';
+    }
+
+    static std::string dotted(const std::vector<std::string>& keys, size_t count) {
+        std::string path;
+        for (size_t i = 0; i < count; ++i) {
+            if (i > 0) path += '.';
+            path += keys[i];
+        }
+        return path;
+    }
+
+    // Parse a (possibly dotted) key into its segments
+    void parse_key(std::vector<std::string>& out) {
+        out.clear();
+        for (;;) {
+            if (out.size() >= max_depth) fail("Key has too many parts");
+            char c = peek();
+            if (c == '"') {
+                if (peek(1) == '"' && peek(2) == '"') fail("Multi-line strings cannot be keys");
+                parse_basic_string();
+                out.push_back(text_);
+            } else if (c == '\'') {
+                if (peek(1) == '\'' && peek(2) == '\'') fail("Multi-line strings cannot be keys");
+                parse_literal_string();
+                out.push_back(text_);
+            } else {
+                size_t start = pos_;
+                while (pos_ < n_ && is_bare_key_char(p_[pos_])) ++pos_;
+                if (pos_ == start) fail("Expected a key");
+                out.emplace_back(p_ + start, pos_ - start);
+            }
+            size_t before_blank = pos_;
+            skip_blank();
+            if (peek() != '.') {
+                pos_ = before_blank;
+                return;
+            }
+            ++pos_;
+            skip_blank();
+        }
+    }
+
+    // [a.b.c]: the super tables are created as needed, c must be new or
+    // only implied by an earlier header
+    StreamTable* open_table(StreamTable& root) {
+        StreamTable* t = walk_header(root);
+        const std::string& key = keys_.back();
+        StreamTable::Item* item = t->find(key);
+        if (!item) {
+            StreamTable::Item& added = t->add(key);
+            added.table.reset(new StreamTable(StreamTable::Origin::Header));
+            return added.table.get();
+        }
+        if (!item->table || item->table->origin != StreamTable::Origin::Implicit)
+            fail("Table '" + dotted(keys_, keys_.size()) + "' is defined more than once");
+        item->table->origin = StreamTable::Origin::Header;
+        return item->table.get();
+    }
+
+    // [[a.b.c]]: a new element of the array of tables c
+    StreamTable* open_array_table(StreamTable& root) {
+        StreamTable* t = walk_header(root);
+        const std::string& key = keys_.back();
+        StreamTable::Item* item = t->find(key);
+        if (!item) {
+            item = &t->add(key);
+            item->array_of_tables = true;
+        } else if (!item->array_of_tables) {
+            fail("'" + dotted(keys_, keys_.size()) + "' is not an array of tables");
+        }
+        item->elements.emplace_back(new StreamTable(StreamTable::Origin::Header));
+        return item->elements.back().get();
+    }
+
+    // Table holding the last segment of a header; arrays of tables on the
+    // way resolve to their last element
+    StreamTable* walk_header(StreamTable& root) {
+        StreamTable* t = &root;
+        for (size_t i = 0; i + 1 < keys_.size(); ++i) {
+            StreamTable::Item* item = t->find(keys_[i]);
+            if (!item) {
+                item = &t->add(keys_[i]);
+                item->table.reset(new StreamTable(StreamTable::Origin::Implicit));
+            }
+            if (item->array_of_tables) {
+                t = item->elements.back().get();
+            } else if (item->table) {
+                t = item->table.get();
+            } else {
+                fail("Key '" + dotted(keys_, i + 1) + "' is already a value");
+            }
+        }
+        return t;
+    }
+
+    // Table that receives the last segment of a dotted key. Dotted keys may
+    // only go through tables that dotted keys created.
+    StreamTable* dotted_parent(StreamTable& table, const std::vector<std::string>& keys) {
+        StreamTable* t = &table;
+        for (size_t i = 0; i + 1 < keys.size(); ++i) {
+            StreamTable::Item* item = t->find(keys[i]);
+            if (!item) {
+                item = &t->add(keys[i]);
+                item->table.reset(new StreamTable(StreamTable::Origin::Dotted));
+            } else if (!item->table || item->table->origin != StreamTable::Origin::Dotted) {
+                fail("Cannot add keys to '" + dotted(keys, i + 1) + "' with a dotted key");
+            }
+            t = item->table.get();
+        }
+        return t;
+    }
+
+    mxArray* parse_value() {
+        return to_mx(parse_element());
+    }
+
+    static mxArray* to_mx(const Element& e) {
+        switch (e.kind) {
+            case Element::Kind::Integer: return integer_to_mx(e.integer, e.flags);
+            case Element::Kind::Float:   return mxCreateDoubleScalar(e.number);
+            case Element::Kind::Boolean: return mxCreateLogicalScalar(e.boolean);
+            case Element::Kind::Other:   return e.value;
+        }
+        return nullptr;
+    }
+
+    Element parse_element() {
+        Element e{Element::Kind::Other, toml::value_flags::none, 0, 0.0, false, nullptr};
+        char c = peek();
+        if (c == '"' || c == '\'') {
+            if (peek(1) == c && peek(2) == c) parse_multiline_string(c);
+            else if (c == '"') parse_basic_string();
+            else parse_literal_string();
+            e.value = mxCreateString(text_.c_str());
+            return e;
+        }
+        if (c == '[') {
+            e.value = parse_array();
+            return e;
+        }
+        if (c == '{') {
+            e.value = parse_inline_table();
+            return e;
+        }
+        if (keyword("true")) {
+            e.kind = Element::Kind::Boolean;
+            e.boolean = true;
+            return e;
+        }
+        if (keyword("false")) {
+            e.kind = Element::Kind::Boolean;
+            return e;
+        }
+        if (is_digit(c) && is_digit(peek(1))) {
+            if (is_digit(peek(2)) && is_digit(peek(3)) && peek(4) == '-') {
+                e.value = parse_date_time();
+                return e;
+            }
+            if (peek(2) == ':') {
+                e.value = time_to_mx(parse_time());
+                end_of_value();
+                return e;
+            }
+        }
+        if (is_digit(c) || c == '+' || c == '-' || c == 'i' || c == 'n') {
+            parse_number(e);
+            return e;
+        }
+        fail("Expected a value");
+    }
+
+    bool keyword(const char* word) {
+        size_t len = std::char_traits<char>::length(word);
+        if (n_ - pos_ < len || std::string_view(p_ + pos_, len) != word) return false;
+        pos_ += len;
+        end_of_value();
+        return true;
+    }
+
+    // A scalar must be followed by a delimiter
+    void end_of_value() {
+        char c = peek();
+        if (pos_ < n_ && c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != '#' &&
+            c != ',' && c != ']' && c != '}')
+            fail("Invalid value");
+    }
+
+    mxArray* parse_array() {
+        if (depth_ >= max_depth) fail("Arrays and inline tables are nested too deeply");
+        ++pos_;
+        if (scratch_.size() <= depth_) scratch_.emplace_back();
+        std::vector<Element>& elements = scratch_[depth_];
+        elements.clear();
+        ++depth_;
+        for (;;) {
+            skip_trivia();
+            if (peek() == ']') break;
+            elements.push_back(parse_element());
+            skip_trivia();
+            if (peek() == ',') {
+                ++pos_;
+                continue;
+            }
+            if (peek() != ']') fail("Expected ',' or ']' in array");
+        }
+        ++pos_;
+        --depth_;
+
+        // Same layout as convert_array
+        if (elements.empty()) return mxCreateCellMatrix(1, 0);
+        size_t integers = 0;
+        size_t floats = 0;
+        size_t bools = 0;
+        int64_t lo = INT64_MAX;
+        int64_t hi = INT64_MIN;
+        for (const Element& e : elements) {
+            if (e.kind == Element::Kind::Integer) {
+                lo = std::min(lo, e.integer);
+                hi = std::max(hi, e.integer);
+                ++integers;
+            } else if (e.kind == Element::Kind::Float) {
+                ++floats;
+            } else if (e.kind == Element::Kind::Boolean) {
+                ++bools;
+            }
+        }
+        size_t count = elements.size();
+        if (integers == count) {
+            return integer_row_vector(count, lo, hi, [&elements](size_t i) { return elements[i].integer; });
+        }
+        if (floats == count || (integers + floats == count && mixed_numbers_to_double(lo, hi))) {
+            mxArray* result = mxCreateUninitNumericMatrix(1, count, mxDOUBLE_CLASS, mxREAL);
+            double* data = static_cast<double*>(mxGetData(result));
+            for (size_t i = 0; i < count; ++i) {
+                const Element& e = elements[i];
+                data[i] = e.kind == Element::Kind::Integer ? static_cast<double>(e.integer) : e.number;
+            }
+            return result;
+        }
+        if (bools == count) {
+            mxArray* result = mxCreateLogicalMatrix(1, count);
+            mxLogical* data = mxGetLogicals(result);
+            for (size_t i = 0; i < count; ++i) data[i] = elements[i].boolean;
+            return result;
+        }
+        mxArray* cell = mxCreateCellMatrix(1, count);
+        for (size_t i = 0; i < count; ++i) mxSetCell(cell, static_cast<mwIndex>(i), to_mx(elements[i]));
+        return cell;
+    }
+
+    mxArray* parse_inline_table() {
+        if (depth_ >= max_depth) fail("Arrays and inline tables are nested too deeply");
+        ++pos_;
+        ++depth_;
+        StreamTable table(StreamTable::Origin::Inline);
+        std::vector<std::string> keys;
+        skip_blank();
+        if (peek() == '}') {
+            ++pos_;
+        } else {
+            for (;;) {
+                skip_blank();
+                size_t key_start = pos_;
+                parse_key(keys);
+                skip_blank();
+                expect('=', "Expected '=' in inline table");
+                skip_blank();
+                StreamTable* target = dotted_parent(table, keys);
+                if (target->find(keys.back())) fail_at(key_start, "Duplicate key '" + keys.back() + "'");
+                StreamTable::Item& item = target->add(keys.back());
+                item.value = parse_value();
+                skip_blank();
+                if (peek() == ',') {
+                    ++pos_;
+                    continue;
+                }
+                expect('}', "Expected ',' or '}' in inline table");
+                break;
+            }
+        }
+        --depth_;
+        return table.finish();
+    }
+
+    // Strings are decoded into text_
+
+    void parse_literal_string() {
+        ++pos_;
+        size_t start = pos_;
+        while (pos_ < n_ && p_[pos_] != '\'') {
+            if (p_[pos_] == '\n' || p_[pos_] == '\r') fail("Unterminated string");
+            ++pos_;
+        }
+        if (pos_ >= n_) fail("Unterminated string");
+        text_.assign(p_ + start, pos_ - start);
+        ++pos_;
+    }
+
+    void parse_basic_string() {
+        ++pos_;
+        text_.clear();
+        for (;;) {
+            size_t start = pos_;
+            while (pos_ < n_ && p_[pos_] != '"' && p_[pos_] != '\\' && p_[pos_] != '\n' && p_[pos_] != '\r')
+                ++pos_;
+            text_.append(p_ + start, pos_ - start);
+            if (pos_ >= n_ || p_[pos_] == '\n' || p_[pos_] == '\r') fail("Unterminated string");
+            if (p_[pos_] == '"') break;
+            parse_escape();
+        }
+        ++pos_;
+    }
+
+    void parse_multiline_string(char quote) {
+        pos_ += 3;
+        text_.clear();
+        // A newline right after the opening delimiter is trimmed
+        if (peek() == '\n') ++pos_, ++line_, line_start_ = pos_;
+        else if (peek() == '\r' && peek(1) == '\n') pos_ += 2, ++line_, line_start_ = pos_;
+
+        while (pos_ < n_) {
+            char c = p_[pos_];
+            if (c == quote && peek(1) == quote && peek(2) == quote) {
+                // Up to two quotes may directly precede the closing delimiter
+                size_t extra = 0;
+                while (extra < 2 && peek(3 + extra) == quote) ++extra;
+                text_.append(extra, quote);
+                pos_ += 3 + extra;
+                return;
+            }
+            if (c == '\n' || c == '\r') {
+                newline();
+                text_ += '\n';
+            } else if (quote == '"' && c == '\\') {
+                // A backslash at the end of a line trims the whitespace after it
+                size_t after = pos_ + 1;
+                while (after < n_ && (p_[after] == ' ' || p_[after] == '\t')) ++after;
+                if (after < n_ && (p_[after] == '\n' || p_[after] == '\r')) {
+                    pos_ = after;
+                    for (;;) {
+                        char d = peek();
+                        if (d == ' ' || d == '\t') ++pos_;
+                        else if (d == '\n' || d == '\r') newline();
+                        else break;
+                    }
+                } else {
+                    parse_escape();
+                }
+            } else {
+                text_ += c;
+                ++pos_;
+            }
+        }
+        fail("Unterminated multi-line string");
+    }
+
+    // Escape sequence at pos_ (the backslash), appended to text_
+    void parse_escape() {
+        char c = peek(1);
+        pos_ += 2;
+        switch (c) {
+            case 'b':  text_ += '\b'; return;
+            case 't':  text_ += '\t'; return;
+            case 'n':  text_ += '\n'; return;
+            case 'f':  text_ += '\f'; return;
+            case 'r':  text_ += '\r'; return;
+            case '"':  text_ += '"'; return;
+            case '\\': text_ += '\\'; return;
+            case 'u':  append_utf8(parse_hex(4)); return;
+            case 'U':  append_utf8(parse_hex(8)); return;
+            default:
+                pos_ -= 2;
+                fail("Invalid escape sequence");
+        }
+    }
+
+    uint32_t parse_hex(int digits) {
+        uint32_t cp = 0;
+        for (int i = 0; i < digits; ++i) {
+            char c = peek();
+            int v;
+            if (c >= '0' && c <= '9') v = c - '0';
+            else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+            else fail("Invalid unicode escape");
+            cp = cp * 16 + static_cast<uint32_t>(v);
+            ++pos_;
+        }
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) fail("Invalid unicode scalar value");
+        return cp;
+    }
+
+    void append_utf8(uint32_t cp) {
+        if (cp < 0x80) {
+            text_ += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            text_ += static_cast<char>(0xC0 | (cp >> 6));
+            text_ += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            text_ += static_cast<char>(0xE0 | (cp >> 12));
+            text_ += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            text_ += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            text_ += static_cast<char>(0xF0 | (cp >> 18));
+            text_ += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            text_ += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            text_ += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    // Numbers: decimal, hex/octal/binary integers, floats, inf and nan
+
+    void parse_number(Element& e) {
+        size_t start = pos_;
+        while (pos_ < n_) {
+            char c = p_[pos_];
+            if (is_bare_key_char(c) || c == '+' || c == '.') ++pos_;
+            else break;
+        }
+        end_of_value();
+        std::string_view token(p_ + start, pos_ - start);
+
+        bool negative = false;
+        std::string_view body = token;
+        if (!body.empty() && (body[0] == '+' || body[0] == '-')) {
+            negative = body[0] == '-';
+            body.remove_prefix(1);
+        }
+
+        if (body == "inf" || body == "nan") {
+            e.kind = Element::Kind::Float;
+            e.number = body == "inf" ? std::numeric_limits<double>::infinity()
+                                     : std::numeric_limits<double>::quiet_NaN();
+            if (negative) e.number = -e.number;
+            return;
+        }
+
+        if (body.size() > 2 && body[0] == '0' && (body[1] == 'x' || body[1] == 'o' || body[1] == 'b')) {
+            if (body.size() != token.size()) fail_at(start, "Hexadecimal, octal and binary integers cannot have a sign");
+            unsigned base = body[1] == 'x' ? 16 : body[1] == 'o' ? 8 : 2;
+            e.kind = Element::Kind::Integer;
+            e.flags = base == 16 ? toml::value_flags::format_as_hexadecimal
+                    : base == 8  ? toml::value_flags::format_as_octal
+                                 : toml::value_flags::format_as_binary;
+            e.integer = parse_integer(body.substr(2), base, false, start);
+            return;
+        }
+
+        if (body.find_first_of(".eE") != std::string_view::npos) {
+            e.kind = Element::Kind::Float;
+            e.number = parse_float(token, start);
+            return;
+        }
+
+        if (body.size() > 1 && body[0] == '0') fail_at(start, "Leading zeros are not allowed");
+        e.kind = Element::Kind::Integer;
+        e.integer = parse_integer(body, 10, negative, start);
+    }
+
+    [[noreturn]] void fail_at(size_t offset, const std::string& msg) {
+        pos_ = offset;
+        fail(msg);
+    }
+
+    // Digits with single underscores between them
+    int64_t parse_integer(std::string_view digits, unsigned base, bool negative, size_t start) {
+        const uint64_t limit = negative ? uint64_t(INT64_MAX) + 1 : uint64_t(INT64_MAX);
+        uint64_t value = 0;
+        bool previous_digit = false;
+        for (char c : digits) {
+            if (c == '_') {
+                if (!previous_digit) fail_at(start, "Invalid underscore in number");
+                previous_digit = false;
+                continue;
+            }
+            unsigned d;
+            if (c >= '0' && c <= '9') d = static_cast<unsigned>(c - '0');
+            else if (c >= 'a' && c <= 'f') d = static_cast<unsigned>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') d = static_cast<unsigned>(c - 'A' + 10);
+            else d = base;
+            if (d >= base) fail_at(start, "Invalid number");
+            if (value > (limit - d) / base) fail_at(start, "Integer out of range");
+            value = value * base + d;
+            previous_digit = true;
+        }
+        if (!previous_digit) fail_at(start, "Invalid number");
+        if (negative) return value == uint64_t(INT64_MAX) + 1 ? INT64_MIN : -static_cast<int64_t>(value);
+        return static_cast<int64_t>(value);
+    }
+
+    double parse_float(std::string_view token, size_t start) {
+        // Check the underscores and the '.' (digits on both sides), then
+        // let strtod convert the digits
+        std::string digits;
+        digits.reserve(token.size());
+        for (size_t i = 0; i < token.size(); ++i) {
+            char c = token[i];
+            bool digit_before = i > 0 && is_digit(token[i - 1]);
+            bool digit_after = i + 1 < token.size() && is_digit(token[i + 1]);
+            if (c == '_' || c == '.') {
+                if (!digit_before || !digit_after) fail_at(start, "Invalid float");
+                if (c == '_') continue;
+            } else if (!is_digit(c) && c != 'e' && c != 'E' && c != '+' && c != '-') {
+                fail_at(start, "Invalid float");
+            }
+            digits += c;
+        }
+        size_t int_start = (digits[0] == '+' || digits[0] == '-') ? 1 : 0;
+        if (digits.size() > int_start + 1 && digits[int_start] == '0' && is_digit(digits[int_start + 1]))
+            fail_at(start, "Leading zeros are not allowed");
+
+        char* end = nullptr;
+        double value = std::strtod(digits.c_str(), &end);
+        if (end != digits.c_str() + digits.size()) fail_at(start, "Invalid float");
+        return value;
+    }
+
+    // Dates and times
+
+    unsigned parse_digits(int count) {
+        unsigned value = 0;
+        for (int i = 0; i < count; ++i) {
+            if (!is_digit(peek())) fail("Invalid date or time");
+            value = value * 10 + static_cast<unsigned>(p_[pos_] - '0');
+            ++pos_;
+        }
+        return value;
+    }
+
+    toml::time parse_time() {
+        toml::time t{};
+        t.hour = static_cast<uint8_t>(parse_digits(2));
+        expect(':', "Invalid time");
+        t.minute = static_cast<uint8_t>(parse_digits(2));
+        // Seconds are required, as in toml++ (TOML 1.0)
+        expect(':', "Invalid time");
+        t.second = static_cast<uint8_t>(parse_digits(2));
+        t.nanosecond = 0;
+        if (peek() == '.') {
+            ++pos_;
+            if (!is_digit(peek())) fail("Invalid time");
+            uint32_t scale = 100000000;
+            while (is_digit(peek())) {
+                t.nanosecond += static_cast<uint32_t>(p_[pos_] - '0') * scale;
+                scale /= 10;
+                ++pos_;
+            }
+        }
+        if (t.hour > 23 || t.minute > 59 || t.second > 60) fail("Invalid time");
+        return t;
+    }
+
+    mxArray* parse_date_time() {
+        toml::date d{};
+        d.year = static_cast<uint16_t>(parse_digits(4));
+        expect('-', "Invalid date");
+        d.month = static_cast<uint8_t>(parse_digits(2));
+        expect('-', "Invalid date");
+        d.day = static_cast<uint8_t>(parse_digits(2));
+        if (d.month < 1 || d.month > 12 || d.day < 1 || d.day > 31) fail("Invalid date");
+
+        char c = peek();
+        bool has_time = c == 'T' || c == 't' ||
+                        (c == ' ' && is_digit(peek(1)) && is_digit(peek(2)) && peek(3) == ':');
+        if (!has_time) {
+            end_of_value();
+            return date_to_mx(d);
+        }
+        ++pos_;
+        toml::date_time dt;
+        dt.date = d;
+        dt.time = parse_time();
+        c = peek();
+        if (c == 'Z' || c == 'z') {
+            ++pos_;
+            dt.offset = toml::time_offset{};
+        } else if (c == '+' || c == '-') {
+            ++pos_;
+            int hours = static_cast<int>(parse_digits(2));
+            expect(':', "Invalid time offset");
+            int minutes = static_cast<int>(parse_digits(2));
+            if (hours > 23 || minutes > 59) fail("Invalid time offset");
+            dt.offset = toml::time_offset{};
+            dt.offset->minutes = static_cast<int16_t>((c == '-' ? -1 : 1) * (hours * 60 + minutes));
+        }
+        end_of_value();
+        return date_time_to_mx(dt);
+    }
+
+    const char* p_;
+    size_t n_;
+    size_t line_;
+    size_t pos_ = 0;
+    size_t line_start_ = 0;
+    size_t depth_ = 0;
+    std::string text_;                            // decoded string scratch
+    std::vector<std::string> keys_;               // key segments of the current line
+    std::deque<std::vector<Element>> scratch_;    // array elements, one per nesting level
+};
+
+// Parse TOML text straight into a MATLAB struct
+inline mxArray* toml_stream_parse(const char* data, size_t size) {
+    TomlStreamParser parser(data, size);
+    return parser.parse();
+}
+
+// Parse a TOML file straight into a MATLAB struct; the file is mapped, not
+// read into a buffer
+inline mxArray* toml_stream_parse_file(const std::string& path) {
+    MappedFile file(path);
+    if (!file.valid()) throw std::runtime_error("File could not be opened for reading: " + path);
+    return toml_stream_parse(file.data(), file.size());
+}
+
+#endif // TOML_STREAM_HPP
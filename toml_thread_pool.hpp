@@ -0,0 +1,131 @@
+/*
+ * toml_thread_pool.hpp
+ * Worker threads shared by the parallel loops of a MEX binary
+ * (serialize_struct_parallel, toml_update_files, toml_merge).
+ *
+ * Threads are started on first use, grow to the largest count requested
+ * and then wait for work, so repeated calls do not pay for thread creation.
+ * In toml_mex all commands share one pool. The workers are stopped with
+ * toml_at_exit, before the binary is unloaded (joining threads from a static
+ * destructor can deadlock in the loader on Windows).
+ *
+ * Usage:
+ *   toml_parallel_for(items.size(), num_threads, [&](size_t i) { ... });
+ */
+
+#ifndef TOML_THREAD_POOL_HPP
+#define TOML_THREAD_POOL_HPP
+
+#include "mex.h"
+#include "toml_at_exit.hpp"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+
+class TomlThreadPool {
+public:
+    static TomlThreadPool& instance() {
+        static TomlThreadPool* pool = nullptr;
+        if (!pool) {
+            pool = new TomlThreadPool();
+            toml_at_exit(&TomlThreadPool::shutdown);
+        }
+        return *pool;
+    }
+
+    // Call work(i) for every i in [0, count) on up to num_threads threads
+    // (0 = one per core), the calling thread included. The first exception
+    // thrown by work is rethrown here once all threads are done.
+    void parallel_for(size_t count, unsigned num_threads, const std::function<void(size_t)>& work) {
+        if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+        if (num_threads == 0) num_threads = 1;
+        if (num_threads > count) num_threads = static_cast<unsigned>(count);
+        if (num_threads <= 1) {
+            for (size_t i = 0; i < count; ++i) work(i);
+            return;
+        }
+
+        Loop loop{work, count};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (workers_.size() < num_threads - 1) workers_.emplace_back(&TomlThreadPool::run, this);
+            for (unsigned t = 1; t < num_threads; ++t) queue_.push_back(&loop);
+            loop.pending = num_threads - 1;
+        }
+        wake_.notify_all();
+
+        loop.run();
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return loop.pending == 0; });
+        if (loop.error) std::rethrow_exception(loop.error);
+    }
+
+private:
+    struct Loop {
+        const std::function<void(size_t)>& work;
+        size_t count;
+        std::atomic<size_t> next{0};
+        unsigned pending = 0;        // queued or running helpers, under mutex_
+        std::exception_ptr error{};  // under error_mutex
+        std::mutex error_mutex{};
+
+        void run() {
+            for (size_t i = next++; i < count; i = next++) {
+                try {
+                    work(i);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!error) error = std::current_exception();
+                    next = count;
+                }
+            }
+        }
+    };
+
+    TomlThreadPool() = default;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            if (stopping_) return;
+            Loop* loop = queue_.front();
+            queue_.pop_front();
+            lock.unlock();
+            loop->run();
+            lock.lock();
+            if (--loop->pending == 0) done_.notify_all();
+        }
+    }
+
+    static void shutdown() {
+        TomlThreadPool& pool = instance();
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex_);
+            pool.stopping_ = true;
+        }
+        pool.wake_.notify_all();
+        for (auto& w : pool.workers_) w.join();
+        pool.workers_.clear();
+        pool.stopping_ = false;
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::deque<Loop*> queue_;
+    std::vector<std::thread> workers_;
+    bool stopping_ = false;
+};
+
+inline void toml_parallel_for(size_t count, unsigned num_threads, const std::function<void(size_t)>& work) {
+    TomlThreadPool::instance().parallel_for(count, num_threads, work);
+}
+
+#endif // TOML_THREAD_POOL_HPP
@@ -0,0 +1,59 @@
+function json = toml_to_json(input, varargin)
+    % TOML_TO_JSON Convert a TOML document to JSON text
+    %
+    % Syntax:
+    %   json = toml_to_json(input)
+    %   json = toml_to_json(input, 'Name', value, ...)
+    %
+    % Description:
+    %   Converts in C++ from the parsed TOML document straight to JSON,
+    %   without building a MATLAB struct, so no type information is lost to
+    %   the struct step. Keys keep their order in the file, integers are
+    %   exact and floats use the shortest text that reads back to the same
+    %   value. Dates become RFC 3339 strings; inf and nan become null.
+    %
+    % Inputs:
+    %   input - TOML file name or TOML text. Without 'Source', an existing
+    %           file is read and anything else is parsed as text.
+    %
+    % Options:
+    %   'Source'      - 'file' or 'string'
+    %   'Tagged'      - Write every value as {"type": ..., "value": "..."}
+    %                   (the toml-test format) so dates, local times,
+    %                   hex/octal/binary integers and inf/nan are kept
+    %                   (default false)
+    %   'PrettyPrint' - Indent the output (default false)
+    %   'File'        - Write the JSON to this file instead of returning it
+    %                   (json is then '')
+    %   'MaxDepth'    - Deepest nesting of tables and arrays that is
+    %                   written (default 1000; Inf for no limit)
+    %
+    % Outputs:
+    %   json - JSON text (char)
+    %
+    % Example:
+    %   body = toml_to_json('service.toml');
+    %   toml_to_json('service.toml', 'File', 'service.json', 'PrettyPrint', true);
+
+    if nargin < 1
+        error('toml_to_json:missingInput', 'Input file or TOML text is required');
+    end
+    if isstring(input)
+        input = char(input);
+    end
+    if ~any(strcmpi(varargin(1:2:end), 'Source'))
+        if isfile(input)
+            varargin = [varargin, {'Source', 'file'}];
+        else
+            varargin = [varargin, {'Source', 'string'}];
+        end
+    end
+
+    try
+        json = toml_mex('json', 'to_json', input, varargin{:});
+    catch ME
+        % Report errors under this function's identifiers
+        id = strrep(ME.identifier, 'toml_json:', 'toml_to_json:');
+        error(id, '%s', ME.message);
+    end
+end
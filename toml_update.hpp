@@ -0,0 +1,369 @@
+/*
+ * toml_update.hpp
+ * Format-preserving updates of existing TOML documents.
+ *
+ * The modification struct is flattened into a ModificationList of dotted
+ * key paths and new values rendered with the writer's serialize_value(), so
+ * updated values look exactly like toml_write_file output. Each path is looked up in the
+ * document's CST index (see toml_cst.hpp) and replaced, or optionally added
+ * to the table it belongs to; the CST then writes the document out with
+ * everything else untouched.
+ *
+ * update_file() runs the whole update of one file: map, scan, apply, write.
+ * It does not touch the mx API, so toml_update_files can run it for many
+ * files on worker threads with one shared list of modifications.
+ *
+ * Struct arrays (and cell arrays of structs) address the elements of arrays
+ * of tables by position: mods.products(3).price becomes "products[3].price"
+ * and only updates the third [[products]] element. Elements whose fields
+ * are all empty are left alone.
+ */
+
+#ifndef TOML_UPDATE_HPP
+#define TOML_UPDATE_HPP
+
+#include "mex.h"
+#include "toml_serialize.hpp"
+#include "toml_limits.hpp"
+#include "toml_cst.hpp"
+#include "toml_file_sink.hpp"
+#include "toml_mapped_file.hpp"
+#include <string>
+#include <vector>
+#include <string_view>
+#include <streambuf>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <cstring>
+#include <cerrno>
+
+// Flattened modifications: (dotted key path, rendered TOML value) pairs,
+// sorted by path. All paths and values are stored in one arena string.
+// Array elements are written "name[k]". field_order() lists the indices in
+// MATLAB field order, which is the order keys are added to a document in.
+class ModificationList {
+public:
+    size_t size() const { return items_.size(); }
+    bool empty() const { return items_.empty(); }
+
+    std::string_view path(size_t i) const {
+        return std::string_view(arena_).substr(items_[i].path_offset, items_[i].path_length);
+    }
+    std::string_view text(size_t i) const {
+        return std::string_view(arena_).substr(items_[i].text_offset, items_[i].text_length);
+    }
+    const std::vector<size_t>& field_order() const { return field_order_; }
+
+    // Flatten a scalar modification struct; throws ConvertLimitError if it
+    // is nested deeper or has more values than limits allow
+    static ModificationList flatten(const mxArray* mx_struct,
+                                    const ConvertLimits& limits = ConvertLimits()) {
+        ModificationList list;
+        ScopedConvertLimits convert_limits(limits);
+        list.flatten_struct(mx_struct);
+        list.sort();
+        return list;
+    }
+
+private:
+    struct Item {
+        size_t path_offset;
+        size_t text_offset;
+        uint32_t path_length;
+        uint32_t text_length;
+    };
+
+    // Stream buffer that appends to the arena, so values are rendered in place
+    class ArenaBuf : public std::streambuf {
+    public:
+        explicit ArenaBuf(std::string& out) : out_(out) {}
+    protected:
+        int_type overflow(int_type ch) override {
+            if (!traits_type::eq_int_type(ch, traits_type::eof()))
+                out_.push_back(traits_type::to_char_type(ch));
+            return traits_type::not_eof(ch);
+        }
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            out_.append(s, static_cast<size_t>(n));
+            return n;
+        }
+    private:
+        std::string& out_;
+    };
+
+    void flatten_struct(const mxArray* mx_struct);
+    void sort();
+
+    std::string arena_;
+    std::vector<Item> items_;
+    std::vector<size_t> field_order_;
+};
+
+// Flatten a modification struct into items in field order, nested tables
+// and elements of arrays of tables depth first. The structs are walked with
+// an explicit work stack, bounded by the current ConvertLimits.
+inline void ModificationList::flatten_struct(const mxArray* mx_struct) {
+    struct Frame {
+        std::vector<FieldEntry> fields;
+        size_t next;
+        size_t prefix_length;       // path of this table
+        const mxArray* elements;    // array of tables being walked, if any
+        mwSize element;
+        mwSize count;
+        size_t name_length;         // path of that array
+    };
+    ConvertBudget& budget = current_convert_budget();
+    std::vector<Frame> frames;
+    std::string path;
+
+    auto open = [&](const mxArray* mx, mwIndex index) {
+        budget.check_depth(frames.size() + 1);
+        budget.count();
+        frames.emplace_back();
+        Frame& frame = frames.back();
+        resolve_field_names(mx, frame.fields);
+        classify_fields(mx, index, frame.fields);
+        frame.next = 0;
+        frame.prefix_length = path.size();
+        frame.elements = nullptr;
+    };
+
+    open(mx_struct, 0);
+    while (!frames.empty()) {
+        Frame& top = frames.back();
+        if (top.elements) {
+            if (top.element == top.count) {
+                top.elements = nullptr;
+                continue;
+            }
+            mwIndex j = top.element++;
+            path.resize(top.name_length);
+            path += '[';
+            path += std::to_string(j + 1);
+            path += ']';
+            if (mxIsStruct(top.elements))
+                open(top.elements, j);
+            else
+                open(mxGetCell(top.elements, j), 0);
+            continue;
+        }
+        if (top.next == top.fields.size()) {
+            path.resize(top.prefix_length);
+            frames.pop_back();
+            continue;
+        }
+
+        const FieldEntry& f = top.fields[top.next++];
+        path.resize(top.prefix_length);
+        if (top.prefix_length > 0) path += '.';
+        path += toml_key_segment(f.name);
+        switch (f.kind) {
+            case FieldKind::Skip:
+                break;
+            case FieldKind::Table:
+                open(f.value, 0);
+                break;
+            case FieldKind::ArrayOfTables:
+                budget.count();
+                top.elements = f.value;
+                top.element = 0;
+                top.count = mxGetNumberOfElements(f.value);
+                top.name_length = path.size();
+                break;
+            default: {
+                budget.count(mx_value_count(f.value));
+                Item item;
+                item.path_offset = arena_.size();
+                item.path_length = static_cast<uint32_t>(path.size());
+                arena_ += path;
+                item.text_offset = arena_.size();
+                ArenaBuf buf(arena_);
+                std::ostream os(&buf);
+                serialize_value(os, f.value, f.kind);
+                item.text_length = static_cast<uint32_t>(arena_.size() - item.text_offset);
+                items_.push_back(item);
+                break;
+            }
+        }
+    }
+}
+
+// Items are appended in field order with increasing offsets, so the path
+// offset recovers that order after sorting
+inline void ModificationList::sort() {
+    std::string_view arena(arena_);
+    std::sort(items_.begin(), items_.end(), [arena](const Item& a, const Item& b) {
+        return arena.substr(a.path_offset, a.path_length) < arena.substr(b.path_offset, b.path_length);
+    });
+    field_order_.resize(items_.size());
+    for (size_t i = 0; i < items_.size(); ++i) field_order_[i] = i;
+    std::sort(field_order_.begin(), field_order_.end(), [this](size_t a, size_t b) {
+        return items_[a].path_offset < items_[b].path_offset;
+    });
+}
+
+struct UpdateOptions {
+    bool atomic = true;
+    bool fsync = false;
+    bool add_missing = false;
+    bool patch = true;
+    ConvertLimits limits;    // of the modification struct
+};
+
+// Outcome of updating one document; modifications are referred to by index
+struct UpdateResult {
+    std::vector<size_t> changed;     // values changed or added
+    std::vector<size_t> unmatched;   // not found (and not added)
+    bool written = false;            // the file was written
+};
+
+// Thrown by update_file() if the file does not exist
+class UpdateFileNotFound : public std::runtime_error {
+public:
+    explicit UpdateFileNotFound(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+// Record the modifications as edits of the document. Paths that do not
+// exist are added if add_missing is set (std::invalid_argument if they
+// cannot be). Result indices are in path order.
+inline void apply_modifications(TomlCst& doc, const ModificationList& mods,
+                                bool add_missing, UpdateResult& result) {
+    for (size_t i : mods.field_order()) {
+        const CstEntry* e = doc.find(mods.path(i));
+        if (e && e->kind == CstKind::KeyValue) {
+            if (doc.replace_value(*e, mods.text(i))) result.changed.push_back(i);
+        } else if (!e && add_missing) {
+            doc.insert(mods.path(i), std::string(mods.text(i)));
+            result.changed.push_back(i);
+        } else {
+            result.unmatched.push_back(i);
+        }
+    }
+    std::sort(result.changed.begin(), result.changed.end());
+    std::sort(result.unmatched.begin(), result.unmatched.end());
+}
+
+// Write same-length edits at their offsets through the descriptor the
+// document was scanned from. Returns false without writing anything if
+// the file was replaced since it was mapped; the whole document is then
+// written instead.
+inline bool patch_in_place(const std::string& filename, MappedFile& file,
+                           TomlCst& doc, const UpdateOptions& opts) {
+    if (!file.still_at(filename)) return false;
+    // A read-only file can still be replaced through its directory
+    if (!file.writable()) return false;
+    // Truncated or extended in place: the offsets no longer fit the file
+    if (!file.same_size())
+        throw std::runtime_error("File changed while it was being updated: " + filename);
+    for (const CstEdit& e : doc.edits())
+        file.write_at(e.begin, e.text.data(), e.text.size());
+    if (opts.fsync) file.sync();
+    file.close();
+    return true;
+}
+
+// Write the edited document over the mapped file
+inline void write_updated(const std::string& filename, MappedFile& file,
+                          TomlCst& doc, const UpdateOptions& opts) {
+    if (opts.patch && doc.same_length() && patch_in_place(filename, file, doc, opts)) {
+        return;
+    }
+
+    // In place, everything before the first edit stays on disk. If the
+    // file was replaced since it was scanned, the mapping still holds the
+    // scanned file and the whole document is written.
+    bool replaced = !file.still_at(filename);
+    const std::vector<CstEdit>& edits = doc.edits();
+    size_t first = edits.empty() ? file.size() : edits.front().begin;
+    if (first > 0 && first == file.size()) --first;  // keep the last byte for appended tables
+    if (replaced) first = 0;
+
+    // In place, the rest is copied out before the file is opened for
+    // writing, since it is overwritten (or truncated) while being written
+    bool in_place = !opts.atomic && !replaced;
+    std::string tail;
+    if (in_place) {
+        tail.assign(file.data() + first, file.size() - first);
+        file.close();
+    }
+
+    FileSink sink(filename, opts.atomic, opts.fsync, first);
+    std::ostream os(&sink);
+    os.exceptions(std::ios::badbit);
+    if (in_place) {
+        doc.emit(os, tail.data(), first, first + tail.size());
+        os.flush();
+    } else {
+        doc.emit(os);
+        os.flush();
+        // The mapping must be released before the file can be replaced on Windows
+        file.close();
+    }
+    sink.commit();
+}
+
+// Apply the modifications to one file and write it if anything changed.
+// Throws UpdateFileNotFound, FileOpenError, TomlScanError,
+// std::invalid_argument (a path cannot be added) or other std::exceptions.
+inline UpdateResult update_file(const std::string& filename, const ModificationList& mods,
+                                const UpdateOptions& opts) {
+    MappedFile file(filename, opts.patch);
+    if (!file.valid())
+        throw UpdateFileNotFound("Cannot open file: " + filename);
+
+    UpdateResult result;
+    TomlCst doc = TomlCst::scan(file.data(), file.size());
+    apply_modifications(doc, mods, opts.add_missing, result);
+    if (doc.modified()) {
+        write_updated(filename, file, doc, opts);
+        result.written = true;
+    }
+    return result;
+}
+
+// Error identifier (without the MEX name) and message for a failed update
+inline void describe_update_error(std::exception_ptr error, std::string& id, std::string& msg) {
+    try {
+        std::rethrow_exception(error);
+    }
+    catch (const UpdateFileNotFound& e) {
+        id = "fileNotFound";
+        msg = e.what();
+    }
+    catch (const FileOpenError& e) {
+        id = "cannotOpenFile";
+        msg = e.what();
+    }
+    catch (const TomlScanError& e) {
+        id = "parseError";
+        msg = std::string("Failed to parse TOML file: ") + e.what();
+    }
+    catch (const std::invalid_argument& e) {
+        id = "invalidModification";
+        msg = e.what();
+    }
+    catch (const ConvertLimitError& e) {
+        id = "limitExceeded";
+        msg = e.what();
+    }
+    catch (const std::exception& e) {
+        id = "error";
+        msg = std::string("Error updating TOML file: ") + e.what();
+    }
+    catch (...) {
+        id = "error";
+        msg = "Error updating TOML file";
+    }
+}
+
+// Cell array (1xN) of the paths of the given modifications
+inline mxArray* modification_paths(const ModificationList& mods,
+                                   const std::vector<size_t>& indices) {
+    mxArray* cell = mxCreateCellMatrix(1, indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+        mxSetCell(cell, i, mxCreateString(std::string(mods.path(indices[i])).c_str()));
+    return cell;
+}
+
+#endif // TOML_UPDATE_HPP
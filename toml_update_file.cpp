@@ -0,0 +1,126 @@
+/*
+ * toml_update_file.cpp
+ * Update values in an existing TOML file while preserving comments,
+ * whitespace, key spelling and layout.
+ *
+ * The file is mapped and scanned once into a lossless CST (toml_cst.hpp),
+ * every modification is looked up in its path index, and the result is
+ * written once as the untouched byte ranges with the new values spliced in.
+ * If no value actually changes, the file is not written at all. New values
+ * are rendered exactly as toml_write_file would write them.
+ *
+ * With 'AddMissing' keys that do not exist yet are added to the end of the
+ * table they belong to; missing tables are appended to the file.
+ *
+ * By default the result replaces the file atomically through a temporary
+ * file. With 'Atomic', false the unchanged prefix up to the first edit is
+ * kept on disk and only the rest of the file is rewritten.
+ *
+ * If every new value has exactly the length of the text it replaces (a
+ * flipped boolean, a fixed-width counter, an equal-length ID) and nothing is
+ * added, the new bytes are written at their offsets in the existing file
+ * instead, so the cost depends on the edits and not on the file size.
+ * 'Patch' (default true) takes precedence over the default 'Atomic', true:
+ * such an edit is not atomic, and readers may observe a partly patched
+ * file. 'Patch', false always rewrites the file as described above. A file
+ * that cannot be opened for writing is rewritten as well.
+ *
+ * 'MaxDepth' (default 1000) and 'MaxNodes' (default Inf) limit how deeply
+ * nested, and how many values, the modification struct may be; beyond
+ * either is a "toml_update_file:limitExceeded" error.
+ *
+ * Compile with:
+ *   mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_update_file.cpp
+ *
+ * Usage in MATLAB:
+ *   mods.title = 'Production';
+ *   mods.database.ports = [8001, 8002];
+ *   toml_update_file('config.toml', mods);
+ *   [updated, unmatched] = toml_update_file('config.toml', mods, 'Fsync', true);
+ *   toml_update_file('config.toml', mods, 'AddMissing', true);
+ *   toml_update_file('config.toml', mods, 'Patch', false);
+ *
+ * updated is the number of values changed or added, unmatched a cell array
+ * of the modification paths that were not applied, sorted by path.
+ */
+
+#include "mex.h"
+#include "toml_update.hpp"
+#include "toml_mex_options.hpp"
+#include <string>
+#include <vector>
+#include <exception>
+
+// Parse trailing 'Name', value option pairs
+static UpdateOptions parse_options(int nrhs, const mxArray* prhs[], int first) {
+    UpdateOptions opts;
+    check_option_pairs(nrhs, first, "toml_update_file");
+    for (int i = first; i < nrhs; i += 2) {
+        std::string opt = option_name(prhs[i], "toml_update_file");
+        const mxArray* v = prhs[i + 1];
+
+        if (option_is(opt, "Atomic")) {
+            opts.atomic = option_logical(v, opt, "toml_update_file");
+        } else if (option_is(opt, "Fsync")) {
+            opts.fsync = option_logical(v, opt, "toml_update_file");
+        } else if (option_is(opt, "AddMissing")) {
+            opts.add_missing = option_logical(v, opt, "toml_update_file");
+        } else if (option_is(opt, "Patch")) {
+            opts.patch = option_logical(v, opt, "toml_update_file");
+        } else if (is_limit_option(opt)) {
+            try {
+                limit_option_from_mx(opts.limits, opt, v);
+            }
+            catch (const std::invalid_argument& e) {
+                option_error("toml_update_file", e.what());
+            }
+        } else {
+            mexErrMsgIdAndTxt("toml_update_file:invalidArgs", "Unknown option '%s'", opt.c_str());
+        }
+    }
+    return opts;
+}
+
+// MEX entry point
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs < 2)
+        mexErrMsgIdAndTxt("toml_update_file:invalidArgs",
+                          "Usage: [updated, unmatched] = toml_update_file(filename, modifications, 'Name', value, ...)");
+
+    if (nlhs > 2)
+        mexErrMsgIdAndTxt("toml_update_file:tooManyOutputs", "Too many output arguments");
+
+    if (!mxIsChar(prhs[0]))
+        mexErrMsgIdAndTxt("toml_update_file:invalidInput", "First input must be a filename string");
+
+    if (!mxIsStruct(prhs[1]) || mxGetNumberOfElements(prhs[1]) != 1)
+        mexErrMsgIdAndTxt("toml_update_file:invalidInput", "Second input must be a scalar struct");
+
+    UpdateOptions opts = parse_options(nrhs, prhs, 2);
+    std::string filename = mx_to_std_string(prhs[0]);
+
+    // Errors are raised only after all C++ objects are gone, so the mapping
+    // and any unfinished temporary file are always cleaned up first
+    std::string error_id;
+    std::string error_msg;
+    ModificationList mods;
+    UpdateResult result;
+    try
+    {
+        mods = ModificationList::flatten(prhs[1], opts.limits);
+        result = update_file(filename, mods, opts);
+    }
+    catch (...)
+    {
+        describe_update_error(std::current_exception(), error_id, error_msg);
+        error_id = "toml_update_file:" + error_id;
+    }
+
+    if (!error_id.empty())
+        mexErrMsgIdAndTxt(error_id.c_str(), "%s", error_msg.c_str());
+
+    plhs[0] = mxCreateDoubleScalar(static_cast<double>(result.changed.size()));
+    if (nlhs > 1)
+        plhs[1] = modification_paths(mods, result.unmatched);
+}
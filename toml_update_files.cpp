@@ -0,0 +1,166 @@
+/*
+ * toml_update_files.cpp
+ * Apply the same modifications to many TOML files, preserving comments and
+ * layout in each (see toml_update_file.cpp for the single-file version).
+ *
+ * The modification struct is flattened and its values are rendered once on
+ * the MATLAB thread. The files are then updated on worker threads, each one
+ * mapped, scanned, edited and written independently. A file that fails
+ * (missing, unparsable, not writable) is reported in its status and does
+ * not stop the others.
+ *
+ * Compile with:
+ *   mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_update_files.cpp
+ *
+ * Usage in MATLAB:
+ *   mods.logging.level = 'warn';
+ *   status = toml_update_files({'a.toml', 'b.toml'}, mods);
+ *   status = toml_update_files(files, mods, 'Threads', 8, 'AddMissing', true);
+ *
+ * status is a struct array with one element per file and the fields
+ *   file       - the file name
+ *   ok         - true if the update succeeded
+ *   updated    - number of values changed or added
+ *   written    - true if the file was written
+ *   changed    - cell array of the modification paths changed or added
+ *   unmatched  - cell array of the modification paths not applied
+ *   identifier - error identifier if the update failed, '' otherwise
+ *   message    - error message if the update failed, '' otherwise
+ *
+ * Options are those of toml_update_file ('Atomic', 'Fsync', 'AddMissing',
+ * 'Patch', 'MaxDepth', 'MaxNodes') plus 'Threads' (0 = one per core, the
+ * default).
+ */
+
+#include "mex.h"
+#include "toml_update.hpp"
+#include "toml_mex_options.hpp"
+#include "toml_thread_pool.hpp"
+#include <string>
+#include <vector>
+#include <exception>
+
+// Outcome for one file; error_id is empty on success
+struct FileStatus {
+    UpdateResult result;
+    std::string error_id;
+    std::string error_msg;
+};
+
+// Parse trailing 'Name', value option pairs
+static UpdateOptions parse_options(int nrhs, const mxArray* prhs[], int first, unsigned& threads) {
+    UpdateOptions opts;
+    check_option_pairs(nrhs, first, "toml_update_files");
+    for (int i = first; i < nrhs; i += 2) {
+        std::string opt = option_name(prhs[i], "toml_update_files");
+        const mxArray* v = prhs[i + 1];
+
+        if (option_is(opt, "Atomic")) {
+            opts.atomic = option_logical(v, opt, "toml_update_files");
+        } else if (option_is(opt, "Fsync")) {
+            opts.fsync = option_logical(v, opt, "toml_update_files");
+        } else if (option_is(opt, "AddMissing")) {
+            opts.add_missing = option_logical(v, opt, "toml_update_files");
+        } else if (option_is(opt, "Patch")) {
+            opts.patch = option_logical(v, opt, "toml_update_files");
+        } else if (is_limit_option(opt)) {
+            try {
+                limit_option_from_mx(opts.limits, opt, v);
+            }
+            catch (const std::invalid_argument& e) {
+                option_error("toml_update_files", e.what());
+            }
+        } else if (option_is(opt, "Threads")) {
+            double n = option_scalar(v, opt, "toml_update_files");
+            threads = n > 0 ? static_cast<unsigned>(n) : 0;
+        } else {
+            mexErrMsgIdAndTxt("toml_update_files:invalidArgs", "Unknown option '%s'", opt.c_str());
+        }
+    }
+    return opts;
+}
+
+// Update every file using up to num_threads threads (0 = one per core)
+static void update_files(const std::vector<std::string>& files, const ModificationList& mods,
+                         const UpdateOptions& opts, unsigned num_threads,
+                         std::vector<FileStatus>& status) {
+    toml_parallel_for(files.size(), num_threads, [&](size_t i) {
+        try {
+            status[i].result = update_file(files[i], mods, opts);
+        }
+        catch (...) {
+            describe_update_error(std::current_exception(), status[i].error_id, status[i].error_msg);
+            status[i].error_id = "toml_update_files:" + status[i].error_id;
+        }
+    });
+}
+
+// MEX entry point
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs < 2)
+        mexErrMsgIdAndTxt("toml_update_files:invalidArgs",
+                          "Usage: status = toml_update_files(filenames, modifications, 'Name', value, ...)");
+
+    if (nlhs > 1)
+        mexErrMsgIdAndTxt("toml_update_files:tooManyOutputs", "Too many output arguments");
+
+    if (!mxIsCell(prhs[0]))
+        mexErrMsgIdAndTxt("toml_update_files:invalidInput", "First input must be a cell array of filenames");
+
+    if (!mxIsStruct(prhs[1]) || mxGetNumberOfElements(prhs[1]) != 1)
+        mexErrMsgIdAndTxt("toml_update_files:invalidInput", "Second input must be a scalar struct");
+
+    unsigned threads = 0;
+    UpdateOptions opts = parse_options(nrhs, prhs, 2, threads);
+
+    size_t num_files = mxGetNumberOfElements(prhs[0]);
+    std::vector<std::string> files(num_files);
+    for (size_t i = 0; i < num_files; ++i) {
+        const mxArray* name = mxGetCell(prhs[0], i);
+        if (!name || !mxIsChar(name))
+            mexErrMsgIdAndTxt("toml_update_files:invalidInput", "Filename %d is not a string",
+                              static_cast<int>(i + 1));
+        files[i] = mx_to_std_string(name);
+    }
+
+    // Everything that touches the mx API happens here, before the workers start
+    std::string error_id;
+    std::string error_msg;
+    ModificationList mods;
+    std::vector<FileStatus> status(num_files);
+    try
+    {
+        mods = ModificationList::flatten(prhs[1], opts.limits);
+        update_files(files, mods, opts, threads, status);
+    }
+    catch (const ConvertLimitError& e)
+    {
+        error_id = "toml_update_files:limitExceeded";
+        error_msg = e.what();
+    }
+    catch (const std::exception& e)
+    {
+        error_id = "toml_update_files:error";
+        error_msg = std::string("Error updating TOML files: ") + e.what();
+    }
+
+    if (!error_id.empty())
+        mexErrMsgIdAndTxt(error_id.c_str(), "%s", error_msg.c_str());
+
+    const char* fields[] = {"file", "ok", "updated", "written", "changed", "unmatched",
+                            "identifier", "message"};
+    plhs[0] = mxCreateStructArray(mxGetNumberOfDimensions(prhs[0]), mxGetDimensions(prhs[0]), 8, fields);
+    for (size_t i = 0; i < num_files; ++i) {
+        const FileStatus& s = status[i];
+        bool ok = s.error_id.empty();
+        mxSetFieldByNumber(plhs[0], i, 0, mxCreateString(files[i].c_str()));
+        mxSetFieldByNumber(plhs[0], i, 1, mxCreateLogicalScalar(ok));
+        mxSetFieldByNumber(plhs[0], i, 2, mxCreateDoubleScalar(static_cast<double>(s.result.changed.size())));
+        mxSetFieldByNumber(plhs[0], i, 3, mxCreateLogicalScalar(s.result.written));
+        mxSetFieldByNumber(plhs[0], i, 4, modification_paths(mods, s.result.changed));
+        mxSetFieldByNumber(plhs[0], i, 5, modification_paths(mods, s.result.unmatched));
+        mxSetFieldByNumber(plhs[0], i, 6, mxCreateString(s.error_id.c_str()));
+        mxSetFieldByNumber(plhs[0], i, 7, mxCreateString(s.error_msg.c_str()));
+    }
+}
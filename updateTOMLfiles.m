@@ -0,0 +1,58 @@
+function status = updateTOMLfiles(filenames, modifications, varargin)
+    % UPDATETOMLFILES Apply the same updates to many TOML files
+    %
+    % Syntax:
+    %   status = updateTOMLfiles(filenames, modifications)
+    %   status = updateTOMLfiles(filenames, modifications, 'Name', value, ...)
+    %
+    % Description:
+    %   Applies one modification struct to every file in filenames, like
+    %   calling updateTOMLfile on each of them, while preserving comments
+    %   and formatting. Wrapper for toml_update_files, which renders the
+    %   modifications once and updates the files on worker threads. A file
+    %   that cannot be updated does not stop the others; check status.ok.
+    %
+    % Inputs:
+    %   filenames     - Cell array of file names or string array
+    %   modifications - Struct with the fields to update (see updateTOMLfile)
+    %
+    % Options:
+    %   'Threads' - Number of worker threads, 0 for one per core (default 0)
+    %   'Atomic', 'Fsync', 'AddMissing', 'Patch', 'MaxDepth', 'MaxNodes' -
+    %             As for updateTOMLfile
+    %
+    % Outputs:
+    %   status - Struct array with one element per file and the fields
+    %            file, ok, updated, written, changed, unmatched,
+    %            identifier and message
+    %
+    % Example:
+    %   mods.logging.level = "warn";
+    %   files = {dir('hosts/*.toml').name};
+    %   status = updateTOMLfiles(fullfile('hosts', files), mods, 'Threads', 8);
+    %   failed = status(~[status.ok]);
+
+    % Validate inputs
+    if nargin < 2
+        error('updateTOMLfiles:missingInput', ...
+              'Two inputs required: updateTOMLfiles(filenames, modifications)');
+    end
+
+    % Accept string arrays and a single file name
+    if isstring(filenames) || ischar(filenames)
+        filenames = cellstr(filenames);
+    end
+
+    if ~isstruct(modifications)
+        error('updateTOMLfiles:invalidModifications', ...
+              'Modifications must be a MATLAB struct');
+    end
+
+    try
+        status = toml_mex('update_files', filenames, modifications, varargin{:});
+    catch ME
+        % Report errors under this function's identifiers
+        id = strrep(ME.identifier, 'toml_update_files:', 'updateTOMLfiles:');
+        error(id, '%s', ME.message);
+    end
+end
@@ -1,18 +1,40 @@
-function success = writeTOMLfile(tomlfile, data)
+function [success, written] = writeTOMLfile(tomlfile, data, varargin)
     % WRITETOMLFILE Write MATLAB struct to TOML file with error handling
     %
     % Syntax:
     %   success = writeTOMLfile(tomlfile, data)
+    %   success = writeTOMLfile(tomlfile, data, 'Name', value, ...)
+    %   [success, written] = writeTOMLfile(tomlfile, data, 'OnlyIfChanged', true)
     %
     % Description:
-    %   Wrapper for toml_write_file with robust error handling and validation
+    %   Wrapper for toml_write_file with robust error handling and validation.
+    %   The document is streamed to disk without building it in memory, and
+    %   replaces the target file atomically once it is complete.
     %
     % Inputs:
     %   tomlfile - Output file path (string or char)
     %   data     - MATLAB struct to write as TOML
     %
+    % Options:
+    %   'Atomic' - Write to a temporary file and rename it over tomlfile
+    %              (default true). Mode, owner and symlinks are kept. In a
+    %              read-only directory this fails; set 'Atomic', false to
+    %              write the file in place there.
+    %   'Fsync'  - Flush the file to disk before returning (default false)
+    %   'OnlyIfChanged' - Leave the file untouched if its contents already
+    %              match the serialized data (default false)
+    %   'Parallel' - Format large numeric arrays on worker threads
+    %              (default false)
+    %   'Threads'  - Number of threads for 'Parallel' (default: one per core)
+    %   'MaxDepth' - Deepest nesting of structs and cell arrays allowed
+    %              (default 1000; Inf for no limit)
+    %   'MaxNodes' - Most values allowed, array elements included
+    %              (default Inf)
+    %
     % Outputs:
     %   success  - True if write succeeded, false otherwise
+    %   written  - True if the file was (re)written, false if it was already
+    %              up to date or the write failed
     %
     % Example:
     %   config = struct();
@@ -28,6 +50,7 @@ function success = writeTOMLfile(tomlfile, data)
     
     % Initialize output
     success = false;
+    written = false;
     
     % Validate inputs
     if nargin < 2
@@ -60,18 +83,8 @@ function success = writeTOMLfile(tomlfile, data)
     
     % Try to serialize and write
     try
-        % Convert struct to TOML string
-        toml_string = toml_write_string(data);
-        
-        % Write to file
-        fid = fopen(tomlfile, 'w');
-        if fid == -1
-            error('writeTOMLfile:cannotOpenFile', ...
-                  'Cannot open file for writing: %s', tomlfile);
-        end
-        
-        fprintf(fid, '%s', toml_string);
-        fclose(fid);
+        % Stream struct to file
+        written = toml_mex('write_file', data, tomlfile, varargin{:});
         
         success = true;
         
@@ -81,10 +94,14 @@ function success = writeTOMLfile(tomlfile, data)
             warning('writeTOMLfile:fileError', ...
                     'Cannot write to file: %s\nError: %s', ...
                     tomlfile, ME.message);
+        elseif contains(ME.identifier, 'limitExceeded')
+            warning('writeTOMLfile:limitExceeded', ...
+                    'Data exceeds the conversion limits, %s not written\nError: %s', ...
+                    tomlfile, ME.message);
         elseif contains(ME.identifier, 'mexNotFound') || contains(ME.message, 'Undefined')
             warning('writeTOMLfile:mexNotCompiled', ...
-                    'toml_write_file MEX function not found. Please compile it first:\n%s', ...
-                    'mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_write_file.cpp');
+                    'toml_mex MEX function not found. Please compile it first:\n%s', ...
+                    'build_toml_mex');
         else
             warning('writeTOMLfile:unknownError', ...
                     'Unexpected error writing TOML file: %s\nError: %s', ...
@@ -1,8 +1,9 @@
-function toml_string = writeTOMLstring(data)
+function toml_string = writeTOMLstring(data, varargin)
     % WRITETOMLSTRING Write MATLAB struct to TOML string with error handling
     %
     % Syntax:
     %   success = writeTOMLstring(data)
+    %   toml_string = writeTOMLstring(data, 'Parallel', true)
     %
     % Description:
     %   Wrapper for toml_write_string with robust error handling and validation
@@ -10,6 +11,15 @@ function toml_string = writeTOMLstring(data)
     % Inputs:
     %   data     - MATLAB struct to write as TOML
     %
+    % Options:
+    %   'Parallel' - Format large numeric arrays on worker threads
+    %                (default false). The output is identical.
+    %   'Threads'  - Number of threads for 'Parallel' (default: one per core)
+    %   'MaxDepth' - Deepest nesting of structs and cell arrays allowed
+    %                (default 1000; Inf for no limit)
+    %   'MaxNodes' - Most values allowed, array elements included
+    %                (default Inf)
+    %
     % Outputs:
     %   success  - True if write succeeded, false otherwise
     %   toml_string - TOML string
@@ -29,10 +39,9 @@ function toml_string = writeTOMLstring(data)
     % Initialize output
     success = false;
     
-    nargin
     % Validate inputs
-    if nargin ~= 1
-        error('writeTOMLstrong:missingInput', ...
+    if nargin < 1
+        error('writeTOMLstring:missingInput', ...
               'One input required: writeTOMLstring(data)');
     end
     
@@ -53,17 +62,20 @@ function toml_string = writeTOMLstring(data)
     % Try to serialize and write
     try
         % Convert struct to TOML string
-        toml_string = toml_write_string(data);
+        toml_string = toml_mex('write_string', data, varargin{:});
 
         success = true;
         
     catch ME
         % Handle different types of errors
         
-        if contains(ME.identifier, 'mexNotFound') || contains(ME.message, 'Undefined')
+        if contains(ME.identifier, 'limitExceeded')
+            warning('writeTOMLstring:limitExceeded', ...
+                    'Data exceeds the conversion limits.\nError: %s', ME.message);
+        elseif contains(ME.identifier, 'mexNotFound') || contains(ME.message, 'Undefined')
             warning('writeTOMLstring:mexNotCompiled', ...
-                    'toml_write_string MEX function not found. Please compile it first:\n%s', ...
-                    'mex -R2018a CXXFLAGS="$CXXFLAGS -std=c++17" -I/path/to/tomlplusplus/include toml_write_string.cpp');
+                    'toml_mex MEX function not found. Please compile it first:\n%s', ...
+                    'build_toml_mex');
         else
             warning('writeTOMLstring:unknownError', ...
                     'Unexpected error writing TOML string: \nError: %s', ...